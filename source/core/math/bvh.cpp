@@ -1,142 +1,384 @@
 #include "Bvh.h"
-#include "bvh/bvh.hpp"
-#include "bvh/leaf_collapser.hpp"
-#include "bvh/locally_ordered_clustering_builder.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
 #include "../parallel/parallel.h"
 
 namespace fantasy 
 {
-    bvh::Vector3<float> ConvertVector(float3 vec)
+    // 多线程 binned SAH 构建, 直接写入 Bvh::Node 数组.
+    // 节点数组按最多 2n - 1 个节点预先分配, 作为节点的 arena, 兄弟节点成对分配, 右孩子为 child_index + 1.
+    // 图元在 primitives 数组中原地划分, 构建完成后数组即为叶子节点的图元顺序.
+    class BinnedSahBuilder
     {
-        return { vec.x, vec.y, vec.z };
-    }
+    public:
+        struct Primitive
+        {
+            Bounds3F box;
+            float3 centroid;
+            uint32_t index = 0;
+        };
 
-    bvh::BoundingBox<float> ConvertBounds(Bounds3F Bounds)
-    {
-        return bvh::BoundingBox<float>{ ConvertVector(Bounds._lower), ConvertVector(Bounds._upper) };
-    }
+        static constexpr uint32_t bin_num = 16;
+        static constexpr uint32_t parallel_primitive_num = 4096;
+        static constexpr float traversal_cost = 1.0f;
+        static constexpr float intersect_cost = 1.0f;
 
+        BinnedSahBuilder(std::span<Primitive> primitives, uint32_t max_leaf_primitive_num, std::vector<Bvh::Node>& nodes) :
+            _primitives(primitives),
+            _max_leaf_primitive_num(max_leaf_primitive_num),
+            _nodes(nodes)
+        {
+        }
 
-    void Bvh::build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num)
-    {
-        global_box = Bounds3F();
-        std::vector<bvh::BoundingBox<float>> PrimitiveBoxes(triangle_num);
-        std::vector<bvh::Vector3<float>> PrimitiveCentroids(triangle_num);
-
-        for (uint32_t ix = 0; ix < triangle_num; ++ix)
-        {
-            Bounds3F PrimitiveBox;
-            uint64_t stVertexIndex = ix * 3;
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex].position);
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex + 1].position);
-            PrimitiveBox = merge(PrimitiveBox, vertices[stVertexIndex + 2].position);
-
-            global_box = merge(global_box, PrimitiveBox);
-            PrimitiveBoxes[ix] = ConvertBounds(PrimitiveBox);
-            PrimitiveCentroids[ix] = ConvertVector(
-                (vertices[stVertexIndex].position + vertices[stVertexIndex + 1].position + vertices[stVertexIndex + 2].position) / 3.0f
-            );
+        // max_leaf_primitive_num 为 1 时, 叶子节点的 child_index 为 Primitive::index, 否则为图元在 primitives 中的位置.
+        void build()
+        {
+            uint32_t primitive_num = static_cast<uint32_t>(_primitives.size());
+
+            // 没有图元时不输出节点, child_num 为 0 的根节点会被当作内部节点.
+            if (primitive_num == 0)
+            {
+                _nodes.clear();
+                return;
+            }
+
+            _nodes.resize(2 * primitive_num - 1);
+            _node_num.store(1, std::memory_order_relaxed);
+
+            build_node(0, 0, primitive_num);
+
+            _nodes.resize(_node_num.load(std::memory_order_relaxed));
         }
-        
-        bvh::Bvh<float> Bvh;
-        bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint32_t> BvhBuilder(Bvh);
-        BvhBuilder.build(
-            ConvertBounds(global_box), 
-            PrimitiveBoxes.data(), 
-            PrimitiveCentroids.data(), 
-            triangle_num
-        );
-        bvh::LeafCollapser<bvh::Bvh<float>> LeafCollapser(Bvh);
-        LeafCollapser.collapse();
 
+    private:
+        struct Bin
+        {
+            Bounds3F box;
+            uint32_t primitive_num = 0;
+        };
 
-        
-        _vertices.clear();
-        _nodes.resize(Bvh.node_count);
+        struct RangeBounds
+        {
+            Bounds3F box;
+            Bounds3F centroid_box;
+        };
+
+        struct Split
+        {
+            uint32_t axis = 0;
+            uint32_t bin_index = 0;
+            float cost = std::numeric_limits<float>::max();
+        };
 
-        for (size_t ix = 0; ix< Bvh.node_count; ++ix)
+        RangeBounds compute_bounds(uint32_t begin, uint32_t end) const
         {
-            const auto& crNode = Bvh.nodes[ix];
-            _nodes[ix].box = Bounds3F(
-                crNode.bounds[0], crNode.bounds[2], crNode.bounds[4], 
-                crNode.bounds[1], crNode.bounds[3], crNode.bounds[5]
+            auto map = [this](const parallel::Range& range, RangeBounds bounds)
+            {
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    bounds.box = merge(bounds.box, _primitives[ix].box);
+                    bounds.centroid_box = merge(bounds.centroid_box, _primitives[ix].centroid);
+                }
+                return bounds;
+            };
+
+            if (end - begin < parallel_primitive_num) return map(parallel::Range{ begin, end }, RangeBounds{});
+
+            return parallel::parallel_reduce(
+                parallel::Range{ begin, end },
+                RangeBounds{},
+                map,
+                [](const RangeBounds& a, const RangeBounds& b)
+                {
+                    return RangeBounds{ merge(a.box, b.box), merge(a.centroid_box, b.centroid_box) };
+                },
+                parallel_primitive_num / 4
             );
+        }
 
-            if (crNode.is_leaf())
+        // 按中心点包围盒把每个轴划分为 bin_count 个 bin, 图元较少时减少 bin 的数量.
+        struct BinMapping
+        {
+            float3 lower;
+            float3 scale;
+            uint32_t bin_count;
+
+            BinMapping(const Bounds3F& centroid_box, uint32_t primitive_num) : 
+                lower(centroid_box._lower), 
+                bin_count(std::min(bin_num, std::max(4u, primitive_num)))
             {
-                uint32_t dwPrimitiveBegin = static_cast<uint32_t>(_vertices.size()) / 3;
+                float3 extent = centroid_box.extent();
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    scale[axis] = extent[axis] > 0.0f ? bin_count * (1.0f - 1e-5f) / extent[axis] : 0.0f;
+                }
+            }
+
+            uint32_t get_bin_index(const float3& centroid, uint32_t axis) const
+            {
+                return std::min(bin_count - 1, static_cast<uint32_t>((centroid[axis] - lower[axis]) * scale[axis]));
+            }
+        };
 
-                uint32_t dwCycleEnd = crNode.first_child_or_primitive + crNode.primitive_count;
-                for (size_t ix = crNode.first_child_or_primitive; ix < dwCycleEnd; ++ix)
+        using AxisBins = std::array<std::array<Bin, bin_num>, 3>;
+
+        void accumulate_bins(uint64_t begin, uint64_t end, const BinMapping& mapping, AxisBins& bins) const
+        {
+            for (uint64_t ix = begin; ix < end; ++ix)
+            {
+                const Primitive& primitive = _primitives[ix];
+                for (uint32_t axis = 0; axis < 3; ++axis)
                 {
-                    uint64_t index = Bvh.primitive_indices[ix] * 3;
-                    _vertices.emplace_back(vertices[index]);
-                    _vertices.emplace_back(vertices[index + 1]);
-                    _vertices.emplace_back(vertices[index + 2]);
+                    Bin& bin = bins[axis][mapping.get_bin_index(primitive.centroid, axis)];
+                    bin.box = merge(bin.box, primitive.box);
+                    bin.primitive_num++;
                 }
+            }
+        }
 
-                uint32_t dwPrimitiveEnd = static_cast<uint32_t>(_vertices.size()) / 3;
+        Split find_split(uint32_t begin, uint32_t end, const BinMapping& mapping) const
+        {
+            AxisBins bins;
+            if (end - begin < parallel_primitive_num)
+            {
+                accumulate_bins(begin, end, mapping, bins);
+            }
+            else
+            {
+                bins = parallel::parallel_reduce(
+                    parallel::Range{ begin, end },
+                    AxisBins{},
+                    [&](const parallel::Range& range, AxisBins partial_bins)
+                    {
+                        accumulate_bins(range.begin, range.end, mapping, partial_bins);
+                        return partial_bins;
+                    },
+                    [](AxisBins a, const AxisBins& b)
+                    {
+                        for (uint32_t axis = 0; axis < 3; ++axis)
+                        {
+                            for (uint32_t ix = 0; ix < bin_num; ++ix)
+                            {
+                                a[axis][ix].box = merge(a[axis][ix].box, b[axis][ix].box);
+                                a[axis][ix].primitive_num += b[axis][ix].primitive_num;
+                            }
+                        }
+                        return a;
+                    },
+                    parallel_primitive_num / 4
+                );
+            }
 
-                assert(dwPrimitiveBegin != dwPrimitiveEnd);
-                _nodes[ix].child_index = dwPrimitiveBegin;
-                _nodes[ix].child_num = dwPrimitiveEnd - dwPrimitiveBegin;
+            Split split;
+            uint32_t bin_count = mapping.bin_count;
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                if (mapping.scale[axis] == 0.0f) continue;
+
+                // 从右往左扫描一遍, 记录每个划分位置右侧的面积与图元数量.
+                std::array<float, bin_num> right_costs;
+                Bounds3F right_box;
+                uint32_t right_primitive_num = 0;
+                for (uint32_t ix = bin_count - 1; ix > 0; --ix)
+                {
+                    right_box = merge(right_box, bins[axis][ix].box);
+                    right_primitive_num += bins[axis][ix].primitive_num;
+                    right_costs[ix] = right_primitive_num == 0 ? 0.0f : right_box.surface_area() * right_primitive_num;
+                }
+
+                Bounds3F left_box;
+                uint32_t left_primitive_num = 0;
+                for (uint32_t ix = 1; ix < bin_count; ++ix)
+                {
+                    left_box = merge(left_box, bins[axis][ix - 1].box);
+                    left_primitive_num += bins[axis][ix - 1].primitive_num;
+                    if (left_primitive_num == 0 || left_primitive_num == end - begin) continue;
+
+                    float cost = left_box.surface_area() * left_primitive_num + right_costs[ix];
+                    if (cost < split.cost)
+                    {
+                        split.axis = axis;
+                        split.bin_index = ix;
+                        split.cost = cost;
+                    }
+                }
             }
-            else 
+            return split;
+        }
+
+        void build_node(uint32_t node_index, uint32_t begin, uint32_t end)
+        {
+            Bvh::Node& node = _nodes[node_index];
+            uint32_t primitive_num = end - begin;
+
+            RangeBounds bounds = compute_bounds(begin, end);
+            node.box = bounds.box;
+
+            if (primitive_num == 1)
+            {
+                make_leaf(node, begin, end);
+                return;
+            }
+
+            uint32_t mid = begin;
+            BinMapping mapping(bounds.centroid_box, primitive_num);
+            Split split = find_split(begin, end, mapping);
+            if (split.cost != std::numeric_limits<float>::max())
             {
-                _nodes[ix].child_index = crNode.first_child_or_primitive;
-                _nodes[ix].child_num = 0;
+                float split_cost = traversal_cost + intersect_cost * split.cost / bounds.box.surface_area();
+                if (primitive_num <= _max_leaf_primitive_num && split_cost >= intersect_cost * primitive_num)
+                {
+                    make_leaf(node, begin, end);
+                    return;
+                }
+
+                mid = static_cast<uint32_t>(std::partition(
+                    _primitives.begin() + begin,
+                    _primitives.begin() + end,
+                    [&](const Primitive& primitive)
+                    {
+                        return mapping.get_bin_index(primitive.centroid, split.axis) < split.bin_index;
+                    }
+                ) - _primitives.begin());
+            }
+            else if (primitive_num <= _max_leaf_primitive_num)
+            {
+                make_leaf(node, begin, end);
+                return;
             }
+            else
+            {
+                // 图元的中心点重合, 无法按空间划分, 按数量对半分.
+                mid = begin + primitive_num / 2;
+            }
+
+            uint32_t child_index = _node_num.fetch_add(2, std::memory_order_relaxed);
+            node.child_index = child_index;
+            node.child_num = 0;
+
+            if (primitive_num < parallel_primitive_num)
+            {
+                build_node(child_index, begin, mid);
+                build_node(child_index + 1, mid, end);
+            }
+            else
+            {
+                parallel::parallel_for(
+                    parallel::Range{ 0, 2 },
+                    [&](const parallel::Range& range)
+                    {
+                        for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                        {
+                            if (ix == 0) build_node(child_index, begin, mid);
+                            else         build_node(child_index + 1, mid, end);
+                        }
+                    },
+                    1
+                );
+            }
+        }
+
+        void make_leaf(Bvh::Node& node, uint32_t begin, uint32_t end) const
+        {
+            node.child_index = _max_leaf_primitive_num == 1 ? _primitives[begin].index : begin;
+            node.child_num = end - begin;
         }
+
+    private:
+        std::span<Primitive> _primitives;
+        uint32_t _max_leaf_primitive_num;
+
+        std::vector<Bvh::Node>& _nodes;
+        std::atomic<uint32_t> _node_num = 0;
+    };
+
+
+    void Bvh::build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num)
+    {
+        std::vector<BinnedSahBuilder::Primitive> primitives(triangle_num);
+
+        global_box = parallel::parallel_reduce(
+            parallel::Range{ 0, triangle_num },
+            Bounds3F(),
+            [&](const parallel::Range& range, Bounds3F box)
+            {
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    const float3& p0 = vertices[ix * 3].position;
+                    const float3& p1 = vertices[ix * 3 + 1].position;
+                    const float3& p2 = vertices[ix * 3 + 2].position;
+
+                    auto& primitive = primitives[ix];
+                    primitive.box = merge(Bounds3F(p0, p1), p2);
+                    primitive.centroid = (p0 + p1 + p2) / 3.0f;
+                    primitive.index = static_cast<uint32_t>(ix);
+                    box = merge(box, primitive.box);
+                }
+                return box;
+            },
+            [](const Bounds3F& a, const Bounds3F& b) { return merge(a, b); }
+        );
+
+        BinnedSahBuilder builder(primitives, max_leaf_triangle_num, _nodes);
+        builder.build();
+
+        // 叶子节点的三角形在 _vertices 中连续存放.
+        _vertices.resize(static_cast<uint64_t>(triangle_num) * 3);
+        parallel::parallel_for(
+            parallel::Range{ 0, triangle_num },
+            [&](const parallel::Range& range)
+            {
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    uint64_t index = static_cast<uint64_t>(primitives[ix].index) * 3;
+                    _vertices[ix * 3] = vertices[index];
+                    _vertices[ix * 3 + 1] = vertices[index + 1];
+                    _vertices[ix * 3 + 2] = vertices[index + 2];
+                }
+            }
+        );
         
         this->triangle_num = triangle_num;
-
     }
 
-
-    
     void Bvh::build(std::span<Bounds3F> boxes, const Bounds3F& global_box)
 	{
-		std::vector<bvh::BoundingBox<float>> BvhBoxes(boxes.size());
-		std::vector<bvh::Vector3<float>> BvhCentroids(boxes.size());
-		for (uint32_t ix = 0; ix < boxes.size(); ++ix)
-		{
-			BvhBoxes[ix] = ConvertBounds(boxes[ix]);
-			BvhCentroids[ix] = ConvertVector((boxes[ix]._upper + boxes[ix]._lower) * 0.5f);
-		}
-
-		bvh::Bvh<float> Bvh;
-		bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint32_t> BvhBuilder(Bvh);
-		BvhBuilder.build(
-			ConvertBounds(global_box),
-			BvhBoxes.data(),
-			BvhCentroids.data(),
-            boxes.size()
+		std::vector<BinnedSahBuilder::Primitive> primitives(boxes.size());
+		parallel::parallel_for(
+			parallel::Range{ 0, boxes.size() },
+			[&](const parallel::Range& range)
+			{
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
+				{
+					primitives[ix].box = boxes[ix];
+					primitives[ix].centroid = (boxes[ix]._upper + boxes[ix]._lower) * 0.5f;
+					primitives[ix].index = static_cast<uint32_t>(ix);
+				}
+			}
 		);
 
-		_nodes.resize(Bvh.node_count);
-		for (size_t ix = 0; ix < Bvh.node_count; ++ix)
-		{
-			const auto& crNode = Bvh.nodes[ix];
-			_nodes[ix].box = Bounds3F(
-				crNode.bounds[0], crNode.bounds[2], crNode.bounds[4],
-				crNode.bounds[1], crNode.bounds[3], crNode.bounds[5]
-			);
-
-			if (crNode.is_leaf())
-			{
-                assert(crNode.primitive_count == 1);
+		// 每个叶子节点只包含一个包围盒, child_index 为包围盒的索引.
+		BinnedSahBuilder builder(primitives, 1, _nodes);
+		builder.build();
 
-				_nodes[ix].child_index = Bvh.primitive_indices[crNode.first_child_or_primitive];
-				_nodes[ix].child_num = 1;
-			}
-			else
-			{
-				_nodes[ix].child_index = crNode.first_child_or_primitive;
-				_nodes[ix].child_num = 0;
-			}
-		}
+		this->global_box = global_box;
 	}
 
+    float Bvh::sah_cost(float traversal_cost, float intersect_cost) const
+    {
+        if (_nodes.empty()) return 0.0f;
+
+        float cost = 0.0f;
+        for (const auto& node : _nodes)
+        {
+            float area = node.box.surface_area();
+            cost += node.child_num == 0 ? area * traversal_cost : area * intersect_cost * node.child_num;
+        }
+        return cost / _nodes[0].box.surface_area();
+    }
+
 #define MORTON_BITS_NUM  10
 #define MORTON_HIGH_BITS 12
 
@@ -3,12 +3,10 @@
 
 #include "bounds.h"
 #include "vector.h"
+#include <atomic>
+#include <memory>
 #include <span>
 #include <vector>
-#include <bvh/bvh.hpp>
-#include <bvh/leaf_collapser.hpp>
-#include <bvh/locally_ordered_clustering_builder.hpp>
-#include <bvh/triangle.hpp>
 
 namespace fantasy 
 {
@@ -29,8 +27,14 @@ namespace fantasy
             float3 normal;
         };
 
+        static constexpr uint32_t max_leaf_triangle_num = 8;
+
 		void build(std::span<Bounds3F> boxes, const Bounds3F& global_box);
 		void build(std::span<Bvh::Vertex> vertices, uint32_t triangle_num);
+
+        // 相对于根节点表面积的 SAH 代价.
+        float sah_cost(float traversal_cost = 1.0f, float intersect_cost = 1.0f) const;
+
         std::span<const Bvh::Node> GetNodes() const { return _nodes; }
         std::span<const Bvh::Vertex> GetVertices() const { return _vertices; }
 
@@ -1,18 +1,103 @@
 #include "graph.h"
+#include <algorithm>
 #include <cstdint>
 #include <numeric>
 #include <utility>
 #include <vector>
 #include <metis.h>
 #include "../tools/log.h"
+#include "../parallel/parallel.h"
+#include <atomic>
 
 
 namespace fantasy 
 {
     
-	bool GraphPartitionar::partition_graph(const SimpleGraph& graph, uint32_t min_part_size, uint32_t max_part_size)
+	void CsrGraphBuilder::reset(uint32_t node_num)
 	{
-		uint32_t node_count = static_cast<uint32_t>(graph.size());
+		_node_num = node_num;
+		_edges.clear();
+	}
+
+	void CsrGraphBuilder::build(CsrGraph& graph)
+	{
+		auto& offsets = graph.adjacency_offsets;
+		auto& nodes = graph.adjacency_nodes;
+		auto& weights = graph.adjacency_weights;
+
+		// 第一遍: 统计每个节点的出边数, 前缀和得到每行的起始位置.
+		offsets.assign(_node_num + 1, 0);
+		for (const auto& edge : _edges) offsets[edge.from + 1]++;
+		for (uint32_t ix = 0; ix < _node_num; ++ix) offsets[ix + 1] += offsets[ix];
+
+		// 第二遍: 按起始位置填充.
+		nodes.resize(_edges.size());
+		weights.resize(_edges.size());
+		_cursors.assign(offsets.begin(), offsets.end() - 1);
+		for (const auto& edge : _edges)
+		{
+			int32_t position = _cursors[edge.from]++;
+			nodes[position] = static_cast<int32_t>(edge.to);
+			weights[position] = edge.weight;
+		}
+
+		// 每行排序并合并重复的边, 原地压缩.
+		int32_t write_position = 0;
+		for (uint32_t ix = 0; ix < _node_num; ++ix)
+		{
+			_row.clear();
+			for (int32_t jx = offsets[ix]; jx < offsets[ix + 1]; ++jx) _row.emplace_back(nodes[jx], weights[jx]);
+			std::sort(_row.begin(), _row.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+			offsets[ix] = write_position;
+			for (uint32_t jx = 0; jx < _row.size(); ++jx)
+			{
+				if (jx > 0 && _row[jx].first == _row[jx - 1].first)
+				{
+					weights[write_position - 1] += _row[jx].second;
+					continue;
+				}
+				nodes[write_position] = _row[jx].first;
+				weights[write_position] = _row[jx].second;
+				write_position++;
+			}
+		}
+		offsets[_node_num] = write_position;
+		nodes.resize(write_position);
+		weights.resize(write_position);
+	}
+    
+	// 节点数不少于此值时, 二分后的两半并行递归.
+	static constexpr uint32_t parallel_bisect_node_num = 2048;
+
+	GraphPartitionar::MetisGraph* GraphPartitionar::MetisGraphPool::allocate()
+	{
+		std::lock_guard lock(_mutex);
+		if (_free_graphs.empty())
+		{
+			_graphs.emplace_back(std::make_unique<MetisGraph>());
+			return _graphs.back().get();
+		}
+
+		MetisGraph* graph = _free_graphs.back();
+		_free_graphs.pop_back();
+		return graph;
+	}
+
+	void GraphPartitionar::MetisGraphPool::release(MetisGraph* graph)
+	{
+		graph->node_count = 0;
+		graph->node_adjacency_start_index.clear();
+		graph->adjandency_nodes.clear();
+		graph->adjandency_node_weights.clear();
+
+		std::lock_guard lock(_mutex);
+		_free_graphs.push_back(graph);
+	}
+
+	bool GraphPartitionar::partition_graph(const CsrGraph& graph, uint32_t min_part_size, uint32_t max_part_size, Mode mode)
+	{
+		uint32_t node_count = graph.node_num();
 		_node_indices.resize(node_count);
 		_node_map.resize(node_count);
 		std::iota(_node_indices.begin(), _node_indices.end(), 0);
@@ -22,20 +107,23 @@ namespace fantasy
 		_min_part_size = min_part_size;
 		_max_part_size = max_part_size;
 
-		MetisGraph* metis_graph = new MetisGraph();
-		metis_graph->node_count = graph.size();
-		for(auto& edge_end_weights : graph)
+		// CsrGraph 的布局与 METIS 相同, 直接拷贝.
+		MetisGraph* metis_graph = _metis_graph_pool.allocate();
+		metis_graph->node_count = static_cast<int32_t>(node_count);
+		metis_graph->node_adjacency_start_index = graph.adjacency_offsets;
+		metis_graph->adjandency_nodes = graph.adjacency_nodes;
+		metis_graph->adjandency_node_weights = graph.adjacency_weights;
+		if (metis_graph->node_adjacency_start_index.empty()) metis_graph->node_adjacency_start_index.push_back(0);
+
+		if (mode == Mode::Kway && node_count > _max_part_size)
 		{
-			metis_graph->node_adjacency_start_index.push_back(static_cast<int32_t>(metis_graph->adjandency_nodes.size()));
-			for(auto[edge_end, weight] : edge_end_weights)
-			{
-				metis_graph->adjandency_nodes.push_back(edge_end);
-				metis_graph->adjandency_node_weights.push_back(weight);
-			}
+			ReturnIfFalse(partition_graph_kway(metis_graph, _part_ranges));
+		}
+		else
+		{
+			ReturnIfFalse(bisect_graph_resursive(metis_graph, 0, node_count, _part_ranges));
 		}
-		metis_graph->node_adjacency_start_index.push_back(static_cast<int32_t>(metis_graph->adjandency_nodes.size()));
 
-        ReturnIfFalse(bisect_graph_resursive(metis_graph, 0, metis_graph->node_count));
         std::sort(_part_ranges.begin(), _part_ranges.end());
         for (uint32_t ix = 0; ix < _node_indices.size(); ++ix)
         {
@@ -45,43 +133,75 @@ namespace fantasy
 		return true;
 	}
 
-	bool GraphPartitionar::bisect_graph_resursive(MetisGraph* metis_graph, uint32_t range_start, uint32_t range_end)
+	bool GraphPartitionar::bisect_graph_resursive(MetisGraph* metis_graph, uint32_t range_start, uint32_t range_end, PartRanges& part_ranges)
 	{
         MetisGraph* child_metis_graphs[2] = { nullptr };
-        uint32_t split_pos = bisect_graph(metis_graph, child_metis_graphs, range_start, range_end);
-        delete metis_graph;
+        uint32_t split_pos = range_end;
+        bool result = bisect_graph(metis_graph, child_metis_graphs, range_start, range_end, split_pos, part_ranges);
+        _metis_graph_pool.release(metis_graph);
+        ReturnIfFalse(result);
 
-        if (child_metis_graphs[0] && child_metis_graphs[1])
+        if (!child_metis_graphs[0] || !child_metis_graphs[1])
         {
-            ReturnIfFalse(bisect_graph_resursive(child_metis_graphs[0], range_start, split_pos));
-            ReturnIfFalse(bisect_graph_resursive(child_metis_graphs[1], split_pos, range_end));
+            ReturnIfFalse(child_metis_graphs[0] == nullptr && child_metis_graphs[1] == nullptr);
+            return true;
         }
-        else 
+
+        uint32_t child_ranges[2][2] = { { range_start, split_pos }, { split_pos, range_end } };
+        if (range_end - range_start < parallel_bisect_node_num)
         {
-            ReturnIfFalse(child_metis_graphs[0] == nullptr && child_metis_graphs[1] == nullptr);
+            ReturnIfFalse(bisect_graph_resursive(child_metis_graphs[0], child_ranges[0][0], child_ranges[0][1], part_ranges));
+            ReturnIfFalse(bisect_graph_resursive(child_metis_graphs[1], child_ranges[1][0], child_ranges[1][1], part_ranges));
+            return true;
         }
+
+        // 两半的节点范围不相交, 可以同时递归, 各自输出切分结果后再按顺序合并.
+        PartRanges child_part_ranges[2];
+        std::atomic<bool> child_result = true;
+        parallel::parallel_for(
+            parallel::Range{ 0, 2 },
+            [&](const parallel::Range& range)
+            {
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    if (!bisect_graph_resursive(child_metis_graphs[ix], child_ranges[ix][0], child_ranges[ix][1], child_part_ranges[ix]))
+                    {
+                        child_result.store(false, std::memory_order_relaxed);
+                    }
+                }
+            },
+            1
+        );
+        ReturnIfFalse(child_result.load());
+
+        part_ranges.insert(part_ranges.end(), child_part_ranges[0].begin(), child_part_ranges[0].end());
+        part_ranges.insert(part_ranges.end(), child_part_ranges[1].begin(), child_part_ranges[1].end());
 		return true;
 	}
 
-	uint32_t GraphPartitionar::bisect_graph(
+	bool GraphPartitionar::bisect_graph(
 		MetisGraph* metis_graph, 
 		MetisGraph* child_metis_graph[2], 
 		uint32_t range_start, 
-		uint32_t range_end
+		uint32_t range_end,
+		uint32_t& split_pos,
+		PartRanges& part_ranges
 	)
 	{
         assert(range_end - range_start == metis_graph->node_count);
 
         if (metis_graph->node_count <= _max_part_size)
         {
-            _part_ranges.push_back(std::make_pair(range_start, range_end));
-            return range_end;
+            part_ranges.push_back(std::make_pair(range_start, range_end));
+            split_pos = range_end;
+            return true;
         }
 
         uint32_t part_size_expectation = (_min_part_size + _max_part_size) / 2u;
         uint32_t part_count_expectation = std::max(2u, (metis_graph->node_count + part_size_expectation - 1) / part_size_expectation);
 
-        std::vector<int32_t> partition_result(metis_graph->node_count);
+        std::vector<int32_t>& partition_result = metis_graph->partition_result;
+        partition_result.resize(metis_graph->node_count);
         int32_t node_weight_dimension = 1, part_num = 2, edge_cut_num = 0;
         double part_weight[]={
             float(part_count_expectation >> 1) / part_count_expectation,
@@ -107,7 +227,8 @@ namespace fantasy
 
         uint32_t left = 0;
         uint32_t right = metis_graph->node_count - 1;
-        std::vector<uint32_t> swap_node_map(metis_graph->node_count);
+        std::vector<uint32_t>& swap_node_map = metis_graph->swap_node_map;
+        swap_node_map.resize(metis_graph->node_count);
 
         while (left <= right)
         {
@@ -132,55 +253,163 @@ namespace fantasy
             }
         }
 
-        uint32_t split_pos = left;
+        split_pos = left;
 
         uint32_t child_graph_size[2] = { split_pos, metis_graph->node_count - split_pos };
         ReturnIfFalse(child_graph_size[0] >= 1 && child_graph_size[1] >= 1);
 
         if (child_graph_size[0] <= _max_part_size && child_graph_size[1] <= _max_part_size)
         {
-            _part_ranges.push_back(std::make_pair(range_start, range_start + split_pos));
-            _part_ranges.push_back(std::make_pair(range_start + split_pos, range_end));
+            part_ranges.push_back(std::make_pair(range_start, range_start + split_pos));
+            part_ranges.push_back(std::make_pair(range_start + split_pos, range_end));
         }
         else 
         {
+            // 交换是成对的, swap_node_map 同时是新到旧与旧到新的映射.
             for (uint32_t ix = 0; ix < 2; ++ix)
             {
-                child_metis_graph[ix] = new MetisGraph();
-                child_metis_graph[ix]->node_count = child_graph_size[ix];
-                child_metis_graph[ix]->node_adjacency_start_index.reserve(child_graph_size[ix] + 1);
-                child_metis_graph[ix]->adjandency_nodes.reserve(metis_graph->adjandency_nodes.size() >> 1);
-                child_metis_graph[ix]->adjandency_node_weights.reserve(metis_graph->adjandency_node_weights.size() >> 1);
+                child_metis_graph[ix] = _metis_graph_pool.allocate();
+                build_child_graph(
+                    *metis_graph, 
+                    swap_node_map, 
+                    swap_node_map, 
+                    ix == 0 ? 0 : split_pos, 
+                    ix == 0 ? split_pos : metis_graph->node_count, 
+                    *child_metis_graph[ix]
+                );
             }
+        }
+        
+        split_pos += range_start;
+		return true;
+	}
 
-            for (uint32_t ix = 0; ix < metis_graph->node_count; ++ix)
+	bool GraphPartitionar::partition_graph_kway(MetisGraph* metis_graph, PartRanges& part_ranges)
+	{
+        uint32_t node_count = static_cast<uint32_t>(metis_graph->node_count);
+        uint32_t part_size_expectation = (_min_part_size + _max_part_size) / 2u;
+        int32_t part_num = static_cast<int32_t>(std::max(2u, (node_count + part_size_expectation - 1) / part_size_expectation));
+
+        std::vector<int32_t>& partition_result = metis_graph->partition_result;
+        partition_result.resize(node_count);
+        int32_t node_weight_dimension = 1, edge_cut_num = 0;
+        ReturnIfFalse(
+            METIS_PartGraphKway(
+                &metis_graph->node_count, 
+                &node_weight_dimension, 
+                metis_graph->node_adjacency_start_index.data(), 
+                metis_graph->adjandency_nodes.data(), 
+                nullptr, 
+                nullptr, 
+                metis_graph->adjandency_node_weights.data(), 
+                &part_num, 
+                nullptr, 
+                nullptr, 
+                nullptr, 
+                &edge_cut_num, 
+                partition_result.data()
+            ) == METIS_OK
+        );
+
+        // 按 part 计数排序, 同一 part 的节点在 _node_indices 中连续.
+        std::vector<uint32_t> part_offsets(part_num + 1, 0);
+        for (int32_t part : partition_result) part_offsets[part + 1]++;
+        for (int32_t ix = 0; ix < part_num; ++ix) part_offsets[ix + 1] += part_offsets[ix];
+
+        std::vector<uint32_t>& node_positions = metis_graph->swap_node_map;
+        node_positions.resize(node_count);
+        std::vector<uint32_t> cursors(part_offsets.begin(), part_offsets.end() - 1);
+        for (uint32_t ix = 0; ix < node_count; ++ix)
+        {
+            uint32_t position = cursors[partition_result[ix]]++;
+            node_positions[ix] = position;
+            _node_indices[position] = ix;
+        }
+
+        // 超出 max_part_size 的 part 继续递归二分.
+        std::vector<std::pair<uint32_t, uint32_t>> oversized_ranges;
+        std::vector<MetisGraph*> oversized_graphs;
+        for (int32_t ix = 0; ix < part_num; ++ix)
+        {
+            uint32_t begin = part_offsets[ix];
+            uint32_t end = part_offsets[ix + 1];
+            if (begin == end) continue;
+
+            if (end - begin <= _max_part_size)
+            {
+                part_ranges.push_back(std::make_pair(begin, end));
+                continue;
+            }
+
+            MetisGraph* child_metis_graph = _metis_graph_pool.allocate();
+            build_child_graph(*metis_graph, _node_indices, node_positions, begin, end, *child_metis_graph);
+            oversized_ranges.push_back(std::make_pair(begin, end));
+            oversized_graphs.push_back(child_metis_graph);
+        }
+        _metis_graph_pool.release(metis_graph);
+
+        std::vector<PartRanges> oversized_part_ranges(oversized_graphs.size());
+        std::atomic<bool> result = true;
+        parallel::parallel_for(
+            parallel::Range{ 0, oversized_graphs.size() },
+            [&](const parallel::Range& range)
             {
-                uint32_t current_child_graph_index = ix >= child_graph_size[0] ? 1 : 0;
-                uint32_t mapped_index = swap_node_map[ix];
-
-                MetisGraph* current_child_graph = child_metis_graph[current_child_graph_index];
-                current_child_graph->node_adjacency_start_index.push_back(current_child_graph->adjandency_nodes.size());
-                for (
-                    uint32_t jx = metis_graph->node_adjacency_start_index[mapped_index]; 
-                    jx < metis_graph->node_adjacency_start_index[mapped_index + 1]; 
-                    ++jx
-                )
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
                 {
-                    uint32_t adjancency_node_weight = metis_graph->adjandency_node_weights[jx];
-                    uint32_t adjancency_node_index = metis_graph->adjandency_nodes[jx];
-                    adjancency_node_index = swap_node_map[adjancency_node_index] - (current_child_graph_index == 1 ? child_graph_size[0] : 0);
-                    if (adjancency_node_index >= 0 && adjancency_node_index < child_graph_size[current_child_graph_index])
+                    const auto& [begin, end] = oversized_ranges[ix];
+                    if (!bisect_graph_resursive(oversized_graphs[ix], begin, end, oversized_part_ranges[ix]))
                     {
-                        current_child_graph->adjandency_nodes.push_back(adjancency_node_index);
-                        current_child_graph->adjandency_node_weights.push_back(adjancency_node_weight);
+                        result.store(false, std::memory_order_relaxed);
                     }
                 }
+            },
+            1
+        );
+        ReturnIfFalse(result.load());
+
+        for (const auto& ranges : oversized_part_ranges)
+        {
+            part_ranges.insert(part_ranges.end(), ranges.begin(), ranges.end());
+        }
+		return true;
+	}
+
+	void GraphPartitionar::build_child_graph(
+		const MetisGraph& metis_graph,
+		const std::vector<uint32_t>& new_to_old,
+		const std::vector<uint32_t>& old_to_new,
+		uint32_t begin,
+		uint32_t end,
+		MetisGraph& child_metis_graph
+	)
+	{
+        uint32_t child_node_count = end - begin;
+        child_metis_graph.node_count = static_cast<int32_t>(child_node_count);
+        child_metis_graph.node_adjacency_start_index.clear();
+        child_metis_graph.adjandency_nodes.clear();
+        child_metis_graph.adjandency_node_weights.clear();
+        child_metis_graph.node_adjacency_start_index.reserve(child_node_count + 1);
+
+        for (uint32_t ix = begin; ix < end; ++ix)
+        {
+            uint32_t mapped_index = new_to_old[ix];
+
+            child_metis_graph.node_adjacency_start_index.push_back(static_cast<int32_t>(child_metis_graph.adjandency_nodes.size()));
+            for (
+                int32_t jx = metis_graph.node_adjacency_start_index[mapped_index]; 
+                jx < metis_graph.node_adjacency_start_index[mapped_index + 1]; 
+                ++jx
+            )
+            {
+                uint32_t adjancency_node_index = old_to_new[metis_graph.adjandency_nodes[jx]];
+                if (adjancency_node_index >= begin && adjancency_node_index < end)
+                {
+                    child_metis_graph.adjandency_nodes.push_back(static_cast<int32_t>(adjancency_node_index - begin));
+                    child_metis_graph.adjandency_node_weights.push_back(metis_graph.adjandency_node_weights[jx]);
+                }
             }
-            child_metis_graph[0]->node_adjacency_start_index.push_back(child_metis_graph[0]->adjandency_nodes.size());
-            child_metis_graph[1]->node_adjacency_start_index.push_back(child_metis_graph[1]->adjandency_nodes.size());
         }
-        
-		return range_start + split_pos;
+        child_metis_graph.node_adjacency_start_index.push_back(static_cast<int32_t>(child_metis_graph.adjandency_nodes.size()));
 	}
 
-}
\ No newline at end of file
+}
@@ -1,15 +1,74 @@
+#ifndef MATH_GRAPH_H
+#define MATH_GRAPH_H
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
 #include <vector>
-#include <map>
 
 namespace fantasy 
 {
-    using SimpleGraph = std::vector<std::map<uint32_t, int32_t>>; 
+    // 压缩稀疏行 (CSR) 格式的图, 每个节点的邻接节点升序排列且不重复, 数组可以直接交给 METIS.
+    struct CsrGraph
+    {
+        std::vector<int32_t> adjacency_offsets;     // node_num + 1 个, 节点 i 的邻接为 [offsets[i], offsets[i + 1]).
+        std::vector<int32_t> adjacency_nodes;
+        std::vector<int32_t> adjacency_weights;
+
+        uint32_t node_num() const { return adjacency_offsets.empty() ? 0 : static_cast<uint32_t>(adjacency_offsets.size() - 1); }
+
+        std::span<const int32_t> get_adjacency_nodes(uint32_t node) const
+        {
+            return std::span<const int32_t>(adjacency_nodes.data() + adjacency_offsets[node], adjacency_offsets[node + 1] - adjacency_offsets[node]);
+        }
+
+        std::span<const int32_t> get_adjacency_weights(uint32_t node) const
+        {
+            return std::span<const int32_t>(adjacency_weights.data() + adjacency_offsets[node], adjacency_offsets[node + 1] - adjacency_offsets[node]);
+        }
+    };
+
+    // 先收集有向边, build 时分两遍生成 CsrGraph: 统计每个节点的边数, 再按节点填充, 最后排序并合并重复边的权重.
+    // 内部数组在多次构建之间复用.
+    class CsrGraphBuilder
+    {
+    public:
+        void reset(uint32_t node_num);
+
+        // 自环会被忽略, METIS 不接受自环.
+        void add_edge(uint32_t from, uint32_t to, int32_t weight = 1)
+        {
+            if (from != to) _edges.push_back(Edge{ from, to, weight });
+        }
+
+        void build(CsrGraph& graph);
+
+    private:
+        struct Edge
+        {
+            uint32_t from;
+            uint32_t to;
+            int32_t weight;
+        };
+
+        uint32_t _node_num = 0;
+        std::vector<Edge> _edges;
+        std::vector<int32_t> _cursors;
+        std::vector<std::pair<int32_t, int32_t>> _row;
+    };
 
 	class GraphPartitionar
 	{
 	public:
-		bool partition_graph(const SimpleGraph& graph, uint32_t min_part_size, uint32_t max_part_size);
+		enum class Mode
+		{
+			RecursiveBisection,		// 每次用 METIS_PartGraphRecursive 切成两半, 两半再并行递归.
+			Kway					// 先用 METIS_PartGraphKway 一次切成 k 份, 超过 max_part_size 的部分再递归二分.
+		};
+
+		bool partition_graph(const CsrGraph& graph, uint32_t min_part_size, uint32_t max_part_size, Mode mode = Mode::RecursiveBisection);
 
 		std::vector<std::pair<uint32_t, uint32_t>> _part_ranges;
 		std::vector<uint32_t> _node_indices;
@@ -22,19 +81,55 @@ namespace fantasy
 			std::vector<int32_t> node_adjacency_start_index;
 			std::vector<int32_t> adjandency_nodes;
 			std::vector<int32_t> adjandency_node_weights;
+
+			std::vector<int32_t> partition_result;
+			std::vector<uint32_t> swap_node_map;
+		};
+
+		// 递归任务之间复用 MetisGraph 的内存, 多个任务可以同时申请与归还.
+		class MetisGraphPool
+		{
+		public:
+			MetisGraph* allocate();
+			void release(MetisGraph* graph);
+
+		private:
+			std::mutex _mutex;
+			std::vector<std::unique_ptr<MetisGraph>> _graphs;
+			std::vector<MetisGraph*> _free_graphs;
 		};
 
-		bool bisect_graph_resursive(MetisGraph* metis_graph, uint32_t range_start, uint32_t range_end);
-		uint32_t bisect_graph(
+		using PartRanges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+		// 每个递归任务只修改 _node_indices 中 [range_start, range_end) 的部分, 切分结果写入自己的 part_ranges.
+		bool bisect_graph_resursive(MetisGraph* metis_graph, uint32_t range_start, uint32_t range_end, PartRanges& part_ranges);
+		bool bisect_graph(
 			MetisGraph* metis_graph, 
 			MetisGraph* child_metis_graph[2], 
 			uint32_t range_start, 
-			uint32_t range_end
+			uint32_t range_end,
+			uint32_t& split_pos,
+			PartRanges& part_ranges
+		);
+		bool partition_graph_kway(MetisGraph* metis_graph, PartRanges& part_ranges);
+
+		// 取出新序号 [begin, end) 的节点组成子图, new_to_old 与 old_to_new 为节点的新旧序号映射.
+		void build_child_graph(
+			const MetisGraph& metis_graph,
+			const std::vector<uint32_t>& new_to_old,
+			const std::vector<uint32_t>& old_to_new,
+			uint32_t begin,
+			uint32_t end,
+			MetisGraph& child_metis_graph
 		);
 
 	private:
 		uint32_t _min_part_size = 0;
 		uint32_t _max_part_size = 0;
+
+		MetisGraphPool _metis_graph_pool;
 	};
 
-}
\ No newline at end of file
+}
+
+#endif
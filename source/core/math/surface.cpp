@@ -1,6 +1,7 @@
 #include "surface.h"
 #include "matrix.h"
 #include "vector.h"
+#include <cmath>
 
 namespace fantasy 
 {
@@ -73,6 +74,36 @@ namespace fantasy
         return ret <= 0.0f ? 0.0f : ret;
     }
 
+    bool QuadricSurface::optimize(float3& position) const
+    {
+        // 解 A * p = -b, A = [a2 ab ac; ab b2 bc; ac bc c2], b = [ad bd cd].
+        double det = 
+            a2 * (b2 * c2 - bc * bc) - 
+            ab * (ab * c2 - bc * ac) + 
+            ac * (ab * bc - b2 * ac);
+        double trace = a2 + b2 + c2;
+        if (std::abs(det) <= 1e-12 * trace * trace * trace) return false;
+
+        double inv_det = 1.0 / det;
+        double x = -ad, y = -bd, z = -cd;
+        position = float3(
+            static_cast<float>(inv_det * (x * (b2 * c2 - bc * bc) - ab * (y * c2 - bc * z) + ac * (y * bc - b2 * z))),
+            static_cast<float>(inv_det * (a2 * (y * c2 - bc * z) - x * (ab * c2 - bc * ac) + ac * (ab * z - y * ac))),
+            static_cast<float>(inv_det * (a2 * (b2 * z - y * bc) - ab * (ab * z - y * ac) + x * (ab * bc - b2 * ac)))
+        );
+        return true;
+    }
+
+    double QuadricSurface::error(const float3& position) const
+    {
+        double x = position.x, y = position.y, z = position.z;
+        double ret = 
+            a2 * x * x + b2 * y * y + c2 * z * z + 
+            2.0 * (ab * x * y + ac * x * z + bc * y * z) + 
+            2.0 * (ad * x + bd * y + cd * z) + d2;
+        return ret <= 0.0 ? 0.0 : ret;
+    }
+
     QuadricSurface merge(const QuadricSurface& surface0, const QuadricSurface& surface1)
     {
         static_assert(sizeof(QuadricSurface) == sizeof(double) * 10);
@@ -2,6 +2,8 @@
 #define MATH_SURFACE_H
 
 #include "vector.h"
+#include <cmath>
+#include <cstdint>
 
 namespace fantasy 
 {
@@ -17,11 +19,124 @@ namespace fantasy
 
         bool get_vertex(float3& position, float3& normal, float3& tangent);
         float distance_to_surface(const float3& p);
+
+        // 双精度求误差最小的位置, 矩阵接近奇异时返回 false.
+        bool optimize(float3& position) const;
+        double error(const float3& position) const;
         float3 calculate_normal(float3 p);
         float3 calculate_tangent(float3 p);
 	};
 
     QuadricSurface merge(const QuadricSurface& surface0, const QuadricSurface& surface1);
+
+
+    // 带顶点属性的二次误差 (Hoppe 1999, New Quadric Metric for Simplifying Meshes with Appearance Attributes).
+    // 属性在三角形上线性插值 s = dot(g, p) + d, 位置确定后最优属性可直接求出, 所以误差仍是位置的二次型.
+    // 属性误差按三角形面积加权, 与平面距离误差一样是长度的平方.
+    template <uint32_t AttributeNum>
+    struct AttributeQuadric
+    {
+        QuadricSurface surface;     // 平面距离.
+        QuadricSurface attribute;   // 各属性 area * (dot(g, p) + d)^2 之和, 形式与平面二次型相同.
+        double gradients[AttributeNum][3] = {};
+        double offsets[AttributeNum] = {};
+        double area = 0.0;
+
+        AttributeQuadric() = default;
+        AttributeQuadric(
+            const Vector3<double>& p0, const Vector3<double>& p1, const Vector3<double>& p2,
+            const float* attributes0, const float* attributes1, const float* attributes2
+        )
+        {
+            Vector3<double> e1 = p1 - p0;
+            Vector3<double> e2 = p2 - p0;
+            Vector3<double> normal = cross(e1, e2);
+            double normal_length2 = dot(normal, normal);
+            if (normal_length2 <= 0.0) return;
+
+            surface = QuadricSurface(p0, p1, p2);
+            area = 0.5 * std::sqrt(normal_length2);
+
+            // g 满足 dot(g, e1) = s1 - s0, dot(g, e2) = s2 - s0, dot(g, normal) = 0.
+            Vector3<double> t1 = cross(e2, normal) * (1.0 / normal_length2);
+            Vector3<double> t2 = cross(normal, e1) * (1.0 / normal_length2);
+            for (uint32_t ix = 0; ix < AttributeNum; ++ix)
+            {
+                Vector3<double> g = 
+                    t1 * static_cast<double>(attributes1[ix] - attributes0[ix]) + 
+                    t2 * static_cast<double>(attributes2[ix] - attributes0[ix]);
+                double d = attributes0[ix] - dot(g, p0);
+
+                attribute.a2 += area * g.x * g.x; attribute.b2 += area * g.y * g.y; attribute.c2 += area * g.z * g.z; 
+                attribute.ab += area * g.x * g.y; attribute.ac += area * g.x * g.z; attribute.bc += area * g.y * g.z;
+                attribute.ad += area * g.x * d; attribute.bd += area * g.y * d; attribute.cd += area * g.z * d;
+                attribute.d2 += area * d * d;
+
+                gradients[ix][0] = area * g.x;
+                gradients[ix][1] = area * g.y;
+                gradients[ix][2] = area * g.z;
+                offsets[ix] = area * d;
+            }
+        }
+
+        // 消去属性后只与位置有关的二次型, 即取最优属性时的误差.
+        QuadricSurface reduce() const
+        {
+            QuadricSurface ret;
+            ret.a2 = surface.a2 + attribute.a2; ret.ab = surface.ab + attribute.ab; ret.ac = surface.ac + attribute.ac; ret.ad = surface.ad + attribute.ad;
+            ret.b2 = surface.b2 + attribute.b2; ret.bc = surface.bc + attribute.bc; ret.bd = surface.bd + attribute.bd;
+            ret.c2 = surface.c2 + attribute.c2; ret.cd = surface.cd + attribute.cd;
+            ret.d2 = surface.d2 + attribute.d2;
+            if (area <= 0.0) return ret;
+
+            double inv_area = 1.0 / area;
+            for (uint32_t ix = 0; ix < AttributeNum; ++ix)
+            {
+                const double* g = gradients[ix];
+                double d = offsets[ix] * inv_area;
+                double gx = g[0] * inv_area, gy = g[1] * inv_area, gz = g[2] * inv_area;
+                ret.a2 -= g[0] * gx; ret.ab -= g[0] * gy; ret.ac -= g[0] * gz; ret.ad -= g[0] * d;
+                ret.b2 -= g[1] * gy; ret.bc -= g[1] * gz; ret.bd -= g[1] * d;
+                ret.c2 -= g[2] * gz; ret.cd -= g[2] * d;
+                ret.d2 -= offsets[ix] * d;
+            }
+            return ret;
+        }
+
+        // position 处的最优属性, 即各三角形插值结果按面积加权的平均.
+        bool get_attributes(const float3& position, float* attributes) const
+        {
+            if (area <= 0.0) return false;
+            for (uint32_t ix = 0; ix < AttributeNum; ++ix)
+            {
+                attributes[ix] = static_cast<float>((
+                    gradients[ix][0] * position.x + 
+                    gradients[ix][1] * position.y + 
+                    gradients[ix][2] * position.z + 
+                    offsets[ix]
+                ) / area);
+            }
+            return true;
+        }
+    };
+
+    template <uint32_t AttributeNum>
+    AttributeQuadric<AttributeNum> merge(const AttributeQuadric<AttributeNum>& quadric0, const AttributeQuadric<AttributeNum>& quadric1)
+    {
+        constexpr uint32_t element_num = 21 + 4 * AttributeNum;
+        static_assert(sizeof(AttributeQuadric<AttributeNum>) == sizeof(double) * element_num);
+
+        const double* quadric0_ptr = reinterpret_cast<const double*>(&quadric0);
+        const double* quadric1_ptr = reinterpret_cast<const double*>(&quadric1);
+
+        AttributeQuadric<AttributeNum> ret;
+        double* ret_ptr = reinterpret_cast<double*>(&ret);
+        for (uint32_t ix = 0; ix < element_num; ++ix)
+        {
+            ret_ptr[ix] = quadric0_ptr[ix] + quadric1_ptr[ix];
+        }
+        return ret;
+    }
 }
 
 
@@ -0,0 +1,544 @@
+#include "wide_bvh.h"
+#include <algorithm>
+#include <immintrin.h>
+
+namespace fantasy
+{
+    static constexpr uint32_t traversal_stack_size = 128;
+
+    // 遍历栈, 先用固定大小的数组, 退化的深层树装不下时把多出的节点放入 overflow, 仍保持后进先出.
+    struct TraversalStack
+    {
+        uint32_t nodes[traversal_stack_size];
+        uint32_t top = 0;
+        std::vector<uint32_t> overflow;
+
+        bool empty() const { return top == 0 && overflow.empty(); }
+
+        void push(uint32_t node_index)
+        {
+            if (top < traversal_stack_size) nodes[top++] = node_index;
+            else overflow.push_back(node_index);
+        }
+
+        uint32_t pop()
+        {
+            if (overflow.empty()) return nodes[--top];
+
+            uint32_t node_index = overflow.back();
+            overflow.pop_back();
+            return node_index;
+        }
+    };
+
+    void WideBvh::build(const Bvh& bvh)
+    {
+        clear();
+
+        std::span<const Bvh::Node> bvh_nodes = bvh.GetNodes();
+        if (bvh_nodes.empty()) return;
+
+        _nodes.reserve(bvh_nodes.size() / 2 + 1);
+        _packets.reserve(bvh.triangle_num / 2 + 1);
+
+        std::span<const Bvh::Vertex> vertices = bvh.GetVertices();
+        auto build_leaf = [&](const Bvh::Node& bvh_node)
+        {
+            uint32_t first_packet_index = static_cast<uint32_t>(_packets.size());
+            for (uint32_t ix = 0; ix < bvh_node.child_num; ix += width)
+            {
+                TrianglePacket& packet = _packets.emplace_back();
+                for (uint32_t jx = 0; jx < width; ++jx)
+                {
+                    uint32_t triangle_index = bvh_node.child_index + ix + jx;
+                    float3 v0, e1, e2;
+                    if (ix + jx < bvh_node.child_num)
+                    {
+                        v0 = vertices[triangle_index * 3].position;
+                        e1 = vertices[triangle_index * 3 + 1].position - v0;
+                        e2 = vertices[triangle_index * 3 + 2].position - v0;
+                    }
+                    else
+                    {
+                        // 退化三角形, det 为 0, 永远不会命中.
+                        triangle_index = INVALID_TRIANGLE_INDEX;
+                    }
+
+                    for (uint32_t axis = 0; axis < 3; ++axis)
+                    {
+                        packet.v0[axis][jx] = v0[axis];
+                        packet.e1[axis][jx] = e1[axis];
+                        packet.e2[axis][jx] = e2[axis];
+                    }
+                    packet.triangle_index[jx] = triangle_index;
+                }
+            }
+            return first_packet_index;
+        };
+
+        // 根节点本身是叶子时, 用只有一个子节点的 4 叉节点包住它.
+        if (bvh_nodes[0].child_num != 0)
+        {
+            Node& root = _nodes.emplace_back();
+            for (uint32_t ix = 0; ix < width; ++ix)
+            {
+                root.lower_x[ix] = root.lower_y[ix] = root.lower_z[ix] = INFINITY;
+                root.upper_x[ix] = root.upper_y[ix] = root.upper_z[ix] = -INFINITY;
+                root.child_index[ix] = 0;
+                root.packet_num[ix] = 0;
+            }
+
+            const Bounds3F& box = bvh_nodes[0].box;
+            root.lower_x[0] = box._lower.x; root.lower_y[0] = box._lower.y; root.lower_z[0] = box._lower.z;
+            root.upper_x[0] = box._upper.x; root.upper_y[0] = box._upper.y; root.upper_z[0] = box._upper.z;
+            root.packet_num[0] = (bvh_nodes[0].child_num + width - 1) / width;
+            root.child_index[0] = build_leaf(bvh_nodes[0]);
+            return;
+        }
+
+        std::vector<uint32_t> pending_node_indices = { 0 };
+        std::vector<uint32_t> bvh_node_indices = { 0 };
+        while (!pending_node_indices.empty())
+        {
+            uint32_t node_index = pending_node_indices.back();
+            uint32_t bvh_node_index = bvh_node_indices.back();
+            pending_node_indices.pop_back();
+            bvh_node_indices.pop_back();
+
+            if (node_index == _nodes.size()) _nodes.emplace_back();
+
+            // 每次展开表面积最大的内部子节点, 直到凑满 width 个子节点.
+            uint32_t children[width] = { bvh_nodes[bvh_node_index].child_index, bvh_nodes[bvh_node_index].child_index + 1 };
+            uint32_t child_num = 2;
+            while (child_num < width)
+            {
+                uint32_t expand_index = width;
+                float max_area = -1.0f;
+                for (uint32_t ix = 0; ix < child_num; ++ix)
+                {
+                    const Bvh::Node& child = bvh_nodes[children[ix]];
+                    if (child.child_num == 0 && child.box.surface_area() > max_area)
+                    {
+                        max_area = child.box.surface_area();
+                        expand_index = ix;
+                    }
+                }
+                if (expand_index == width) break;
+
+                uint32_t expand_node_index = children[expand_index];
+                children[expand_index] = bvh_nodes[expand_node_index].child_index;
+                children[child_num++] = bvh_nodes[expand_node_index].child_index + 1;
+            }
+
+            Node node;
+            for (uint32_t ix = 0; ix < width; ++ix)
+            {
+                if (ix >= child_num)
+                {
+                    // 空的子节点, 包围盒为空, 射线与最近点测试都不会通过.
+                    node.lower_x[ix] = node.lower_y[ix] = node.lower_z[ix] = INFINITY;
+                    node.upper_x[ix] = node.upper_y[ix] = node.upper_z[ix] = -INFINITY;
+                    node.child_index[ix] = 0;
+                    node.packet_num[ix] = 0;
+                    continue;
+                }
+
+                const Bvh::Node& child = bvh_nodes[children[ix]];
+                node.lower_x[ix] = child.box._lower.x; node.lower_y[ix] = child.box._lower.y; node.lower_z[ix] = child.box._lower.z;
+                node.upper_x[ix] = child.box._upper.x; node.upper_y[ix] = child.box._upper.y; node.upper_z[ix] = child.box._upper.z;
+
+                if (child.child_num != 0)
+                {
+                    node.packet_num[ix] = (child.child_num + width - 1) / width;
+                    node.child_index[ix] = build_leaf(child);
+                }
+                else
+                {
+                    node.packet_num[ix] = 0;
+                    node.child_index[ix] = static_cast<uint32_t>(_nodes.size());
+                    _nodes.emplace_back();
+
+                    pending_node_indices.push_back(node.child_index[ix]);
+                    bvh_node_indices.push_back(children[ix]);
+                }
+            }
+            _nodes[node_index] = node;
+        }
+    }
+
+    struct SimdRay
+    {
+        __m128 origin[3];
+        __m128 inv_dir[3];
+        __m128 dir[3];
+
+        // 按方向的符号选择近平面与远平面, 空的子节点 (lower = +inf, upper = -inf) 总是不相交.
+        uint32_t near_offset[3];
+        uint32_t far_offset[3];
+
+        explicit SimdRay(const Ray& ray)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                float dir_value = ray.dir[axis];
+                if (std::abs(dir_value) < 1e-30f) dir_value = dir_value < 0.0f ? -1e-30f : 1e-30f;
+
+                origin[axis] = _mm_set1_ps(ray.ori[axis]);
+                dir[axis] = _mm_set1_ps(ray.dir[axis]);
+                inv_dir[axis] = _mm_set1_ps(1.0f / dir_value);
+
+                // Node 中每个轴依次为 lower, upper.
+                near_offset[axis] = axis * 2 + (dir_value < 0.0f ? 1 : 0);
+                far_offset[axis] = axis * 2 + (dir_value < 0.0f ? 0 : 1);
+            }
+        }
+
+        // 返回相交的子节点掩码, 并输出进入距离.
+        int intersect(const WideBvh::Node& node, float max_t, __m128& t_near) const
+        {
+            const float* planes = node.lower_x;
+
+            __m128 t_min = _mm_setzero_ps();
+            __m128 t_max = _mm_set1_ps(max_t);
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                __m128 near_plane = _mm_load_ps(planes + near_offset[axis] * WideBvh::width);
+                __m128 far_plane = _mm_load_ps(planes + far_offset[axis] * WideBvh::width);
+                t_min = _mm_max_ps(t_min, _mm_mul_ps(_mm_sub_ps(near_plane, origin[axis]), inv_dir[axis]));
+                t_max = _mm_min_ps(t_max, _mm_mul_ps(_mm_sub_ps(far_plane, origin[axis]), inv_dir[axis]));
+            }
+
+            t_near = t_min;
+            return _mm_movemask_ps(_mm_cmple_ps(t_min, t_max));
+        }
+
+        // Möller–Trumbore, 一次测试 4 个三角形, 返回命中掩码.
+        int intersect(const WideBvh::TrianglePacket& packet, __m128 max_t, __m128& t, __m128& u, __m128& v) const
+        {
+            __m128 v0[3], e1[3], e2[3];
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                v0[axis] = _mm_load_ps(packet.v0[axis]);
+                e1[axis] = _mm_load_ps(packet.e1[axis]);
+                e2[axis] = _mm_load_ps(packet.e2[axis]);
+            }
+
+            // p = cross(dir, e2)
+            __m128 p[3] = {
+                _mm_sub_ps(_mm_mul_ps(dir[1], e2[2]), _mm_mul_ps(dir[2], e2[1])),
+                _mm_sub_ps(_mm_mul_ps(dir[2], e2[0]), _mm_mul_ps(dir[0], e2[2])),
+                _mm_sub_ps(_mm_mul_ps(dir[0], e2[1]), _mm_mul_ps(dir[1], e2[0]))
+            };
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])), _mm_mul_ps(e1[2], p[2]));
+            __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+            __m128 s[3] = { _mm_sub_ps(origin[0], v0[0]), _mm_sub_ps(origin[1], v0[1]), _mm_sub_ps(origin[2], v0[2]) };
+            u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])), _mm_mul_ps(s[2], p[2])), inv_det);
+
+            // q = cross(s, e1)
+            __m128 q[3] = {
+                _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+                _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+                _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]))
+            };
+            v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dir[0], q[0]), _mm_mul_ps(dir[1], q[1])), _mm_mul_ps(dir[2], q[2])), inv_det);
+            t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])), _mm_mul_ps(e2[2], q[2])), inv_det);
+
+            __m128 zero = _mm_setzero_ps();
+            __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+            __m128 mask = _mm_cmpgt_ps(abs_det, _mm_set1_ps(1e-12f));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, max_t));
+            return _mm_movemask_ps(mask);
+        }
+    };
+
+    static uint32_t count_trailing_zero(uint32_t value)
+    {
+        uint32_t count = 0;
+        while ((value & 1) == 0) { value >>= 1; ++count; }
+        return count;
+    }
+
+    bool WideBvh::intersect_closest(const Ray& ray, Hit& hit) const
+    {
+        if (_nodes.empty()) return false;
+
+        SimdRay simd_ray(ray);
+        hit = Hit{ .t = ray.max };
+
+        TraversalStack stack;
+        stack.push(0);
+
+        while (!stack.empty())
+        {
+            const Node& node = _nodes[stack.pop()];
+
+            __m128 t_near;
+            int mask = simd_ray.intersect(node, hit.t, t_near);
+            if (mask == 0) continue;
+
+            alignas(16) float near_distances[width];
+            _mm_store_ps(near_distances, t_near);
+
+            // 近的子节点最后入栈, 最先被访问.
+            uint32_t hit_children[width];
+            uint32_t hit_child_num = 0;
+            while (mask != 0)
+            {
+                uint32_t ix = count_trailing_zero(static_cast<uint32_t>(mask));
+                mask &= mask - 1;
+
+                uint32_t jx = hit_child_num++;
+                while (jx > 0 && near_distances[hit_children[jx - 1]] < near_distances[ix])
+                {
+                    hit_children[jx] = hit_children[jx - 1];
+                    --jx;
+                }
+                hit_children[jx] = ix;
+            }
+
+            for (uint32_t kx = 0; kx < hit_child_num; ++kx)
+            {
+                uint32_t ix = hit_children[kx];
+                if (node.packet_num[ix] == 0)
+                {
+                    stack.push(node.child_index[ix]);
+                    continue;
+                }
+
+                for (uint32_t packet_index = node.child_index[ix]; packet_index < node.child_index[ix] + node.packet_num[ix]; ++packet_index)
+                {
+                    const TrianglePacket& packet = _packets[packet_index];
+
+                    __m128 t, u, v;
+                    int triangle_mask = simd_ray.intersect(packet, _mm_set1_ps(hit.t), t, u, v);
+                    if (triangle_mask == 0) continue;
+
+                    alignas(16) float ts[width], us[width], vs[width];
+                    _mm_store_ps(ts, t);
+                    _mm_store_ps(us, u);
+                    _mm_store_ps(vs, v);
+                    while (triangle_mask != 0)
+                    {
+                        uint32_t jx = count_trailing_zero(static_cast<uint32_t>(triangle_mask));
+                        triangle_mask &= triangle_mask - 1;
+                        if (ts[jx] < hit.t)
+                        {
+                            hit = Hit{ .t = ts[jx], .u = us[jx], .v = vs[jx], .triangle_index = packet.triangle_index[jx] };
+                        }
+                    }
+                }
+            }
+        }
+
+        return hit.triangle_index != INVALID_TRIANGLE_INDEX;
+    }
+
+    bool WideBvh::intersect_any(const Ray& ray) const
+    {
+        if (_nodes.empty()) return false;
+
+        SimdRay simd_ray(ray);
+        __m128 max_t = _mm_set1_ps(ray.max);
+
+        TraversalStack stack;
+        stack.push(0);
+
+        while (!stack.empty())
+        {
+            const Node& node = _nodes[stack.pop()];
+
+            __m128 t_near;
+            int mask = simd_ray.intersect(node, ray.max, t_near);
+            while (mask != 0)
+            {
+                uint32_t ix = count_trailing_zero(static_cast<uint32_t>(mask));
+                mask &= mask - 1;
+
+                if (node.packet_num[ix] == 0)
+                {
+                    stack.push(node.child_index[ix]);
+                    continue;
+                }
+
+                for (uint32_t packet_index = node.child_index[ix]; packet_index < node.child_index[ix] + node.packet_num[ix]; ++packet_index)
+                {
+                    __m128 t, u, v;
+                    if (simd_ray.intersect(_packets[packet_index], max_t, t, u, v) != 0) return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    uint32_t WideBvh::intersect_count(const Ray& ray) const
+    {
+        if (_nodes.empty()) return 0;
+
+        SimdRay simd_ray(ray);
+        __m128 max_t = _mm_set1_ps(ray.max);
+
+        TraversalStack stack;
+        stack.push(0);
+
+        uint32_t count = 0;
+        while (!stack.empty())
+        {
+            const Node& node = _nodes[stack.pop()];
+
+            __m128 t_near;
+            int mask = simd_ray.intersect(node, ray.max, t_near);
+            while (mask != 0)
+            {
+                uint32_t ix = count_trailing_zero(static_cast<uint32_t>(mask));
+                mask &= mask - 1;
+
+                if (node.packet_num[ix] == 0)
+                {
+                    stack.push(node.child_index[ix]);
+                    continue;
+                }
+
+                for (uint32_t packet_index = node.child_index[ix]; packet_index < node.child_index[ix] + node.packet_num[ix]; ++packet_index)
+                {
+                    __m128 t, u, v;
+                    int triangle_mask = simd_ray.intersect(_packets[packet_index], max_t, t, u, v);
+                    while (triangle_mask != 0)
+                    {
+                        triangle_mask &= triangle_mask - 1;
+                        ++count;
+                    }
+                }
+            }
+        }
+
+        return count;
+    }
+
+    // Real-Time Collision Detection 5.1.5.
+    static float3 closest_point_on_triangle(const float3& p, const float3& a, const float3& b, const float3& c)
+    {
+        float3 ab = b - a;
+        float3 ac = c - a;
+        float3 ap = p - a;
+        float d1 = dot(ab, ap);
+        float d2 = dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+        float3 bp = p - b;
+        float d3 = dot(ab, bp);
+        float d4 = dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) return b;
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+        float3 cp = p - c;
+        float d5 = dot(ab, cp);
+        float d6 = dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) return c;
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+        float denom = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    bool WideBvh::closest_point(const float3& position, float max_distance, ClosestPoint& result) const
+    {
+        result = ClosestPoint{ .position = float3(0.0f), .distance = max_distance, .triangle_index = INVALID_TRIANGLE_INDEX };
+        if (_nodes.empty()) return false;
+
+        __m128 p[3] = { _mm_set1_ps(position.x), _mm_set1_ps(position.y), _mm_set1_ps(position.z) };
+        float max_distance_squared = max_distance * max_distance;
+
+        TraversalStack stack;
+        stack.push(0);
+
+        while (!stack.empty())
+        {
+            const Node& node = _nodes[stack.pop()];
+
+            // 点到 4 个包围盒的距离平方, 空的子节点为无穷大.
+            __m128 zero = _mm_setzero_ps();
+            __m128 distance_squared = zero;
+            const float* planes = node.lower_x;
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                __m128 lower = _mm_load_ps(planes + axis * 2 * width);
+                __m128 upper = _mm_load_ps(planes + (axis * 2 + 1) * width);
+                __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(lower, p[axis]), _mm_sub_ps(p[axis], upper)), zero);
+                distance_squared = _mm_add_ps(distance_squared, _mm_mul_ps(d, d));
+            }
+
+            alignas(16) float distances[width];
+            _mm_store_ps(distances, distance_squared);
+            int mask = _mm_movemask_ps(_mm_cmple_ps(distance_squared, _mm_set1_ps(max_distance_squared)));
+
+            uint32_t hit_children[width];
+            uint32_t hit_child_num = 0;
+            while (mask != 0)
+            {
+                uint32_t ix = count_trailing_zero(static_cast<uint32_t>(mask));
+                mask &= mask - 1;
+
+                uint32_t jx = hit_child_num++;
+                while (jx > 0 && distances[hit_children[jx - 1]] < distances[ix])
+                {
+                    hit_children[jx] = hit_children[jx - 1];
+                    --jx;
+                }
+                hit_children[jx] = ix;
+            }
+
+            for (uint32_t kx = 0; kx < hit_child_num; ++kx)
+            {
+                uint32_t ix = hit_children[kx];
+                if (distances[ix] > max_distance_squared) continue;
+
+                if (node.packet_num[ix] == 0)
+                {
+                    stack.push(node.child_index[ix]);
+                    continue;
+                }
+
+                for (uint32_t packet_index = node.child_index[ix]; packet_index < node.child_index[ix] + node.packet_num[ix]; ++packet_index)
+                {
+                    const TrianglePacket& packet = _packets[packet_index];
+                    for (uint32_t jx = 0; jx < width; ++jx)
+                    {
+                        if (packet.triangle_index[jx] == INVALID_TRIANGLE_INDEX) continue;
+
+                        float3 a(packet.v0[0][jx], packet.v0[1][jx], packet.v0[2][jx]);
+                        float3 b = a + float3(packet.e1[0][jx], packet.e1[1][jx], packet.e1[2][jx]);
+                        float3 c = a + float3(packet.e2[0][jx], packet.e2[1][jx], packet.e2[2][jx]);
+
+                        float3 point = closest_point_on_triangle(position, a, b, c);
+                        float3 offset = point - position;
+                        float squared = dot(offset, offset);
+                        if (squared < max_distance_squared)
+                        {
+                            max_distance_squared = squared;
+                            result.position = point;
+                            result.triangle_index = packet.triangle_index[jx];
+                        }
+                    }
+                }
+            }
+        }
+
+        if (result.triangle_index == INVALID_TRIANGLE_INDEX) return false;
+
+        result.distance = std::sqrt(max_distance_squared);
+        return true;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef MATH_WIDE_BVH_H
+#define MATH_WIDE_BVH_H
+
+#include "bvh.h"
+#include "ray.h"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace fantasy
+{
+    // 由二叉 Bvh 合并得到的 4 叉 BVH, 用于 CPU 端的烘焙查询 (SDF 校验, surface cache 摆放, 拾取).
+    // 节点的四个子包围盒与叶子中的三角形都按 SoA 存放, 一次 SSE 指令测试 4 个包围盒或 4 个三角形.
+    // 三角形索引与 Bvh::GetVertices() 中的三角形顺序一致, 也就是 SDF 着色器使用的顺序.
+    class WideBvh
+    {
+    public:
+        static constexpr uint32_t width = 4;
+
+        struct alignas(16) Node
+        {
+            float lower_x[width];
+            float upper_x[width];
+            float lower_y[width];
+            float upper_y[width];
+            float lower_z[width];
+            float upper_z[width];
+
+            // packet_num 为 0 时 child_index 为子节点索引, 否则为叶子中第一个 TrianglePacket 的索引.
+            uint32_t child_index[width];
+            uint32_t packet_num[width];
+        };
+        static_assert(sizeof(Node) == sizeof(float) * 32);
+
+        // 4 个三角形, 存放 v0 与两条边, 不足 4 个时用退化三角形补齐.
+        struct alignas(16) TrianglePacket
+        {
+            float v0[3][width];
+            float e1[3][width];
+            float e2[3][width];
+            uint32_t triangle_index[width];
+        };
+
+        struct Hit
+        {
+            float t = INFINITY;
+            float u = 0.0f;
+            float v = 0.0f;
+            uint32_t triangle_index = INVALID_TRIANGLE_INDEX;
+        };
+
+        struct ClosestPoint
+        {
+            float3 position;
+            float distance = INFINITY;
+            uint32_t triangle_index = INVALID_TRIANGLE_INDEX;
+        };
+
+        static constexpr uint32_t INVALID_TRIANGLE_INDEX = static_cast<uint32_t>(-1);
+
+        void build(const Bvh& bvh);
+
+        // 最近交点, ray.max 限制查询距离, 命中时返回 true.
+        bool intersect_closest(const Ray& ray, Hit& hit) const;
+
+        // 任意交点, 适合阴影和可见性测试.
+        bool intersect_any(const Ray& ray) const;
+
+        // 射线穿过的三角形个数, 用于奇偶性判断内外.
+        uint32_t intersect_count(const Ray& ray) const;
+
+        // 距离 position 最近的三角形上的点 (无符号距离), 只搜索 max_distance 以内的三角形.
+        bool closest_point(const float3& position, float max_distance, ClosestPoint& result) const;
+
+        bool empty() const { return _nodes.empty(); }
+
+        void clear()
+        {
+            _nodes.clear(); _nodes.shrink_to_fit();
+            _packets.clear(); _packets.shrink_to_fit();
+        }
+
+    private:
+        std::vector<Node> _nodes;
+        std::vector<TrianglePacket> _packets;
+    };
+}
+
+#endif
@@ -1,7 +1,8 @@
 #include "parallel.h"
 #include <cassert>
 #include <functional>
-#include <queue>
+#include <algorithm>
+#include <atomic>
 #include "thread_pool.h"
 #include "../math/common.h"
 #include "../tools/log.h"
@@ -10,42 +11,6 @@ namespace fantasy
 {
     namespace parallel 
     {
-        template <typename T>
-        class TaskQueue
-        {
-        public:
-            void push(const T& task)
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _queue.push(task);
-                _condition_variable.notify_one();
-            }
-            
-            T pop()
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                T msg = _queue.front();
-                _queue.pop();
-                return msg;
-            }
-            
-            void wait()
-            {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _condition_variable.wait(lock, [this]() {
-                    return (!_queue.empty());
-                    });
-            }
-
-        private:
-            std::condition_variable _condition_variable;
-            std::mutex _mutex;
-            std::queue<T> _queue;
-        };
-
-
-
-        static TaskQueue<TaskNode*> node_queue;
         static std::unique_ptr<ThreadPool> thread_pool;
 
         void initialize()
@@ -73,6 +38,75 @@ namespace fantasy
             thread_pool->parallel_for(func, x, y);
         }
 
+        void parallel_for(const Range& range, const std::function<void(const Range&)>& func, uint64_t grain)
+        {
+            if (range.empty()) return;
+
+            thread_pool->parallel_for_range(
+                range.begin, 
+                range.end, 
+                grain, 
+                [&func](uint64_t begin, uint64_t end) { func(Range{ begin, end }); }
+            );
+        }
+
+        void parallel_for(const Range2D& range, const std::function<void(const Range2D&)>& func, uint64_t tile_size)
+        {
+            if (range.x.empty() || range.y.empty()) return;
+
+            if (tile_size == 0) tile_size = 16;
+            uint64_t tile_num_x = (range.x.size() + tile_size - 1) / tile_size;
+            uint64_t tile_num_y = (range.y.size() + tile_size - 1) / tile_size;
+
+            thread_pool->parallel_for_range(
+                0, 
+                tile_num_x * tile_num_y, 
+                0, 
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t tile = begin; tile < end; ++tile)
+                    {
+                        uint64_t lower_x = range.x.begin + (tile % tile_num_x) * tile_size;
+                        uint64_t lower_y = range.y.begin + (tile / tile_num_x) * tile_size;
+                        func(Range2D{
+                            .x = Range{ lower_x, std::min(lower_x + tile_size, range.x.end) },
+                            .y = Range{ lower_y, std::min(lower_y + tile_size, range.y.end) }
+                        });
+                    }
+                }
+            );
+        }
+
+        void parallel_for(const Range3D& range, const std::function<void(const Range3D&)>& func, uint64_t tile_size)
+        {
+            if (range.x.empty() || range.y.empty() || range.z.empty()) return;
+
+            if (tile_size == 0) tile_size = 8;
+            uint64_t tile_num_x = (range.x.size() + tile_size - 1) / tile_size;
+            uint64_t tile_num_y = (range.y.size() + tile_size - 1) / tile_size;
+            uint64_t tile_num_z = (range.z.size() + tile_size - 1) / tile_size;
+
+            thread_pool->parallel_for_range(
+                0, 
+                tile_num_x * tile_num_y * tile_num_z, 
+                0, 
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t tile = begin; tile < end; ++tile)
+                    {
+                        uint64_t lower_x = range.x.begin + (tile % tile_num_x) * tile_size;
+                        uint64_t lower_y = range.y.begin + (tile / tile_num_x % tile_num_y) * tile_size;
+                        uint64_t lower_z = range.z.begin + (tile / (tile_num_x * tile_num_y)) * tile_size;
+                        func(Range3D{
+                            .x = Range{ lower_x, std::min(lower_x + tile_size, range.x.end) },
+                            .y = Range{ lower_y, std::min(lower_y + tile_size, range.y.end) },
+                            .z = Range{ lower_z, std::min(lower_z + tile_size, range.z.end) }
+                        });
+                    }
+                }
+            );
+        }
+
         bool thread_finished(uint64_t index)
         {
             if (index == INVALID_SIZE_64) return false;
@@ -90,50 +124,50 @@ namespace fantasy
             return thread_pool->submit(std::move(rrFunc));
         }
 
+        struct TaskFlowState
+        {
+            std::atomic<uint32_t> unfinished_task_count = 0;
+            std::atomic<bool> failed = false;
+        };
+
+        static void run_task_node(TaskNode* node, TaskFlowState* state)
+        {
+            // 有任务失败后, 剩余的任务只做依赖计数, 不再执行.
+            if (!state->failed.load(std::memory_order_relaxed) && !node->run())
+            {
+                state->failed.store(true, std::memory_order_relaxed);
+            }
+
+            for (TaskNode* successor : node->successors)
+            {
+                if (successor->unfinished_dependent_task_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    thread_pool->spawn([successor, state]() { run_task_node(successor, state); });
+                }
+            }
+
+            // 后继任务已经提交, 计数不会提前归零.
+            state->unfinished_task_count.fetch_sub(1, std::memory_order_release);
+        }
+
         bool run(TaskFlow& flow)
         {
             ReturnIfFalse(!flow.empty());
 
-            uint32_t unfinished_task_count = flow.TotalTaskNum;
+            flow.reset_dependencies();
+
+            TaskFlowState state;
+            state.unfinished_task_count.store(flow.TotalTaskNum, std::memory_order_relaxed);
 
             const auto& src_nodes = flow.GetSrcNodes();
             for (const auto& node : src_nodes)
             {
-                thread_pool->submit(
-                    [node]() -> bool
-                    {
-                        ReturnIfFalse(node->run());
-                        node_queue.push(node);     // 入队就说明已经完成了
-                        return true;
-                    }
-                );
+                thread_pool->spawn([node, state_ptr = &state]() { run_task_node(node, state_ptr); });
             }
-            
-            while (unfinished_task_count > 0)
-            {
-                node_queue.wait();
-                unfinished_task_count--;
 
-                TaskNode* node = node_queue.pop();
-                for (const auto& successor : node->successors)
-                {
-                    successor->unfinished_dependent_task_count--;
-                    if (successor->unfinished_dependent_task_count == 0)
-                    {
-                        thread_pool->submit(
-                            [successor]() -> bool
-                            {
-                                ReturnIfFalse(successor->run());
-                                node_queue.push(successor);
-                                return true;
-                            }
-                        );
-                        successor->unfinished_dependent_task_count = successor->unfinished_dependent_task_count_back_up;
-                    }
-                }
-            }
+            thread_pool->wait(state.unfinished_task_count);
 
-            thread_pool->wait_for_idle();
+            ReturnIfFalse(!state.failed.load(std::memory_order_relaxed));
             return true;
         }
     }
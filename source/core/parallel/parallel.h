@@ -2,7 +2,9 @@
 #define TASK_FLOW_H
 
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <functional>
 
@@ -13,7 +15,9 @@ namespace fantasy
         std::function<bool()> func;
         std::vector<TaskNode*> successors;
         std::vector<TaskNode*> Dependents;
-        uint32_t unfinished_dependent_task_count = 0;
+
+        // 由完成前驱任务的线程递减, 归零的线程负责启动该任务.
+        std::atomic<uint32_t> unfinished_dependent_task_count = 0;
         uint32_t unfinished_dependent_task_count_back_up = 0;
 
 
@@ -27,6 +31,12 @@ namespace fantasy
             InNode->unfinished_dependent_task_count_back_up++;
         }
 
+        // 每次运行前重置, 同一个 TaskFlow 可以每帧重复运行.
+        void reset()
+        {
+            unfinished_dependent_task_count.store(unfinished_dependent_task_count_back_up, std::memory_order_relaxed);
+        }
+
         bool run() const { return func(); }
     };
 
@@ -84,6 +94,14 @@ namespace fantasy
 			return Nodes.back().get();
 		}
 
+        void reset_dependencies()
+        {
+            for (const auto& Node : Nodes)
+            {
+                Node->reset();
+            }
+        }
+
         void reset()
         {
             SrcNodes.clear();
@@ -131,10 +149,62 @@ namespace fantasy
         }
 
         uint64_t begin_thread(std::function<bool()>&& rrFunc);
-        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 1);
+        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 0);
         void parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y);
         bool thread_finished(uint64_t index);
         bool thread_success(uint64_t index);
+
+
+        struct Range
+        {
+            uint64_t begin = 0;
+            uint64_t end = 0;
+
+            uint64_t size() const { return end > begin ? end - begin : 0; }
+            bool empty() const { return end <= begin; }
+        };
+
+        struct Range2D
+        {
+            Range x;
+            Range y;
+        };
+
+        struct Range3D
+        {
+            Range x;
+            Range y;
+            Range z;
+        };
+
+        // func 每次处理一个子范围, 子范围的大小由调度器根据负载自动决定, 不会小于 grain.
+        // grain 为 0 时根据范围大小和线程数自动选择.
+        void parallel_for(const Range& range, const std::function<void(const Range&)>& func, uint64_t grain = 0);
+
+        // 按 tile 划分, tile_size 为 0 时 2D 使用 16x16, 3D 使用 8x8x8.
+        void parallel_for(const Range2D& range, const std::function<void(const Range2D&)>& func, uint64_t tile_size = 0);
+        void parallel_for(const Range3D& range, const std::function<void(const Range3D&)>& func, uint64_t tile_size = 0);
+
+        // map(const Range&, T) 在子范围上从 identity 开始累积, reduce(T, T) 合并子范围的结果.
+        // 合并顺序不固定, reduce 需要满足结合律和交换律.
+        template <typename T, typename MapFunc, typename ReduceFunc>
+        T parallel_reduce(const Range& range, const T& identity, MapFunc&& map, ReduceFunc&& reduce, uint64_t grain = 0)
+        {
+            std::mutex mutex;
+            T result = identity;
+            parallel_for(
+                range,
+                [&](const Range& sub_range)
+                {
+                    T partial = map(sub_range, identity);
+
+                    std::lock_guard lock(mutex);
+                    result = reduce(result, partial);
+                },
+                grain
+            );
+            return result;
+        }
     };
 }
 
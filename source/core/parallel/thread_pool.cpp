@@ -1,16 +1,54 @@
 #include "thread_pool.h"
-#include <chrono>
+#include <algorithm>
 #include <memory>
 #include <mutex>
 
-namespace fantasy 
+namespace fantasy
 {
+    static constexpr uint32_t invalid_worker_index = static_cast<uint32_t>(-1);
+    static constexpr uint32_t spin_count_before_sleep = 64;
+
+    static thread_local ThreadPool* current_thread_pool = nullptr;
+    static thread_local uint32_t current_worker_index = invalid_worker_index;
+
+    void ThreadPool::ExternalQueue::push(ThreadTaskSlot* slot)
+    {
+        std::lock_guard lock(mutex);
+        tasks.push_back(slot);
+        count.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    ThreadTaskSlot* ThreadPool::ExternalQueue::pop()
+    {
+        if (count.load(std::memory_order_seq_cst) == 0) return nullptr;
+
+        std::lock_guard lock(mutex);
+        if (head == tasks.size()) return nullptr;
+
+        ThreadTaskSlot* slot = tasks[head++];
+        if (head == tasks.size())
+        {
+            // 保留容量, 之后的 push 不再分配内存.
+            tasks.clear();
+            head = 0;
+        }
+        count.fetch_sub(1, std::memory_order_seq_cst);
+        return slot;
+    }
+
+
     ThreadPool::ThreadPool(uint32_t thread_num)
     {
-        uint64_t max_thread_num = std::thread::hardware_concurrency() / 4;
+        // 等待的线程也会执行任务, 所以给调用线程留出一个核心.
+        uint32_t hardware_thread_num = std::thread::hardware_concurrency();
+        uint32_t max_thread_num = hardware_thread_num > 1 ? hardware_thread_num - 1 : 1;
         if (thread_num > 0) max_thread_num = thread_num;
-        
-        for (uint64_t ix = 0; ix < max_thread_num; ++ix)
+
+        for (uint32_t ix = 0; ix < max_thread_num; ++ix)
+        {
+            _workers.emplace_back(std::make_unique<Worker>());
+        }
+        for (uint32_t ix = 0; ix < max_thread_num; ++ix)
         {
             _threads.emplace_back(&ThreadPool::worker_thread, this, ix);
         }
@@ -18,11 +56,10 @@ namespace fantasy
 
     ThreadPool::~ThreadPool()
     {
-        {
-            _done = true;
-            _pool_task_queue.condition_variable.notify_all();
-        }
-        
+        _done = true;
+        _work_epoch.fetch_add(1, std::memory_order_seq_cst);
+        _work_epoch.notify_all();
+
         for (auto& thread : _threads)
         {
             if (thread.joinable())
@@ -30,102 +67,281 @@ namespace fantasy
                 thread.join();
             }
         }
+
+        // 未执行的任务直接释放.
+        for (auto& worker : _workers)
+        {
+            while (ThreadTaskSlot* slot = worker->deque.pop()) _task_pool.release(slot);
+        }
+        while (ThreadTaskSlot* slot = _external_queue.pop()) _task_pool.release(slot);
+        while (ThreadTaskSlot* slot = _long_task_queue.pop()) _task_pool.release(slot);
     }
 
-    uint64_t ThreadPool::submit(std::function<bool()> func)
+    void ThreadPool::schedule(ThreadTaskSlot* slot)
+    {
+        if (current_thread_pool == this && current_worker_index != invalid_worker_index)
+        {
+            _workers[current_worker_index]->deque.push(slot);
+        }
+        else
+        {
+            _external_queue.push(slot);
+        }
+        notify();
+    }
+
+    void ThreadPool::schedule_long_task(ThreadTaskSlot* slot)
+    {
+        _long_task_queue.push(slot);
+        notify();
+    }
+
+    void ThreadPool::notify()
+    {
+        _work_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (_sleeping_thread_num.load(std::memory_order_seq_cst) > 0)
+        {
+            _work_epoch.notify_one();
+        }
+    }
+
+    ThreadTaskSlot* ThreadPool::find_task(uint32_t worker_index, bool allow_long_task)
     {
-        auto task = std::make_shared<std::packaged_task<bool()>>(func);
-        _futures.emplace_back(task->get_future());
-        _pool_task_queue.push([task]() { (*task)(); });
+        ThreadTaskSlot* slot = nullptr;
+        if (worker_index != invalid_worker_index)
+        {
+            if ((slot = _workers[worker_index]->deque.pop())) return slot;
+        }
+        if ((slot = _external_queue.pop())) return slot;
+
+        uint32_t worker_num = static_cast<uint32_t>(_workers.size());
+        uint32_t start_index = worker_index != invalid_worker_index ? worker_index + 1 : 0;
+        for (uint32_t ix = 0; ix < worker_num; ++ix)
+        {
+            uint32_t victim_index = (start_index + ix) % worker_num;
+            if (victim_index == worker_index) continue;
+            if ((slot = _workers[victim_index]->deque.steal())) return slot;
+        }
+
+        if (allow_long_task && (slot = _long_task_queue.pop())) return slot;
+        return nullptr;
+    }
 
-        return _futures.size() - 1;
+    void ThreadPool::execute(ThreadTaskSlot* slot)
+    {
+        slot->task();
+        _task_pool.release(slot);
     }
 
-    void ThreadPool::wait_for_idle(uint32_t index)
+    void ThreadPool::wait(const std::atomic<uint32_t>& counter)
     {
-        while (index-- > 0)
+        uint32_t worker_index = current_thread_pool == this ? current_worker_index : invalid_worker_index;
+        while (counter.load(std::memory_order_acquire) != 0)
         {
-            if (_futures.back().get())
+            if (ThreadTaskSlot* slot = find_task(worker_index, false))
+            {
+                execute(slot);
+            }
+            else
             {
-                _futures.pop_back();
+                std::this_thread::yield();
             }
         }
     }
 
-    bool ThreadPool::thread_finished(uint64_t index)
+    uint64_t ThreadPool::submit(std::function<bool()> func)
     {
-        return _futures[index].wait_for(std::chrono::milliseconds(0)) == std::future_status::ready;
+        uint64_t handle = _job_pool.allocate(std::move(func));
+        if (handle == ThreadJobPool::invalid_handle) return handle;
+
+        auto run_job = [this, handle]()
+        {
+            ThreadJobSlot* job = _job_pool.get_slot(handle);
+            job->result = job->func();
+            job->state.store(ThreadJobSlot::State::Finished, std::memory_order_release);
+        };
+
+        ThreadTaskSlot* slot = _task_pool.allocate();
+        if (slot == nullptr)
+        {
+            run_job();
+        }
+        else
+        {
+            slot->task.emplace(run_job);
+            schedule_long_task(slot);
+        }
+
+        return handle;
     }
 
-    bool ThreadPool::thread_success(uint64_t index)
+    bool ThreadPool::thread_finished(uint64_t handle) const
     {
-        auto iter = std::next(_futures.begin(), index);
-        if (iter->get())
+        const ThreadJobSlot* job = _job_pool.get_slot(handle);
+        return job != nullptr && job->state.load(std::memory_order_acquire) == ThreadJobSlot::State::Finished;
+    }
+
+    bool ThreadPool::thread_success(uint64_t handle)
+    {
+        ThreadJobSlot* job = _job_pool.get_slot(handle);
+        if (job == nullptr) return false;
+
+        // 等待的 job 本身可能还在 _long_task_queue 中, 所以允许执行 long task.
+        uint32_t worker_index = current_thread_pool == this ? current_worker_index : invalid_worker_index;
+        while (job->state.load(std::memory_order_acquire) != ThreadJobSlot::State::Finished)
         {
-            _futures.erase(iter);
-            return true;
+            if (ThreadTaskSlot* slot = find_task(worker_index, true))
+            {
+                execute(slot);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
         }
-        return false;
+
+        bool result = job->result;
+        return _job_pool.release(handle) && result;
     }
 
-    void ThreadPool::parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size)
+    bool ThreadPool::local_queue_empty() const
     {
-        for (uint64_t ix = 0; ix < count; ix += chun_size)
+        if (current_thread_pool == this && current_worker_index != invalid_worker_index)
         {
-            auto task = std::make_shared<std::packaged_task<bool()>>(
-                [&func, ix, count, chun_size]() 
-                {
-                    uint32_t dwEndIndex = std::min(ix + chun_size, count);
-                    for (uint64_t ij = ix; ij < dwEndIndex; ++ij)
+            return _workers[current_worker_index]->deque.empty();
+        }
+        return _external_queue.count.load(std::memory_order_relaxed) == 0;
+    }
+
+    void ThreadPool::execute_range(
+        uint64_t begin, 
+        uint64_t end, 
+        uint64_t grain, 
+        const std::function<void(uint64_t, uint64_t)>& func, 
+        std::atomic<uint32_t>& unfinished_range_num
+    )
+    {
+        while (end - begin > grain)
+        {
+            if (local_queue_empty())
+            {
+                // 没有可以被窃取的任务, 拆出后一半.
+                uint64_t mid = begin + (end - begin) / 2;
+                unfinished_range_num.fetch_add(1, std::memory_order_relaxed);
+                spawn(
+                    [this, mid, end, grain, &func, &unfinished_range_num]()
                     {
-                        func(ij);
+                        execute_range(mid, end, grain, func, unfinished_range_num);
                     }
-                    return true;
-                }
-            );
-            _futures.emplace_back(task->get_future());
-            _pool_task_queue.push([task]() { (*task)(); });
+                );
+                end = mid;
+            }
+            else
+            {
+                func(begin, begin + grain);
+                begin += grain;
+            }
         }
 
-        wait_for_idle(count);
+        func(begin, end);
+        unfinished_range_num.fetch_sub(1, std::memory_order_release);
     }
-    
-    void ThreadPool::parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y)
+
+    void ThreadPool::parallel_for_range(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& func)
     {
-        for (uint64_t iy = 0; iy < y; ++iy)
+        if (begin >= end) return;
+
+        if (grain == 0)
         {
-            auto task = std::make_shared<std::packaged_task<bool()>>(
-                [&func, iy, x]() 
+            grain = std::max<uint64_t>(1, (end - begin) / (16 * (get_thread_num() + 1)));
+        }
+
+        std::atomic<uint32_t> unfinished_range_num = 1;
+        execute_range(begin, end, grain, func, unfinished_range_num);
+        wait(unfinished_range_num);
+    }
+
+    void ThreadPool::parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size)
+    {
+        parallel_for_range(
+            0, 
+            count, 
+            chun_size, 
+            [&func](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t ix = begin; ix < end; ++ix)
                 {
-                    for (uint64_t ix = 0; ix < x; ++ix)
+                    func(ix);
+                }
+            }
+        );
+    }
+
+    void ThreadPool::parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y)
+    {
+        constexpr uint64_t tile_size = 16;
+        uint64_t tile_num_x = (x + tile_size - 1) / tile_size;
+        uint64_t tile_num_y = (y + tile_size - 1) / tile_size;
+
+        parallel_for_range(
+            0, 
+            tile_num_x * tile_num_y, 
+            0, 
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t tile = begin; tile < end; ++tile)
+                {
+                    uint64_t lower_x = (tile % tile_num_x) * tile_size;
+                    uint64_t lower_y = (tile / tile_num_x) * tile_size;
+                    uint64_t upper_x = std::min(lower_x + tile_size, x);
+                    uint64_t upper_y = std::min(lower_y + tile_size, y);
+
+                    for (uint64_t iy = lower_y; iy < upper_y; ++iy)
                     {
-                        func(ix, iy);
+                        for (uint64_t ix = lower_x; ix < upper_x; ++ix)
+                        {
+                            func(ix, iy);
+                        }
                     }
-                    return true;
                 }
-            );
-            _futures.emplace_back(task->get_future());
-            _pool_task_queue.push([task]() { (*task)(); });
-        }
-        wait_for_idle(y);
+            }
+        );
     }
 
-    void ThreadPool::worker_thread(uint64_t index)
+    void ThreadPool::worker_thread(uint32_t index)
     {
-        std::mutex mutex;
-        std::unique_lock<std::mutex> Lock(mutex);
+        current_thread_pool = this;
+        current_worker_index = index;
+
+        uint32_t spin_count = 0;
         while (!_done)
         {
-            std::function<void()> Task;
-            if (_pool_task_queue.try_pop(Task))
+            ThreadTaskSlot* slot = find_task(index, true);
+            if (slot == nullptr && ++spin_count < spin_count_before_sleep)
             {
-                Task();
+                std::this_thread::yield();
+                continue;
             }
-            else
+
+            if (slot == nullptr)
+            {
+                // 先增加 _sleeping_thread_num 再读取 epoch, notify() 中 epoch 的改变不会被遗漏.
+                _sleeping_thread_num.fetch_add(1, std::memory_order_seq_cst);
+                uint32_t epoch = _work_epoch.load(std::memory_order_seq_cst);
+                slot = find_task(index, true);
+                if (slot == nullptr && !_done)
+                {
+                    _work_epoch.wait(epoch, std::memory_order_seq_cst);
+                }
+                _sleeping_thread_num.fetch_sub(1, std::memory_order_seq_cst);
+            }
+
+            if (slot != nullptr)
             {
-                _pool_task_queue.condition_variable.wait(Lock);
+                spin_count = 0;
+                execute(slot);
             }
         }
     }
 
-}
\ No newline at end of file
+}
@@ -1,13 +1,17 @@
 ﻿#ifndef TASK_FLOW_THREAD_POOL_H
 #define TASK_FLOW_THREAD_POOL_H
 
+#include <atomic>
 #include <functional>
-#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-#include "thread_queue.h"
+#include "thread_task.h"
+#include "work_stealing_deque.h"
 
-namespace fantasy 
+namespace fantasy
 {
     class ThreadPool
     {
@@ -15,28 +19,96 @@ namespace fantasy
         ThreadPool(uint32_t thread_num = 0);
         ~ThreadPool();
 
+        // 提交一个不需要返回值的小任务, 在 worker 线程中调用时会压入该 worker 自己的队列.
+        template <typename F>
+        void spawn(F&& func)
+        {
+            ThreadTaskSlot* slot = _task_pool.allocate();
+            if (slot == nullptr)
+            {
+                func();
+                return;
+            }
+            slot->task.emplace(std::forward<F>(func));
+            schedule(slot);
+        }
+
+        // 执行其他任务直到 counter 归零.
+        void wait(const std::atomic<uint32_t>& counter);
+
+        // 将 [begin, end) 递归二分, 只有当前线程的队列为空 (没有可被窃取的任务) 时才继续拆分,
+        // 否则按 grain 大小顺序执行. grain 为 0 时根据范围大小和线程数自动选择.
+        void parallel_for_range(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& func);
+
+        // 提交耗时较长的 job, 返回的 handle 需要通过 thread_success() 释放.
         uint64_t submit(std::function<bool()> func);
-        void wait_for_idle(uint32_t index = 1);
 
-        bool thread_finished(uint64_t index);
-        bool thread_success(uint64_t index);
+        bool thread_finished(uint64_t handle) const;
+
+        // 等待 job 完成 (期间执行其他任务) 并释放 handle, handle 已失效时返回 false.
+        bool thread_success(uint64_t handle);
 
-        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 1);
+        void parallel_for(std::function<void(uint64_t)> func, uint64_t count, uint32_t chun_size = 0);
         void parallel_for(std::function<void(uint64_t, uint64_t)> func, uint64_t x, uint64_t y);
 
+        uint32_t get_thread_num() const { return static_cast<uint32_t>(_threads.size()); }
+
     private:
-        void worker_thread(uint64_t index);
+        void schedule(ThreadTaskSlot* slot);
+        void schedule_long_task(ThreadTaskSlot* slot);
+        void notify();
+
+        bool local_queue_empty() const;
+        void execute_range(
+            uint64_t begin, 
+            uint64_t end, 
+            uint64_t grain, 
+            const std::function<void(uint64_t, uint64_t)>& func, 
+            std::atomic<uint32_t>& unfinished_range_num
+        );
+
+        ThreadTaskSlot* find_task(uint32_t worker_index, bool allow_long_task);
+        void execute(ThreadTaskSlot* slot);
+
+        void worker_thread(uint32_t index);
 
     private:
+        struct Worker
+        {
+            WorkStealingDeque<ThreadTaskSlot*> deque;
+        };
+
+        // 非 worker 线程提交的任务.
+        struct ExternalQueue
+        {
+            std::mutex mutex;
+            std::vector<ThreadTaskSlot*> tasks;
+            uint64_t head = 0;
+            std::atomic<uint64_t> count = 0;
+
+            void push(ThreadTaskSlot* slot);
+            ThreadTaskSlot* pop();
+        };
+
         std::atomic<bool> _done = false;
 
         std::vector<std::thread> _threads;
-        std::vector<std::future<bool>> _futures;
-        ConcurrentQueue<std::function<void()>> _pool_task_queue;
+        std::vector<std::unique_ptr<Worker>> _workers;
+
+        ThreadTaskPool _task_pool;
+        ExternalQueue _external_queue;
+
+        // 耗时较长的任务 (如模型加载) 只由 worker 线程的主循环执行, 避免等待中的线程被长时间占用.
+        ExternalQueue _long_task_queue;
+
+        std::atomic<uint32_t> _work_epoch = 0;
+        std::atomic<uint32_t> _sleeping_thread_num = 0;
+
+        ThreadJobPool _job_pool;
     };
 
 
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,7 @@
 ﻿#ifndef TASK_FLOW_CONCURRENT_QUEUE_H
 #define TASK_FLOW_CONCURRENT_QUEUE_H
 
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 
@@ -0,0 +1,140 @@
+#include "thread_task.h"
+
+namespace fantasy
+{
+    ThreadTaskPool::~ThreadTaskPool()
+    {
+        for (uint32_t ix = 0; ix < _chunk_num; ++ix)
+        {
+            delete[] _chunks[ix];
+        }
+    }
+
+    ThreadTaskSlot* ThreadTaskPool::allocate()
+    {
+        while (true)
+        {
+            uint64_t head = _free_head.load(std::memory_order_acquire);
+            uint32_t index = static_cast<uint32_t>(head);
+            if (index == 0)
+            {
+                if (!grow()) return nullptr;
+                continue;
+            }
+
+            ThreadTaskSlot* slot = get_slot(index - 1);
+            uint64_t next = (((head >> 32) + 1) << 32) | slot->next_free.load(std::memory_order_relaxed);
+            if (_free_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return slot;
+            }
+        }
+    }
+
+    void ThreadTaskPool::release(ThreadTaskSlot* slot)
+    {
+        slot->task.reset();
+        push_free_list(slot->index, slot);
+    }
+
+    void ThreadTaskPool::push_free_list(uint32_t first_index, ThreadTaskSlot* last_slot)
+    {
+        uint64_t head = _free_head.load(std::memory_order_relaxed);
+        uint64_t next = 0;
+        do
+        {
+            last_slot->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            next = (((head >> 32) + 1) << 32) | (first_index + 1);
+        }
+        while (!_free_head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool ThreadTaskPool::grow()
+    {
+        std::lock_guard lock(_grow_mutex);
+
+        // 等待锁期间其他线程可能已经扩容.
+        if (static_cast<uint32_t>(_free_head.load(std::memory_order_acquire)) != 0) return true;
+        if (_chunk_num == max_chunk_num) return false;
+
+        ThreadTaskSlot* chunk = new ThreadTaskSlot[chunk_size];
+        uint32_t first_index = _chunk_num * chunk_size;
+        for (uint32_t ix = 0; ix < chunk_size; ++ix)
+        {
+            chunk[ix].index = first_index + ix;
+            chunk[ix].next_free.store(first_index + ix + 2, std::memory_order_relaxed);
+        }
+        _chunks[_chunk_num++] = chunk;
+
+        push_free_list(first_index, &chunk[chunk_size - 1]);
+        return true;
+    }
+
+
+    ThreadJobPool::~ThreadJobPool()
+    {
+        uint32_t chunk_num = _chunk_num.load(std::memory_order_acquire);
+        for (uint32_t ix = 0; ix < chunk_num; ++ix)
+        {
+            delete[] _chunks[ix];
+        }
+    }
+
+    uint64_t ThreadJobPool::allocate(std::function<bool()> func)
+    {
+        uint32_t index = 0;
+        {
+            std::lock_guard lock(_mutex);
+            if (_free_indices.empty())
+            {
+                uint32_t chunk_num = _chunk_num.load(std::memory_order_relaxed);
+                if (chunk_num == max_chunk_num) return invalid_handle;
+
+                _chunks[chunk_num] = new ThreadJobSlot[chunk_size];
+                for (uint32_t ix = chunk_size; ix > 0; --ix)
+                {
+                    _free_indices.push_back(chunk_num * chunk_size + ix - 1);
+                }
+                _chunk_num.store(chunk_num + 1, std::memory_order_release);
+            }
+            index = _free_indices.back();
+            _free_indices.pop_back();
+        }
+
+        ThreadJobSlot* slot = &_chunks[index / chunk_size][index % chunk_size];
+        slot->func = std::move(func);
+        slot->result = false;
+        slot->state.store(ThreadJobSlot::State::Pending, std::memory_order_relaxed);
+
+        uint64_t generation = slot->generation.load(std::memory_order_relaxed);
+        return (generation << 32) | index;
+    }
+
+    ThreadJobSlot* ThreadJobPool::get_slot(uint64_t handle) const
+    {
+        if (handle == invalid_handle) return nullptr;
+
+        uint32_t index = static_cast<uint32_t>(handle);
+        if (index / chunk_size >= _chunk_num.load(std::memory_order_acquire)) return nullptr;
+
+        ThreadJobSlot* slot = &_chunks[index / chunk_size][index % chunk_size];
+        if (slot->generation.load(std::memory_order_acquire) != static_cast<uint32_t>(handle >> 32)) return nullptr;
+        return slot;
+    }
+
+    bool ThreadJobPool::release(uint64_t handle)
+    {
+        ThreadJobSlot* slot = get_slot(handle);
+        if (slot == nullptr) return false;
+
+        uint32_t generation = static_cast<uint32_t>(handle >> 32);
+        uint32_t next_generation = generation + 1 == static_cast<uint32_t>(invalid_handle >> 32) ? 1 : generation + 1;
+        if (!slot->generation.compare_exchange_strong(generation, next_generation, std::memory_order_acq_rel)) return false;
+
+        slot->func = nullptr;
+
+        std::lock_guard lock(_mutex);
+        _free_indices.push_back(static_cast<uint32_t>(handle));
+        return true;
+    }
+}
\ No newline at end of file
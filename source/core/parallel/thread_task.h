@@ -0,0 +1,155 @@
+#ifndef TASK_FLOW_THREAD_TASK_H
+#define TASK_FLOW_THREAD_TASK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fantasy
+{
+    // 小缓冲区任务, 可调用对象不超过 inline_size 时直接构造在内部, 不会发生堆分配.
+    class ThreadTask
+    {
+    public:
+        static constexpr uint64_t inline_size = 64;
+
+        ThreadTask() = default;
+        ~ThreadTask() { reset(); }
+
+        ThreadTask(const ThreadTask&) = delete;
+        ThreadTask& operator=(const ThreadTask&) = delete;
+
+        template <typename F>
+        void emplace(F&& func)
+        {
+            using Func = std::decay_t<F>;
+
+            reset();
+            if constexpr (sizeof(Func) <= inline_size && alignof(Func) <= alignof(std::max_align_t))
+            {
+                new (_storage) Func(std::forward<F>(func));
+                _invoke = [](void* storage) { (*static_cast<Func*>(storage))(); };
+                _destroy = [](void* storage) { static_cast<Func*>(storage)->~Func(); };
+            }
+            else
+            {
+                *reinterpret_cast<Func**>(_storage) = new Func(std::forward<F>(func));
+                _invoke = [](void* storage) { (**static_cast<Func**>(storage))(); };
+                _destroy = [](void* storage) { delete *static_cast<Func**>(storage); };
+            }
+        }
+
+        void operator()() { _invoke(_storage); }
+
+        void reset()
+        {
+            if (_destroy)
+            {
+                _destroy(_storage);
+                _destroy = nullptr;
+                _invoke = nullptr;
+            }
+        }
+
+    private:
+        alignas(std::max_align_t) uint8_t _storage[inline_size];
+        void (*_invoke)(void*) = nullptr;
+        void (*_destroy)(void*) = nullptr;
+    };
+
+    struct ThreadTaskSlot
+    {
+        ThreadTask task;
+        uint32_t index = 0;
+        std::atomic<uint32_t> next_free = 0;
+    };
+
+    // 无锁 slot 池, slot 按块分配且地址不会移动, 稳定运行后提交任务不会再分配内存.
+    class ThreadTaskPool
+    {
+    public:
+        static constexpr uint32_t chunk_size = 1024;
+        static constexpr uint32_t max_chunk_num = 1024;
+
+        ThreadTaskPool() = default;
+        ~ThreadTaskPool();
+
+        ThreadTaskPool(const ThreadTaskPool&) = delete;
+        ThreadTaskPool& operator=(const ThreadTaskPool&) = delete;
+
+        // 池已满时返回 nullptr.
+        ThreadTaskSlot* allocate();
+        void release(ThreadTaskSlot* slot);
+
+    private:
+        ThreadTaskSlot* get_slot(uint32_t index) const { return &_chunks[index / chunk_size][index % chunk_size]; }
+
+        void push_free_list(uint32_t first_index, ThreadTaskSlot* last_slot);
+        bool grow();
+
+    private:
+        // 高 32 位为 ABA 标记, 低 32 位为 slot 索引 + 1, 0 表示空.
+        std::atomic<uint64_t> _free_head = 0;
+
+        std::mutex _grow_mutex;
+        uint32_t _chunk_num = 0;
+        ThreadTaskSlot* _chunks[max_chunk_num] = {};
+    };
+
+
+    struct ThreadJobSlot
+    {
+        enum class State : uint32_t
+        {
+            Pending,
+            Finished
+        };
+
+        std::function<bool()> func;
+        bool result = false;
+
+        std::atomic<uint32_t> generation = 1;
+        std::atomic<State> state = State::Pending;
+    };
+
+    // begin_thread 提交的 job, handle 的高 32 位为 generation, 低 32 位为 slot 索引.
+    // slot 被释放后 generation 加一, 旧的 handle 自动失效, 不会误读到新 job 的结果.
+    class ThreadJobPool
+    {
+    public:
+        static constexpr uint64_t invalid_handle = ~0ull;
+        static constexpr uint32_t chunk_size = 64;
+        static constexpr uint32_t max_chunk_num = 1024;
+
+        ThreadJobPool() = default;
+        ~ThreadJobPool();
+
+        ThreadJobPool(const ThreadJobPool&) = delete;
+        ThreadJobPool& operator=(const ThreadJobPool&) = delete;
+
+        // 池已满时返回 invalid_handle.
+        uint64_t allocate(std::function<bool()> func);
+
+        // handle 已失效时返回 nullptr.
+        ThreadJobSlot* get_slot(uint64_t handle) const;
+
+        // 只有第一个释放该 handle 的线程返回 true.
+        bool release(uint64_t handle);
+
+    private:
+        std::mutex _mutex;
+        std::vector<uint32_t> _free_indices;
+
+        std::atomic<uint32_t> _chunk_num = 0;
+        ThreadJobSlot* _chunks[max_chunk_num] = {};
+    };
+}
+
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef TASK_FLOW_WORK_STEALING_DEQUE_H
+#define TASK_FLOW_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace fantasy
+{
+    // Chase-Lev 双端队列, 参考 "Correct and Efficient Work-Stealing for Weak Memory Models".
+    // 只有所属线程可以 push() 和 pop(), 其他线程只能 steal().
+    template <typename T>
+    class WorkStealingDeque
+    {
+        static_assert(std::is_pointer_v<T>, "WorkStealingDeque only holds pointers.");
+
+        struct Buffer
+        {
+            int64_t capacity;
+            int64_t mask;
+            std::unique_ptr<std::atomic<T>[]> data;
+
+            explicit Buffer(int64_t in_capacity) :
+                capacity(in_capacity), mask(in_capacity - 1), data(std::make_unique<std::atomic<T>[]>(in_capacity))
+            {
+            }
+
+            void put(int64_t index, T item) { data[index & mask].store(item, std::memory_order_relaxed); }
+            T get(int64_t index) const { return data[index & mask].load(std::memory_order_relaxed); }
+        };
+
+    public:
+        explicit WorkStealingDeque(int64_t capacity = 1024)
+        {
+            _buffers.emplace_back(std::make_unique<Buffer>(capacity));
+            _buffer.store(_buffers.back().get(), std::memory_order_relaxed);
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        bool empty() const
+        {
+            int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            int64_t top = _top.load(std::memory_order_relaxed);
+            return bottom <= top;
+        }
+
+        void push(T item)
+        {
+            int64_t bottom = _bottom.load(std::memory_order_relaxed);
+            int64_t top = _top.load(std::memory_order_acquire);
+            Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+
+            if (bottom - top > buffer->capacity - 1)
+            {
+                buffer = grow(buffer, bottom, top);
+            }
+
+            buffer->put(bottom, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        T pop()
+        {
+            int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+            Buffer* buffer = _buffer.load(std::memory_order_relaxed);
+            _bottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = _top.load(std::memory_order_relaxed);
+
+            T item = nullptr;
+            if (top <= bottom)
+            {
+                item = buffer->get(bottom);
+                if (top == bottom)
+                {
+                    // 只剩最后一个元素, 与 steal() 竞争.
+                    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    {
+                        item = nullptr;
+                    }
+                    _bottom.store(bottom + 1, std::memory_order_relaxed);
+                }
+            }
+            else
+            {
+                _bottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        T steal()
+        {
+            int64_t top = _top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = _bottom.load(std::memory_order_acquire);
+
+            T item = nullptr;
+            if (top < bottom)
+            {
+                Buffer* buffer = _buffer.load(std::memory_order_acquire);
+                item = buffer->get(top);
+                if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    return nullptr;
+                }
+            }
+            return item;
+        }
+
+    private:
+        Buffer* grow(Buffer* old_buffer, int64_t bottom, int64_t top)
+        {
+            // 旧的 buffer 可能仍在被 steal() 读取, 所以只有析构时才释放.
+            _buffers.emplace_back(std::make_unique<Buffer>(old_buffer->capacity * 2));
+            Buffer* new_buffer = _buffers.back().get();
+            for (int64_t ix = top; ix < bottom; ++ix)
+            {
+                new_buffer->put(ix, old_buffer->get(ix));
+            }
+            _buffer.store(new_buffer, std::memory_order_release);
+            return new_buffer;
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> _top = 0;
+        alignas(64) std::atomic<int64_t> _bottom = 0;
+        alignas(64) std::atomic<Buffer*> _buffer = nullptr;
+
+        std::vector<std::unique_ptr<Buffer>> _buffers;
+    };
+}
+
+
+#endif
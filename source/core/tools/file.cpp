@@ -0,0 +1,207 @@
+#include "file.h"
+#include "../parallel/parallel.h"
+#include <atomic>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fantasy
+{
+#ifdef _WIN32
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		_file = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+
+		_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping == nullptr)
+		{
+			close();
+			return false;
+		}
+
+		_data = static_cast<const uint8_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (_data == nullptr)
+		{
+			close();
+			return false;
+		}
+		_size = static_cast<uint64_t>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data) UnmapViewOfFile(_data);
+		if (_mapping) CloseHandle(_mapping);
+		if (_file) CloseHandle(_file);
+		_data = nullptr;
+		_mapping = nullptr;
+		_file = nullptr;
+		_size = 0;
+	}
+#else
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0) return false;
+
+		struct stat file_stat;
+		if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+		{
+			::close(file);
+			return false;
+		}
+
+		void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		::close(file);
+		if (data == MAP_FAILED) return false;
+
+		_data = static_cast<const uint8_t*>(data);
+		_size = static_cast<uint64_t>(file_stat.st_size);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data) munmap(const_cast<uint8_t*>(_data), static_cast<size_t>(_size));
+		_data = nullptr;
+		_size = 0;
+	}
+#endif
+}
+
+namespace fantasy::serialization
+{
+	static const uint32_t stored_block_flag = 1u << 31;
+
+	void compress_blocks(std::span<const uint8_t> data, std::vector<uint8_t>& output, int32_t level)
+	{
+		uint32_t block_num = static_cast<uint32_t>((data.size() + compression_block_size - 1) / compression_block_size);
+
+		std::vector<std::vector<uint8_t>> blocks(block_num);
+		std::vector<uint32_t> block_sizes(block_num);
+		parallel::parallel_for(
+			parallel::Range{ 0, block_num },
+			[&](const parallel::Range& range)
+			{
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
+				{
+					std::span<const uint8_t> block = data.subspan(ix * compression_block_size);
+					if (block.size() > compression_block_size) block = block.first(compression_block_size);
+
+					uLongf compressed_size = compressBound(static_cast<uLong>(block.size()));
+					blocks[ix].resize(compressed_size);
+					if (
+						compress2(blocks[ix].data(), &compressed_size, block.data(), static_cast<uLong>(block.size()), level) == Z_OK &&
+						compressed_size < block.size()
+					)
+					{
+						blocks[ix].resize(compressed_size);
+						block_sizes[ix] = static_cast<uint32_t>(compressed_size);
+					}
+					else
+					{
+						blocks[ix].assign(block.begin(), block.end());
+						block_sizes[ix] = static_cast<uint32_t>(block.size()) | stored_block_flag;
+					}
+				}
+			},
+			1
+		);
+
+		uint64_t raw_size = data.size();
+		uint32_t header[2] = { compression_block_size, block_num };
+
+		output.clear();
+		output.insert(output.end(), reinterpret_cast<const uint8_t*>(&raw_size), reinterpret_cast<const uint8_t*>(&raw_size + 1));
+		output.insert(output.end(), reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header + 2));
+		output.insert(output.end(), reinterpret_cast<const uint8_t*>(block_sizes.data()), reinterpret_cast<const uint8_t*>(block_sizes.data() + block_num));
+		for (const auto& block : blocks) output.insert(output.end(), block.begin(), block.end());
+	}
+
+	bool decompress_blocks(std::span<const uint8_t> data, std::span<uint8_t> output)
+	{
+		uint64_t raw_size = 0;
+		uint32_t header[2] = {};
+		if (data.size() < sizeof(uint64_t) + sizeof(header)) return false;
+		memcpy(&raw_size, data.data(), sizeof(uint64_t));
+		memcpy(header, data.data() + sizeof(uint64_t), sizeof(header));
+		data = data.subspan(sizeof(uint64_t) + sizeof(header));
+
+		uint32_t block_size = header[0];
+		uint32_t block_num = header[1];
+		if (
+			raw_size != output.size() || block_size == 0 || 
+			block_num != (raw_size + block_size - 1) / block_size ||
+			data.size() < static_cast<uint64_t>(block_num) * sizeof(uint32_t)
+		)
+		{
+			return false;
+		}
+
+		std::vector<uint32_t> block_sizes(block_num);
+		memcpy(block_sizes.data(), data.data(), block_num * sizeof(uint32_t));
+		data = data.subspan(block_num * sizeof(uint32_t));
+
+		std::vector<uint64_t> block_offsets(block_num);
+		uint64_t offset = 0;
+		for (uint32_t ix = 0; ix < block_num; ++ix)
+		{
+			block_offsets[ix] = offset;
+			offset += block_sizes[ix] & ~stored_block_flag;
+		}
+		if (offset != data.size()) return false;
+
+		std::atomic<bool> result = true;
+		parallel::parallel_for(
+			parallel::Range{ 0, block_num },
+			[&](const parallel::Range& range)
+			{
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
+				{
+					std::span<const uint8_t> block = data.subspan(block_offsets[ix], block_sizes[ix] & ~stored_block_flag);
+					std::span<uint8_t> raw_block = output.subspan(ix * block_size);
+					if (raw_block.size() > block_size) raw_block = raw_block.first(block_size);
+
+					if (block_sizes[ix] & stored_block_flag)
+					{
+						if (block.size() != raw_block.size()) result.store(false, std::memory_order_relaxed);
+						else memcpy(raw_block.data(), block.data(), block.size());
+						continue;
+					}
+
+					uLongf raw_block_size = static_cast<uLongf>(raw_block.size());
+					if (
+						uncompress(raw_block.data(), &raw_block_size, block.data(), static_cast<uLong>(block.size())) != Z_OK ||
+						raw_block_size != raw_block.size()
+					)
+					{
+						result.store(false, std::memory_order_relaxed);
+					}
+				}
+			},
+			1
+		);
+		return result.load();
+	}
+}
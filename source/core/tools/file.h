@@ -1,8 +1,13 @@
 #ifndef CORE_FILE_H
 #define CORE_FILE_H
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <string>
 #include <fstream>
+#include <span>
+#include <type_traits>
+#include <vector>
 
 namespace fantasy
 {
@@ -40,12 +45,97 @@ namespace fantasy
 	}
 
 
+	// 只读的文件内存映射, 数据由系统按页载入, 不需要先整体读入内存.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path);
+		void close();
+
+		std::span<const uint8_t> data() const { return std::span<const uint8_t>(_data, _size); }
+		bool is_open() const { return _data != nullptr; }
+
+	private:
+		const uint8_t* _data = nullptr;
+		uint64_t _size = 0;
+
+#ifdef _WIN32
+		void* _file = nullptr;
+		void* _mapping = nullptr;
+#endif
+	};
+
+
 	namespace serialization
 	{
+		// 文件头 { magic, version } 之后依次是各个值的原始字节, 值之间没有分隔符.
+		// vector 与 string 先写入 uint64_t 的元素个数, 可以按字节读写的元素在个数之后按 16 字节对齐整体写入,
+		// 因此 MappedBinaryInput 可以直接返回指向映射内存的 span.
+		// 没有文件头的旧文件在每个值之后有一个 '\n', 由 BinaryInput 兼容读取.
+		static constexpr uint32_t binary_magic_number = 0x52455346;      // "FSER"
+		static constexpr uint32_t binary_version = 2;                    // 2: 加入分块压缩的数据.
+		static constexpr uint64_t binary_alignment = 16;
+
+		// 分块压缩: 每块用 zlib 独立压缩, 解压时各块在线程池上并行.
+		// 格式: uint64_t 原始大小, uint32_t 块大小, uint32_t 块数, 每块压缩后的大小 (最高位表示该块未压缩), 之后是各块的数据.
+		// 压缩后不变小的块原样存放, 因此结果不会大于 get_compressed_bound().
+		static constexpr uint32_t compression_block_size = 256 * 1024;
+		static constexpr uint64_t max_compression_ratio = 1032;      // deflate 的最大压缩比.
+
+		inline uint64_t get_compressed_bound(uint64_t size)
+		{
+			uint64_t block_num = (size + compression_block_size - 1) / compression_block_size;
+			return sizeof(uint64_t) + sizeof(uint32_t) * 2 + block_num * sizeof(uint32_t) + size;
+		}
+
+		void compress_blocks(std::span<const uint8_t> data, std::vector<uint8_t>& output, int32_t level = 6);
+		bool decompress_blocks(std::span<const uint8_t> data, std::span<uint8_t> output);
+
+		// 用于缓存文件的校验与源数据的哈希, 可以把上一次的结果作为 hash 继续累积.
+		inline uint64_t get_checksum(std::span<const uint8_t> data, uint64_t hash = 0)
+		{
+			uint64_t ix = 0;
+			for (; ix + sizeof(uint64_t) <= data.size(); ix += sizeof(uint64_t))
+			{
+				uint64_t word;
+				memcpy(&word, data.data() + ix, sizeof(uint64_t));
+				hash = (hash ^ (word * 0x87c37b91114253d5ull)) * 0x4cf5ad432745937full;
+				hash ^= hash >> 31;
+			}
+			for (; ix < data.size(); ++ix) hash = (hash ^ data[ix]) * 0x100000001b3ull;
+			return hash;
+		}
+
+		// 标准布局且析构为空的类型 (如 float3, Vertex) 也按字节读写.
+		template <typename T>
+		inline constexpr bool is_bulk_serializable = 
+			std::is_trivially_copyable_v<T> || (std::is_standard_layout_v<T> && std::is_trivially_destructible_v<T>);
+
+		inline uint64_t get_binary_padding(uint64_t offset)
+		{
+			return (binary_alignment - offset % binary_alignment) % binary_alignment;
+		}
+
+		struct BinaryHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+		};
+
 		class BinaryOutput
 		{
 		public:
-			BinaryOutput(const std::string& file_name) : _output(file_name, std::ios::binary) {}
+			BinaryOutput(const std::string& file_name) : _output(file_name, std::ios::binary) 
+			{
+				BinaryHeader header{ binary_magic_number, binary_version };
+				save_binary_data(&header, sizeof(BinaryHeader));
+			}
 			~BinaryOutput() { _output.close(); }
 
 			template <typename... Args>
@@ -54,16 +144,29 @@ namespace fantasy
 				(process(arguments), ...);
 			}
 
+			bool is_valid() const { return _output.is_open() && !_output.fail(); }
+
 		public:
 			void save_binary_data(const void* data, int64_t size)
 			{
-				if (_output.is_open())
+				if (_output.is_open() && size > 0)
 				{
 					_output.write(static_cast<const char*>(data), size);
-					_output.write("\n", 1);
+					_offset += static_cast<uint64_t>(size);
 				}
 			}
 
+			// 先写入压缩后的大小, 再写入分块压缩的数据, 对应 load_compressed_data().
+			void save_compressed_data(const void* data, uint64_t size, int32_t level = 6)
+			{
+				std::vector<uint8_t> compressed_data;
+				compress_blocks(std::span<const uint8_t>(static_cast<const uint8_t*>(data), size), compressed_data, level);
+
+				uint64_t compressed_size = compressed_data.size();
+				save_binary_data(&compressed_size, sizeof(uint64_t));
+				save_binary_data(compressed_data.data(), static_cast<int64_t>(compressed_size));
+			}
+
 		private:
 			template <typename T>
 			void process(T&& value)
@@ -76,9 +179,15 @@ namespace fantasy
 			{
 				uint64_t size = value.size();
 				save_binary_data(&size, sizeof(uint64_t));
-				for (const T& element : value)
+				if constexpr (is_bulk_serializable<T>)
 				{
-					process_impl(element);
+					static const uint8_t zeros[binary_alignment] = {};
+					save_binary_data(zeros, static_cast<int64_t>(get_binary_padding(_offset)));
+					save_binary_data(value.data(), static_cast<int64_t>(size * sizeof(T)));
+				}
+				else
+				{
+					for (const T& element : value) process_impl(element);
 				}
 			}
 
@@ -89,18 +198,39 @@ namespace fantasy
 				save_binary_data(value.data(), static_cast<int64_t>(size));
 			}
 
-			void process_impl(uint64_t value) { save_binary_data(&value, sizeof(uint64_t)); }
-			void process_impl(uint32_t value) { save_binary_data(&value, sizeof(uint32_t)); }
-			void process_impl(float value) { save_binary_data(&value, sizeof(float)); }
+			template <typename T> requires is_bulk_serializable<T>
+			void process_impl(const T& value) { save_binary_data(&value, sizeof(T)); }
 
 		private:
 			std::ofstream _output;
+			uint64_t _offset = 0;
 		};
 
 		class BinaryInput
 		{
 		public:
-			BinaryInput(const std::string& file_name) : _input(file_name, std::ios::binary) {}
+			BinaryInput(const std::string& file_name) : _input(file_name, std::ios::binary) 
+			{
+				_input.seekg(0, std::ios::end);
+				std::streamoff file_size = _input.tellg();
+				_file_size = file_size > 0 ? static_cast<uint64_t>(file_size) : 0;
+				_input.seekg(0);
+
+				BinaryHeader header{};
+				_input.read(reinterpret_cast<char*>(&header), sizeof(BinaryHeader));
+				if (_input.gcount() == sizeof(BinaryHeader) && header.magic == binary_magic_number)
+				{
+					// 不认识的版本按读取失败处理.
+					if (header.version != binary_version) _input.setstate(std::ios::failbit);
+					_offset = sizeof(BinaryHeader);
+				}
+				else
+				{
+					_legacy = true;
+					_input.clear();
+					_input.seekg(0);
+				}
+			}
 			~BinaryInput() noexcept { _input.close(); }
 
 			template <typename... Args>
@@ -109,17 +239,50 @@ namespace fantasy
 				(process(arguments), ...);
 			}
 
+			bool is_valid() const { return _input.is_open() && !_input.fail(); }
+
 		public:
 			void load_binary_data(void* out_data, int64_t size)
 			{
 				if (_input.is_open())
 				{
-					_input.read(static_cast<char*>(out_data), size);
-					char new_line;
-					_input.read(&new_line, 1);
+					if (size > 0) _input.read(static_cast<char*>(out_data), size);
+					_offset += static_cast<uint64_t>(size);
+					if (_legacy)
+					{
+						char new_line;
+						_input.read(&new_line, 1);
+					}
 				}
 			}
 
+			// 旧文件中的数据没有压缩, 直接读取.
+			bool load_compressed_data(void* out_data, uint64_t size)
+			{
+				if (_legacy)
+				{
+					load_binary_data(out_data, static_cast<int64_t>(size));
+					return is_valid();
+				}
+
+				uint64_t compressed_size = 0;
+				load_binary_data(&compressed_size, sizeof(uint64_t));
+				if (!is_valid() || compressed_size > get_compressed_bound(size))
+				{
+					_input.setstate(std::ios::failbit);
+					return false;
+				}
+
+				std::vector<uint8_t> compressed_data(compressed_size);
+				load_binary_data(compressed_data.data(), static_cast<int64_t>(compressed_size));
+				if (!is_valid() || !decompress_blocks(compressed_data, std::span<uint8_t>(static_cast<uint8_t*>(out_data), size)))
+				{
+					_input.setstate(std::ios::failbit);
+					return false;
+				}
+				return true;
+			}
+
 		private:
 			template <typename T>
 			void process(T&& value)
@@ -127,48 +290,209 @@ namespace fantasy
 				process_impl(value);
 			}
 
+			// 文件中读出的元素个数在分配内存之前先与剩余的字节数比较, 损坏或截断的文件按读取失败处理, 不会分配过大的内存.
+			bool check_size(uint64_t size, uint64_t element_byte_size)
+			{
+				std::streamoff position = _input.tellg();
+				uint64_t remaining_size = position < 0 || static_cast<uint64_t>(position) > _file_size ? 0 : _file_size - static_cast<uint64_t>(position);
+				if (size > remaining_size / element_byte_size)
+				{
+					_input.setstate(std::ios::failbit);
+					return false;
+				}
+				return true;
+			}
+
 			template <typename T>
 			void process_impl(std::vector<T>& out)
 			{
 				uint64_t size = 0;
 				load_binary_data(&size, sizeof(uint64_t));
+				if (!is_valid()) return;
 
-				out.resize(size);
-				for (T& element : out)
+				// 每个元素至少占一个字节.
+				if (!check_size(size, is_bulk_serializable<T> ? sizeof(T) : 1)) return;
+
+				if constexpr (is_bulk_serializable<T>)
 				{
-					process_impl(element);
+					if (!_legacy)
+					{
+						uint64_t padding = get_binary_padding(_offset);
+						_input.seekg(static_cast<std::streamoff>(padding), std::ios::cur);
+						_offset += padding;
+						if (!check_size(size, sizeof(T))) return;
+
+						out.resize(size);
+						load_binary_data(out.data(), static_cast<int64_t>(size * sizeof(T)));
+						return;
+					}
 				}
+
+				out.resize(size);
+				for (T& element : out) process_impl(element);
 			}
 
 			void process_impl(std::string& out)
 			{
 				uint64_t size = 0;
 				load_binary_data(&size, sizeof(uint64_t));
+				if (!is_valid() || !check_size(size, 1)) return;
 
 				out.resize(size);
 				load_binary_data(out.data(), static_cast<int64_t>(size));
 			}
 
-			void process_impl(uint64_t& OutValue) { load_binary_data(&OutValue, sizeof(uint64_t)); }
-			void process_impl(uint32_t& OutValue) { load_binary_data(&OutValue, sizeof(uint32_t)); }
-			void process_impl(float& OutValue) { load_binary_data(&OutValue, sizeof(float)); }
+			template <typename T> requires is_bulk_serializable<T>
+			void process_impl(T& out) { load_binary_data(&out, sizeof(T)); }
 
 		private:
 			std::ifstream _input;
+			uint64_t _file_size = 0;
+			uint64_t _offset = 0;
+			bool _legacy = false;
 		};
-	}
-}
 
+		// 基于内存映射的读取, 只支持带文件头的格式, vector 可以直接以 span 的形式读取, 不发生拷贝.
+		// 越界时 is_valid() 返回 false, 之后的读取都返回空数据.
+		class MappedBinaryInput
+		{
+		public:
+			MappedBinaryInput(const std::string& file_name)
+			{
+				BinaryHeader header{};
+				if (_file.open(file_name) && _file.data().size() >= sizeof(BinaryHeader))
+				{
+					memcpy(&header, _file.data().data(), sizeof(BinaryHeader));
+					_valid = header.magic == binary_magic_number && header.version == binary_version;
+					_offset = sizeof(BinaryHeader);
+				}
+			}
+
+			template <typename... Args>
+			void operator()(Args&&... arguments)
+			{
+				(process(arguments), ...);
+			}
 
+			bool is_valid() const { return _valid; }
 
+		public:
+			std::span<const uint8_t> get_binary_data(uint64_t size)
+			{
+				std::span<const uint8_t> data = _file.data();
+				if (!_valid || size > data.size() - _offset)
+				{
+					_valid = false;
+					return {};
+				}
+				_offset += size;
+				return data.subspan(_offset - size, size);
+			}
 
+			void load_binary_data(void* out_data, int64_t size)
+			{
+				std::span<const uint8_t> data = get_binary_data(static_cast<uint64_t>(size));
+				if (!data.empty()) memcpy(out_data, data.data(), data.size());
+			}
 
+			// 直接从映射的内存解压.
+			bool load_compressed_data(void* out_data, uint64_t size)
+			{
+				uint64_t compressed_size = 0;
+				load_binary_data(&compressed_size, sizeof(uint64_t));
 
+				std::span<const uint8_t> compressed_data = get_binary_data(compressed_size);
+				if (!_valid || !decompress_blocks(compressed_data, std::span<uint8_t>(static_cast<uint8_t*>(out_data), size)))
+				{
+					_valid = false;
+					return false;
+				}
+				return true;
+			}
 
+			// size 来自文件, 先与压缩数据记录的原始大小及最大压缩比比较, 一致后才分配 output.
+			bool load_compressed_data(std::vector<uint8_t>& output, uint64_t size)
+			{
+				uint64_t compressed_size = 0;
+				load_binary_data(&compressed_size, sizeof(uint64_t));
+				std::span<const uint8_t> compressed_data = get_binary_data(compressed_size);
 
+				uint64_t raw_size = 0;
+				if (_valid && compressed_data.size() >= sizeof(uint64_t)) memcpy(&raw_size, compressed_data.data(), sizeof(uint64_t));
+				if (!_valid || raw_size != size || size / max_compression_ratio > compressed_data.size())
+				{
+					_valid = false;
+					return false;
+				}
 
+				output.resize(size);
+				if (!decompress_blocks(compressed_data, output))
+				{
+					_valid = false;
+					return false;
+				}
+				return true;
+			}
 
+			template <typename T> requires is_bulk_serializable<T>
+			std::span<const T> get_span()
+			{
+				uint64_t size = 0;
+				load_binary_data(&size, sizeof(uint64_t));
+				get_binary_data(get_binary_padding(_offset));
+				if (!_valid || size > (_file.data().size() - _offset) / sizeof(T))
+				{
+					_valid = false;
+					return {};
+				}
+
+				std::span<const uint8_t> data = get_binary_data(size * sizeof(T));
+				return std::span<const T>(reinterpret_cast<const T*>(data.data()), size);
+			}
 
+		private:
+			template <typename T>
+			void process(T&& value)
+			{
+				process_impl(value);
+			}
 
+			template <typename T>
+			void process_impl(std::vector<T>& out)
+			{
+				if constexpr (is_bulk_serializable<T>)
+				{
+					std::span<const T> data = get_span<T>();
+					out.assign(data.begin(), data.end());
+				}
+				else
+				{
+					uint64_t size = 0;
+					load_binary_data(&size, sizeof(uint64_t));
+					if (!_valid) return;
+
+					out.resize(size);
+					for (T& element : out) process_impl(element);
+				}
+			}
+
+			void process_impl(std::string& out)
+			{
+				uint64_t size = 0;
+				load_binary_data(&size, sizeof(uint64_t));
+				std::span<const uint8_t> data = get_binary_data(size);
+				out.assign(data.begin(), data.end());
+			}
+
+			template <typename T> requires is_bulk_serializable<T>
+			void process_impl(T& out) { load_binary_data(&out, sizeof(T)); }
+
+		private:
+			MappedFile _file;
+			uint64_t _offset = 0;
+			bool _valid = false;
+		};
+	}
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -1,10 +1,14 @@
 #ifndef CORE_TOOLS_LRU_CACHE_H
 #define CORE_TOOLS_LRU_CACHE_H
 
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <list>
+#include <span>
 #include <unordered_map>
 #include <functional>
+#include <vector>
 
 namespace fantasy 
 {
@@ -60,6 +64,176 @@ namespace fantasy
         std::unordered_map<uint64_t,  typename std::list<std::pair<uint64_t, T>>::iterator> _map;
         std::list<std::pair<uint64_t, T>> _list;
     };
+
+    // 容量固定的 LRU, 数据存放在预先分配的 slot 数组中, 双向链表的前后指针直接存在 slot 里, key 由开放寻址的哈希表索引.
+    // 插入, 访问与淘汰都不分配内存. 淘汰时以 on_evict(slot, value) 通知调用方被释放的 slot, 新插入的数据随后放入该 slot.
+    template <typename T, typename OnEvict = std::function<void(uint32_t, T&)>>
+    class FixedLruCache
+    {
+    public:
+        static constexpr uint32_t invalid_slot = ~0u;
+
+        explicit FixedLruCache(uint32_t capacity = 0, OnEvict on_evict = [](uint32_t, T&) {}) :
+            _on_evict(on_evict),
+            _slots(capacity),
+            _index(std::bit_ceil(std::max(capacity * 2, 16u)))
+        {
+        }
+
+        uint32_t capacity() const { return static_cast<uint32_t>(_slots.size()); }
+        uint32_t size() const { return _size; }
+
+        // 下一次插入新 key 时会被淘汰的 slot, 还有空闲的 slot 时返回 invalid_slot.
+        uint32_t get_evict_slot() const { return _size < _slots.size() ? invalid_slot : _tail; }
+
+        // 不改变访问顺序, key 不存在时返回 invalid_slot.
+        uint32_t find(uint64_t key) const { return _index[find_index_entry(key)].slot; }
+
+        // 移到最前, key 不存在时返回 invalid_slot.
+        uint32_t touch(uint64_t key)
+        {
+            uint32_t slot = find(key);
+            if (slot != invalid_slot) move_to_front(slot);
+            return slot;
+        }
+
+        T* get(uint64_t key)
+        {
+            uint32_t slot = touch(key);
+            return slot == invalid_slot ? nullptr : &_slots[slot].value;
+        }
+
+        // key 已存在时覆盖并移到最前, 否则放入空闲的 slot, 没有空闲的 slot 时淘汰最久未访问的. 返回所在的 slot.
+        uint32_t insert(uint64_t key, const T& value)
+        {
+            if (_slots.empty()) return invalid_slot;
+
+            uint32_t entry = find_index_entry(key);
+            uint32_t slot = _index[entry].slot;
+            if (slot != invalid_slot)
+            {
+                _slots[slot].value = value;
+                move_to_front(slot);
+                return slot;
+            }
+
+            if (_size < _slots.size())
+            {
+                slot = _size++;
+            }
+            else
+            {
+                slot = _tail;
+                unlink(slot);
+                erase_index_entry(find_index_entry(_slots[slot].key));
+                _on_evict(slot, _slots[slot].value);
+
+                // 删除时后面的项会前移.
+                entry = find_index_entry(key);
+            }
+
+            _index[entry] = IndexEntry{ .key = key, .slot = slot };
+            _slots[slot].key = key;
+            _slots[slot].value = value;
+            push_front(slot);
+            return slot;
+        }
+
+        // 按顺序依次处理, 靠后的 key 更新. slots 的大小需要与 keys 相同.
+        void touch(std::span<const uint64_t> keys, std::span<uint32_t> slots)
+        {
+            for (uint64_t ix = 0; ix < keys.size(); ++ix) slots[ix] = touch(keys[ix]);
+        }
+
+        void insert(std::span<const uint64_t> keys, std::span<const T> values, std::span<uint32_t> slots)
+        {
+            for (uint64_t ix = 0; ix < keys.size(); ++ix) slots[ix] = insert(keys[ix], values[ix]);
+        }
+
+        T& operator[](uint32_t slot) { return _slots[slot].value; }
+        const T& operator[](uint32_t slot) const { return _slots[slot].value; }
+
+    private:
+        struct Slot
+        {
+            uint64_t key = 0;
+            uint32_t prev = invalid_slot;
+            uint32_t next = invalid_slot;
+            T value;
+        };
+
+        struct IndexEntry
+        {
+            uint64_t key = 0;
+            uint32_t slot = invalid_slot;
+        };
+
+        static uint32_t hash(uint64_t key)
+        {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            return static_cast<uint32_t>(key);
+        }
+
+        // 返回 key 所在的项, 不存在时返回探测到的第一个空项.
+        uint32_t find_index_entry(uint64_t key) const
+        {
+            uint32_t mask = static_cast<uint32_t>(_index.size()) - 1;
+            uint32_t entry = hash(key) & mask;
+            while (_index[entry].slot != invalid_slot && _index[entry].key != key) entry = (entry + 1) & mask;
+            return entry;
+        }
+
+        // 线性探测的删除, 把后面可以前移的项移到空出的位置, 不需要墓碑.
+        void erase_index_entry(uint32_t hole)
+        {
+            uint32_t mask = static_cast<uint32_t>(_index.size()) - 1;
+            for (uint32_t entry = (hole + 1) & mask; _index[entry].slot != invalid_slot; entry = (entry + 1) & mask)
+            {
+                uint32_t home = hash(_index[entry].key) & mask;
+                if (((entry - home) & mask) >= ((entry - hole) & mask))
+                {
+                    _index[hole] = _index[entry];
+                    hole = entry;
+                }
+            }
+            _index[hole].slot = invalid_slot;
+        }
+
+        void unlink(uint32_t slot)
+        {
+            Slot& node = _slots[slot];
+            if (node.prev != invalid_slot) _slots[node.prev].next = node.next; else _head = node.next;
+            if (node.next != invalid_slot) _slots[node.next].prev = node.prev; else _tail = node.prev;
+            node.prev = node.next = invalid_slot;
+        }
+
+        void push_front(uint32_t slot)
+        {
+            Slot& node = _slots[slot];
+            node.prev = invalid_slot;
+            node.next = _head;
+            if (_head != invalid_slot) _slots[_head].prev = slot; else _tail = slot;
+            _head = slot;
+        }
+
+        void move_to_front(uint32_t slot)
+        {
+            if (slot == _head) return;
+            unlink(slot);
+            push_front(slot);
+        }
+
+    private:
+        OnEvict _on_evict;
+        std::vector<Slot> _slots;
+        std::vector<IndexEntry> _index;
+
+        uint32_t _size = 0;
+        uint32_t _head = invalid_slot;
+        uint32_t _tail = invalid_slot;
+    };
 }
 
 
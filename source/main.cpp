@@ -1,7 +1,16 @@
 #include "global_render.h"
+#include "test/benchmark.h"
 
 int main()
 {
+#ifdef BENCHMARK
+	if (!fantasy::benchmark::run())
+	{
+		LOG_ERROR("Benchmark Failed.");
+		return -1;
+	}
+	return 0;
+#else
 	fantasy::GlobalRender render;
 	if (!render.Init() || !render.run())
 	{
@@ -9,4 +18,5 @@ int main()
 		return -1;
 	}
 	return 0;
+#endif
 }
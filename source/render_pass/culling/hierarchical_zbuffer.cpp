@@ -1,6 +1,8 @@
 #include "hierarchical_zbuffer.h"
 #include "../../shader/shader_compiler.h"
 #include "../../core/tools/check_cast.h"
+#include "../../scene/camera.h"
+#include <algorithm>
 #include <memory>
 
 namespace fantasy
@@ -20,7 +22,7 @@ namespace fantasy
 		{
 			BindingLayoutItemArray binding_layout_items(2 + texture_mip_levels);
 			binding_layout_items[0] = BindingLayoutItem::create_push_constants(0, sizeof(constant::HierarchicalZBufferPassConstant));
-			binding_layout_items[1] = BindingLayoutItem::create_sampler(0);
+			binding_layout_items[1] = BindingLayoutItem::create_texture_srv(0);
             for (uint32_t ix = 0; ix < texture_mip_levels; ++ix)
             {
 			    binding_layout_items[2 + ix] = BindingLayoutItem::create_texture_uav(ix);
@@ -33,7 +35,7 @@ namespace fantasy
 		// Shader.
 		{
 			ShaderCompileDesc cs_compile_desc;
-			cs_compile_desc.shader_name = "culling/hierarchical_zbuffer_ps.slang";
+			cs_compile_desc.shader_name = "culling/hierarchical_zbuffer_cs.slang";
 			cs_compile_desc.entry_point = "main";
 			cs_compile_desc.target = ShaderTarget::Compute;
 			cs_compile_desc.defines.push_back("THREAD_GROUP_SIZE_X=" + std::to_string(THREAD_GROUP_SIZE_X));
@@ -58,7 +60,7 @@ namespace fantasy
 		{
 			BindingSetItemArray binding_set_items(2 + texture_mip_levels);
 			binding_set_items[0] = BindingSetItem::create_push_constants(0, sizeof(constant::HierarchicalZBufferPassConstant));
-			binding_set_items[1] = BindingSetItem::create_sampler(0, check_cast<SamplerInterface>(cache->require("linear_clamp_sampler")));
+			binding_set_items[1] = BindingSetItem::create_texture_srv(0, check_cast<TextureInterface>(cache->require("world_position_view_depth_texture")));
             for (uint32_t ix = 0; ix < texture_mip_levels; ++ix)
             {
 			    binding_set_items[2 + ix] = BindingSetItem::create_texture_uav(
@@ -86,7 +88,11 @@ namespace fantasy
 
         uint32_t* ptr = &_pass_constants[0].hzb_resolution;
         ReturnIfFalse(cache->require_constants("hzb_resolution", reinterpret_cast<void**>(&ptr)));
-        for (auto& constant : _pass_constants) constant.hzb_resolution = _pass_constants[0].hzb_resolution;
+        for (uint32_t ix = 0; ix < texture_mip_levels; ++ix)
+        {
+            _pass_constants[ix].hzb_resolution = _pass_constants[0].hzb_resolution;
+            _pass_constants[ix].mip_level = ix;
+        }
  
 		return true;
 	}
@@ -95,13 +101,19 @@ namespace fantasy
 	{
 		ReturnIfFalse(cmdlist->open());
 
-		uint2 thread_group_num = {
-			static_cast<uint32_t>((align(_pass_constants[0].hzb_resolution, THREAD_GROUP_SIZE_X) / THREAD_GROUP_SIZE_X)),
-			static_cast<uint32_t>((align(_pass_constants[0].hzb_resolution, THREAD_GROUP_SIZE_Y) / THREAD_GROUP_SIZE_Y)),
-		};
+        Camera* camera = cache->get_world()->get_global_entity()->get_component<Camera>();
+        float near_z = -camera->proj_matrix[3][2] / camera->proj_matrix[2][2];
 
         for (uint32_t ix = 0; ix < _pass_constants.size(); ++ix)
         {
+            _pass_constants[ix].near_z = near_z;
+
+            uint32_t mip_resolution = std::max(_pass_constants[ix].hzb_resolution >> ix, 1u);
+            uint2 thread_group_num = {
+                static_cast<uint32_t>((align(mip_resolution, THREAD_GROUP_SIZE_X) / THREAD_GROUP_SIZE_X)),
+                static_cast<uint32_t>((align(mip_resolution, THREAD_GROUP_SIZE_Y) / THREAD_GROUP_SIZE_Y)),
+            };
+
             ReturnIfFalse(cmdlist->set_compute_state(_compute_state));
             ReturnIfFalse(cmdlist->set_push_constants(
                 &_pass_constants[ix], 
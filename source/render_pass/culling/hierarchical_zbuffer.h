@@ -11,7 +11,8 @@ namespace fantasy
 		{
             uint2 client_resolution = uint2{ CLIENT_WIDTH, CLIENT_HEIGHT };
             uint32_t hzb_resolution = 0;
-            uint32_t last_mip_level = 0;
+            uint32_t mip_level = 0;		// 0 时从 world_position_view_depth_texture 构建, 否则取上一级 2x2 的最小值.
+            float near_z = 0.0f;
 		};
 	}
 
@@ -0,0 +1,333 @@
+#include "mesh_cluster_culler.h"
+#include "../../core/parallel/parallel.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <immintrin.h>
+
+namespace fantasy
+{
+	bool DepthPyramid::build(std::span<const float> view_depths, uint32_t width, uint32_t height, uint32_t resolution, float near_z)
+	{
+		if (!std::has_single_bit(resolution) || view_depths.size() < static_cast<uint64_t>(width) * height) return false;
+
+		_resolution = resolution;
+		_mip_offsets.clear();
+
+		uint64_t depth_num = 0;
+		for (uint32_t mip_resolution = resolution; mip_resolution > 0; mip_resolution >>= 1)
+		{
+			_mip_offsets.push_back(depth_num);
+			depth_num += static_cast<uint64_t>(mip_resolution) * mip_resolution;
+		}
+		_depths.resize(depth_num);
+
+		// mip 0 的每个 texel 取它覆盖的所有像素中最远的深度, 相邻 texel 覆盖的像素可以重叠.
+		parallel::parallel_for(
+			parallel::Range{ 0, resolution },
+			[&](const parallel::Range& range)
+			{
+				for (uint64_t y = range.begin; y < range.end; ++y)
+				{
+					uint64_t pixel_y_begin = y * height / resolution;
+					uint64_t pixel_y_end = std::max(((y + 1) * height + resolution - 1) / resolution, pixel_y_begin + 1);
+					for (uint64_t x = 0; x < resolution; ++x)
+					{
+						uint64_t pixel_x_begin = x * width / resolution;
+						uint64_t pixel_x_end = std::max(((x + 1) * width + resolution - 1) / resolution, pixel_x_begin + 1);
+
+						float depth = 1.0f;
+						for (uint64_t py = pixel_y_begin; py < std::min<uint64_t>(pixel_y_end, height); ++py)
+						{
+							for (uint64_t px = pixel_x_begin; px < std::min<uint64_t>(pixel_x_end, width); ++px)
+							{
+								float view_z = view_depths[py * width + px];
+								depth = std::min(depth, view_z >= near_z ? near_z / view_z : 0.0f);
+							}
+						}
+						_depths[y * resolution + x] = depth;
+					}
+				}
+			}
+		);
+
+		for (uint32_t mip_level = 1; mip_level < _mip_offsets.size(); ++mip_level)
+		{
+			uint32_t mip_resolution = resolution >> mip_level;
+			const float* src = _depths.data() + _mip_offsets[mip_level - 1];
+			float* dst = _depths.data() + _mip_offsets[mip_level];
+			parallel::parallel_for(
+				parallel::Range{ 0, mip_resolution },
+				[&](const parallel::Range& range)
+				{
+					for (uint64_t y = range.begin; y < range.end; ++y)
+					{
+						const float* row0 = src + y * 2 * (mip_resolution * 2);
+						const float* row1 = row0 + mip_resolution * 2;
+						for (uint64_t x = 0; x < mip_resolution; ++x)
+						{
+							dst[y * mip_resolution + x] = std::min(std::min(row0[x * 2], row0[x * 2 + 1]), std::min(row1[x * 2], row1[x * 2 + 1]));
+						}
+					}
+				}
+			);
+		}
+		return true;
+	}
+
+	void MeshClusterCuller::SphereArray::resize(uint64_t size)
+	{
+		// 补齐的部分可以被整组读取, 不参与结果.
+		uint64_t padded_size = (size + simd_width - 1) / simd_width * simd_width + simd_width;
+		x.assign(padded_size, 0.0f);
+		y.assign(padded_size, 0.0f);
+		z.assign(padded_size, 0.0f);
+		radius.assign(padded_size, 0.0f);
+	}
+
+	void MeshClusterCuller::SphereArray::set(uint64_t index, const float4& sphere)
+	{
+		x[index] = sphere.x;
+		y[index] = sphere.y;
+		z[index] = sphere.z;
+		radius[index] = sphere.w;
+	}
+
+	void MeshClusterCuller::set_clusters(std::span<const MeshClusterGroupGpu> groups, std::span<const MeshClusterGpu> clusters)
+	{
+		_group_count = static_cast<uint32_t>(groups.size());
+		_cluster_count = static_cast<uint32_t>(clusters.size());
+
+		_group_lod_spheres.resize(groups.size());
+		_group_max_parent_lod_errors.assign(_group_lod_spheres.x.size(), 0.0f);
+		_group_cluster_offsets.resize(groups.size() + 1);
+		for (uint32_t ix = 0; ix < groups.size(); ++ix)
+		{
+			_group_lod_spheres.set(ix, groups[ix].lod_bounding_sphere);
+			_group_max_parent_lod_errors[ix] = groups[ix].max_parent_lod_error;
+			_group_cluster_offsets[ix] = groups[ix].cluster_index_offset;
+		}
+		_group_cluster_offsets[groups.size()] = _cluster_count;
+
+		_cluster_spheres.resize(clusters.size());
+		_cluster_lod_spheres.resize(clusters.size());
+		_cluster_lod_errors.assign(_cluster_spheres.x.size(), 0.0f);
+		for (uint32_t ix = 0; ix < clusters.size(); ++ix)
+		{
+			_cluster_spheres.set(ix, clusters[ix].bounding_sphere);
+			_cluster_lod_spheres.set(ix, clusters[ix].lod_bounding_sphere);
+			_cluster_lod_errors[ix] = clusters[ix].lod_error;
+		}
+	}
+
+	struct ClusterCullingConstants
+	{
+		__m128 view_matrix[4][3];
+		__m128 lod_scale;			// 一个像素在单位距离处对应的大小.
+		__m128 proj_x;
+		__m128 proj_y;
+		__m128 frustum_x_scale;		// 视锥左右与上下平面法线的归一化系数.
+		__m128 frustum_y_scale;
+		__m128 near_z;
+
+		explicit ClusterCullingConstants(const ClusterCullingView& view)
+		{
+			for (uint32_t row = 0; row < 4; ++row)
+			{
+				for (uint32_t column = 0; column < 3; ++column) view_matrix[row][column] = _mm_set1_ps(view.view_matrix[row][column]);
+			}
+
+			float p00 = view.proj_matrix[0][0];
+			float p11 = view.proj_matrix[1][1];
+			lod_scale = _mm_set1_ps(radians(view.camera_fov_y) / view.client_height);
+			proj_x = _mm_set1_ps(p00);
+			proj_y = _mm_set1_ps(p11);
+			frustum_x_scale = _mm_set1_ps(1.0f / std::sqrt(p00 * p00 + 1.0f));
+			frustum_y_scale = _mm_set1_ps(1.0f / std::sqrt(p11 * p11 + 1.0f));
+			near_z = _mm_set1_ps(-view.proj_matrix[3][2] / view.proj_matrix[2][2]);
+		}
+
+		void transform(__m128 x, __m128 y, __m128 z, __m128 view_position[3]) const
+		{
+			for (uint32_t ix = 0; ix < 3; ++ix)
+			{
+				// 与 mul(float4, float4x4) 的求和顺序相同, 结果与逐个计算一致.
+				view_position[ix] = _mm_add_ps(
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, view_matrix[0][ix]), _mm_mul_ps(y, view_matrix[1][ix])), _mm_mul_ps(z, view_matrix[2][ix])),
+					view_matrix[3][ix]
+				);
+			}
+		}
+
+		// 球到相机的最近距离上一个像素的大小不小于 error 时, 误差在屏幕上不可见.
+		__m128 check_lod(const __m128 view_position[3], __m128 radius, __m128 error) const
+		{
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(view_position[0], view_position[0]), _mm_mul_ps(view_position[1], view_position[1])),
+				_mm_mul_ps(view_position[2], view_position[2])
+			));
+			__m128 distance = _mm_max_ps(_mm_sub_ps(length, radius), _mm_setzero_ps());
+			return _mm_cmpge_ps(_mm_mul_ps(distance, lod_scale), error);
+		}
+
+		// 视锥的左右与上下平面关于原点对称, 取绝对值后只需测试两个平面, 另外剔除完全在近平面之后的球.
+		__m128 frustum_cull(const __m128 view_position[3], __m128 radius) const
+		{
+			__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+			__m128 x_distance = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_and_ps(view_position[0], abs_mask), proj_x), view_position[2]), frustum_x_scale);
+			__m128 y_distance = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_and_ps(view_position[1], abs_mask), proj_y), view_position[2]), frustum_y_scale);
+			__m128 visible = _mm_and_ps(_mm_cmplt_ps(x_distance, radius), _mm_cmplt_ps(y_distance, radius));
+			return _mm_and_ps(visible, _mm_cmpgt_ps(_mm_add_ps(view_position[2], radius), near_z));
+		}
+	};
+
+	// 球与近平面相交时投影无效, 视为可见.
+	static bool hierarchical_zbuffer_cull(const DepthPyramid& hzb, float3 center, float radius, float proj_x, float proj_y, float near_z)
+	{
+		if (center.z - radius <= near_z) return true;
+
+		// 透视投影下球在屏幕上的包围矩形, 转换到 uv, y 朝下.
+		float zr2 = center.z * center.z - radius * radius;
+		float vx = std::sqrt(center.x * center.x + zr2);
+		float min_x = (vx * center.x - radius * center.z) / (vx * center.z + radius * center.x);
+		float max_x = (vx * center.x + radius * center.z) / (vx * center.z - radius * center.x);
+		float vy = std::sqrt(center.y * center.y + zr2);
+		float min_y = (vy * center.y - radius * center.z) / (vy * center.z + radius * center.y);
+		float max_y = (vy * center.y + radius * center.z) / (vy * center.z - radius * center.y);
+
+		float u0 = std::clamp(min_x * proj_x * 0.5f + 0.5f, 0.0f, 1.0f);
+		float u1 = std::clamp(max_x * proj_x * 0.5f + 0.5f, 0.0f, 1.0f);
+		float v0 = std::clamp(max_y * proj_y * -0.5f + 0.5f, 0.0f, 1.0f);
+		float v1 = std::clamp(min_y * proj_y * -0.5f + 0.5f, 0.0f, 1.0f);
+
+		// 选择矩形不超过一个 texel 的 mip, 最多覆盖 2x2 个 texel.
+		float resolution = static_cast<float>(hzb.get_resolution());
+		float extent = std::max((u1 - u0) * resolution, (v1 - v0) * resolution);
+		uint32_t mip_level = std::min(static_cast<uint32_t>(std::bit_width(static_cast<uint32_t>(std::ceil(std::max(extent, 1.0f))) - 1)), hzb.get_mip_levels() - 1);
+
+		uint32_t mip_resolution = hzb.get_resolution() >> mip_level;
+		uint32_t x0 = std::min(static_cast<uint32_t>(u0 * resolution) >> mip_level, mip_resolution - 1);
+		uint32_t x1 = std::min(static_cast<uint32_t>(u1 * resolution) >> mip_level, mip_resolution - 1);
+		uint32_t y0 = std::min(static_cast<uint32_t>(v0 * resolution) >> mip_level, mip_resolution - 1);
+		uint32_t y1 = std::min(static_cast<uint32_t>(v1 * resolution) >> mip_level, mip_resolution - 1);
+
+		float min_depth = 1.0f;
+		for (uint32_t y = y0; y <= y1; ++y)
+		{
+			for (uint32_t x = x0; x <= x1; ++x) min_depth = std::min(min_depth, hzb.load(x, y, mip_level));
+		}
+		return near_z / (center.z - radius) >= min_depth;
+	}
+
+	void MeshClusterCuller::cull_groups(
+		const ClusterCullingView& view,
+		const DepthPyramid* hzb,
+		uint32_t begin,
+		uint32_t end,
+		std::vector<uint32_t>& visible_cluster_ids
+	) const
+	{
+		ClusterCullingConstants constants(view);
+		float proj_x = view.proj_matrix[0][0];
+		float proj_y = view.proj_matrix[1][1];
+		float near_z = _mm_cvtss_f32(constants.near_z);
+
+		for (uint32_t group_begin = begin; group_begin < end; group_begin += simd_width)
+		{
+			// parent 的误差已经不可见时由更粗一级的 cluster 绘制, 跳过该 group.
+			__m128 group_view_position[3];
+			constants.transform(
+				_mm_loadu_ps(&_group_lod_spheres.x[group_begin]),
+				_mm_loadu_ps(&_group_lod_spheres.y[group_begin]),
+				_mm_loadu_ps(&_group_lod_spheres.z[group_begin]),
+				group_view_position
+			);
+			uint32_t group_mask = ~_mm_movemask_ps(constants.check_lod(
+				group_view_position,
+				_mm_loadu_ps(&_group_lod_spheres.radius[group_begin]),
+				_mm_loadu_ps(&_group_max_parent_lod_errors[group_begin])
+			)) & ((1u << std::min(simd_width, end - group_begin)) - 1);
+
+			for (; group_mask != 0; group_mask &= group_mask - 1)
+			{
+				uint32_t group_index = group_begin + std::countr_zero(group_mask);
+				uint32_t cluster_end = _group_cluster_offsets[group_index + 1];
+				for (uint32_t cluster_begin = _group_cluster_offsets[group_index]; cluster_begin < cluster_end; cluster_begin += simd_width)
+				{
+					__m128 lod_view_position[3];
+					constants.transform(
+						_mm_loadu_ps(&_cluster_lod_spheres.x[cluster_begin]),
+						_mm_loadu_ps(&_cluster_lod_spheres.y[cluster_begin]),
+						_mm_loadu_ps(&_cluster_lod_spheres.z[cluster_begin]),
+						lod_view_position
+					);
+					__m128 visible = constants.check_lod(
+						lod_view_position,
+						_mm_loadu_ps(&_cluster_lod_spheres.radius[cluster_begin]),
+						_mm_loadu_ps(&_cluster_lod_errors[cluster_begin])
+					);
+
+					__m128 view_position[3];
+					__m128 radius = _mm_loadu_ps(&_cluster_spheres.radius[cluster_begin]);
+					constants.transform(
+						_mm_loadu_ps(&_cluster_spheres.x[cluster_begin]),
+						_mm_loadu_ps(&_cluster_spheres.y[cluster_begin]),
+						_mm_loadu_ps(&_cluster_spheres.z[cluster_begin]),
+						view_position
+					);
+					visible = _mm_and_ps(visible, constants.frustum_cull(view_position, radius));
+
+					uint32_t cluster_mask = _mm_movemask_ps(visible) & ((1u << std::min(simd_width, cluster_end - cluster_begin)) - 1);
+					if (cluster_mask == 0) continue;
+
+					alignas(16) float x[simd_width], y[simd_width], z[simd_width], r[simd_width];
+					if (hzb != nullptr)
+					{
+						_mm_store_ps(x, view_position[0]);
+						_mm_store_ps(y, view_position[1]);
+						_mm_store_ps(z, view_position[2]);
+						_mm_store_ps(r, radius);
+					}
+
+					for (; cluster_mask != 0; cluster_mask &= cluster_mask - 1)
+					{
+						uint32_t lane = std::countr_zero(cluster_mask);
+						if (hzb == nullptr || hierarchical_zbuffer_cull(*hzb, float3(x[lane], y[lane], z[lane]), r[lane], proj_x, proj_y, near_z))
+						{
+							visible_cluster_ids.push_back(cluster_begin + lane);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void MeshClusterCuller::cull(const ClusterCullingView& view, const DepthPyramid* hzb)
+	{
+		uint32_t chunk_num = (_group_count + group_chunk_size - 1) / group_chunk_size;
+		_chunk_visible_cluster_ids.resize(chunk_num);
+
+		parallel::parallel_for(
+			parallel::Range{ 0, chunk_num },
+			[&](const parallel::Range& range)
+			{
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
+				{
+					auto& visible_cluster_ids = _chunk_visible_cluster_ids[ix];
+					visible_cluster_ids.clear();
+
+					uint32_t begin = static_cast<uint32_t>(ix) * group_chunk_size;
+					cull_groups(view, hzb, begin, std::min(begin + group_chunk_size, _group_count), visible_cluster_ids);
+				}
+			},
+			1
+		);
+
+		// group 的 cluster 按 group 顺序连续存放, 按块的顺序拼接即为升序.
+		_visible_cluster_ids.clear();
+		for (const auto& visible_cluster_ids : _chunk_visible_cluster_ids)
+		{
+			_visible_cluster_ids.insert(_visible_cluster_ids.end(), visible_cluster_ids.begin(), visible_cluster_ids.end());
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#ifndef RENDER_MESH_CLUSTER_CULLER_H
+#define RENDER_MESH_CLUSTER_CULLER_H
+
+#include "../../core/math/matrix.h"
+#include "../../scene/virtual_mesh.h"
+#include <span>
+#include <vector>
+
+namespace fantasy
+{
+	// 与 MeshClusterCullingPass 的 pass constant 相同, view space 为左手系, z 朝前.
+	struct ClusterCullingView
+	{
+		float4x4 view_matrix;
+		float4x4 proj_matrix;
+
+		uint32_t client_width = CLIENT_WIDTH;
+		uint32_t client_height = CLIENT_HEIGHT;
+		float camera_fov_y = 0.0f;		// 角度.
+	};
+
+	// CPU 上的 hierarchical zbuffer, 存放 near_z / view_z, 越大越近, 没有几何的像素为 0.
+	// 每一级取上一级 2x2 的最小值, 即该范围内最远的深度.
+	class DepthPyramid
+	{
+	public:
+		// view_depths 是 width * height 的 view space z, 小于 near_z 的视为没有几何 (gbuffer 清屏为 0), resolution 需要是 2 的幂.
+		bool build(std::span<const float> view_depths, uint32_t width, uint32_t height, uint32_t resolution, float near_z);
+
+		uint32_t get_resolution() const { return _resolution; }
+		uint32_t get_mip_levels() const { return static_cast<uint32_t>(_mip_offsets.size()); }
+
+		float load(uint32_t x, uint32_t y, uint32_t mip_level) const
+		{
+			return _depths[_mip_offsets[mip_level] + static_cast<uint64_t>(y) * (_resolution >> mip_level) + x];
+		}
+
+	private:
+		uint32_t _resolution = 0;
+		std::vector<uint64_t> _mip_offsets;
+		std::vector<float> _depths;
+	};
+
+	// mesh_cluster_culling_cs.slang 的 CPU 实现, 对相同的 group 与 cluster 数组输出相同的可见 cluster.
+	// 先按 group 的 parent lod error 跳过已由更粗一级绘制的 group, 再对其中的 cluster 做 lod, 视锥与 hzb 测试.
+	// cluster 以 SoA 存放, 一次 SSE 指令测试 4 个球, group 按块分给线程池.
+	class MeshClusterCuller
+	{
+	public:
+		static constexpr uint32_t simd_width = 4;
+		static constexpr uint32_t group_chunk_size = 256;
+
+		void set_clusters(std::span<const MeshClusterGroupGpu> groups, std::span<const MeshClusterGpu> clusters);
+
+		// hzb 为空时不做遮挡剔除. 可见 cluster 按 cluster 序号升序输出.
+		void cull(const ClusterCullingView& view, const DepthPyramid* hzb = nullptr);
+
+		const std::vector<uint32_t>& get_visible_cluster_ids() const { return _visible_cluster_ids; }
+		uint32_t get_cluster_count() const { return _cluster_count; }
+
+	private:
+		// 每个分量一个数组, 末尾补齐到 simd_width 的整数倍.
+		struct SphereArray
+		{
+			std::vector<float> x, y, z, radius;
+
+			void resize(uint64_t size);
+			void set(uint64_t index, const float4& sphere);
+		};
+
+		void cull_groups(const ClusterCullingView& view, const DepthPyramid* hzb, uint32_t begin, uint32_t end, std::vector<uint32_t>& visible_cluster_ids) const;
+
+	private:
+		uint32_t _group_count = 0;
+		uint32_t _cluster_count = 0;
+
+		SphereArray _group_lod_spheres;
+		std::vector<float> _group_max_parent_lod_errors;
+		std::vector<uint32_t> _group_cluster_offsets;		// 最后一项是 cluster 总数.
+
+		SphereArray _cluster_spheres;
+		SphereArray _cluster_lod_spheres;
+		std::vector<float> _cluster_lod_errors;
+
+		std::vector<std::vector<uint32_t>> _chunk_visible_cluster_ids;
+		std::vector<uint32_t> _visible_cluster_ids;
+	};
+}
+
+#endif
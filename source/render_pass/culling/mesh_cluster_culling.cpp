@@ -99,8 +99,8 @@ namespace fantasy
                 2, 
                 _hierarchical_zbuffer_texture,
                 TextureSubresourceSet{ 
-                    .base_mip_level = hzb_mip_levels - 1,
-                    .mip_level_count = 1,
+                    .base_mip_level = 0,
+                    .mip_level_count = hzb_mip_levels,
                     .base_array_slice = 0,
                     .array_slice_count = 1
                 }
@@ -131,6 +131,7 @@ namespace fantasy
         _pass_constant.camera_fov_y = camera->get_fov_y();
         _pass_constant.view_matrix = camera->view_matrix;
         _pass_constant.proj_matrix = camera->proj_matrix;
+        _pass_constant.near_z = -camera->proj_matrix[3][2] / camera->proj_matrix[2][2];
 
         if (!_resource_writed)
         {
@@ -144,27 +145,24 @@ namespace fantasy
             ReturnIfFalse(world->each<VirtualMesh>(
                 [&](Entity* entity, VirtualMesh* virtual_mesh) -> bool
                 {
-                    for (const auto& submesh : virtual_mesh->_submeshes)
-                    {
-                        _pass_constant.group_count += static_cast<uint32_t>(submesh.cluster_groups.size());
-
-                        for (const auto& group : submesh.cluster_groups)
-                        {
-                            _mesh_cluster_groups.emplace_back(convert_mesh_cluster_group(group, cluster_index_offset));
-
-                            for (auto ix : group.cluster_indices)
-                            {
-                                const auto& cluster = submesh.clusters[ix];
-                                _mesh_clusters.emplace_back(convert_mesh_cluster(cluster, vertex_offset, triangle_offset));
+                    // VirtualMesh 中已经按 group 顺序展开, 只需要加上之前各个 mesh 的偏移.
+                    _pass_constant.group_count += static_cast<uint32_t>(virtual_mesh->_cluster_group_gpus.size());
 
-                                vertex_offset += static_cast<uint32_t>(cluster.vertices.size());
-                                triangle_offset += static_cast<uint32_t>(cluster.indices.size() / 3);
-                            }
-                            
-                            cluster_index_offset += static_cast<uint32_t>(group.cluster_indices.size());
-                        }
-
-                    }  
+                    for (auto group : virtual_mesh->_cluster_group_gpus)
+                    {
+                        group.cluster_index_offset += cluster_index_offset;
+                        _mesh_cluster_groups.emplace_back(group);
+                    }
+                    for (auto cluster : virtual_mesh->_cluster_gpus)
+                    {
+                        cluster.vertex_offset += vertex_offset;
+                        cluster.triangle_offset += triangle_offset;
+                        _mesh_clusters.emplace_back(cluster);
+                    }
+
+                    vertex_offset += static_cast<uint32_t>(virtual_mesh->_cluster_vertices.size());
+                    triangle_offset += static_cast<uint32_t>(virtual_mesh->_cluster_triangles.size());
+                    cluster_index_offset += static_cast<uint32_t>(virtual_mesh->_cluster_gpus.size());
                     return true;
                 }
             ));
@@ -220,9 +218,38 @@ namespace fantasy
             )));
             _compute_state.binding_sets[0] = _binding_set.get();
 
+            if (_cpu_culling) _cpu_culler.set_clusters(_mesh_cluster_groups, _mesh_clusters);
             _resource_writed = true;
         }
 
+        if (_cpu_culling)
+        {
+            _cpu_culler.cull(ClusterCullingView{
+                .view_matrix = _pass_constant.view_matrix,
+                .proj_matrix = _pass_constant.proj_matrix,
+                .client_width = _pass_constant.client_width,
+                .client_height = _pass_constant.client_height,
+                .camera_fov_y = _pass_constant.camera_fov_y
+            });
+
+            const auto& visible_cluster_ids = _cpu_culler.get_visible_cluster_ids();
+            DrawIndirectArguments draw_arguments{
+                .vertex_count = _pass_constant.cluster_size,
+                .instance_count = static_cast<uint32_t>(visible_cluster_ids.size())
+            };
+            ReturnIfFalse(cmdlist->write_buffer(_virtual_gbuffer_indirect_buffer.get(), &draw_arguments, sizeof(DrawIndirectArguments)));
+            if (!visible_cluster_ids.empty())
+            {
+                ReturnIfFalse(cmdlist->write_buffer(
+                    _visible_cluster_id_buffer.get(), 
+                    visible_cluster_ids.data(), 
+                    sizeof(uint32_t) * visible_cluster_ids.size()
+                ));
+            }
+            ReturnIfFalse(cmdlist->close());
+            return true;
+        }
+
 		uint32_t thread_group_num = 
             static_cast<uint32_t>((align(_pass_constant.group_count, THREAD_GROUP_SIZE_X) / THREAD_GROUP_SIZE_X));
 
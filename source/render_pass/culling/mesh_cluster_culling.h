@@ -3,6 +3,7 @@
 
 #include "../../render_graph/render_pass.h"
 #include "../../scene/virtual_mesh.h"
+#include "mesh_cluster_culler.h"
 #include <memory>
 
 namespace fantasy
@@ -16,18 +17,20 @@ namespace fantasy
 
             uint32_t client_width = CLIENT_WIDTH;
             uint32_t client_height = CLIENT_HEIGHT;
-            uint32_t camera_fov_y = 0;
+            float camera_fov_y = 0.0f;
             uint32_t hzb_resolution = 0;
 
             uint32_t group_count = 0;
 			uint32_t cluster_size = MeshCluster::cluster_size;
+			float near_z = 0.0f;
 		};
 	}
 
 	class MeshClusterCullingPass : public RenderPassInterface
 	{
 	public:
-		MeshClusterCullingPass() { type = RenderPassType::Compute; }
+		// cpu_culling 为 true 时由 MeshClusterCuller 在 CPU 上剔除并上传结果, 不做遮挡剔除.
+		explicit MeshClusterCullingPass(bool cpu_culling = false) : _cpu_culling(cpu_culling) { type = RenderPassType::Compute; }
 
 		bool compile(DeviceInterface* device, RenderResourceCache* cache) override;
 		bool execute(CommandListInterface* cmdlist, RenderResourceCache* cache) override;
@@ -35,11 +38,13 @@ namespace fantasy
 
 	private:
 		bool _resource_writed = false;
+		bool _cpu_culling = false;
         uint32_t _hzb_resolution = 1024u;
 		constant::MeshClusterCullingPassConstant _pass_constant;
 
         std::vector<MeshClusterGroupGpu> _mesh_cluster_groups;
         std::vector<MeshClusterGpu> _mesh_clusters;
+		MeshClusterCuller _cpu_culler;
 
 		std::shared_ptr<BufferInterface> _mesh_cluster_group_buffer;
 		std::shared_ptr<BufferInterface> _mesh_cluster_buffer;
@@ -3,9 +3,10 @@
 #include "../../core/parallel/parallel.h"
 #include "../../core/tools/check_cast.h"
 #include "../../scene/virtual_mesh.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <memory>
-#include <mutex>
 
 namespace fantasy
 {
@@ -75,14 +76,14 @@ namespace fantasy
 				TextureDesc::create_render_target(
 					CLIENT_WIDTH,
 					CLIENT_HEIGHT,
-					Format::RG32_UINT,
+					Format::RGBA32_UINT,
 					"vt_indirect_texture"
 				)
 			)));
 
 			uint32_t slice_num = physical_texture_resolution / physical_texture_slice_size;
 			slice_num *= slice_num;
-			_vt_physical_textures.resize(slice_num);
+			_vt_physical_textures.resize(slice_num * Material::TextureType_Num);
 
 			for (uint32_t ix = 0; ix < Material::TextureType_Num; ++ix)
 			{
@@ -90,10 +91,11 @@ namespace fantasy
 				{
 					uint32_t index = ix * slice_num + jx;
 					ReturnIfFalse(_vt_physical_textures[index] = std::shared_ptr<TextureInterface>(device->create_texture(
-						TextureDesc::create_render_target(
-							CLIENT_WIDTH,
-							CLIENT_HEIGHT,
-							Format::RGBA32_FLOAT,
+						TextureDesc::create_shader_resource(
+							physical_texture_slice_size,
+							physical_texture_slice_size,
+							Format::RGBA8_UNORM,
+							true,
 							VTPhysicalTable::get_slice_name(ix, jx)
 						)
 					)));
@@ -101,6 +103,17 @@ namespace fantasy
 				
 			}
 
+			// 一帧最多上传的 page 按行排列, 每种贴图占一列.
+			ReturnIfFalse(_vt_upload_texture = std::unique_ptr<StagingTextureInterface>(device->create_staging_texture(
+				TextureDesc::create_read_back(
+					page_size * Material::TextureType_Num,
+					page_size * vt_max_upload_page_num,
+					Format::RGBA8_UNORM,
+					"vt_upload_texture"
+				),
+				CpuAccessMode::Write
+			)));
+
 			ReturnIfFalse(_world_position_view_depth_texture = std::shared_ptr<TextureInterface>(device->create_texture(
 				TextureDesc::create_render_target(
 					CLIENT_WIDTH,
@@ -235,29 +248,10 @@ namespace fantasy
 			bool res = cache->get_world()->each<VirtualMesh, Mesh, Material>(
                 [&](Entity* entity, VirtualMesh* virtual_mesh, Mesh* mesh, Material* material) -> bool
                 {
-                    for (const auto& submesh : virtual_mesh->_submeshes)
-                    {
-                        for (const auto& group : submesh.cluster_groups)
-                        {
-                            for (auto ix : group.cluster_indices)
-                            {
-                                const auto& cluster = submesh.clusters[ix];
-								_cluster_vertices.insert(_cluster_vertices.end(), cluster.vertices.begin(), cluster.vertices.end());
-
-								for(uint32_t ix = 0; ix < cluster.indices.size() / 3; ++ix)
-								{
-									uint32_t i0 = cluster.indices[ix * 3];
-									uint32_t i1 = cluster.indices[ix * 3 + 1];
-									uint32_t i2 = cluster.indices[ix * 3 + 2];
-
-									uint32_t max_index = sizeof(uint8_t);
-									ReturnIfFalse(i0 < max_index && i1 < max_index && i2 < max_index);
-
-									_cluster_triangles.push_back(uint32_t(i0 | (i1 << 8) | (i2 << 16)));
-								}
-                            }
-                        }
-                    }  
+					// 三角形中的索引是 cluster 内的局部索引, 不需要随 mesh 偏移.
+					_cluster_vertices.insert(_cluster_vertices.end(), virtual_mesh->_cluster_vertices.begin(), virtual_mesh->_cluster_vertices.end());
+					_cluster_triangles.insert(_cluster_triangles.end(), virtual_mesh->_cluster_triangles.begin(), virtual_mesh->_cluster_triangles.end());
+
 					for (const auto& submesh : mesh->submeshes)
 					{
 						const auto& submaterial = material->submaterials[submesh.material_index];
@@ -310,8 +304,8 @@ namespace fantasy
 			));
 
 			ReturnIfFalse(cmdlist->write_buffer(_cluster_vertex_buffer.get(), _cluster_vertices.data(), sizeof(Vertex) * _cluster_vertices.size()));
-			ReturnIfFalse(cmdlist->write_buffer(_cluster_triangle_buffer.get(), _cluster_triangles.data(), sizeof(Vertex) * _cluster_vertices.size()));
-			ReturnIfFalse(cmdlist->write_buffer(_geometry_constant_buffer.get(), _geometry_constants.data(), sizeof(Vertex) * _cluster_vertices.size()));
+			ReturnIfFalse(cmdlist->write_buffer(_cluster_triangle_buffer.get(), _cluster_triangles.data(), sizeof(uint32_t) * _cluster_triangles.size()));
+			ReturnIfFalse(cmdlist->write_buffer(_geometry_constant_buffer.get(), _geometry_constants.data(), sizeof(GeometryConstantGpu) * _geometry_constants.size()));
 
 			_binding_set.reset();
 			_binding_set_items[1] = BindingSetItem::create_structured_buffer_srv(0, _geometry_constant_buffer);
@@ -349,119 +343,152 @@ namespace fantasy
 
 		VTPageInfo* data = static_cast<VTPageInfo*>(_vt_page_info_buffer->map(CpuAccessMode::Read, fence_event));
 		
-		struct TextureCopyInfo
+		// 以 mesh_id 索引的贴图分辨率与 page 文件.
+		std::vector<uint32_t> mesh_texture_resolutions;
+		std::vector<const VTPageFile*> mesh_page_files;
+		ReturnIfFalse(world->each<Mesh, Material, VTPageFile>(
+			[&](Entity* entity, Mesh* mesh, Material* material, VTPageFile* page_file) -> bool
+			{
+				if (mesh->mesh_id >= mesh_texture_resolutions.size())
+				{
+					mesh_texture_resolutions.resize(mesh->mesh_id + 1, 0);
+					mesh_page_files.resize(mesh->mesh_id + 1, nullptr);
+				}
+				mesh_texture_resolutions[mesh->mesh_id] = material->image_resolution;
+				mesh_page_files[mesh->mesh_id] = page_file->is_valid() ? page_file : nullptr;
+				return true;
+			}
+		));
+		ReturnIfFalse(world->each<MipmapLUT>(
+			[&](Entity* entity, MipmapLUT* mipmap_lut) -> bool
+			{
+				_vt_feedback_resolver.set_mipmap_lut(mipmap_lut);
+				return true;
+			}
+		));
+
+		_vt_feedback_resolver.resolve(
+			std::span<const VTPageInfo>(data, CLIENT_WIDTH * CLIENT_HEIGHT), 
+			CLIENT_WIDTH, 
+			CLIENT_HEIGHT, 
+			mesh_texture_resolutions, 
+			&_vt_pixel_requests
+		);
+
+		// 没有 page 文件或 submaterial 没有贴图的请求在调度前去掉, 调度器不会为它们占用 tile.
+		const auto& requests = _vt_feedback_resolver.get_requests();
+		_vt_streaming_requests.clear();
+		_vt_streaming_request_indices.assign(requests.size(), INVALID_SIZE_32);
+		for (uint32_t ix = 0; ix < requests.size(); ++ix)
 		{
-			uint32_t submesh_id = 0;
-			VTPage* page = nullptr;
-			uint2 page_physical_pos;
-			std::string* model_name = nullptr;
-		};
+			const VTPageFile* page_file = mesh_page_files[requests[ix].geometry_id >> 16];
+			if (page_file == nullptr || !page_file->has_textures(requests[ix].geometry_id)) continue;
 
-		std::mutex info_mutex;
-		std::vector<TextureCopyInfo> copy_infos;
+			_vt_streaming_request_indices[ix] = static_cast<uint32_t>(_vt_streaming_requests.size());
+			_vt_streaming_requests.push_back(requests[ix]);
+		}
 
-		uint32_t page_info_count = CLIENT_WIDTH * CLIENT_HEIGHT;
+		// 只拷贝调度器在本帧预算内选出的 page, 其余请求回退到已加载的更粗一级 mip.
+		_vt_streaming_scheduler.schedule(_vt_streaming_requests);
+
+		const auto& mappings = _vt_streaming_scheduler.get_mappings();
 		parallel::parallel_for(
 			[&](uint64_t x, uint64_t y)
 			{
-				uint32_t offset = static_cast<uint32_t>(x + y * CLIENT_WIDTH);
-				const auto& info = *(data + offset);
+				uint2 pixel_id = uint2(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+				uint32_t request_index = _vt_pixel_requests[x + y * CLIENT_WIDTH];
+				if (request_index != INVALID_SIZE_32) request_index = _vt_streaming_request_indices[request_index];
+				if (request_index == INVALID_SIZE_32 || mappings[request_index].mip_level == INVALID_SIZE_32)
+				{
+					_vt_indirect_table.set_page_null(pixel_id);
+					return;
+				}
 
-				uint2 page_id = uint2(
-					((info.page_id_mip_level >> 12) & 0xf << 8) | (info.page_id_mip_level >> 24) & 0xff,
-					((info.page_id_mip_level >> 8) & 0xf << 8) | (info.page_id_mip_level >> 16) & 0xff
+				// 回退的 page 覆盖 2^delta x 2^delta 个请求 mip 的 page.
+				const auto& mapping = mappings[request_index];
+				const auto& request = _vt_streaming_requests[request_index];
+				uint32_t mip_delta = mapping.mip_level - request.mip_level;
+				uint32_t offset_mask = (1u << mip_delta) - 1;
+				_vt_indirect_table.set_page(
+					pixel_id, 
+					mapping.physical_position, 
+					mip_delta, 
+					uint2(request.page_id.x & offset_mask, request.page_id.y & offset_mask)
 				);
-				uint32_t mip_level = info.page_id_mip_level & 0xff;
-				uint32_t mesh_id = info.geometry_id >> 16;
-				uint32_t submesh_id = info.geometry_id & 0xffff;
-
-
-				bool res = world->each<std::string, Mesh, Material>(
-					[&](Entity* entity, std::string* model_name, Mesh* mesh, Material* material) -> bool
-					{
-						if (mesh->mesh_id == mesh_id)
-						{
-							const auto& submesh = mesh->submeshes[submesh_id];
-							
-							ReturnIfFalse(world->each<MipmapLUT>(
-								[&](Entity* entity, MipmapLUT* mipmap_lut) -> bool
-								{
-									bool found = false;
-									if (mipmap_lut->get_mip0_resolution() == material->image_resolution)
-									{
-										found = true;
-
-										VTPage* page = mipmap_lut->query_page(page_id, mip_level);
-										
-										uint2 page_physical_pos;
-										{
-											std::lock_guard lock(info_mutex);
-
-											VTPage::LoadFlag flag = page->flag;
-											page_physical_pos = _vt_physical_table.add_page(page);
-
-											if (flag == VTPage::LoadFlag::Unload)
-											{
-												copy_infos.emplace_back(TextureCopyInfo{
-													.submesh_id = submesh_id,
-													.page = page,
-													.page_physical_pos = page_physical_pos,
-													.model_name = model_name
-												});
-											}
-										}
-										_vt_indirect_table.set_page(
-											uint2(static_cast<uint32_t>(x), static_cast<uint32_t>(y)), 
-											page_physical_pos
-										);
-									}
-									return found;
-								}
-							));
-						}
-						return true;
-					}
-				);
-				assert(res);
 			}, 
 			CLIENT_WIDTH,
 			CLIENT_HEIGHT
 		);
-
-		for (const auto& info : copy_infos)
+		ReturnIfFalse(cmdlist->write_texture(
+			_vt_indirect_texture.get(), 
+			0, 
+			0, 
+			reinterpret_cast<const uint8_t*>(_vt_indirect_table.get_data()), 
+			sizeof(uint4) * CLIENT_WIDTH
+		));
+
+		// page 直接从 page 文件中读出, 经 upload texture 拷贝到 physical texture, 不需要常驻完整的 GPU 贴图.
+		const auto& uploads = _vt_streaming_scheduler.get_uploads();
+		if (!uploads.empty())
 		{
+			struct TextureCopyInfo
+			{
+				uint32_t physical_texture_index = 0;
+				TextureSlice dst_slice;
+				TextureSlice src_slice;
+			};
+			std::vector<TextureCopyInfo> copy_infos;
+
+			uint64_t row_pitch = 0;
+			uint8_t* upload_data = static_cast<uint8_t*>(_vt_upload_texture->map(TextureSlice{}, CpuAccessMode::Write, fence_event, &row_pitch));
+			if (upload_data == nullptr) return false;
+
 			uint32_t slice_row_num = physical_texture_resolution / physical_texture_slice_size;
-			uint2 slice_id = info.page_physical_pos / physical_texture_slice_size;
-			uint32_t slice_index_offset = slice_id.x + slice_id.y * slice_row_num;
-			
-			for (uint32_t ix = 0; ix < Material::TextureType_Num; ++ix)
+			uint32_t upload_num = std::min(static_cast<uint32_t>(uploads.size()), vt_max_upload_page_num);
+			for (uint32_t ix = 0; ix < upload_num; ++ix)
 			{
-				uint32_t index = ix * slice_row_num * slice_row_num + slice_index_offset;
-				
-				TextureSlice dst_slice = TextureSlice{
-					.x = info.page_physical_pos.x * page_size,
-					.y = info.page_physical_pos.y * page_size,
-					.width = page_size,
-					.height = page_size
-				};
-				TextureSlice src_slice = TextureSlice{
-					.x = info.page->bounds._lower.x,
-					.y = info.page->bounds._lower.y,
-					.width = info.page->bounds.width(),
-					.height = info.page->bounds.height()
-				};
+				const auto& upload = uploads[ix];
+				const VTPageFile* page_file = mesh_page_files[upload.geometry_id >> 16];
+
+				uint2 page_id = uint2(
+					static_cast<uint32_t>(upload.page->bounds._lower.x) / page_size,
+					static_cast<uint32_t>(upload.page->bounds._lower.y) / page_size
+				);
+				uint3 slice_position = get_physical_slice_position(upload.physical_position);
+
+				for (uint32_t jx = 0; jx < Material::TextureType_Num; ++jx)
+				{
+					// submaterial 没有该种贴图时写入 0, tile 中不会留下之前 page 的数据.
+					std::span<const uint8_t> page = page_file->get_page(upload.geometry_id, jx, page_id, upload.page->mip_level);
+
+					uint8_t* dst = upload_data + static_cast<uint64_t>(ix) * page_size * row_pitch + jx * page_size * 4;
+					for (uint32_t row = 0; row < page_size; ++row)
+					{
+						if (page.empty()) std::memset(dst + row * row_pitch, 0, page_size * 4);
+						else std::memcpy(dst + row * row_pitch, page.data() + row * page_size * 4, page_size * 4);
+					}
 
+					copy_infos.emplace_back(TextureCopyInfo{
+						.physical_texture_index = jx * slice_row_num * slice_row_num + slice_position.z,
+						.dst_slice = TextureSlice{
+							.x = slice_position.x * page_size,
+							.y = slice_position.y * page_size,
+							.width = page_size,
+							.height = page_size
+						},
+						.src_slice = TextureSlice{ .x = jx * page_size, .y = ix * page_size, .width = page_size, .height = page_size }
+					});
+				}
+			}
+			_vt_upload_texture->unmap();
+
+			for (const auto& info : copy_infos)
+			{
 				ReturnIfFalse(cmdlist->copy_texture(
-					_vt_physical_textures[index].get(), 
-					dst_slice, 
-					check_cast<TextureInterface>(
-						cache->require(get_geometry_texture_name(
-							info.submesh_id, 
-							ix, 
-							info.page->mip_level, 
-							*info.model_name
-						).c_str())).get(), 
-					src_slice
+					_vt_physical_textures[info.physical_texture_index].get(), 
+					info.dst_slice, 
+					_vt_upload_texture.get(), 
+					info.src_slice
 				));
 			}
 		}
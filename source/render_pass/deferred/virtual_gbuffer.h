@@ -42,6 +42,11 @@ namespace fantasy
 	class VirtualGBufferPass : public RenderPassInterface
 	{
 	public:
+		// 每帧上传的 page 数不超过调度器的预算.
+		static constexpr uint32_t vt_max_upload_page_num = static_cast<uint32_t>(
+			VTStreamingScheduler::default_frame_byte_budget / (VTPageFile::page_byte_size * Material::TextureType_Num)
+		);
+
 		VirtualGBufferPass() { type = RenderPassType::Graphics | RenderPassType::Feedback; }
 
 		bool compile(DeviceInterface* device, RenderResourceCache* cache) override;
@@ -55,7 +60,11 @@ namespace fantasy
 		constant::VirtualGBufferPassConstant _pass_constant;
 
 		VTIndirectTable _vt_indirect_table;
-		VTPhysicalTable _vt_physical_table;
+		VTStreamingScheduler _vt_streaming_scheduler;
+		VTFeedbackResolver _vt_feedback_resolver;
+		std::vector<uint32_t> _vt_pixel_requests;
+		std::vector<VTFeedbackResolver::Request> _vt_streaming_requests;		// 有 page 数据可以上传的请求.
+		std::vector<uint32_t> _vt_streaming_request_indices;				// 以 feedback 请求索引, 不调度的请求为 INVALID_SIZE_32.
 
 		std::vector<Vertex> _cluster_vertices;
 		std::vector<uint32_t> _cluster_triangles;
@@ -69,6 +78,7 @@ namespace fantasy
 
 		std::shared_ptr<TextureInterface> _vt_indirect_texture;
 		std::vector<std::shared_ptr<TextureInterface>> _vt_physical_textures;
+		std::unique_ptr<StagingTextureInterface> _vt_upload_texture;
 
 		std::shared_ptr<TextureInterface> _world_position_view_depth_texture;
 		std::shared_ptr<TextureInterface> _view_space_velocity_texture;
@@ -267,7 +267,7 @@ namespace fantasy
 				mesh_df.sdf_box._upper.y,
 				mesh_df.sdf_box._upper.z
 			);
-			_binary_output->save_binary_data(sdf_data.data(), sdf_data.size() * sizeof(float));
+			_binary_output->save_compressed_data(sdf_data.data(), sdf_data.size() * sizeof(float));
 
 			_read_back_texture.reset();
 			_bvh_node_buffer.reset();
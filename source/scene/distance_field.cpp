@@ -1,5 +1,8 @@
 #include "distance_field.h"
 #include "../core/tools/file.h"
+#include "../core/tools/timer.h"
+#include "../core/parallel/parallel.h"
+#include "../core/math/wide_bvh.h"
 #include "../gui/gui_panel.h"
 #include "scene.h"
 
@@ -12,18 +15,24 @@ namespace fantasy
 		float chunk_size = VOXEL_NUM_PER_CHUNK * voxel_size;
 
 		chunks.resize(chunk_num_per_axis * chunk_num_per_axis * chunk_num_per_axis);
-		std::vector<Bounds3F> boxes(chunk_num_per_axis * chunk_num_per_axis * chunk_num_per_axis);
-		for (uint32_t z = 0; z < chunk_num_per_axis; ++z)
-			for (uint32_t y = 0; y < chunk_num_per_axis; ++y)
-				for (uint32_t x = 0; x < chunk_num_per_axis; ++x)
-				{
-					float3 Lower = {
-						-SCENE_GRID_SIZE * 0.5f + x * chunk_size,
-						-SCENE_GRID_SIZE * 0.5f + y * chunk_size,
-						-SCENE_GRID_SIZE * 0.5f + z * chunk_size
-					};
-					boxes[x + y * chunk_num_per_axis + z * chunk_num_per_axis * chunk_num_per_axis] = Bounds3F(Lower, Lower + chunk_size);
-				}
+		boxes.resize(chunk_num_per_axis * chunk_num_per_axis * chunk_num_per_axis);
+		parallel::parallel_for(
+			parallel::Range3D{ .x = { 0, chunk_num_per_axis }, .y = { 0, chunk_num_per_axis }, .z = { 0, chunk_num_per_axis } },
+			[&](const parallel::Range3D& tile)
+			{
+				for (uint64_t z = tile.z.begin; z < tile.z.end; ++z)
+					for (uint64_t y = tile.y.begin; y < tile.y.end; ++y)
+						for (uint64_t x = tile.x.begin; x < tile.x.end; ++x)
+						{
+							float3 Lower = {
+								-SCENE_GRID_SIZE * 0.5f + x * chunk_size,
+								-SCENE_GRID_SIZE * 0.5f + y * chunk_size,
+								-SCENE_GRID_SIZE * 0.5f + z * chunk_size
+							};
+							boxes[x + y * chunk_num_per_axis + z * chunk_num_per_axis * chunk_num_per_axis] = Bounds3F(Lower, Lower + chunk_size);
+						}
+			}
+		);
 		Bounds3F global_box(float3(-SCENE_GRID_SIZE * 0.5f), float3(SCENE_GRID_SIZE * 0.5f));
 		bvh.build(boxes, global_box);
 	}
@@ -76,19 +85,133 @@ namespace fantasy
 		return ret;
 	}
 
+	bool DistanceField::MeshDistanceField::bake()
+	{
+		// 以 8x8x8 体素的砖块为单位烘焙.
+		constexpr uint32_t brick_size = 8;
+		constexpr uint32_t brick_num_per_axis = SDF_RESOLUTION / brick_size;
+
+		WideBvh wide_bvh;
+		wide_bvh.build(bvh);
+		ReturnIfFalse(!wide_bvh.empty());
+
+		float3 voxel_size = (sdf_box._upper - sdf_box._lower) / static_cast<float>(SDF_RESOLUTION);
+
+		// 避开坐标轴与对角线的方向, 减少射线恰好擦过三角形边或顶点的情况.
+		const float3 sign_ray_directions[3] = {
+			normalize(float3(0.31f, 0.62f, 0.72f)),
+			normalize(float3(-0.71f, 0.23f, 0.66f)),
+			normalize(float3(0.19f, -0.83f, 0.52f))
+		};
+
+		// 射线穿过奇数个三角形时在内部, 三条射线多数表决.
+		auto is_inside = [&](const float3& position)
+		{
+			uint32_t odd_num = 0;
+			for (const auto& direction : sign_ray_directions)
+			{
+				if (wide_bvh.intersect_count(Ray(position, direction)) & 1) odd_num++;
+			}
+			return odd_num >= 2;
+		};
+
+		sdf_data.resize(static_cast<uint64_t>(SDF_RESOLUTION) * SDF_RESOLUTION * SDF_RESOLUTION * sizeof(float));
+		float* distances = reinterpret_cast<float*>(sdf_data.data());
+
+		parallel::parallel_for(
+			parallel::Range3D{ .x = { 0, brick_num_per_axis }, .y = { 0, brick_num_per_axis }, .z = { 0, brick_num_per_axis } },
+			[&](const parallel::Range3D& tile)
+			{
+				for (uint64_t bz = tile.z.begin; bz < tile.z.end; ++bz)
+					for (uint64_t by = tile.y.begin; by < tile.y.end; ++by)
+						for (uint64_t bx = tile.x.begin; bx < tile.x.end; ++bx)
+						{
+							uint3 voxel_begin = uint3(
+								static_cast<uint32_t>(bx * brick_size),
+								static_cast<uint32_t>(by * brick_size),
+								static_cast<uint32_t>(bz * brick_size)
+							);
+							float3 brick_center = sdf_box._lower + (float3(voxel_begin) + brick_size * 0.5f) * voxel_size;
+
+							// 砖块内体素中心到砖块中心的最大距离.
+							float3 half_extent = voxel_size * ((brick_size - 1) * 0.5f);
+							float brick_radius = std::sqrt(dot(half_extent, half_extent));
+
+							WideBvh::ClosestPoint center_point;
+							wide_bvh.closest_point(brick_center, INFINITY, center_point);
+
+							// 以砖块中心为球心, 半径为 center_point.distance 的球内没有三角形, 
+							// 砖块内所有体素中心都在球内, 内外关系相同, 只需判断一次.
+							bool empty_brick = center_point.distance > brick_radius;
+							bool brick_inside = empty_brick && is_inside(brick_center);
+
+							for (uint32_t z = voxel_begin.z; z < voxel_begin.z + brick_size; ++z)
+								for (uint32_t y = voxel_begin.y; y < voxel_begin.y + brick_size; ++y)
+								{
+									float last_distance = INFINITY;
+									for (uint32_t x = voxel_begin.x; x < voxel_begin.x + brick_size; ++x)
+									{
+										float3 position = sdf_box._lower + (float3(x, y, z) + 0.5f) * voxel_size;
+
+										// u(q) <= u(p) + ||p - q||, 取砖块中心与 x 方向上一个体素给出的较小上界.
+										float upper_bound = std::min(
+											center_point.distance + distance(position, brick_center),
+											last_distance + voxel_size.x
+										);
+
+										WideBvh::ClosestPoint point;
+										wide_bvh.closest_point(position, upper_bound * 1.0001f, point);
+										last_distance = point.distance;
+
+										bool inside = empty_brick ? brick_inside : is_inside(position);
+										distances[x + y * SDF_RESOLUTION + z * SDF_RESOLUTION * SDF_RESOLUTION] = inside ? -point.distance : point.distance;
+									}
+								}
+						}
+			},
+			1
+		);
+		return true;
+	}
+
+	bool DistanceField::save(const std::string& path) const
+	{
+		ReturnIfFalse(check_sdf_cache_exist());
+
+		serialization::BinaryOutput output(path);
+		output(SDF_RESOLUTION);
+		for (const auto& mesh_df : mesh_distance_fields)
+		{
+			output(
+				mesh_df.sdf_box._lower.x,
+				mesh_df.sdf_box._lower.y,
+				mesh_df.sdf_box._lower.z,
+				mesh_df.sdf_box._upper.x,
+				mesh_df.sdf_box._upper.y,
+				mesh_df.sdf_box._upper.z
+			);
+			output.save_compressed_data(mesh_df.sdf_data.data(), mesh_df.sdf_data.size());
+		}
+		return true;
+	}
+
 	bool SceneSystem::publish(World* world, const event::OnComponentAssigned<DistanceField>& event)
 	{
 		DistanceField* distance_field = event.component;
 		Mesh* mesh = event.entity->get_component<Mesh>();
 		distance_field->mesh_distance_fields.resize(mesh->submeshes.size());
 
+		std::string sdf_data_path = std::string(PROJ_DIR) + "asset/sdf/" + *event.entity->get_component<std::string>() + ".sdf";
+
 		bool load_from_file = false;
-		if (is_file_exist(_sdf_data_path.c_str()))
+		if (is_file_exist(sdf_data_path.c_str()))
 		{
-			serialization::BinaryInput input(_sdf_data_path);
+			Timer timer;
+			serialization::BinaryInput input(sdf_data_path);
 			uint32_t mesh_sdf_resolution = 0;
 			input(mesh_sdf_resolution);
 			
+			uint64_t data_size = static_cast<uint64_t>(SDF_RESOLUTION) * SDF_RESOLUTION * SDF_RESOLUTION * sizeof(float);
 			if (mesh_sdf_resolution == SDF_RESOLUTION)
 			{
 				for (uint32_t ix = 0; ix < distance_field->mesh_distance_fields.size(); ++ix)
@@ -105,12 +228,20 @@ namespace fantasy
 						mesh_df.sdf_box._upper.z
 					);
 
-					uint64_t data_size = static_cast<uint64_t>(SDF_RESOLUTION) * SDF_RESOLUTION * SDF_RESOLUTION * sizeof(float);
 					mesh_df.sdf_data.resize(data_size);
-					input.load_binary_data(mesh_df.sdf_data.data(), data_size);
+					input.load_compressed_data(mesh_df.sdf_data.data(), data_size);
 				}
-				gui::notify_message(gui::ENotifyType::Info, "Loaded " + _sdf_data_path.substr(_sdf_data_path.find("asset")));
-				load_from_file = true;
+				load_from_file = input.is_valid();
+			}
+
+			if (load_from_file)
+			{
+				LOG_INFO(
+					"Sdf cache load " + std::to_string(timer.peek() * 1000.0f) + " ms, " + 
+					std::to_string(std::filesystem::file_size(sdf_data_path) / 1048576.0f) + " MB on disk, " + 
+					std::to_string(data_size * distance_field->mesh_distance_fields.size() / 1048576.0f) + " MB raw."
+				);
+				gui::notify_message(gui::ENotifyType::Info, "Loaded " + sdf_data_path.substr(sdf_data_path.find("asset")));
 			}
 		}
 
@@ -123,19 +254,37 @@ namespace fantasy
 				const auto& submesh = mesh->submeshes[ix];
 				mesh_df.sdf_texture_name = model_name + "SdfTexture" + std::to_string(ix);
 
-				uint64_t jx = 0;
+				float4x4 normal_matrix = transpose(inverse(submesh.world_matrix));
 				std::vector<Bvh::Vertex> BvhVertices(submesh.indices.size());
-				for (auto VertexIndex : submesh.indices)
-				{
-					BvhVertices[jx++] = {
-						float3(mul(float4(submesh.vertices[VertexIndex].position, 1.0f), submesh.world_matrix)),
-						float3(mul(float4(submesh.vertices[VertexIndex].normal, 1.0f), transpose(inverse(submesh.world_matrix))))
-					};
-				}
+				parallel::parallel_for(
+					parallel::Range{ 0, submesh.indices.size() },
+					[&](const parallel::Range& range)
+					{
+						for (uint64_t jx = range.begin; jx < range.end; ++jx)
+						{
+							uint32_t VertexIndex = submesh.indices[jx];
+							BvhVertices[jx] = {
+								float3(mul(float4(submesh.vertices[VertexIndex].position, 1.0f), submesh.world_matrix)),
+								float3(mul(float4(submesh.vertices[VertexIndex].normal, 1.0f), normal_matrix))
+							};
+						}
+					}
+				);
 
 				mesh_df.bvh.build(BvhVertices, static_cast<uint32_t>(submesh.indices.size() / 3));
 				mesh_df.sdf_box = mesh_df.bvh.global_box;
+
+#ifdef SDF_CPU_BAKE
+				ReturnIfFalse(mesh_df.bake());
+				mesh_df.bvh.clear();
+#endif
 			}
+
+#ifdef SDF_CPU_BAKE
+			// sdf_data 已就绪, SdfGeneratePass 只需上传.
+			ReturnIfFalse(distance_field->save(sdf_data_path));
+			gui::notify_message(gui::ENotifyType::Info, model_name + ".sdf bake finished.");
+#endif
 		}
 
 		SceneGrid* grid = _global_entity->get_component<SceneGrid>();
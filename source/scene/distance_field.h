@@ -36,11 +36,17 @@ namespace fantasy
 			Bvh bvh;
 
 			TransformData get_transformed(const Transform* transform) const;
+
+			// 不依赖 GPU, 用 bvh 在 CPU 上烘焙 sdf_data, 布局与 SdfGeneratePass 回读的结果相同.
+			bool bake();
 		};
 
 		std::vector<MeshDistanceField> mesh_distance_fields;
 
 		bool check_sdf_cache_exist() const { return !mesh_distance_fields.empty() && !mesh_distance_fields[0].sdf_data.empty(); }
+
+		// 写出 .sdf 缓存, 格式与 SceneSystem::publish(OnComponentAssigned<DistanceField>) 读取的一致.
+		bool save(const std::string& path) const;
 	};
 
 	inline const float SCENE_GRID_SIZE = 64.0f;
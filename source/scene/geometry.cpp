@@ -1,7 +1,10 @@
 #include "geometry.h"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
+#include <unordered_map>
 #include <vector>
 
 #include "scene.h"
@@ -14,54 +17,259 @@
 
 #include "../core/parallel/parallel.h"
 #include "../core/tools/file.h"
+#include "../core/tools/hash_table.h"
+#include "../core/tools/timer.h"
 
 
 namespace fantasy
 {
-	static const aiScene* assimp_scene = nullptr;
+	// 把 func 的执行时间计入 stage 的统计.
+	template <typename F>
+	static bool run_stage(ModelImport& model_import, uint32_t stage, F&& func)
+	{
+		uint64_t begin_time = static_cast<uint64_t>(model_import.timer.peek() * 1000000.0f);
+		bool result = func();
+		uint64_t end_time = static_cast<uint64_t>(model_import.timer.peek() * 1000000.0f);
+
+		auto& timing = model_import.stage_timings[stage];
+		timing.task_num.fetch_add(1, std::memory_order_relaxed);
+		timing.cpu_time.fetch_add(end_time - begin_time, std::memory_order_relaxed);
+
+		uint64_t time = timing.begin_time.load(std::memory_order_relaxed);
+		while (begin_time < time && !timing.begin_time.compare_exchange_weak(time, begin_time, std::memory_order_relaxed));
+		time = timing.end_time.load(std::memory_order_relaxed);
+		while (end_time > time && !timing.end_time.compare_exchange_weak(time, end_time, std::memory_order_relaxed));
 
+		return result;
+	}
 
 	bool SceneSystem::publish(World* world, const event::OnModelLoad& event)
 	{
 		std::string proj_dir = PROJ_DIR;
 
+		ModelImport model_import;
+		model_import.entity = event.entity;
+		model_import.model_path = event.model_path;
+		model_import.model_name = remove_file_extension(event.model_path.c_str());
+		model_import.model_directory = proj_dir + event.model_path.substr(0, event.model_path.find_last_of('/') + 1);
+		model_import.surface_cache_path = proj_dir + "asset/SurfaceCache/" + model_import.model_name + ".sc";
+		model_import.virtual_mesh_path = proj_dir + "asset/VirtualMesh/" + model_import.model_name + ".vm";
+		model_import.page_file_path = proj_dir + "asset/VirtualTexture/" + model_import.model_name + ".vt";
+
+		// 组件都是空的, 由下面各阶段的任务直接在组件中填充, 实体在导入完成后才加入 World.
+		event.entity->assign<std::string>(model_import.model_name);
+		Mesh* mesh = event.entity->assign<Mesh>();
+		Material* material = event.entity->assign<Material>();
+		event.entity->assign<Transform>();
+		event.entity->assign<SurfaceCache>();
+		VirtualMesh* virtual_mesh = event.entity->assign<VirtualMesh>();
+		event.entity->assign<VTPageFile>();
+		// event.entity->assign<DistanceField>();
+		uint32_t* finished_task_num = event.entity->assign<uint32_t>(0);
+
+		mesh->mesh_id = _current_mesh_count.fetch_add(1);
+
+		// 解析: 读取文件, 收集 submesh 与贴图, 之后的阶段按这里得到的数量展开为任务.
 		Assimp::Importer assimp_importer;
+		bool parse_result = run_stage(
+			model_import,
+			ModelImport::Stage_Parse,
+			[&]() -> bool
+			{
+				const aiScene* assimp_scene = assimp_importer.ReadFile(
+					proj_dir + event.model_path, 
+					aiProcess_Triangulate | 
+					aiProcess_GenSmoothNormals | 
+					aiProcess_FlipUVs |
+					aiProcess_CalcTangentSpace |
+					aiProcess_ConvertToLeftHanded
+				);
+
+				if(!assimp_scene || assimp_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !assimp_scene->mRootNode)
+				{
+					LOG_ERROR("Failed to load model.");
+					LOG_ERROR(assimp_importer.GetErrorString());
+					return false;
+				}
+				model_import.assimp_scene = assimp_scene;
+
+				std::function<void(aiNode*, const float4x4&)> func;
+				func = [&](aiNode* node, const float4x4& parent_matrix) -> void
+				{
+					const auto& m = node->mTransformation;
+					float4x4 world_matrix = mul(
+						parent_matrix, 
+						float4x4(
+							m.a1, m.a2, m.a3, m.a4, 
+							m.b1, m.b2, m.b3, m.b4, 
+							m.c1, m.c2, m.c3, m.c4, 
+							m.d1, m.d2, m.d3, m.d4
+						)
+					);
+
+					for (uint32_t ix = 0; ix < node->mNumMeshes; ++ix)
+					{
+						model_import.assimp_meshes.emplace_back(assimp_scene->mMeshes[node->mMeshes[ix]]);
+						model_import.world_matrixs.push_back(world_matrix);
+					}
+
+					for(uint32_t ix = 0; ix < node->mNumChildren; ix++)
+					{
+						func(node->mChildren[ix], world_matrix);
+					}
+				};
+				func(assimp_scene->mRootNode, mesh->world_matrix);
+
+				material->submaterials.resize(assimp_scene->mNumMaterials);
+				std::unordered_map<std::string, uint32_t> image_source_indices;
+				for (uint32_t ix = 0; ix < assimp_scene->mNumMaterials; ++ix)
+				{
+					auto& submaterial = material->submaterials[ix];
+					aiMaterial* assimp_material = assimp_scene->mMaterials[ix];
+
+					aiColor4D ai_color;
+					if (assimp_material->Get(AI_MATKEY_BASE_COLOR, ai_color) == AI_SUCCESS) 
+						memcpy(submaterial.base_color_factor, &ai_color, sizeof(float) * 4);
+					if (assimp_material->Get(AI_MATKEY_COLOR_EMISSIVE, ai_color) == AI_SUCCESS) 
+						memcpy(submaterial.emissive_factor, &ai_color, sizeof(float) * 4);
+					
+					float ai_float;
+					if (assimp_material->Get(AI_MATKEY_METALLIC_FACTOR, ai_float) == AI_SUCCESS) 
+						submaterial.metallic_factor = ai_float;
+					if (assimp_material->Get(AI_MATKEY_ROUGHNESS_FACTOR, ai_float) == AI_SUCCESS) 
+						submaterial.roughness_factor = ai_float;
+
+					std::pair<aiTextureType, uint32_t> texture_types[] = {
+						{ aiTextureType_BASE_COLOR, Material::TextureType_BaseColor },
+						{ aiTextureType_NORMAL_CAMERA, Material::TextureType_Normal },
+						{ aiTextureType_METALNESS, Material::TextureType_PBR },
+						{ aiTextureType_EMISSION_COLOR, Material::TextureType_Emissive }
+					};
+					for (const auto& [assimp_texture_type, texture_type] : texture_types)
+					{
+						aiString material_name;
+						if (assimp_material->GetTexture(assimp_texture_type, 0, &material_name) == aiReturn_SUCCESS)
+						{
+							std::string file_path = model_import.model_directory + material_name.C_Str();
+							auto [iter, inserted] = image_source_indices.emplace(file_path, static_cast<uint32_t>(model_import.image_sources.size()));
+							if (inserted) model_import.image_sources.emplace_back().file_path = file_path;
+							model_import.image_sources[iter->second].targets.emplace_back(ix, texture_type);
+						}
+					}
+				}
+				return true;
+			}
+		);
+		if (!parse_result) return false;
 
-        assimp_scene = assimp_importer.ReadFile(
-			proj_dir + event.model_path, 
-			aiProcess_Triangulate | 
-			aiProcess_GenSmoothNormals | 
-			aiProcess_FlipUVs |
-			aiProcess_CalcTangentSpace |
-			aiProcess_ConvertToLeftHanded
+		uint32_t submesh_num = static_cast<uint32_t>(model_import.assimp_meshes.size());
+		mesh->submeshes.resize(submesh_num);
+		model_import.vertex_cache_statistics.resize(submesh_num * 2);
+		virtual_mesh->begin_build(mesh);
+
+		TaskFlow flow;
+
+		// 贴图解码与网格处理互不依赖, 全部贴图解码后检查分辨率.
+		Task material_task = flow.Emplace(
+			[&]() -> bool { return run_stage(model_import, ModelImport::Stage_Image, [&]() { return check_material(model_import); }); }
 		);
+		for (uint32_t ix = 0; ix < model_import.image_sources.size(); ++ix)
+		{
+			Task image_task = flow.Emplace(
+				[&, ix]() -> bool { return run_stage(model_import, ModelImport::Stage_Image, [&]() { return import_image(model_import, ix); }); }
+			);
+			image_task.precede(material_task);
+		}
 
-        if(!assimp_scene || assimp_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !assimp_scene->mRootNode)
-        {
-			LOG_ERROR("Failed to load model.");
-			LOG_ERROR(assimp_importer.GetErrorString());
-			return false;
-        }
+		// surface cache 只依赖 submesh 的数量.
+		flow.Emplace(
+			[&]() -> bool { return run_stage(model_import, ModelImport::Stage_SurfaceCache, [&]() { return prepare_surface_cache(model_import); }); }
+		);
 
-		std::string model_name = remove_file_extension(event.model_path.c_str());
+		// 每个 submesh 处理完即可开始构建它的 virtual mesh, 不需要等待其他 submesh.
+		// 有磁盘缓存时先用完整网格的哈希尝试读取, 读取成功则跳过构建.
+		Task mesh_task = flow.Emplace(
+			[&]() -> bool
+			{
+				VertexCacheStatistics source_statistics;
+				VertexCacheStatistics optimized_statistics;
+				for (uint32_t ix = 0; ix < submesh_num; ++ix)
+				{
+					source_statistics += model_import.vertex_cache_statistics[ix * 2];
+					optimized_statistics += model_import.vertex_cache_statistics[ix * 2 + 1];
+				}
 
-		_model_directory = event.model_path.substr(0, event.model_path.find_last_of('/') + 1);
-		_sdf_data_path = proj_dir + "asset/sdf/" + model_name + ".sdf";
-		_surface_cache_path = proj_dir + "asset/SurfaceCache/" + model_name + ".sc";
+				LOG_INFO(
+					"Mesh import " + std::to_string(submesh_num) + " submeshes, vertices " + 
+					std::to_string(model_import.source_vertex_num.load()) + " -> " + std::to_string(model_import.welded_vertex_num.load()) + ", " + 
+					"ACMR " + std::to_string(source_statistics.acmr()) + " -> " + std::to_string(optimized_statistics.acmr()) + ", " + 
+					"ATVR " + std::to_string(source_statistics.atvr()) + " -> " + std::to_string(optimized_statistics.atvr()) + "."
+				);
+				return true;
+			}
+		);
 
-		event.entity->assign<std::string>(model_name);
-		event.entity->assign<Mesh>();
-		event.entity->assign<Material>();
-		event.entity->assign<Transform>();
-		event.entity->assign<SurfaceCache>();
-		event.entity->assign<VirtualMesh>();
-		// event.entity->assign<DistanceField>();
-		uint32_t* finished_task_num = event.entity->assign<uint32_t>(0);
+		// page 文件的哈希包含贴图与 submesh 的材质索引, 需要等待两者都完成.
+		Task page_file_task = flow.Emplace(
+			[&]() -> bool { return run_stage(model_import, ModelImport::Stage_PageFile, [&]() { return prepare_page_file(model_import); }); }
+		);
+		page_file_task.succeed(material_task, mesh_task);
 
-		_sdf_data_path.clear();
-		_model_directory.clear();
+		bool virtual_mesh_cache_exist = is_file_exist(model_import.virtual_mesh_path.c_str());
+		Task virtual_mesh_load_task;
+		if (virtual_mesh_cache_exist)
+		{
+			virtual_mesh_load_task = flow.Emplace(
+				[&]() -> bool { return run_stage(model_import, ModelImport::Stage_VirtualMesh, [&]() { return load_virtual_mesh(model_import); }); }
+			);
+			mesh_task.precede(virtual_mesh_load_task);
+		}
+
+		Task virtual_mesh_save_task = flow.Emplace(
+			[&]() -> bool
+			{
+				if (model_import.virtual_mesh_loaded) return true;
+				return run_stage(model_import, ModelImport::Stage_VirtualMesh, [&]() { return save_virtual_mesh(model_import); });
+			}
+		);
 
-		_loaded_model_names.insert(event.model_path);
+		for (uint32_t ix = 0; ix < submesh_num; ++ix)
+		{
+			Task submesh_task = flow.Emplace(
+				[&, ix]() -> bool { return run_stage(model_import, ModelImport::Stage_Mesh, [&]() { return import_submesh(model_import, ix); }); }
+			);
+			Task virtual_submesh_task = flow.Emplace(
+				[&, ix]() -> bool
+				{
+					if (model_import.virtual_mesh_loaded) return true;
+					return run_stage(model_import, ModelImport::Stage_VirtualMesh, [&]() { return virtual_mesh->build(mesh, ix); });
+				}
+			);
+
+			submesh_task.precede(mesh_task, virtual_submesh_task);
+			if (virtual_mesh_cache_exist) virtual_submesh_task.succeed(virtual_mesh_load_task);
+			virtual_submesh_task.precede(virtual_mesh_save_task);
+		}
+
+		if (!parallel::run(flow))
+		{
+			LOG_ERROR("Failed to import " + event.model_path);
+			return false;
+		}
+
+		const char* stage_names[ModelImport::Stage_Num] = { "parse", "mesh", "image", "virtual mesh", "surface cache", "page file" };
+		LOG_INFO("Model import " + event.model_path + " " + std::to_string(model_import.timer.peek() * 1000.0f) + " ms:");
+		for (uint32_t ix = 0; ix < ModelImport::Stage_Num; ++ix)
+		{
+			const auto& timing = model_import.stage_timings[ix];
+			if (timing.task_num == 0) continue;
+
+			LOG_INFO(
+				"    " + std::string(stage_names[ix]) + ": " + std::to_string(timing.task_num.load()) + " tasks, " + 
+				std::to_string(timing.cpu_time.load() / 1000.0f) + " ms cpu time, " + 
+				std::to_string(timing.begin_time.load() / 1000.0f) + " -> " + std::to_string(timing.end_time.load() / 1000.0f) + " ms."
+			);
+		}
 
 		// ReturnIfFalse(_global_entity->get_component<event::GenerateSdf>()->broadcast(event.entity));
 		// ReturnIfFalse(_global_entity->get_component<event::GenerateMipmap>()->broadcast(event.entity));
@@ -70,7 +278,7 @@ namespace fantasy
 		// if (*finished_task_num < 3) std::this_thread::yield();
 		// gui::notify_message(gui::ENotifyType::Info, "Loaded " + event.model_path);
 
-		ReturnIfFalse(_current_mesh_count++ < max_mesh_num);
+		ReturnIfFalse(mesh->mesh_id < max_mesh_num);
 		
 		// Entity* tmp_model_entity = event.entity;
 		// gui::add(
@@ -99,146 +307,387 @@ namespace fantasy
 		return true;
 	}
 
-	bool SceneSystem::publish(World* world, const event::OnComponentAssigned<Mesh>& event)
+	bool SceneSystem::import_submesh(ModelImport& model_import, uint32_t submesh_index)
 	{
-		if (!assimp_scene)
+		const aiMesh* assimp_mesh = model_import.assimp_meshes[submesh_index];
+
+		auto& submesh = model_import.entity->get_component<Mesh>()->submeshes[submesh_index];
+		submesh.world_matrix = model_import.world_matrixs[submesh_index];
+		submesh.material_index = assimp_mesh->mMaterialIndex;
+
+		uint64_t index_num = 0;
+		for(uint32_t jx = 0; jx < assimp_mesh->mNumFaces; jx++)
 		{
-			LOG_ERROR("You should load a model first.");
-			return false;
+			index_num += assimp_mesh->mFaces[jx].mNumIndices;
 		}
+		submesh.indices.reserve(index_num);
 
-		std::vector<float4x4> world_matrixs;
-		std::vector<const aiMesh*> assimp_meshes;
+		for(uint32_t jx = 0; jx < assimp_mesh->mNumFaces; jx++)
+		{
+			const aiFace& face = assimp_mesh->mFaces[jx];
+			submesh.indices.insert(submesh.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+		}
 
-		std::function<void(aiNode *node, const aiScene *scene, const float4x4&)> func;
-		func = [&](aiNode* node, const aiScene* scene, const float4x4& parent_matrix) -> void
+		submesh.vertices.resize(assimp_mesh->mNumVertices);
+		for(uint32_t jx = 0; jx < assimp_mesh->mNumVertices; jx++)
 		{
-			const auto& m = node->mTransformation;
-			float4x4 world_matrix = mul(
-				parent_matrix, 
-				float4x4(
-					m.a1, m.a2, m.a3, m.a4, 
-					m.b1, m.b2, m.b3, m.b4, 
-					m.c1, m.c2, m.c3, m.c4, 
-					m.d1, m.d2, m.d3, m.d4
-				)
-			);
+			Vertex& vertex = submesh.vertices[jx];
+			
+			vertex.position.x = assimp_mesh->mVertices[jx].x;
+			vertex.position.y = assimp_mesh->mVertices[jx].y;
+			vertex.position.z = assimp_mesh->mVertices[jx].z;
 
-			for (uint32_t ix = 0; ix < node->mNumMeshes; ++ix)
+			if (assimp_mesh->HasNormals())
 			{
-				assimp_meshes.emplace_back(assimp_scene->mMeshes[node->mMeshes[ix]]);
-				world_matrixs.push_back(world_matrix);
+				vertex.normal.x = assimp_mesh->mNormals[jx].x;
+				vertex.normal.y = assimp_mesh->mNormals[jx].y;
+				vertex.normal.z = assimp_mesh->mNormals[jx].z;
 			}
 
-			for(uint32_t ix = 0; ix < node->mNumChildren; ix++)
+			if (assimp_mesh->HasTangentsAndBitangents())
 			{
-				func(node->mChildren[ix], scene, world_matrix);
+				vertex.tangent.x = assimp_mesh->mTangents[jx].x;
+				vertex.tangent.y = assimp_mesh->mTangents[jx].y;
+				vertex.tangent.z = assimp_mesh->mTangents[jx].z;
 			}
-		};
 
-		func(assimp_scene->mRootNode, assimp_scene, event.component->world_matrix);
+			if(assimp_mesh->HasTextureCoords(0))
+			{
+				vertex.uv.x = assimp_mesh->mTextureCoords[0][jx].x; 
+				vertex.uv.y = assimp_mesh->mTextureCoords[0][jx].y;
+			}
+		}
 
+		// assimp 对部分格式按面展开顶点, 合并完全相同的顶点, 之后的 virtual mesh 构建与 gbuffer 上传都使用合并后的网格.
+		std::vector<uint32_t> vertex_remap;
+		uint32_t vertex_num = weld_vertices(submesh.vertices, submesh.indices, vertex_remap);
 
-		Mesh* mesh = event.component;
-		mesh->mesh_id = _current_mesh_count;
-		
-		auto& submeshes = mesh->submeshes;
-		submeshes.resize(assimp_meshes.size());
+		// gbuffer 按索引顺序绘制, 重排三角形与顶点以提高 vertex cache 命中率与顶点读取的局部性.
+		std::vector<uint32_t> triangle_order;
+		model_import.vertex_cache_statistics[submesh_index * 2] = analyze_vertex_cache(submesh.indices, vertex_num);
+		optimize_vertex_cache(submesh.indices, vertex_num, triangle_order);
+		vertex_num = optimize_vertex_fetch(submesh.vertices, submesh.indices, vertex_remap);
+		model_import.vertex_cache_statistics[submesh_index * 2 + 1] = analyze_vertex_cache(submesh.indices, vertex_num);
 
+		model_import.source_vertex_num.fetch_add(assimp_mesh->mNumVertices, std::memory_order_relaxed);
+		model_import.welded_vertex_num.fetch_add(vertex_num, std::memory_order_relaxed);
+		return true;
+	}
+
+	uint32_t weld_vertices(
+		std::vector<Vertex>& vertices, 
+		std::vector<uint32_t>& indices, 
+		std::vector<uint32_t>& vertex_remap, 
+		bool position_only, 
+		float quantize_step
+	)
+	{
+		static_assert(sizeof(Vertex) == sizeof(float) * 11);
+
+		uint32_t vertex_num = static_cast<uint32_t>(vertices.size());
+		uint32_t component_num = position_only ? 3 : static_cast<uint32_t>(sizeof(Vertex) / sizeof(float));
+
+		// 每个顶点的比较键: 量化后的整数, 或者把 -0.0 归一化为 0.0 后的浮点位.
+		std::vector<uint32_t> keys(static_cast<uint64_t>(vertex_num) * component_num);
+		std::vector<uint32_t> hashes(vertex_num);
 		parallel::parallel_for(
-			[&](uint64_t ix)
+			parallel::Range{ 0, vertex_num },
+			[&](const parallel::Range& range)
 			{
-				auto& submesh = submeshes[ix];
-				submesh.world_matrix = world_matrixs[ix];
-				submesh.material_index = assimp_meshes[ix]->mMaterialIndex;
-
-				for(uint32_t jx = 0; jx < assimp_meshes[ix]->mNumFaces; jx++)
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
 				{
-					aiFace face = assimp_meshes[ix]->mFaces[jx];
-					for(uint32_t kx = 0; kx < face.mNumIndices; kx++)
+					const float* components = reinterpret_cast<const float*>(&vertices[ix]);
+					uint32_t* key = keys.data() + ix * component_num;
+
+					uint32_t hash = 0;
+					for (uint32_t jx = 0; jx < component_num; ++jx)
 					{
-						submesh.indices.push_back(face.mIndices[kx]);
+						float value = components[jx];
+						if (quantize_step > 0.0f)
+						{
+							key[jx] = static_cast<uint32_t>(static_cast<int32_t>(std::floor(value / quantize_step + 0.5f)));
+						}
+						else
+						{
+							if (value == 0.0f) value = 0.0f;
+							memcpy(key + jx, &value, sizeof(float));
+						}
+						hash = murmur_add(hash, key[jx]);
 					}
+					hashes[ix] = murmur_mix(hash);
 				}
+			},
+			4096
+		);
 
-				for(uint32_t jx = 0; jx < assimp_meshes[ix]->mNumVertices; jx++)
+		// 线性探测的开放寻址表, 槽中存放每组相同顶点中第一个顶点的索引.
+		uint32_t slot_mask = next_power_of_2(std::max(vertex_num * 2, 16u)) - 1;
+		std::vector<uint32_t> slots(slot_mask + 1, INVALID_SIZE_32);
+		std::vector<uint32_t> unique_vertex_indices;
+		unique_vertex_indices.reserve(vertex_num);
+		vertex_remap.resize(vertex_num);
+
+		for (uint32_t ix = 0; ix < vertex_num; ++ix)
+		{
+			const uint32_t* key = keys.data() + static_cast<uint64_t>(ix) * component_num;
+			uint32_t slot = hashes[ix] & slot_mask;
+			while (true)
+			{
+				uint32_t vertex_index = slots[slot];
+				if (vertex_index == INVALID_SIZE_32)
 				{
-					Vertex& vertex = submesh.vertices.emplace_back();
-					
-					vertex.position.x = assimp_meshes[ix]->mVertices[jx].x;
-					vertex.position.y = assimp_meshes[ix]->mVertices[jx].y;
-					vertex.position.z = assimp_meshes[ix]->mVertices[jx].z;
+					slots[slot] = ix;
+					vertex_remap[ix] = static_cast<uint32_t>(unique_vertex_indices.size());
+					unique_vertex_indices.push_back(ix);
+					break;
+				}
+				if (
+					hashes[vertex_index] == hashes[ix] && 
+					memcmp(keys.data() + static_cast<uint64_t>(vertex_index) * component_num, key, component_num * sizeof(uint32_t)) == 0
+				)
+				{
+					vertex_remap[ix] = vertex_remap[vertex_index];
+					break;
+				}
+				slot = (slot + 1) & slot_mask;
+			}
+		}
 
-					if (assimp_meshes[ix]->HasNormals())
-					{
-						vertex.normal.x = assimp_meshes[ix]->mNormals[jx].x;
-						vertex.normal.y = assimp_meshes[ix]->mNormals[jx].y;
-						vertex.normal.z = assimp_meshes[ix]->mNormals[jx].z;
-					}
+		uint32_t welded_vertex_num = static_cast<uint32_t>(unique_vertex_indices.size());
+		if (welded_vertex_num == vertex_num) return vertex_num;
+
+		std::vector<Vertex> welded_vertices(welded_vertex_num);
+		for (uint32_t ix = 0; ix < welded_vertex_num; ++ix) welded_vertices[ix] = vertices[unique_vertex_indices[ix]];
+		vertices = std::move(welded_vertices);
+
+		uint64_t index_num = 0;
+		for (uint64_t ix = 0; ix + 2 < indices.size(); ix += 3)
+		{
+			uint32_t i0 = vertex_remap[indices[ix]];
+			uint32_t i1 = vertex_remap[indices[ix + 1]];
+			uint32_t i2 = vertex_remap[indices[ix + 2]];
+			if (i0 == i1 || i1 == i2 || i2 == i0) continue;
+
+			indices[index_num++] = i0;
+			indices[index_num++] = i1;
+			indices[index_num++] = i2;
+		}
+		indices.resize(index_num);
+
+		return welded_vertex_num;
+	}
+
+	VertexCacheStatistics analyze_vertex_cache(std::span<const uint32_t> indices, uint32_t vertex_num, uint32_t cache_size)
+	{
+		VertexCacheStatistics statistics;
+		statistics.triangle_num = indices.size() / 3;
+		statistics.vertex_num = vertex_num;
+
+		// 记录每个顶点进入缓存时的时间戳, 之后又有 cache_size 个顶点进入缓存时被挤出.
+		std::vector<uint32_t> cache_timestamps(vertex_num, 0);
+		uint32_t timestamp = cache_size + 1;
+		for (uint32_t vertex_index : indices)
+		{
+			if (timestamp - cache_timestamps[vertex_index] > cache_size)
+			{
+				cache_timestamps[vertex_index] = timestamp++;
+				statistics.transformed_vertex_num++;
+			}
+		}
+		return statistics;
+	}
+
+	// Forsyth, "Linear-Speed Vertex Cache Optimisation".
+	static constexpr uint32_t vertex_cache_size = 32;
+	static constexpr uint32_t max_valence_score_num = 32;
+
+	struct VertexScoreTable
+	{
+		float cache_scores[vertex_cache_size];
+		float valence_scores[max_valence_score_num];
+
+		VertexScoreTable()
+		{
+			for (uint32_t ix = 0; ix < vertex_cache_size; ++ix)
+			{
+				// 刚使用过的三角形的顶点给固定的分数, 避免总是选择与上一个三角形共边的三角形.
+				cache_scores[ix] = ix < 3 ? 0.75f : std::pow(1.0f - static_cast<float>(ix - 3) / (vertex_cache_size - 3), 1.5f);
+			}
+			for (uint32_t ix = 0; ix < max_valence_score_num; ++ix)
+			{
+				// 剩余三角形越少的顶点分数越高, 尽快用完以免之后再次变换.
+				valence_scores[ix] = ix == 0 ? 0.0f : 2.0f / std::sqrt(static_cast<float>(ix));
+			}
+		}
+
+		float get(uint32_t cache_position, uint32_t live_triangle_num) const
+		{
+			if (live_triangle_num == 0) return -1.0f;
+
+			float score = cache_position < vertex_cache_size ? cache_scores[cache_position] : 0.0f;
+			score += live_triangle_num < max_valence_score_num ? 
+				valence_scores[live_triangle_num] : 2.0f / std::sqrt(static_cast<float>(live_triangle_num));
+			return score;
+		}
+	};
+
+	void optimize_vertex_cache(std::vector<uint32_t>& indices, uint32_t vertex_num, std::vector<uint32_t>& triangle_order)
+	{
+		static const VertexScoreTable score_table;
+
+		uint32_t triangle_num = static_cast<uint32_t>(indices.size() / 3);
+		triangle_order.clear();
+		triangle_order.reserve(triangle_num);
+		if (triangle_num == 0) return;
+
+		// 每个顶点尚未输出的三角形, 前 live_triangle_nums[vertex_index] 个有效.
+		std::vector<uint32_t> vertex_triangle_offsets(vertex_num + 1, 0);
+		for (uint32_t ix = 0; ix < triangle_num * 3; ++ix) vertex_triangle_offsets[indices[ix] + 1]++;
+		for (uint32_t ix = 0; ix < vertex_num; ++ix) vertex_triangle_offsets[ix + 1] += vertex_triangle_offsets[ix];
+
+		std::vector<uint32_t> live_triangle_nums(vertex_num, 0);
+		std::vector<uint32_t> vertex_triangles(triangle_num * 3);
+		for (uint32_t ix = 0; ix < triangle_num * 3; ++ix)
+		{
+			uint32_t vertex_index = indices[ix];
+			vertex_triangles[vertex_triangle_offsets[vertex_index] + live_triangle_nums[vertex_index]++] = ix / 3;
+		}
+
+		std::vector<uint32_t> cache_positions(vertex_num, INVALID_SIZE_32);
+		std::vector<float> vertex_scores(vertex_num);
+		for (uint32_t ix = 0; ix < vertex_num; ++ix) vertex_scores[ix] = score_table.get(INVALID_SIZE_32, live_triangle_nums[ix]);
+
+		std::vector<bool> triangle_emitted(triangle_num, false);
 
-					if (assimp_meshes[ix]->HasTangentsAndBitangents())
+		uint32_t cache[vertex_cache_size + 3];
+		uint32_t new_cache[vertex_cache_size + 3];
+		uint32_t cache_num = 0;
+
+		uint32_t best_triangle = INVALID_SIZE_32;
+		uint32_t input_cursor = 0;
+		while (triangle_order.size() < triangle_num)
+		{
+			// 缓存中的顶点已经没有剩余的三角形, 按输入顺序取下一个.
+			if (best_triangle == INVALID_SIZE_32)
+			{
+				while (triangle_emitted[input_cursor]) input_cursor++;
+				best_triangle = input_cursor;
+			}
+
+			triangle_order.push_back(best_triangle);
+			triangle_emitted[best_triangle] = true;
+
+			const uint32_t* triangle_vertices = indices.data() + best_triangle * 3;
+			uint32_t new_cache_num = 0;
+			for (uint32_t ix = 0; ix < 3; ++ix)
+			{
+				uint32_t vertex_index = triangle_vertices[ix];
+				new_cache[new_cache_num++] = vertex_index;
+
+				uint32_t begin = vertex_triangle_offsets[vertex_index];
+				uint32_t& live_triangle_num = live_triangle_nums[vertex_index];
+				for (uint32_t jx = begin; jx < begin + live_triangle_num; ++jx)
+				{
+					if (vertex_triangles[jx] == best_triangle)
 					{
-						vertex.tangent.x = assimp_meshes[ix]->mTangents[jx].x;
-						vertex.tangent.y = assimp_meshes[ix]->mTangents[jx].y;
-						vertex.tangent.z = assimp_meshes[ix]->mTangents[jx].z;
+						std::swap(vertex_triangles[jx], vertex_triangles[begin + live_triangle_num - 1]);
+						live_triangle_num--;
+						break;
 					}
+				}
+			}
+			for (uint32_t ix = 0; ix < cache_num; ++ix)
+			{
+				uint32_t vertex_index = cache[ix];
+				if (vertex_index != triangle_vertices[0] && vertex_index != triangle_vertices[1] && vertex_index != triangle_vertices[2])
+				{
+					new_cache[new_cache_num++] = vertex_index;
+				}
+			}
+
+			// 超出缓存大小的顶点被挤出, 它们的分数也需要更新.
+			for (uint32_t ix = 0; ix < new_cache_num; ++ix)
+			{
+				uint32_t vertex_index = new_cache[ix];
+				cache_positions[vertex_index] = ix < vertex_cache_size ? ix : INVALID_SIZE_32;
+				vertex_scores[vertex_index] = score_table.get(cache_positions[vertex_index], live_triangle_nums[vertex_index]);
+			}
 
-					if(assimp_meshes[ix]->HasTextureCoords(0))
+			best_triangle = INVALID_SIZE_32;
+			float best_score = 0.0f;
+			for (uint32_t ix = 0; ix < new_cache_num; ++ix)
+			{
+				uint32_t vertex_index = new_cache[ix];
+				uint32_t begin = vertex_triangle_offsets[vertex_index];
+				for (uint32_t jx = begin; jx < begin + live_triangle_nums[vertex_index]; ++jx)
+				{
+					uint32_t triangle_index = vertex_triangles[jx];
+					const uint32_t* vertices = indices.data() + triangle_index * 3;
+					float score = vertex_scores[vertices[0]] + vertex_scores[vertices[1]] + vertex_scores[vertices[2]];
+					if (score > best_score)
 					{
-						vertex.uv.x = assimp_meshes[ix]->mTextureCoords[0][jx].x; 
-						vertex.uv.y = assimp_meshes[ix]->mTextureCoords[0][jx].y;
+						best_score = score;
+						best_triangle = triangle_index;
 					}
 				}
-			},
-			submeshes.size()
-		);
+			}
 
-		return true;
+			cache_num = std::min(new_cache_num, vertex_cache_size);
+			std::copy(new_cache, new_cache + cache_num, cache);
+		}
+
+		std::vector<uint32_t> source_indices = indices;
+		for (uint32_t ix = 0; ix < triangle_num; ++ix)
+		{
+			uint32_t triangle_index = triangle_order[ix];
+			indices[ix * 3] = source_indices[triangle_index * 3];
+			indices[ix * 3 + 1] = source_indices[triangle_index * 3 + 1];
+			indices[ix * 3 + 2] = source_indices[triangle_index * 3 + 2];
+		}
 	}
 
-	bool SceneSystem::publish(World* world, const event::OnComponentAssigned<Material>& event)
+	uint32_t optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& vertex_remap)
 	{
-		std::string file_path = PROJ_DIR + _model_directory;
-		
-		auto& material = event.component;
+		vertex_remap.assign(vertices.size(), INVALID_SIZE_32);
 
-		if (!assimp_scene)
+		std::vector<Vertex> fetch_vertices;
+		fetch_vertices.reserve(vertices.size());
+		for (uint32_t& vertex_index : indices)
 		{
-			LOG_ERROR("You should load a model first.");
-			return false;
+			uint32_t& new_vertex_index = vertex_remap[vertex_index];
+			if (new_vertex_index == INVALID_SIZE_32)
+			{
+				new_vertex_index = static_cast<uint32_t>(fetch_vertices.size());
+				fetch_vertices.push_back(vertices[vertex_index]);
+			}
+			vertex_index = new_vertex_index;
 		}
+		vertices = std::move(fetch_vertices);
 
-		material->submaterials.resize(assimp_scene->mNumMaterials);
-		
-		parallel::parallel_for(
-			[&material, &file_path](uint64_t ix)
-			{
-				auto& submaterial = material->submaterials[ix];
-				aiMaterial* assimp_material = assimp_scene->mMaterials[ix];
-
-				aiColor4D ai_color;
-				if (assimp_material->Get(AI_MATKEY_BASE_COLOR, ai_color) == AI_SUCCESS) 
-					memcpy(submaterial.base_color_factor, &ai_color, sizeof(float) * 4);
-				if (assimp_material->Get(AI_MATKEY_COLOR_EMISSIVE, ai_color) == AI_SUCCESS) 
-					memcpy(submaterial.emissive_factor, &ai_color, sizeof(float) * 4);
-				
-				float ai_float;
-				if (assimp_material->Get(AI_MATKEY_METALLIC_FACTOR, ai_float) == AI_SUCCESS) 
-					submaterial.metallic_factor = ai_float;
-				if (assimp_material->Get(AI_MATKEY_ROUGHNESS_FACTOR, ai_float) == AI_SUCCESS) 
-					submaterial.roughness_factor = ai_float;
-
-				aiString material_name;
-				if (assimp_material->GetTexture(aiTextureType_BASE_COLOR, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_BaseColor] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_NORMAL_CAMERA, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_BaseColor] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_METALNESS, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_PBR] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-				if (assimp_material->GetTexture(aiTextureType_EMISSION_COLOR, 0, &material_name) == aiReturn_SUCCESS)
-					submaterial.images[Material::TextureType_Emissive] = Image::load_image_from_file((file_path + material_name.C_Str()).c_str());
-			},
-			material->submaterials.size()
+		return static_cast<uint32_t>(vertices.size());
+	}
+
+	bool SceneSystem::import_image(ModelImport& model_import, uint32_t image_index)
+	{
+		const auto& image_source = model_import.image_sources[image_index];
+		Material* material = model_import.entity->get_component<Material>();
+
+		Image image = _image_cache.load(image_source.file_path);
+		for (const auto& [submaterial_index, texture_type] : image_source.targets)
+		{
+			material->submaterials[submaterial_index].images[texture_type] = image;
+		}
+		return true;
+	}
+
+	bool SceneSystem::check_material(ModelImport& model_import)
+	{
+		Material* material = model_import.entity->get_component<Material>();
+
+		LOG_INFO(
+			"Material import " + std::to_string(material->submaterials.size()) + " submaterials, " + 
+			std::to_string(model_import.image_sources.size()) + " image files, image cache " + 
+			std::to_string(_image_cache.get_decode_num()) + " decoded / " + std::to_string(_image_cache.get_hit_num()) + " hits."
 		);
 
 		uint2 resolution = uint2(
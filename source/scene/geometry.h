@@ -10,6 +10,7 @@
 #include "image.h"
 #include <basetsd.h>
 #include <cstdint>
+#include <span>
 #include <vector>
 
 
@@ -131,6 +132,49 @@ namespace fantasy
         uint32_t mesh_id = 0;
     };
 
+    // 合并重复顶点并重映射索引, 返回合并后的顶点数, vertex_remap 输出旧顶点到新顶点的映射.
+    // position_only 为 true 时只比较位置, 否则比较所有属性; quantize_step 大于 0 时属性先按该步长量化再比较.
+    // 合并后退化的三角形会被删除, 没有被引用的顶点仍然保留.
+    uint32_t weld_vertices(
+        std::vector<Vertex>& vertices, 
+        std::vector<uint32_t>& indices, 
+        std::vector<uint32_t>& vertex_remap, 
+        bool position_only = false, 
+        float quantize_step = 0.0f
+    );
+
+    // 在 FIFO 顶点缓存上模拟 post-transform vertex cache 的命中情况.
+    struct VertexCacheStatistics
+    {
+        uint64_t triangle_num = 0;
+        uint64_t vertex_num = 0;
+        uint64_t transformed_vertex_num = 0;
+
+        // 平均每个三角形需要变换的顶点数 (ACMR), 下限约为 0.5.
+        float acmr() const { return triangle_num == 0 ? 0.0f : static_cast<float>(transformed_vertex_num) / triangle_num; }
+
+        // 平均每个顶点被变换的次数 (ATVR), 下限为 1.
+        float atvr() const { return vertex_num == 0 ? 0.0f : static_cast<float>(transformed_vertex_num) / vertex_num; }
+
+        VertexCacheStatistics& operator+=(const VertexCacheStatistics& other)
+        {
+            triangle_num += other.triangle_num;
+            vertex_num += other.vertex_num;
+            transformed_vertex_num += other.transformed_vertex_num;
+            return *this;
+        }
+    };
+
+    VertexCacheStatistics analyze_vertex_cache(std::span<const uint32_t> indices, uint32_t vertex_num, uint32_t cache_size = 16);
+
+    // 按 Forsyth 的线性算法重排三角形以提高 vertex cache 命中率, 三角形内顶点的顺序 (绕序) 不变.
+    // triangle_order[新的三角形索引] 为原来的三角形索引.
+    void optimize_vertex_cache(std::vector<uint32_t>& indices, uint32_t vertex_num, std::vector<uint32_t>& triangle_order);
+
+    // 按三角形中首次使用的顺序重排顶点以提高顶点读取的局部性, 没有被引用的顶点会被删除.
+    // 返回重排后的顶点数, vertex_remap 输出旧顶点到新顶点的映射, 被删除的顶点为 INVALID_SIZE_32.
+    uint32_t optimize_vertex_fetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<uint32_t>& vertex_remap);
+
     struct GeometryConstantGpu
     {
         float4x4 world_matrix;
@@ -29,19 +29,93 @@ namespace fantasy
         ret.width = width;
         ret.height = height;
         ret.format = Format::RGBA8_UNORM;
-        ret.data = std::make_shared<uint8_t[]>(ret.size);
 
-        std::vector<uint8_t> tmp(ret.size);
-        for (uint32_t ix = 0; ix < ret.size; ++ix)
+        // 直接接管 stb 分配的内存, 不再拷贝.
+        ret.data = std::shared_ptr<uint8_t[]>(data, [](uint8_t* data) { stbi_image_free(data); });
+        
+        return ret;
+    }
+
+    Image ImageCache::load(const std::string& file_path)
+    {
+        std::error_code error;
+        std::filesystem::path path = std::filesystem::weakly_canonical(file_path, error);
+        if (error) path = file_path;
+        std::filesystem::file_time_type write_time = std::filesystem::last_write_time(path, error);
+
+        std::string key = path.generic_string();
+        std::promise<Image> promise;
+        std::shared_future<Image> decoding;
+        Image cached_image;
+        uint64_t decode_index = 0;
         {
-            tmp[ix] = data[ix];
+            std::lock_guard lock(_mutex);
+            auto iter = _entries.find(key);
+            if (iter != _entries.end() && iter->second.write_time == write_time)
+            {
+                if (iter->second.decoding.valid())
+                {
+                    decoding = iter->second.decoding;
+                }
+                else if (auto data = iter->second.data.lock())
+                {
+                    cached_image = iter->second.image;
+                    cached_image.data = std::move(data);
+                }
+            }
+
+            if (!decoding.valid() && !cached_image.is_valid())
+            {
+                decode_index = ++_next_decode_index;
+                _entries[key] = Entry{ 
+                    .write_time = write_time, 
+                    .decode_index = decode_index, 
+                    .decoding = promise.get_future().share(),
+                    .image = Image{},
+                    .data = std::weak_ptr<uint8_t[]>()
+                };
+            }
         }
 
-        memcpy(ret.data.get(), data, ret.size);
+        if (decoding.valid() || cached_image.is_valid())
+        {
+            _hit_num.fetch_add(1, std::memory_order_relaxed);
+            return decoding.valid() ? decoding.get() : cached_image;
+        }
+        _decode_num.fetch_add(1, std::memory_order_relaxed);
 
-        stbi_image_free(data);
-        
-        return ret;
+        Image image = Image::load_image_from_file(key.c_str());
+        promise.set_value(image);
+
+        {
+            // 期间可能已被 clear() 或更新的解码替换.
+            std::lock_guard lock(_mutex);
+            auto iter = _entries.find(key);
+            if (iter != _entries.end() && iter->second.decode_index == decode_index)
+            {
+                if (!image.is_valid())
+                {
+                    _entries.erase(iter);
+                }
+                else
+                {
+                    Entry& entry = iter->second;
+                    entry.decoding = std::shared_future<Image>();
+                    entry.image = image;
+                    entry.image.data = nullptr;
+                    entry.data = image.data;
+                }
+            }
+        }
+        return image;
+    }
+
+    void ImageCache::clear()
+    {
+        std::lock_guard lock(_mutex);
+        _entries.clear();
+        _decode_num.store(0, std::memory_order_relaxed);
+        _hit_num.store(0, std::memory_order_relaxed);
     }
 }
 
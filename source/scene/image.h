@@ -2,7 +2,13 @@
 #define SCENE_IMAGE_H
 
 #include "../dynamic_rhi/format.h"
+#include <atomic>
+#include <filesystem>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 
 namespace fantasy 
@@ -33,6 +39,36 @@ namespace fantasy
         
         static Image load_image_from_file(const char* file_name);
     };
+
+    // 以规范化路径和修改时间为键的解码缓存, 同一文件只解码一次, 返回的 Image 共享像素数据.
+    // 多个线程同时请求同一文件时由第一个线程解码, 其余线程等待它的结果. 文件被修改后重新解码.
+    // 缓存只持有像素数据的 weak_ptr, 所有使用者都释放后数据随之释放, 下次请求时重新解码. 解码失败的文件不会被缓存.
+    class ImageCache
+    {
+    public:
+        Image load(const std::string& file_path);
+        void clear();
+
+        uint32_t get_decode_num() const { return _decode_num.load(std::memory_order_relaxed); }
+        uint32_t get_hit_num() const { return _hit_num.load(std::memory_order_relaxed); }
+
+    private:
+        struct Entry
+        {
+            std::filesystem::file_time_type write_time;
+            uint64_t decode_index = 0;
+
+            std::shared_future<Image> decoding;     // 解码完成前有效.
+            Image image;                            // 解码完成后的图像信息, 不持有像素数据.
+            std::weak_ptr<uint8_t[]> data;
+        };
+
+        std::mutex _mutex;
+        std::unordered_map<std::string, Entry> _entries;
+        uint64_t _next_decode_index = 0;
+        std::atomic<uint32_t> _decode_num = 0;
+        std::atomic<uint32_t> _hit_num = 0;
+    };
 }
 
 
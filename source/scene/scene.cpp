@@ -15,11 +15,7 @@ namespace fantasy
 		_world = world;
 		_world->subscribe<event::OnModelLoad>(this);
 		_world->subscribe<event::OnModelTransform>(this);
-		_world->subscribe<event::OnComponentAssigned<Mesh>>(this);
-		_world->subscribe<event::OnComponentAssigned<Material>>(this);
-		_world->subscribe<event::OnComponentAssigned<SurfaceCache>>(this);
 		_world->subscribe<event::OnComponentAssigned<DistanceField>>(this);
-		_world->subscribe<event::OnComponentAssigned<VirtualMesh>>(this);
 
 		_global_entity = _world->get_global_entity();
 
@@ -57,11 +53,9 @@ namespace fantasy
 		));
 
 		// Load Model.
+		// 每个模型在各自的线程中导入, 导入过程中可以继续选择其他模型, 各模型的导入任务在线程池中交错执行.
 		{
-			static uint64_t thread_id = INVALID_SIZE_64;
-			static Entity* model_entity = nullptr;
-
-			if (gui::has_file_selected() && model_entity == nullptr)
+			if (gui::has_file_selected())
 			{
 				std::string file_path = gui::get_selected_file_path();
 				std::string model_name = file_path.substr(file_path.find("asset"));
@@ -69,9 +63,11 @@ namespace fantasy
 
 				if (!_loaded_model_names.contains(model_name))
 				{
-					model_entity = _world->create_entity_delay();
-					thread_id = parallel::begin_thread(
-						[this, model_name]() -> bool
+					_loaded_model_names.insert(model_name);
+
+					Entity* model_entity = _world->create_entity_delay();
+					uint64_t thread_id = parallel::begin_thread(
+						[this, model_entity, model_name]() -> bool
 						{
 							return _world->broadcast(event::OnModelLoad{
 								.entity = model_entity,
@@ -79,6 +75,7 @@ namespace fantasy
 							});
 						}
 					);
+					_loading_models.emplace_back(LoadingModel{ model_entity, model_name, thread_id });
 				}
 				else
 				{
@@ -86,13 +83,25 @@ namespace fantasy
 				}
 			}
 
-			if (model_entity && parallel::thread_finished(thread_id) && parallel::thread_success(thread_id))
+			for (auto iter = _loading_models.begin(); iter != _loading_models.end();)
 			{
-				_world->add_delay_entity(model_entity);
-				ReturnIfFalse(_global_entity->get_component<event::ModelLoaded>()->broadcast());
+				if (!parallel::thread_finished(iter->thread_id))
+				{
+					++iter;
+					continue;
+				}
 
-				thread_id = INVALID_SIZE_64;
-				model_entity = nullptr;
+				if (parallel::thread_success(iter->thread_id))
+				{
+					_world->add_delay_entity(iter->entity);
+					ReturnIfFalse(_global_entity->get_component<event::ModelLoaded>()->broadcast());
+				}
+				else
+				{
+					_loaded_model_names.erase(iter->model_path);
+					gui::notify_message(gui::ENotifyType::Error, "Failed to load " + iter->model_path);
+				}
+				iter = _loading_models.erase(iter);
 			}
 		}
 
@@ -5,20 +5,74 @@
 #include "distance_field.h"
 #include "surface_cache.h"
 #include "virtual_mesh.h"
+#include "virtual_texture.h"
+#include "../core/tools/timer.h"
+#include <atomic>
+
+struct aiScene;
+struct aiMesh;
 
 namespace fantasy
 {
 	static const uint32_t max_mesh_num = sizeof(uint16_t);
 
+	// 一次模型导入的状态, 各阶段的任务只读写自己负责的部分, 多个模型可以同时导入.
+	struct ModelImport
+	{
+		enum
+		{
+			Stage_Parse,
+			Stage_Mesh,
+			Stage_Image,
+			Stage_VirtualMesh,
+			Stage_SurfaceCache,
+			Stage_PageFile,
+			Stage_Num
+		};
+
+		struct StageTiming
+		{
+			std::atomic<uint32_t> task_num = 0;
+			std::atomic<uint64_t> cpu_time = 0;				// 微秒, 各任务执行时间之和.
+			std::atomic<uint64_t> begin_time = INVALID_SIZE_64;	// 微秒, 相对导入开始的时间.
+			std::atomic<uint64_t> end_time = 0;
+		};
+
+		// 同一个贴图文件只解码一次, 结果写入所有引用它的 submaterial.
+		struct ImageSource
+		{
+			std::string file_path;
+			std::vector<std::pair<uint32_t, uint32_t>> targets;		// submaterial index, texture type.
+		};
+
+		Entity* entity = nullptr;
+		std::string model_path;
+		std::string model_name;
+		std::string model_directory;
+		std::string surface_cache_path;
+		std::string virtual_mesh_path;
+		std::string page_file_path;
+
+		const aiScene* assimp_scene = nullptr;
+		std::vector<const aiMesh*> assimp_meshes;
+		std::vector<float4x4> world_matrixs;
+		std::vector<ImageSource> image_sources;
+
+		std::vector<VertexCacheStatistics> vertex_cache_statistics;		// 每个 submesh 优化前后各一个.
+		std::atomic<uint64_t> source_vertex_num = 0;
+		std::atomic<uint64_t> welded_vertex_num = 0;
+
+		bool virtual_mesh_loaded = false;
+
+		Timer timer;
+		StageTiming stage_timings[Stage_Num];
+	};
+
 	class SceneSystem :
 		public EntitySystemInterface,
 		public EventSubscriber<event::OnModelLoad>,
 		public EventSubscriber<event::OnModelTransform>,
-		public EventSubscriber<event::OnComponentAssigned<Mesh>>,
-		public EventSubscriber<event::OnComponentAssigned<Material>>,
-		public EventSubscriber<event::OnComponentAssigned<SurfaceCache>>,
-		public EventSubscriber<event::OnComponentAssigned<DistanceField>>,
-		public EventSubscriber<event::OnComponentAssigned<VirtualMesh>>
+		public EventSubscriber<event::OnComponentAssigned<DistanceField>>
 	{
 	public:
 		bool initialize(World* world) override;
@@ -28,19 +82,33 @@ namespace fantasy
 
 		bool publish(World* world, const event::OnModelLoad& event) override;
 		bool publish(World* world, const event::OnModelTransform& event) override;
-		bool publish(World* world, const event::OnComponentAssigned<Mesh>& event) override;
-		bool publish(World* world, const event::OnComponentAssigned<Material>& event) override;
-		bool publish(World* world, const event::OnComponentAssigned<SurfaceCache>& event) override;
 		bool publish(World* world, const event::OnComponentAssigned<DistanceField>& event) override;
-		bool publish(World* world, const event::OnComponentAssigned<VirtualMesh>& event) override;
+
+	private:
+		// 模型导入的各个阶段, 由 publish(OnModelLoad) 组织为 TaskFlow.
+		bool import_submesh(ModelImport& model_import, uint32_t submesh_index);
+		bool import_image(ModelImport& model_import, uint32_t image_index);
+		bool check_material(ModelImport& model_import);
+		bool load_virtual_mesh(ModelImport& model_import);
+		bool save_virtual_mesh(ModelImport& model_import);
+		bool prepare_surface_cache(ModelImport& model_import);
+		bool prepare_page_file(ModelImport& model_import);
 
 	private:
 		World* _world = nullptr;
 		Entity* _global_entity = nullptr;
-		std::string _model_directory;
-		std::string _sdf_data_path;
-		std::string _surface_cache_path;
-		uint32_t _current_mesh_count = 0;
+		std::atomic<uint32_t> _current_mesh_count = 0;
+
+		// 所有模型共用, 不同模型引用的相同贴图也只解码一次.
+		ImageCache _image_cache;
+
+		struct LoadingModel
+		{
+			Entity* entity = nullptr;
+			std::string model_path;
+			uint64_t thread_id = INVALID_SIZE_64;
+		};
+		std::vector<LoadingModel> _loading_models;
 
 		std::unordered_set<std::string> _loaded_model_names;
 	};
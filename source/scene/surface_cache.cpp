@@ -1,21 +1,38 @@
 #include "surface_cache.h"
 #include "../core/tools/file.h"
+#include "../core/tools/timer.h"
 #include "../gui/gui_panel.h"
 #include "scene.h"
 
 namespace fantasy 
 {
+	bool SurfaceCache::save(const std::string& path) const
+	{
+		ReturnIfFalse(check_surface_cache_exist());
 
-	bool SceneSystem::publish(World* world, const event::OnComponentAssigned<SurfaceCache>& event)
+		serialization::BinaryOutput output(path);
+		output(CARD_RESOLUTION, SURFACE_RESOLUTION);
+		for (const auto& mesh_surface_cache : mesh_surface_caches)
+		{
+			for (const auto& surface : mesh_surface_cache.surfaces)
+			{
+				output.save_compressed_data(surface.data.data(), surface.data.size());
+			}
+		}
+		return true;
+	}
+
+	bool SceneSystem::prepare_surface_cache(ModelImport& model_import)
 	{
-		SurfaceCache* surface_cache = event.component;
-		Mesh* mesh = event.entity->get_component<Mesh>();
+		SurfaceCache* surface_cache = model_import.entity->get_component<SurfaceCache>();
+		Mesh* mesh = model_import.entity->get_component<Mesh>();
 		surface_cache->mesh_surface_caches.resize(mesh->submeshes.size());
 
 		bool load_from_file = false;
-		if (is_file_exist(_surface_cache_path.c_str()))
+		if (is_file_exist(model_import.surface_cache_path.c_str()))
 		{
-			serialization::BinaryInput input(_surface_cache_path);
+			Timer timer;
+			serialization::BinaryInput input(model_import.surface_cache_path);
 			uint32_t card_resolution = 0;
 			uint32_t surface_resolution = 0;
 			input(card_resolution);
@@ -32,19 +49,27 @@ namespace fantasy
 					for (uint32_t ix = 0; ix < SurfaceCache::MeshSurfaceCache::SurfaceType::Count; ++ix)
 					{
 						mesh_surface_cache.surfaces[ix].surface_texture_name = 
-							*event.entity->get_component<std::string>() + "SurfaceTexture" + std::to_string(ix);
+							model_import.model_name + "SurfaceTexture" + std::to_string(ix);
 						mesh_surface_cache.surfaces[ix].data.resize(data_size);
-						input.load_binary_data(mesh_surface_cache.surfaces[ix].data.data(), data_size);
+						input.load_compressed_data(mesh_surface_cache.surfaces[ix].data.data(), data_size);
 					}
 				}
-				gui::notify_message(gui::ENotifyType::Info, "Loaded " + _sdf_data_path.substr(_sdf_data_path.find("asset")));
-				load_from_file = true;
+				load_from_file = input.is_valid();
+			}
+
+			if (load_from_file)
+			{
+				LOG_INFO(
+					"Surface cache load " + std::to_string(timer.peek() * 1000.0f) + " ms, " + 
+					std::to_string(std::filesystem::file_size(model_import.surface_cache_path) / 1048576.0f) + " MB on disk."
+				);
+				gui::notify_message(gui::ENotifyType::Info, "Loaded " + model_import.surface_cache_path.substr(model_import.surface_cache_path.find("asset")));
 			}
 		}
 
 		if (!load_from_file)
 		{
-			std::string model_name = *event.entity->get_component<std::string>();
+			const std::string& model_name = model_import.model_name;
 			for (uint32_t ix = 0; ix < surface_cache->mesh_surface_caches.size(); ++ix)
 			{
 				std::string strMeshIndex = std::to_string(ix);
@@ -44,6 +44,8 @@ namespace fantasy
 		std::vector<MeshSurfaceCache> mesh_surface_caches;
 
 		bool check_surface_cache_exist() const { return !mesh_surface_caches.empty() && !mesh_surface_caches[0].surfaces[0].data.empty(); }
+
+		bool save(const std::string& path) const;
 	};
 
 }
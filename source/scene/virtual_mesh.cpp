@@ -1,6 +1,17 @@
 #include "virtual_mesh.h"
 #include "geometry.h"
 #include "scene.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/file.h"
+#include "../core/tools/timer.h"
+#include "../gui/gui_panel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <type_traits>
 
 namespace fantasy
 {
@@ -119,540 +130,1074 @@ namespace fantasy
 		_heap_indices[_heap[index]] = index;
 	}
 
-	MeshOptimizer::MeshOptimizer(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) :
-		_vertices(vertices), 
-		_indices(indices),
-		_vertex_ref_count(vertices.size()),
-		_vertex_table(vertices.size()),
-		_index_table(indices.size()),
-		_flags(indices.size()),
-		_triangle_surfaces(indices.size() / 3.0f),
-		_triangle_removed_array(indices.size() / 3.0f, false)
+	void MeshOptimizer::reset(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
 	{
-		_remain_vertex_num = static_cast<uint32_t>(_vertices.size());
-		_remain_triangle_num = static_cast<uint32_t>(_triangle_surfaces.size());
+		_vertices = &vertices;
+		_indices = &indices;
+		_max_error = 0.0f;
 
-		for (uint32_t ix = 0; ix < _vertices.size(); ++ix)
+		uint32_t vertex_num = static_cast<uint32_t>(vertices.size());
+		uint32_t triangle_num = static_cast<uint32_t>(indices.size() / 3);
+
+		_vertex_flags.assign(vertex_num, 0);
+		_vertex_triangle_num.assign(vertex_num, 0);
+		_triangle_removed.assign(triangle_num, 0);
+		_corner_heads.assign(vertex_num, INVALID_SIZE_32);
+		_corner_nexts.resize(indices.size());
+		_collapse_targets.assign(vertex_num, INVALID_SIZE_32);
+		_vertex_marks.assign(vertex_num, 0);
+		_current_mark = 0;
+
+		// Merge vertices at the same position, _collapse_targets is used as the remap table here.
+		std::vector<uint32_t>& vertex_remap = _collapse_targets;
+		_position_table.resize(vertex_num);
+		for (uint32_t ix = 0; ix < vertex_num; ++ix)
 		{
-			_vertex_table.insert(hash(_vertices[ix].position), ix);
+			const float3& position = vertices[ix].position;
+			uint32_t key = hash(position);
+			for (uint32_t jx : _position_table[key])
+			{
+				if (vertices[jx].position == position)
+				{
+					vertex_remap[ix] = jx;
+					break;
+				}
+			}
+			if (vertex_remap[ix] == INVALID_SIZE_32)
+			{
+				_position_table.insert(key, ix);
+				vertex_remap[ix] = ix;
+			}
 		}
+		for (uint32_t& vertex_index : indices) vertex_index = vertex_remap[vertex_index];
+		std::fill(_collapse_targets.begin(), _collapse_targets.end(), INVALID_SIZE_32);
 
-		uint64_t edge_num = std::min(std::min(_indices.size(), 3 * _vertices.size() - 6), _triangle_surfaces.size() + _vertices.size());
-		_edges.reserve(edge_num);
-		_edges_begin_table.resize(edge_num);
-		_edges_end_table.resize(edge_num);
-
-		for (uint32_t ix = 0; ix < _indices.size(); ++ix)
+		// Remove degenerate and duplicate triangles.
+		_remain_triangle_num = 0;
+		_triangle_table.resize(triangle_num);
+		for (uint32_t ix = 0; ix < triangle_num; ++ix)
 		{
-			_vertex_ref_count[_indices[ix]]++;
-			const auto& vertex = _vertices[_indices[ix]];
-
-			_index_table.insert(hash(vertex.position), ix);
-			
-			Vertex p0 = vertex;
-			Vertex p1 = _vertices[_indices[triangle_index_cycle3(ix)]];
-
-			uint32_t key0 = hash(p0.position);
-			uint32_t key1 = hash(p1.position);
-			if (key0 > key1)
+			uint32_t v0 = indices[ix * 3 + 0];
+			uint32_t v1 = indices[ix * 3 + 1];
+			uint32_t v2 = indices[ix * 3 + 2];
+			if (v0 == v1 || v1 == v2 || v2 == v0)
 			{
-				std::swap(key0, key1);
-				std::swap(p0, p1);
+				_triangle_removed[ix] = 1;
+				continue;
 			}
 
-			bool already_exist = false;
-			for (uint32_t jx : _edges_begin_table[key0])
+			uint32_t min_index = std::min(v0, std::min(v1, v2));
+			uint32_t max_index = std::max(v0, std::max(v1, v2));
+			uint32_t key = murmur_mix(murmur_add(murmur_add(min_index, v0 ^ v1 ^ v2 ^ min_index ^ max_index), max_index));
+
+			bool duplicated = false;
+			for (uint32_t jx : _triangle_table[key])
 			{
-				const auto& edge = _edges[jx];
-				if (edge.first == p0 && edge.second == p1) 
+				if (is_same_triangle(ix, jx))
 				{
-					already_exist = true;
+					duplicated = true;
 					break;
 				}
 			}
-			if (!already_exist)
+			if (duplicated)
+			{
+				_triangle_removed[ix] = 1;
+				continue;
+			}
+			_triangle_table.insert(key, ix);
+			_remain_triangle_num++;
+
+			for (uint32_t jx = ix * 3; jx < ix * 3 + 3; ++jx)
 			{
-				_edges_begin_table.insert(key0, static_cast<uint32_t>(_edges.size()));
-				_edges_end_table.insert(key1, static_cast<uint32_t>(_edges.size()));
-				_edges.emplace_back(std::make_pair(p0, p1));
+				uint32_t vertex_index = indices[jx];
+				_vertex_triangle_num[vertex_index]++;
+				_corner_nexts[jx] = _corner_heads[vertex_index];
+				_corner_heads[vertex_index] = jx;
 			}
 		}
-	}
 
+		_remain_vertex_num = 0;
+		for (uint32_t num : _vertex_triangle_num) if (num > 0) _remain_vertex_num++;
+	}
 
-	bool MeshOptimizer::optimize(uint32_t target_triangle_num)
+	void MeshOptimizer::lock_position(const float3& position)
 	{
-		for (uint32_t ix = 0; ix < _triangle_surfaces.size(); ++ix) fix_triangle(ix);
-
-		if (_remain_triangle_num <= target_triangle_num)
+		for (uint32_t ix : _position_table[hash(position)])
 		{
-			bool ret = compact();
-
-			_vertices.resize(_remain_vertex_num);
-			_indices.resize(_remain_triangle_num * 3);
-
-			return ret;
+			if ((*_vertices)[ix].position == position)
+			{
+				_vertex_flags[ix] |= LockFlag;
+				return;
+			}
 		}
+	}
 
-		_heap.resize(_edges.size());
+	bool MeshOptimizer::optimize(uint32_t target_triangle_num)
+	{
+		std::vector<Vertex>& vertices = *_vertices;
+		std::vector<uint32_t>& indices = *_indices;
+		uint32_t vertex_num = static_cast<uint32_t>(vertices.size());
+
+		if (_remain_triangle_num <= target_triangle_num) return compact();
 
-		uint32_t ix = 0;
-		for (const auto& edge : _edges)
+		// Accumulate the quadric of each vertex only once.
+		_quadrics.assign(vertex_num, Quadric());
+		for (uint32_t ix = 0; ix < _triangle_removed.size(); ++ix)
 		{
-			float error = evaluate(edge.first, edge.second, false);
-			_heap.insert(error, ix++);
+			if (_triangle_removed[ix]) continue;
+
+			const Vertex& p0 = vertices[indices[ix * 3 + 0]];
+			const Vertex& p1 = vertices[indices[ix * 3 + 1]];
+			const Vertex& p2 = vertices[indices[ix * 3 + 2]];
+			float attributes0[attribute_num] = { p0.uv.x, p0.uv.y, p0.normal.x, p0.normal.y, p0.normal.z };
+			float attributes1[attribute_num] = { p1.uv.x, p1.uv.y, p1.normal.x, p1.normal.y, p1.normal.z };
+			float attributes2[attribute_num] = { p2.uv.x, p2.uv.y, p2.normal.x, p2.normal.y, p2.normal.z };
+
+			Quadric quadric(
+				Vector3<double>(p0.position), 
+				Vector3<double>(p1.position), 
+				Vector3<double>(p2.position), 
+				attributes0, 
+				attributes1, 
+				attributes2
+			);
+			for (uint32_t jx = 0; jx < 3; ++jx)
+			{
+				Quadric& vertex_quadric = _quadrics[indices[ix * 3 + jx]];
+				vertex_quadric = merge(vertex_quadric, quadric);
+			}
 		}
 
-		_max_error = 0.0f;
+		_heap.resize(vertex_num);
+		for (uint32_t ix = 0; ix < vertex_num; ++ix) evaluate_vertex(ix);
+
 		while (!_heap.empty())
 		{
-			uint32_t edge_index = _heap.top();
+			uint32_t vertex_index = _heap.top();
 
 			// Excessive error.
-			if (_heap.get_key(edge_index) >= 1e6) break;
+			if (_heap.get_key(vertex_index) >= 1e6) break;
 
 			_heap.pop();
-			
-			const auto& edge = _edges[edge_index];
-			_edges_begin_table.remove(hash(edge.first.position), edge_index);
-			_edges_end_table.remove(hash(edge.second.position), edge_index);
 
-			_max_error = std::max(evaluate(edge.first, edge.second, true), _max_error);
+			uint32_t target_vertex_index = _collapse_targets[vertex_index];
+			if (_vertex_triangle_num[target_vertex_index] == 0)
+			{
+				evaluate_vertex(vertex_index);
+				continue;
+			}
+
+			Vertex merged_vertex;
+			evaluate(vertex_index, target_vertex_index, &merged_vertex);
+			collapse(vertex_index, target_vertex_index, merged_vertex);
 
 			if (_remain_triangle_num <= target_triangle_num) break;
+		}
+
+		return compact();
+	}
 
-			for (uint32_t ix : edge_need_reevaluate_indices)
+	bool MeshOptimizer::compact()
+	{
+		std::vector<Vertex>& vertices = *_vertices;
+		std::vector<uint32_t>& indices = *_indices;
+
+		// _collapse_targets is no longer needed, reuse it as the remap table.
+		std::vector<uint32_t>& vertex_remap = _collapse_targets;
+		uint32_t count = 0;
+		for (uint32_t ix = 0; ix < vertices.size(); ++ix)
+		{
+			if (_vertex_triangle_num[ix] > 0)
 			{
-				const auto& reevaluate_edge = _edges[ix];
-				float error = evaluate(reevaluate_edge.first, reevaluate_edge.second, false);
-				_heap.insert(error, ix);
+				if (ix != count) vertices[count] = vertices[ix];
+				vertex_remap[ix] = count++;
 			}
+		}
+		ReturnIfFalse(count == _remain_vertex_num);
 
-			edge_need_reevaluate_indices.clear();
+		count = 0;
+		for (uint32_t ix = 0; ix < _triangle_removed.size(); ++ix)
+		{
+			if (!_triangle_removed[ix])
+			{
+				for (uint32_t jx = 0; jx < 3; ++jx)
+				{
+					indices[count * 3 + jx] = vertex_remap[indices[ix * 3 + jx]];
+				}
+				count++;
+			}
 		}
+		ReturnIfFalse(count == _remain_triangle_num);
 
-		bool ret = compact();
+		vertices.resize(_remain_vertex_num);
+		indices.resize(_remain_triangle_num * 3);
+		return true;
+	}
 
-		_vertices.resize(_remain_vertex_num);
-		_indices.resize(_remain_triangle_num * 3);
+	void MeshOptimizer::remove_triangle(uint32_t triangle_index)
+	{
+		_triangle_removed[triangle_index] = 1;
+		_remain_triangle_num--;
 
-		return ret;
+		for (uint32_t ix = triangle_index * 3; ix < triangle_index * 3 + 3; ++ix)
+		{
+			uint32_t vertex_index = (*_indices)[ix];
+			if (--_vertex_triangle_num[vertex_index] == 0)
+			{
+				_remain_vertex_num--;
+				if (_heap.is_valid(vertex_index)) _heap.remove(vertex_index);
+			}
+		}
 	}
 
-	void MeshOptimizer::lock_position(const float3& position)
+	bool MeshOptimizer::is_same_triangle(uint32_t triangle_index0, uint32_t triangle_index1)
 	{
-		for (uint32_t ix : _index_table[hash(position)])
+		const uint32_t* indices0 = _indices->data() + triangle_index0 * 3;
+		const uint32_t* indices1 = _indices->data() + triangle_index1 * 3;
+		for (uint32_t ix = 0; ix < 3; ++ix)
 		{
-			if (_vertices[_indices[ix]].position == position)
+			if (
+				indices0[0] == indices1[ix] && 
+				indices0[1] == indices1[(ix + 1) % 3] && 
+				indices0[2] == indices1[(ix + 2) % 3]
+			)
 			{
-				_flags[ix] |= LockFlag;
+				return true;
 			}
 		}
+		return false;
 	}
 
-	void MeshOptimizer::fix_triangle(uint32_t triangle_index)
+	float MeshOptimizer::evaluate(uint32_t vertex_index0, uint32_t vertex_index1, Vertex* merged_vertex)
 	{
-		if (_triangle_removed_array[triangle_index]) return;
+		const Vertex& p0 = (*_vertices)[vertex_index0];
+		const Vertex& p1 = (*_vertices)[vertex_index1];
+		bool lock0 = (_vertex_flags[vertex_index0] & LockFlag) != 0;
+		bool lock1 = (_vertex_flags[vertex_index1] & LockFlag) != 0;
 
-		uint32_t vertex_index0 = _indices[triangle_index * 3 + 0];
-		uint32_t vertex_index1 = _indices[triangle_index * 3 + 1];
-		uint32_t vertex_index2 = _indices[triangle_index * 3 + 2];
+		float error = 0.0f;
 
-		const float3& p0 = _vertices[vertex_index0].position;	
-		const float3& p1 = _vertices[vertex_index1].position;	
-		const float3& p2 = _vertices[vertex_index2].position;
+		// The two triangles sharing the edge are counted twice.
+		uint32_t adjacency_triangle_num = _vertex_triangle_num[vertex_index0] + _vertex_triangle_num[vertex_index1];
+		if (adjacency_triangle_num > 26u) error += 0.5f * (adjacency_triangle_num - 26u);
+		if (lock0 && lock1) error += 1e8;
 
-		bool need_removed = p0 == p1 || p1 == p2 || p2 == p0;
-		if (!need_removed)
+		Quadric quadric = merge(_quadrics[vertex_index0], _quadrics[vertex_index1]);
+		QuadricSurface reduced_quadric = quadric.reduce();
+
+		float3 average_position = (p0.position + p1.position) * 0.5f;
+		float3 position = average_position;
+		if (lock0 && !lock1) position = p0.position;
+		else if (!lock0 && lock1) position = p1.position;
+		else if (
+			!reduced_quadric.optimize(position) ||
+			!(distance(position, p0.position) + distance(position, p1.position) <= 2.0f * distance(p0.position, p1.position))
+		)
 		{
-			for (uint32_t ix = 0; ix < 3; ++ix)
-			{
-				// Remove vertices at the same position.
-				uint32_t& vertex_index = _indices[triangle_index * 3 + ix];
-				const auto& vertex_position = _vertices[vertex_index].position;
-				uint32_t key = hash(vertex_position);
-				for (uint32_t jx : _vertex_table[key])
-				{
-					if (jx == vertex_index)
-					{
-						break;
-					}
-					else if (vertex_position == _vertices[jx].position) 
-					{
-						assert(_vertex_ref_count[vertex_index] > 0);
-						if (--_vertex_ref_count[vertex_index] == 0)
-						{
-							_vertex_table.remove(key, vertex_index);
-							_remain_vertex_num--;
-						}
-						vertex_index = jx;
-						if (vertex_index != INVALID_SIZE_32) _vertex_ref_count[vertex_index]++;
-						break;
-					}
-				}
-			}
-			
-			// Check if the triangle is duplicated.
-			for (uint32_t ix : _index_table[hash(p0)])
-			{
-				if (
-					ix != triangle_index * 3 &&
-					vertex_index0 == _indices[ix] && 
-					vertex_index1 == _indices[triangle_index_cycle3(ix)] && 
-					vertex_index2 == _indices[triangle_index_cycle3(ix, 2)] 
-				)
-				{
-					need_removed = true;
-				}
-			}
+			position = average_position;
 		}
 
-		if (need_removed)
-		{
-			// Remove the whole triangle.
-			_triangle_removed_array.set_true(triangle_index);
-			_remain_triangle_num--;
+		error += static_cast<float>(reduced_quadric.error(position));
 
-			for (uint32_t ix = 0; ix < 3; ++ix)
+		if (merged_vertex)
+		{
+			if (lock0 && !lock1) *merged_vertex = p0;
+			else if (!lock0 && lock1) *merged_vertex = p1;
+			else
 			{
-				uint32_t index_index = triangle_index * 3 + ix;
-				uint32_t& vertex_index = _indices[index_index];
-				const auto& vertex_position = _vertices[vertex_index].position;
-
-				uint32_t key = hash(vertex_position);
-				_index_table.remove(key, index_index);
+				merged_vertex->position = position;
+				merged_vertex->tangent = normalize(p0.tangent + p1.tangent);
 
-				if (vertex_index == INVALID_SIZE_32) continue;
-				assert(_vertex_ref_count[vertex_index] > 0);
-				if (--_vertex_ref_count[vertex_index] == 0)
+				float attributes[attribute_num];
+				float3 normal;
+				if (quadric.get_attributes(position, attributes))
+				{
+					merged_vertex->uv = float2(attributes[0], attributes[1]);
+					normal = float3(attributes[2], attributes[3], attributes[4]);
+				}
+				else 
 				{
-					_vertex_table.remove(key, vertex_index);
-					_remain_vertex_num--;
+					merged_vertex->uv = (p0.uv + p1.uv) * 0.5f;
+					normal = p0.normal + p1.normal;
 				}
-				vertex_index = INVALID_SIZE_32;
+				merged_vertex->normal = dot(normal, normal) > 0.0f ? normalize(normal) : p0.normal;
 			}
 		}
-		else 
-		{
-			_triangle_surfaces[triangle_index] = QuadricSurface(
-				Vector3<double>(p0), 
-				Vector3<double>(p1), 
-				Vector3<double>(p2)
-			);
-		}
+
+		return error;
 	}
 
-	bool MeshOptimizer::compact()
+	void MeshOptimizer::evaluate_vertex(uint32_t vertex_index)
 	{
-		uint32_t count = 0;
-		for (uint32_t ix = 0; ix < _vertices.size(); ++ix)
+		if (_heap.is_valid(vertex_index)) _heap.remove(vertex_index);
+		_collapse_targets[vertex_index] = INVALID_SIZE_32;
+		if (_vertex_triangle_num[vertex_index] == 0) return;
+
+		uint32_t mark = ++_current_mark;
+		_vertex_marks[vertex_index] = mark;
+
+		const std::vector<uint32_t>& indices = *_indices;
+		float min_error = std::numeric_limits<float>::max();
+		for (uint32_t* corner_link = &_corner_heads[vertex_index]; *corner_link != INVALID_SIZE_32;)
 		{
-			if (_vertex_ref_count[ix] > 0)
+			uint32_t corner = *corner_link;
+			if (_triangle_removed[corner / 3])
 			{
-				if (ix != count) _vertices[count] = _vertices[ix];
-				_vertex_ref_count[ix] = count++;
+				*corner_link = _corner_nexts[corner];
+				continue;
 			}
-		}
-		ReturnIfFalse(count == _remain_vertex_num);
+			corner_link = &_corner_nexts[corner];
 
-		count = 0;
-		for (uint32_t ix = 0; ix < _triangle_surfaces.size(); ++ix)
-		{
-			if (!_triangle_removed_array[ix])
+			for (uint32_t ix = 1; ix < 3; ++ix)
 			{
-				for (uint32_t jx = 0; jx < 3; ++jx)
+				uint32_t adjacency_vertex_index = indices[triangle_index_cycle3(corner, ix)];
+				if (_vertex_marks[adjacency_vertex_index] == mark) continue;
+				_vertex_marks[adjacency_vertex_index] = mark;
+
+				float error = evaluate(vertex_index, adjacency_vertex_index, nullptr);
+				if (error < min_error)
 				{
-					_indices[count * 3 + jx] = _vertex_ref_count[_indices[ix * 3 + jx]];
+					min_error = error;
+					_collapse_targets[vertex_index] = adjacency_vertex_index;
 				}
-				count++;
 			}
 		}
-		return count == _remain_triangle_num;
+
+		if (_collapse_targets[vertex_index] != INVALID_SIZE_32) _heap.insert(min_error, vertex_index);
 	}
 
-	float MeshOptimizer::evaluate(const Vertex& p0, const Vertex& p1, bool if_merge)
+	void MeshOptimizer::collapse(uint32_t vertex_index, uint32_t target_vertex_index, const Vertex& merged_vertex)
 	{
-		if (p0 == p1) return 0.0f;
+		std::vector<uint32_t>& indices = *_indices;
 
-		float error = 0.0f;
-
-		std::vector<uint32_t> adjacency_triangle_indices;
-		auto BuildAdjacencyTrianlges = [this, &adjacency_triangle_indices](const float3& vertex_position, bool& lock)
+		// 二次误差或相邻三角形数改变的顶点需要重新计算所有折叠.
+		uint32_t mark = ++_current_mark;
+		_reevaluate_vertex_indices.clear();
+		_update_vertex_indices.clear();
+		auto add_reevaluate_vertex = [&](uint32_t index)
 		{
-			for (uint32_t ix : _index_table[hash(vertex_position)])
+			if (_vertex_marks[index] == mark) return;
+			_vertex_marks[index] = mark;
+			_reevaluate_vertex_indices.push_back(index);
+		};
+		add_reevaluate_vertex(target_vertex_index);
+		_vertex_marks[vertex_index] = mark;
+
+		// Move the triangles of vertex_index to target_vertex_index, triangles containing both become degenerate.
+		_moved_triangle_indices.clear();
+		uint32_t corner = _corner_heads[vertex_index];
+		_corner_heads[vertex_index] = INVALID_SIZE_32;
+		while (corner != INVALID_SIZE_32)
+		{
+			uint32_t next_corner = _corner_nexts[corner];
+			uint32_t triangle_index = corner / 3;
+			if (!_triangle_removed[triangle_index])
 			{
-				if (_vertices[_indices[ix]].position == vertex_position)
+				uint32_t v1 = indices[triangle_index_cycle3(corner, 1)];
+				uint32_t v2 = indices[triangle_index_cycle3(corner, 2)];
+				if (v1 == target_vertex_index || v2 == target_vertex_index)
 				{
-					uint32_t triangle_index = ix / 3;
-					if ((_flags[triangle_index * 3] & AdjacencyFlag) == 0)
-					{
-						_flags[triangle_index * 3] |= AdjacencyFlag;
-						adjacency_triangle_indices.push_back(triangle_index);
-					}
-
-					if (_flags[ix] & LockFlag) lock = true;
+					add_reevaluate_vertex(v1 == target_vertex_index ? v2 : v1);
+					remove_triangle(triangle_index);
+				}
+				else 
+				{
+					indices[corner] = target_vertex_index;
+					_corner_nexts[corner] = _corner_heads[target_vertex_index];
+					_corner_heads[target_vertex_index] = corner;
+					_moved_triangle_indices.push_back(triangle_index);
 				}
 			}
-		};
-
-		bool lock0 = false, lock1 = false;
-		BuildAdjacencyTrianlges(p0.position, lock0);
-		BuildAdjacencyTrianlges(p1.position, lock1);
-
-		if (adjacency_triangle_indices.empty()) return 0.0f;
-		if (adjacency_triangle_indices.size() > 24u) error += 0.5f * (adjacency_triangle_indices.size() - 24u);
-
-		QuadricSurface surface;
-		for (uint32_t ix : adjacency_triangle_indices) surface = merge(surface, _triangle_surfaces[ix]);
+			corner = next_corner;
+		}
 
-		Vertex average_p;
-		average_p.position = (p0.position + p1.position) * 0.5f;
-		average_p.normal = normalize(p0.normal + p1.normal);
-		average_p.tangent = normalize(p0.tangent + p1.tangent);
-		average_p.uv = (p0.uv + p1.uv) * 0.5f;
-		
-		Vertex p = average_p;
-		if (lock0 && lock1) error += 1e8;
-		if (lock0 && !lock1) p = p0;
-		else if (!lock0 && lock1) p = p1;
-		else if (!surface.get_vertex(
-			p.position, p.normal, p.tangent
-		))
+		if (!_moved_triangle_indices.empty())
 		{
-			p = average_p;
+			// All triangles of target_vertex_index may have been degenerate and removed.
+			if (_vertex_triangle_num[target_vertex_index] == 0) _remain_vertex_num++;
+			_vertex_triangle_num[target_vertex_index] += static_cast<uint32_t>(_moved_triangle_indices.size());
+			_vertex_triangle_num[vertex_index] = 0;
+			_remain_vertex_num--;
 		}
-		
-		if (
-			distance(p.position, p0.position) + distance(p.position, p1.position) > 
-			2.0f * distance(p0.position, p1.position)
-		) 
+		if (_heap.is_valid(vertex_index)) _heap.remove(vertex_index);
+
+		// Check if the moved triangles are duplicated.
+		for (uint32_t triangle_index : _moved_triangle_indices)
 		{
-			p = average_p;
-		} 
+			for (uint32_t* corner_link = &_corner_heads[target_vertex_index]; *corner_link != INVALID_SIZE_32;)
+			{
+				uint32_t target_corner = *corner_link;
+				if (_triangle_removed[target_corner / 3])
+				{
+					*corner_link = _corner_nexts[target_corner];
+					continue;
+				}
+				corner_link = &_corner_nexts[target_corner];
 
+				if (target_corner / 3 != triangle_index && is_same_triangle(triangle_index, target_corner / 3))
+				{
+					for (uint32_t ix = 0; ix < 3; ++ix) add_reevaluate_vertex(indices[triangle_index * 3 + ix]);
+					remove_triangle(triangle_index);
+					break;
+				}
+			}
+		}
 
-		error += surface.distance_to_surface(p.position);
+		Quadric& quadric = _quadrics[target_vertex_index];
+		quadric = merge(quadric, _quadrics[vertex_index]);
+		(*_vertices)[target_vertex_index] = merged_vertex;
+		_vertex_flags[target_vertex_index] |= _vertex_flags[vertex_index];
+		_max_error = std::max(_max_error, static_cast<float>(quadric.surface.error(merged_vertex.position)));
 
-		if (if_merge)
+		// 其余相邻顶点只有与 target_vertex_index 的折叠改变, 除非原来的折叠目标就是这两个顶点, 否则只需比较这一条边.
+		// 相邻三角形数只影响惩罚项, 它们的邻居不再更新.
+		for (uint32_t* corner_link = &_corner_heads[target_vertex_index]; *corner_link != INVALID_SIZE_32;)
 		{
-			merge_begin(p0);
-			merge_begin(p1);
+			uint32_t target_corner = *corner_link;
+			if (_triangle_removed[target_corner / 3])
+			{
+				*corner_link = _corner_nexts[target_corner];
+				continue;
+			}
+			corner_link = &_corner_nexts[target_corner];
 
-			for (uint32_t ix : adjacency_triangle_indices)
+			for (uint32_t ix = 1; ix < 3; ++ix)
 			{
-				for (uint32_t jx = 0; jx < 3; ++jx)
+				uint32_t adjacency_vertex_index = indices[triangle_index_cycle3(target_corner, ix)];
+				if (_vertex_marks[adjacency_vertex_index] == mark) continue;
+				_vertex_marks[adjacency_vertex_index] = mark;
+
+				uint32_t collapse_target = _collapse_targets[adjacency_vertex_index];
+				if (collapse_target == vertex_index || collapse_target == target_vertex_index || !_heap.is_valid(adjacency_vertex_index))
 				{
-					uint32_t vertex_index = ix * 3 + jx;
-					Vertex& vertex = _vertices[_indices[vertex_index]];
-					if (vertex == p0 || vertex == p1)
-					{
-						vertex = p;
-						if (lock0 || lock1)
-						{
-							_flags[vertex_index] |= LockFlag;
-						}
-					}
+					_reevaluate_vertex_indices.push_back(adjacency_vertex_index);
+				}
+				else 
+				{
+					_update_vertex_indices.push_back(adjacency_vertex_index);
 				}
 			}
-			for (uint32_t ix : moved_edge_indices)
+		}
+
+		for (uint32_t index : _reevaluate_vertex_indices) evaluate_vertex(index);
+		for (uint32_t index : _update_vertex_indices)
+		{
+			float error = evaluate(index, target_vertex_index, nullptr);
+			if (error < _heap.get_key(index))
 			{
-				auto& edge = _edges[ix];
-				if (edge.first == p0 || edge.first == p1) edge.first = p;
-				if (edge.second == p0 || edge.second == p1) edge.second = p;
+				_heap.remove(index);
+				_heap.insert(error, index);
+				_collapse_targets[index] = target_vertex_index;
 			}
+		}
+	}
 
-			mergen_end();
+	bool VirtualMesh::build(const Mesh* mesh)
+	{
+		Timer timer;
+
+		begin_build(mesh);
 
-			std::vector<uint32_t> adjacency_vertex_indices;
-			adjacency_vertex_indices.reserve((adjacency_triangle_indices.size() * 3));
-			for (uint32_t ix : adjacency_triangle_indices)
+		// submesh 之间互不依赖, 输出写入各自的位置, 结果与串行构建相同.
+		std::atomic<bool> result = true;
+		parallel::parallel_for(
+			parallel::Range{ 0, mesh->submeshes.size() },
+			[&](const parallel::Range& range)
 			{
-				for (uint32_t jx = 0; jx < 3; ++jx)
+				for (uint64_t ix = range.begin; ix < range.end; ++ix)
 				{
-					adjacency_vertex_indices.push_back(_indices[ix * 3 + jx]);
+					if (!build(mesh, static_cast<uint32_t>(ix))) result.store(false, std::memory_order_relaxed);
 				}
-			}
+			},
+			1
+		);
+		ReturnIfFalse(result.load());
+
+		LOG_INFO("Virtual mesh build " + std::to_string(timer.peek() * 1000.0f) + " ms, " + std::to_string(mesh->submeshes.size()) + " submeshes.");
+		return end_build();
+	}
 
-			std::sort(adjacency_vertex_indices.begin(), adjacency_vertex_indices.end());
+	void VirtualMesh::begin_build(const Mesh* mesh)
+	{
+		_build_submesh_offset = static_cast<uint32_t>(_submeshes.size());
+		_submeshes.resize(_build_submesh_offset + mesh->submeshes.size());
+		_build_statistics.clear();
+		_build_statistics.resize(mesh->submeshes.size());
+	}
 
-			// Remove duplicate elements.
-			adjacency_vertex_indices.erase(
-				std::unique(adjacency_vertex_indices.begin(), adjacency_vertex_indices.end()), 
-				adjacency_vertex_indices.end()
+	bool VirtualMesh::build(const Mesh* mesh, uint32_t submesh_index)
+	{
+		return build_submesh(
+			mesh->submeshes[submesh_index],
+			(mesh->mesh_id << 16) + submesh_index,
+			_submeshes[_build_submesh_offset + submesh_index],
+			_build_statistics[submesh_index]
+		);
+	}
+
+	bool VirtualMesh::end_build()
+	{
+		std::vector<LevelStatistics> total_statistics;
+		for (const auto& submesh_statistics : _build_statistics)
+		{
+			if (total_statistics.size() < submesh_statistics.size()) total_statistics.resize(submesh_statistics.size());
+			for (uint32_t ix = 0; ix < submesh_statistics.size(); ++ix)
+			{
+				total_statistics[ix].cluster_group_num += submesh_statistics[ix].cluster_group_num;
+				total_statistics[ix].parent_cluster_num += submesh_statistics[ix].parent_cluster_num;
+				total_statistics[ix].build_time += submesh_statistics[ix].build_time;
+				total_statistics[ix].vertex_cache_before += submesh_statistics[ix].vertex_cache_before;
+				total_statistics[ix].vertex_cache_after += submesh_statistics[ix].vertex_cache_after;
+			}
+		}
+		_build_statistics.clear();
+
+		for (uint32_t ix = 0; ix < total_statistics.size(); ++ix)
+		{
+			LOG_INFO(
+				"    mip level " + std::to_string(ix) + ": " + 
+				std::to_string(total_statistics[ix].cluster_group_num) + " groups -> " + 
+				std::to_string(total_statistics[ix].parent_cluster_num) + " parent clusters, " + 
+				std::to_string(total_statistics[ix].build_time) + " ms cpu time (approx.), cluster ACMR " + 
+				std::to_string(total_statistics[ix].vertex_cache_before.acmr()) + " -> " + 
+				std::to_string(total_statistics[ix].vertex_cache_after.acmr()) + "."
 			);
+		}
+		return flatten();
+	}
 
-			for (uint32_t vertex_index : adjacency_vertex_indices)
+	bool VirtualMesh::flatten()
+	{
+		uint64_t cluster_num = 0;
+		uint64_t group_num = 0;
+		uint64_t vertex_num = 0;
+		uint64_t triangle_num = 0;
+		for (const auto& submesh : _submeshes)
+		{
+			group_num += submesh.cluster_groups.size();
+			for (const auto& group : submesh.cluster_groups)
 			{
-				const auto& vertex = _vertices[vertex_index];
-				uint32_t key = hash(vertex.position);
-				for (uint32_t ix : _edges_begin_table[key])
+				cluster_num += group.cluster_indices.size();
+				for (auto ix : group.cluster_indices)
 				{
-					if (_edges[ix].first == vertex && _heap.is_valid(ix))
-					{
-						_heap.remove(ix);
-						edge_need_reevaluate_indices.push_back(ix);
-					}
+					vertex_num += submesh.clusters[ix].vertices.size();
+					triangle_num += submesh.clusters[ix].indices.size() / 3;
 				}
-				for (uint32_t ix : _edges_end_table[key])
+			}
+		}
+
+		_cluster_gpus.clear(); _cluster_gpus.reserve(cluster_num);
+		_cluster_group_gpus.clear(); _cluster_group_gpus.reserve(group_num);
+		_cluster_vertices.clear(); _cluster_vertices.reserve(vertex_num);
+		_cluster_triangles.clear(); _cluster_triangles.reserve(triangle_num);
+
+		// 与 MeshClusterCullingPass 的遍历顺序相同, 每个 group 的 cluster 连续存放.
+		for (const auto& submesh : _submeshes)
+		{
+			for (const auto& group : submesh.cluster_groups)
+			{
+				_cluster_group_gpus.emplace_back(convert_mesh_cluster_group(group, static_cast<uint32_t>(_cluster_gpus.size())));
+
+				for (auto ix : group.cluster_indices)
 				{
-					if (_edges[ix].second == vertex && _heap.is_valid(ix))
+					const auto& cluster = submesh.clusters[ix];
+					_cluster_gpus.emplace_back(convert_mesh_cluster(
+						cluster, 
+						static_cast<uint32_t>(_cluster_vertices.size()), 
+						static_cast<uint32_t>(_cluster_triangles.size())
+					));
+					_cluster_vertices.insert(_cluster_vertices.end(), cluster.vertices.begin(), cluster.vertices.end());
+
+					for (uint32_t jx = 0; jx < cluster.indices.size() / 3; ++jx)
 					{
-						_heap.remove(ix);
-						edge_need_reevaluate_indices.push_back(ix);
+						uint32_t i0 = cluster.indices[jx * 3];
+						uint32_t i1 = cluster.indices[jx * 3 + 1];
+						uint32_t i2 = cluster.indices[jx * 3 + 2];
+						ReturnIfFalse(i0 < 256 && i1 < 256 && i2 < 256);
+
+						_cluster_triangles.push_back(i0 | (i1 << 8) | (i2 << 16));
 					}
 				}
 			}
-			
-			for (uint32_t triangle_index : adjacency_triangle_indices) fix_triangle(triangle_index);
-		}	
+		}
+		return true;
+	}
 
-		for (uint32_t triangle_index : adjacency_triangle_indices) _flags[triangle_index * 3] &= ~AdjacencyFlag;
 
-		return error;
+	// 缓存文件: 文件头之后是 16 字节对齐的若干段, 每段都是一个 POD 数组.
+	// cluster 与 group 的变长数组放在公共的池中, 记录里只保存偏移与数量, 读取时按段整体拷贝.
+	struct VirtualMeshCacheHeader
+	{
+		static const uint32_t magic_number = 0x434d5646;     // "FVMC"
+		static const uint32_t current_version = 1;
+
+		enum Section : uint32_t
+		{
+			Submeshes,
+			Clusters,
+			ClusterGroups,
+			ClusterVertices,
+			ClusterIndices,
+			ClusterExternalEdges,
+			GroupClusterIndices,
+			GroupExternalEdges,     // 每条边两个 uint32_t: cluster_index, edge_index.
+			ClusterGpus,
+			ClusterGroupGpus,
+			GpuClusterVertices,
+			GpuClusterTriangles,
+			Count
+		};
+
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		uint64_t checksum;          // 文件头之后所有数据的校验和.
+		uint64_t section_offsets[Section::Count];
+		uint64_t section_sizes[Section::Count];
+	};
+
+	struct VirtualSubmeshRecord
+	{
+		uint32_t cluster_offset;
+		uint32_t cluster_num;
+		uint32_t group_offset;
+		uint32_t group_num;
+		uint32_t mip_level_num;
+	};
+
+	struct MeshClusterRecord
+	{
+		Bounds3F bounding_box;
+		Sphere bounding_sphere;
+		Sphere lod_bounding_sphere;
+		float lod_error;
+		uint32_t mip_level;
+		uint32_t group_id;
+		uint32_t geometry_id;
+
+		uint32_t vertex_offset;
+		uint32_t vertex_num;
+		uint32_t index_offset;
+		uint32_t index_num;
+		uint32_t external_edge_offset;
+		uint32_t external_edge_num;
+	};
+
+	struct MeshClusterGroupRecord
+	{
+		Sphere bounding_sphere;
+		Sphere lod_bounding_sphere;
+		float parent_lod_error;
+		uint32_t mip_level;
+
+		uint32_t cluster_index_offset;
+		uint32_t cluster_index_num;
+		uint32_t external_edge_offset;
+		uint32_t external_edge_num;
+	};
+
+	// 向量类型自定义了拷贝赋值, 不是 trivially copyable, 但都是按字节读写的标准布局类型.
+	static_assert(std::is_standard_layout_v<VirtualMeshCacheHeader>);
+	static_assert(std::is_standard_layout_v<MeshClusterRecord>);
+	static_assert(std::is_standard_layout_v<MeshClusterGroupRecord>);
+	static_assert(std::is_standard_layout_v<MeshClusterGpu>);
+	static_assert(std::is_standard_layout_v<MeshClusterGroupGpu>);
+	static_assert(std::is_standard_layout_v<Vertex>);
+
+	template <typename T>
+	static std::span<const uint8_t> get_bytes(const std::vector<T>& data)
+	{
+		return std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size() * sizeof(T));
 	}
 
-	void MeshOptimizer::merge_begin(const Vertex& p)
+	uint64_t VirtualMesh::get_source_hash(const Mesh* mesh)
 	{
-		uint32_t key = hash(p.position);
-		for (uint32_t ix : _vertex_table[key])
+		std::vector<uint32_t> parameters = { 
+			VirtualMeshCacheHeader::current_version, 
+			MeshCluster::cluster_size, 
+			MeshClusterGroup::group_size,
+			static_cast<uint32_t>(mesh->submeshes.size())
+		};
+		uint64_t hash = serialization::get_checksum(get_bytes(parameters));
+		for (const auto& submesh : mesh->submeshes)
 		{
-			if (_vertices[ix] == p)
-			{
-				_vertex_table.remove(key, ix);
-				moved_vertex_indices.push_back(ix);
-			}
+			hash = serialization::get_checksum(get_bytes(submesh.vertices), hash);
+			hash = serialization::get_checksum(get_bytes(submesh.indices), hash);
 		}
-		for (uint32_t ix : _index_table[key])
+		return hash;
+	}
+
+	bool VirtualMesh::save(const std::string& path, uint64_t source_hash) const
+	{
+		std::vector<VirtualSubmeshRecord> submesh_records;
+		std::vector<MeshClusterRecord> cluster_records;
+		std::vector<MeshClusterGroupRecord> group_records;
+		std::vector<Vertex> cluster_vertices;
+		std::vector<uint32_t> cluster_indices;
+		std::vector<uint32_t> cluster_external_edges;
+		std::vector<uint32_t> group_cluster_indices;
+		std::vector<uint32_t> group_external_edges;
+
+		for (const auto& submesh : _submeshes)
 		{
-			if (_vertices[_indices[ix]] == p)
+			submesh_records.emplace_back(VirtualSubmeshRecord{
+				.cluster_offset = static_cast<uint32_t>(cluster_records.size()),
+				.cluster_num = static_cast<uint32_t>(submesh.clusters.size()),
+				.group_offset = static_cast<uint32_t>(group_records.size()),
+				.group_num = static_cast<uint32_t>(submesh.cluster_groups.size()),
+				.mip_level_num = submesh.mip_level_num
+			});
+
+			for (const auto& cluster : submesh.clusters)
 			{
-				_index_table.remove(key, ix);
-				moved_index_indices.push_back(ix);
+				cluster_records.emplace_back(MeshClusterRecord{
+					.bounding_box = cluster.bounding_box,
+					.bounding_sphere = cluster.bounding_sphere,
+					.lod_bounding_sphere = cluster.lod_bounding_sphere,
+					.lod_error = cluster.lod_error,
+					.mip_level = cluster.mip_level,
+					.group_id = cluster.group_id,
+					.geometry_id = cluster.geometry_id,
+					.vertex_offset = static_cast<uint32_t>(cluster_vertices.size()),
+					.vertex_num = static_cast<uint32_t>(cluster.vertices.size()),
+					.index_offset = static_cast<uint32_t>(cluster_indices.size()),
+					.index_num = static_cast<uint32_t>(cluster.indices.size()),
+					.external_edge_offset = static_cast<uint32_t>(cluster_external_edges.size()),
+					.external_edge_num = static_cast<uint32_t>(cluster.external_edges.size())
+				});
+				cluster_vertices.insert(cluster_vertices.end(), cluster.vertices.begin(), cluster.vertices.end());
+				cluster_indices.insert(cluster_indices.end(), cluster.indices.begin(), cluster.indices.end());
+				cluster_external_edges.insert(cluster_external_edges.end(), cluster.external_edges.begin(), cluster.external_edges.end());
 			}
-		}
-		for (uint32_t ix : _edges_begin_table[key])
-		{
-			if (_edges[ix].first == p)
+
+			for (const auto& group : submesh.cluster_groups)
 			{
-				_edges_begin_table.remove(key, ix);
-				_edges_end_table.remove(hash(_edges[ix].second.position), ix);
-				moved_edge_indices.push_back(ix);
+				group_records.emplace_back(MeshClusterGroupRecord{
+					.bounding_sphere = group.bounding_sphere,
+					.lod_bounding_sphere = group.lod_bounding_sphere,
+					.parent_lod_error = group.parent_lod_error,
+					.mip_level = group.mip_level,
+					.cluster_index_offset = static_cast<uint32_t>(group_cluster_indices.size()),
+					.cluster_index_num = static_cast<uint32_t>(group.cluster_indices.size()),
+					.external_edge_offset = static_cast<uint32_t>(group_external_edges.size() / 2),
+					.external_edge_num = static_cast<uint32_t>(group.external_edges.size())
+				});
+				group_cluster_indices.insert(group_cluster_indices.end(), group.cluster_indices.begin(), group.cluster_indices.end());
+				for (const auto& [cluster_index, edge_index] : group.external_edges)
+				{
+					group_external_edges.push_back(cluster_index);
+					group_external_edges.push_back(edge_index);
+				}
 			}
 		}
-		for (uint32_t ix : _edges_end_table[key])
+
+		std::span<const uint8_t> sections[VirtualMeshCacheHeader::Section::Count] = {
+			get_bytes(submesh_records),
+			get_bytes(cluster_records),
+			get_bytes(group_records),
+			get_bytes(cluster_vertices),
+			get_bytes(cluster_indices),
+			get_bytes(cluster_external_edges),
+			get_bytes(group_cluster_indices),
+			get_bytes(group_external_edges),
+			get_bytes(_cluster_gpus),
+			get_bytes(_cluster_group_gpus),
+			get_bytes(_cluster_vertices),
+			get_bytes(_cluster_triangles)
+		};
+
+		auto align = [](uint64_t offset) { return (offset + 15) & ~15ull; };
+
+		VirtualMeshCacheHeader header{};
+		header.magic = VirtualMeshCacheHeader::magic_number;
+		header.version = VirtualMeshCacheHeader::current_version;
+		header.source_hash = source_hash;
+
+		uint64_t file_size = align(sizeof(VirtualMeshCacheHeader));
+		for (uint32_t ix = 0; ix < VirtualMeshCacheHeader::Section::Count; ++ix)
 		{
-			if (_edges[ix].second == p)
-			{
-				_edges_begin_table.remove(hash(_edges[ix].first.position), ix);
-				_edges_end_table.remove(key, ix);
-				moved_edge_indices.push_back(ix);
-			}
+			header.section_offsets[ix] = file_size;
+			header.section_sizes[ix] = sections[ix].size();
+			file_size = align(file_size + sections[ix].size());
+		}
+
+		std::vector<uint8_t> data(file_size, 0);
+		for (uint32_t ix = 0; ix < VirtualMeshCacheHeader::Section::Count; ++ix)
+		{
+			if (!sections[ix].empty()) memcpy(data.data() + header.section_offsets[ix], sections[ix].data(), sections[ix].size());
+		}
+		header.checksum = serialization::get_checksum(std::span<const uint8_t>(data).subspan(sizeof(VirtualMeshCacheHeader)));
+		memcpy(data.data(), &header, sizeof(VirtualMeshCacheHeader));
+
+		std::filesystem::path file_path(path);
+		if (file_path.has_parent_path())
+		{
+			std::error_code error;
+			std::filesystem::create_directories(file_path.parent_path(), error);
 		}
+
+		std::ofstream output(path, std::ios::binary);
+		ReturnIfFalse(output.is_open());
+		output.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		ReturnIfFalse(output.good());
+		return true;
 	}
 
-	void MeshOptimizer::mergen_end()
+	template <typename T>
+	static bool get_section(
+		std::span<const uint8_t> data, 
+		const VirtualMeshCacheHeader& header, 
+		VirtualMeshCacheHeader::Section section, 
+		std::span<const T>& output
+	)
 	{
-		for (uint32_t ix : moved_vertex_indices)
+		uint64_t offset = header.section_offsets[section];
+		uint64_t size = header.section_sizes[section];
+		if (offset % 16 != 0 || offset > data.size() || size > data.size() - offset || size % sizeof(T) != 0) return false;
+
+		// 映射的起始地址按页对齐, 段偏移按 16 字节对齐, 可以直接作为 T 数组访问.
+		output = std::span<const T>(reinterpret_cast<const T*>(data.data() + offset), size / sizeof(T));
+		return true;
+	}
+
+	static bool is_valid_range(uint64_t offset, uint64_t num, uint64_t size)
+	{
+		return offset <= size && num <= size - offset;
+	}
+
+	bool VirtualMesh::load(const std::string& path, uint64_t source_hash, const Mesh* mesh)
+	{
+		MappedFile file;
+		if (!file.open(path)) return false;
+
+		std::span<const uint8_t> data = file.data();
+		if (data.size() < sizeof(VirtualMeshCacheHeader)) return false;
+
+		VirtualMeshCacheHeader header;
+		memcpy(&header, data.data(), sizeof(VirtualMeshCacheHeader));
+		if (
+			header.magic != VirtualMeshCacheHeader::magic_number || 
+			header.version != VirtualMeshCacheHeader::current_version || 
+			header.source_hash != source_hash
+		)
 		{
-			_vertex_table.insert(hash(_vertices[ix].position), ix);
+			return false;
 		}
-		for (uint32_t ix : moved_index_indices)
+		if (serialization::get_checksum(data.subspan(sizeof(VirtualMeshCacheHeader))) != header.checksum)
 		{
-			_index_table.insert(hash(_vertices[_indices[ix]].position), ix);
+			LOG_WARN("Virtual mesh cache " + path + " is corrupted.");
+			return false;
 		}
-		for (uint32_t ix : moved_edge_indices)
+
+		std::span<const VirtualSubmeshRecord> submesh_records;
+		std::span<const MeshClusterRecord> cluster_records;
+		std::span<const MeshClusterGroupRecord> group_records;
+		std::span<const Vertex> cluster_vertices;
+		std::span<const uint32_t> cluster_indices;
+		std::span<const uint32_t> cluster_external_edges;
+		std::span<const uint32_t> group_cluster_indices;
+		std::span<const uint32_t> group_external_edges;
+		std::span<const MeshClusterGpu> cluster_gpus;
+		std::span<const MeshClusterGroupGpu> cluster_group_gpus;
+		std::span<const Vertex> gpu_cluster_vertices;
+		std::span<const uint32_t> gpu_cluster_triangles;
+		if (
+			!get_section(data, header, VirtualMeshCacheHeader::Section::Submeshes, submesh_records) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::Clusters, cluster_records) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterGroups, group_records) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterVertices, cluster_vertices) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterIndices, cluster_indices) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterExternalEdges, cluster_external_edges) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::GroupClusterIndices, group_cluster_indices) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::GroupExternalEdges, group_external_edges) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterGpus, cluster_gpus) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::ClusterGroupGpus, cluster_group_gpus) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::GpuClusterVertices, gpu_cluster_vertices) ||
+			!get_section(data, header, VirtualMeshCacheHeader::Section::GpuClusterTriangles, gpu_cluster_triangles) ||
+			submesh_records.size() != mesh->submeshes.size()
+		)
 		{
-			auto& edge = _edges[ix];
-			
-			uint32_t h0 = hash(edge.first.position);
-			uint32_t h1 = hash(edge.second.position);
-			if (h0 > h1)
-			{
-				std::swap(h0, h1);
-				std::swap(edge.first, edge.second);
-			}
+			return false;
+		}
+
+		// 缓存中的 geometry_id 来自构建时的 mesh_id, 需要替换为当前的 mesh_id.
+		auto get_geometry_id = [&](uint32_t geometry_id) { return (mesh->mesh_id << 16) + (geometry_id & 0xffff); };
 
-			if (edge.first == edge.second)
+		std::vector<VirtualSubmesh> submeshes(submesh_records.size());
+		for (uint32_t ix = 0; ix < submesh_records.size(); ++ix)
+		{
+			const auto& submesh_record = submesh_records[ix];
+			if (
+				!is_valid_range(submesh_record.cluster_offset, submesh_record.cluster_num, cluster_records.size()) ||
+				!is_valid_range(submesh_record.group_offset, submesh_record.group_num, group_records.size())
+			)
 			{
-				_heap.remove(ix);
-				continue;
+				return false;
 			}
 
-			bool alread_exist = false;
-			for (uint32_t ix : _edges_begin_table[h0])
+			auto& submesh = submeshes[ix];
+			submesh.mip_level_num = submesh_record.mip_level_num;
+
+			submesh.clusters.resize(submesh_record.cluster_num);
+			for (uint32_t jx = 0; jx < submesh_record.cluster_num; ++jx)
 			{
-				const auto& edge_copy = _edges[ix];
-				if (edge_copy.first == edge.first && edge_copy.second == edge.second) 
+				const auto& record = cluster_records[submesh_record.cluster_offset + jx];
+				if (
+					!is_valid_range(record.vertex_offset, record.vertex_num, cluster_vertices.size()) ||
+					!is_valid_range(record.index_offset, record.index_num, cluster_indices.size()) ||
+					!is_valid_range(record.external_edge_offset, record.external_edge_num, cluster_external_edges.size())
+				)
 				{
-					alread_exist = true;
-					break;
+					return false;
 				}
+
+				auto& cluster = submesh.clusters[jx];
+				cluster.vertices.assign(
+					cluster_vertices.begin() + record.vertex_offset, 
+					cluster_vertices.begin() + record.vertex_offset + record.vertex_num
+				);
+				cluster.indices.assign(
+					cluster_indices.begin() + record.index_offset, 
+					cluster_indices.begin() + record.index_offset + record.index_num
+				);
+				cluster.external_edges.assign(
+					cluster_external_edges.begin() + record.external_edge_offset, 
+					cluster_external_edges.begin() + record.external_edge_offset + record.external_edge_num
+				);
+				cluster.bounding_box = record.bounding_box;
+				cluster.bounding_sphere = record.bounding_sphere;
+				cluster.lod_bounding_sphere = record.lod_bounding_sphere;
+				cluster.lod_error = record.lod_error;
+				cluster.mip_level = record.mip_level;
+				cluster.group_id = record.group_id;
+				cluster.geometry_id = get_geometry_id(record.geometry_id);
 			}
-			if (!alread_exist)
-			{
-				_edges_begin_table.insert(h0, ix);
-				_edges_end_table.insert(h1, ix);
-			}
-			else 
+
+			submesh.cluster_groups.resize(submesh_record.group_num);
+			for (uint32_t jx = 0; jx < submesh_record.group_num; ++jx)
 			{
-				_heap.remove(ix);
-			}
+				const auto& record = group_records[submesh_record.group_offset + jx];
+				if (
+					!is_valid_range(record.cluster_index_offset, record.cluster_index_num, group_cluster_indices.size()) ||
+					!is_valid_range(record.external_edge_offset, record.external_edge_num, group_external_edges.size() / 2)
+				)
+				{
+					return false;
+				}
+
+				auto& group = submesh.cluster_groups[jx];
+				group.cluster_indices.assign(
+					group_cluster_indices.begin() + record.cluster_index_offset, 
+					group_cluster_indices.begin() + record.cluster_index_offset + record.cluster_index_num
+				);
+				for (auto cluster_index : group.cluster_indices)
+				{
+					if (cluster_index >= submesh.clusters.size()) return false;
+				}
 
+				group.external_edges.resize(record.external_edge_num);
+				for (uint32_t kx = 0; kx < record.external_edge_num; ++kx)
+				{
+					uint32_t edge_offset = (record.external_edge_offset + kx) * 2;
+					group.external_edges[kx] = std::make_pair(group_external_edges[edge_offset], group_external_edges[edge_offset + 1]);
+				}
+				group.bounding_sphere = record.bounding_sphere;
+				group.lod_bounding_sphere = record.lod_bounding_sphere;
+				group.parent_lod_error = record.parent_lod_error;
+				group.mip_level = record.mip_level;
+			}
 		}
-		
-		moved_edge_indices.clear();
-		moved_vertex_indices.clear();
-		moved_index_indices.clear();
+
+		_submeshes = std::move(submeshes);
+		_cluster_gpus.assign(cluster_gpus.begin(), cluster_gpus.end());
+		_cluster_group_gpus.assign(cluster_group_gpus.begin(), cluster_group_gpus.end());
+		_cluster_vertices.assign(gpu_cluster_vertices.begin(), gpu_cluster_vertices.end());
+		_cluster_triangles.assign(gpu_cluster_triangles.begin(), gpu_cluster_triangles.end());
+		for (auto& cluster_gpu : _cluster_gpus) cluster_gpu.geometry_id = get_geometry_id(cluster_gpu.geometry_id);
+		return true;
 	}
 
-	bool VirtualMesh::build(const Mesh* mesh)
+	bool VirtualMesh::build_submesh(
+		const Mesh::Submesh& submesh, 
+		uint32_t geometry_id, 
+		VirtualSubmesh& virtual_submesh, 
+		std::vector<LevelStatistics>& level_statistics
+	)
 	{
-		_current_geometry_id = mesh->mesh_id << 16;
-
-		for (const auto& submesh : mesh->submeshes)
+		std::vector<Vertex> vertices = submesh.vertices;
+		std::vector<uint32_t> indices = submesh.indices;
+
+		// 导入时已按所有属性合并, 这里再按位置合并, cluster 的邻接关系与边界锁定都依赖按位置连通的拓扑.
+		std::vector<uint32_t> vertex_remap;
+		weld_vertices(vertices, indices, vertex_remap, true);
+
+		level_statistics.emplace_back();
+		ReturnIfFalse(cluster_triangles(virtual_submesh, vertices, indices, geometry_id, level_statistics[0]));
+		uint32_t level_offset = 0;
+		uint32_t mip_level = 0;
+		while (true)
 		{
-			_indices.insert(_indices.end(), submesh.indices.begin(), submesh.indices.end());
-			
-			uint32_t start_index = _vertices.size();
-			_vertices.resize(_vertices.size() + submesh.vertices.size());
+			uint32_t level_cluster_count = virtual_submesh.clusters.size() - level_offset;
+			if(level_cluster_count<=1) break;
+
+			uint32_t old_cluster_num = virtual_submesh.clusters.size();
+			uint32_t old_group_num = virtual_submesh.cluster_groups.size();
+
+			Timer timer;
+			ReturnIfFalse(build_cluster_groups(virtual_submesh, level_offset, level_cluster_count, mip_level));
+			float build_time = timer.peek() * 1000.0f;
+
+			// 每个 group 的 parent cluster 先写入各自的数组, 再按 group 顺序追加, 保证输出顺序确定.
+			uint32_t group_num = static_cast<uint32_t>(virtual_submesh.cluster_groups.size()) - old_group_num;
+			std::vector<std::vector<MeshCluster>> parent_clusters(group_num);
+			std::vector<LevelStatistics> group_statistics(group_num);
+			std::atomic<bool> result = true;
+			parallel::parallel_for(
+				parallel::Range{ 0, group_num },
+				[&](const parallel::Range& range)
+				{
+					for (uint64_t ix = range.begin; ix < range.end; ++ix)
+					{
+						Timer group_timer;
+						if (!build_parent_clusters(
+							virtual_submesh, 
+							virtual_submesh.cluster_groups[old_group_num + ix], 
+							parent_clusters[ix], 
+							group_statistics[ix]
+						))
+						{
+							result.store(false, std::memory_order_relaxed);
+						}
+						group_statistics[ix].build_time = group_timer.peek() * 1000.0f;
+					}
+				},
+				1
+			);
+			ReturnIfFalse(result.load());
 
-			for (uint32_t ix = 0; ix < submesh.vertices.size(); ++ix)
+			for (auto& clusters : parent_clusters)
 			{
-				_vertices[start_index + ix] = submesh.vertices[ix];
+				for (auto& cluster : clusters) virtual_submesh.clusters.emplace_back(std::move(cluster));
 			}
 
-			auto& virtual_submesh = _submeshes.emplace_back();
-			
-			MeshOptimizer optimizer(_vertices, _indices);
-			ReturnIfFalse(optimizer.optimize(_indices.size()));
-
-			ReturnIfFalse(cluster_triangles(virtual_submesh));
-			uint32_t level_offset = 0;
-			uint32_t mip_level = 0;
-			while (true)
+			// group 计时包含 partition_graph 等待嵌套并行时线程窃取执行的其他任务, 只作为近似的 cpu 时间.
+			LevelStatistics parent_statistics;
+			for (const auto& statistics : group_statistics)
 			{
-				uint32_t level_cluster_count = virtual_submesh.clusters.size() - level_offset;
-				if(level_cluster_count<=1) break;
-
-				uint32_t old_cluster_num = virtual_submesh.clusters.size();
-				uint32_t old_group_num = virtual_submesh.cluster_groups.size();
-
-				ReturnIfFalse(build_cluster_groups(virtual_submesh, level_offset, level_cluster_count, mip_level));
-
-				for(uint32_t ix = old_group_num; ix < virtual_submesh.cluster_groups.size(); ix++)
-				{
-					ReturnIfFalse(build_parent_clusters(virtual_submesh, ix));
-				}
-
-				level_offset = old_cluster_num;
-				mip_level++;
+				build_time += statistics.build_time;
+				parent_statistics.vertex_cache_before += statistics.vertex_cache_before;
+				parent_statistics.vertex_cache_after += statistics.vertex_cache_after;
 			}
-			virtual_submesh.mip_level_num = mip_level + 1;
 
-			_current_geometry_id++;
-			_indices.clear();
-			_vertices.clear();
+			level_statistics[mip_level].cluster_group_num = group_num;
+			level_statistics[mip_level].parent_cluster_num = static_cast<uint32_t>(virtual_submesh.clusters.size()) - old_cluster_num;
+			level_statistics[mip_level].build_time = build_time;
+			level_statistics.push_back(parent_statistics);
+
+			level_offset = old_cluster_num;
+			mip_level++;
 		}
+		virtual_submesh.mip_level_num = mip_level + 1;
 
 		return true;
 	}
@@ -668,12 +1213,13 @@ namespace fantasy
 	void VirtualMesh::build_adjacency_graph(
 		const std::vector<Vertex>& vertices, 
 		const std::vector<uint32_t>& indices, 
-		SimpleGraph& edge_link_graph, 
-		SimpleGraph& adjacency_graph
+		CsrGraphBuilder& graph_builder,
+		CsrGraph& edge_link_graph, 
+		CsrGraph& adjacency_graph
 	)
 	{
 		HashTable edge_table(static_cast<uint32_t>(indices.size()));
-		edge_link_graph.resize(indices.size());
+		graph_builder.reset(static_cast<uint32_t>(indices.size()));
 
 		for (uint32_t edge_start_index = 0; edge_start_index < indices.size(); ++edge_start_index)
 		{
@@ -690,29 +1236,59 @@ namespace fantasy
 				)
 				{
 					// Increase weight.
-					edge_link_graph[edge_start_index][edge_end_index]++;
-					edge_link_graph[edge_end_index][edge_start_index]++;
+					graph_builder.add_edge(edge_start_index, edge_end_index);
+					graph_builder.add_edge(edge_end_index, edge_start_index);
 				}
 			}
 		}
+		graph_builder.build(edge_link_graph);
 
-		adjacency_graph.resize(edge_link_graph.size() / 3);
-		uint32_t edge_start_node = 0;
-		for (const auto& edge_end_node_weights : edge_link_graph)
+		graph_builder.reset(edge_link_graph.node_num() / 3);
+		for (uint32_t edge_start_node = 0; edge_start_node < edge_link_graph.node_num(); ++edge_start_node)
 		{
-			for (const auto& [edge_end_node, weight] : edge_end_node_weights)
+			for (int32_t edge_end_node : edge_link_graph.get_adjacency_nodes(edge_start_node))
 			{
-				adjacency_graph[edge_start_node / 3][edge_end_node / 3] += 1;
+				graph_builder.add_edge(edge_start_node / 3, static_cast<uint32_t>(edge_end_node) / 3);
 			}
-			edge_start_node++;
 		}
+		graph_builder.build(adjacency_graph);
 	}
 
-	bool VirtualMesh::cluster_triangles(VirtualSubmesh& submesh)
+	// cluster 的三角形按图划分的顺序输出, 顶点按首次使用的顺序. 先重排三角形提高 vertex cache 命中率,
+	// 再按新的三角形顺序重排顶点, external_edges 记录的是 indices 中的位置, 随三角形一起重映射.
+	static void optimize_cluster(MeshCluster& cluster, VertexCacheStatistics& before, VertexCacheStatistics& after)
 	{
-		SimpleGraph edge_link_graph;
-		SimpleGraph triangle_adjacency_graph;
-		build_adjacency_graph(_vertices, _indices, edge_link_graph, triangle_adjacency_graph);
+		uint32_t vertex_num = static_cast<uint32_t>(cluster.vertices.size());
+		before += analyze_vertex_cache(cluster.indices, vertex_num);
+
+		std::vector<uint32_t> triangle_order;
+		optimize_vertex_cache(cluster.indices, vertex_num, triangle_order);
+
+		std::vector<uint32_t> triangle_remap(triangle_order.size());
+		for (uint32_t ix = 0; ix < triangle_order.size(); ++ix) triangle_remap[triangle_order[ix]] = ix;
+		for (uint32_t& edge_index : cluster.external_edges)
+		{
+			edge_index = triangle_remap[edge_index / 3] * 3 + edge_index % 3;
+		}
+		std::sort(cluster.external_edges.begin(), cluster.external_edges.end());
+
+		std::vector<uint32_t> vertex_remap;
+		vertex_num = optimize_vertex_fetch(cluster.vertices, cluster.indices, vertex_remap);
+		after += analyze_vertex_cache(cluster.indices, vertex_num);
+	}
+
+	bool VirtualMesh::cluster_triangles(
+		VirtualSubmesh& submesh, 
+		const std::vector<Vertex>& vertices, 
+		const std::vector<uint32_t>& indices, 
+		uint32_t geometry_id,
+		LevelStatistics& statistics
+	)
+	{
+		CsrGraphBuilder graph_builder;
+		CsrGraph edge_link_graph;
+		CsrGraph triangle_adjacency_graph;
+		build_adjacency_graph(vertices, indices, graph_builder, edge_link_graph, triangle_adjacency_graph);
 
 		GraphPartitionar partitionar;
 		partitionar.partition_graph(triangle_adjacency_graph, MeshCluster::cluster_size - 4, MeshCluster::cluster_size);
@@ -720,7 +1296,7 @@ namespace fantasy
 		for (const auto& [left, right] : partitionar._part_ranges)
 		{
 			auto& cluster = submesh.clusters.emplace_back();
-			cluster.geometry_id = _current_geometry_id;
+			cluster.geometry_id = geometry_id;
 
 			// Map the vertices in _vertices to the _clusters.
 			std::unordered_map<uint32_t, uint32_t> cluster_vertex_index_map;
@@ -730,15 +1306,15 @@ namespace fantasy
 				for (uint32_t jx = 0; jx < 3; ++jx)
 				{
 					uint32_t edge_start_index = triangle_index * 3 + jx;
-					uint32_t vertex_index = _indices[edge_start_index];
+					uint32_t vertex_index = indices[edge_start_index];
 					if (cluster_vertex_index_map.find(vertex_index) == cluster_vertex_index_map.end())
 					{
 						cluster_vertex_index_map[vertex_index] = static_cast<uint32_t>(cluster.vertices.size());
-						cluster.vertices.push_back(_vertices[vertex_index]);
+						cluster.vertices.push_back(vertices[vertex_index]);
 					}
 
 					bool is_external = false;
-					for (const auto& [edge_end_index, weight] : edge_link_graph[edge_start_index])
+					for (int32_t edge_end_index : edge_link_graph.get_adjacency_nodes(edge_start_index))
 					{
 						uint32_t remapped_edge_end_index = partitionar._node_map[edge_end_index / 3];
 						
@@ -756,6 +1332,8 @@ namespace fantasy
 					cluster.indices.push_back(cluster_vertex_index_map[vertex_index]);
 				}
 			}
+			optimize_cluster(cluster, statistics.vertex_cache_before, statistics.vertex_cache_after);
+
 			std::vector<float3> vertex_positions(cluster.vertices.size());
 			for (uint32_t ix = 0; ix < vertex_positions.size(); ++ix) vertex_positions[ix] = cluster.vertices[ix].position;
 
@@ -790,7 +1368,8 @@ namespace fantasy
 			}
 		}
 
-		SimpleGraph edge_link_graph(cluster_edge_map.size());
+		CsrGraphBuilder graph_builder;
+		graph_builder.reset(static_cast<uint32_t>(cluster_edge_map.size()));
 
 		HashTable edge_table(static_cast<uint32_t>(cluster_edge_map.size()));
 		for (uint32_t ix = 0; ix < cluster_edge_map.size(); ++ix)
@@ -813,22 +1392,27 @@ namespace fantasy
 					p0 == another_vertices[another_indices[triangle_index_cycle3(another_edge_start_index)]]
 				)
 				{
-					edge_link_graph[ix][jx]++;
-					edge_link_graph[jx][ix]++;
+					graph_builder.add_edge(ix, jx);
+					graph_builder.add_edge(jx, ix);
 				}
 			}
 		}
 
-		SimpleGraph cluster_graph(level_cluster_count);
-		
-		for (uint32_t edge_start_index = 0; edge_start_index < edge_link_graph.size(); ++edge_start_index)
+		CsrGraph edge_link_graph;
+		graph_builder.build(edge_link_graph);
+
+		graph_builder.reset(level_cluster_count);
+		for (uint32_t edge_start_index = 0; edge_start_index < edge_link_graph.node_num(); ++edge_start_index)
 		{
-			const auto& edge_end_node_weights = edge_link_graph[edge_start_index];
-			for (const auto& [edge_end_node, weight] : edge_end_node_weights)
+			std::span<const int32_t> edge_end_nodes = edge_link_graph.get_adjacency_nodes(edge_start_index);
+			std::span<const int32_t> weights = edge_link_graph.get_adjacency_weights(edge_start_index);
+			for (uint32_t ix = 0; ix < edge_end_nodes.size(); ++ix)
 			{
-				cluster_graph[edge_cluster_map[edge_start_index]][edge_cluster_map[edge_end_node]] += weight;
+				graph_builder.add_edge(edge_cluster_map[edge_start_index], edge_cluster_map[edge_end_nodes[ix]], weights[ix]);
 			}
 		}
+		CsrGraph cluster_graph;
+		graph_builder.build(cluster_graph);
 
 
 		GraphPartitionar partitionar;
@@ -852,7 +1436,7 @@ namespace fantasy
 				)
 				{
 					bool is_external = false;
-					for (const auto& [edge_end_index, weight] : edge_link_graph[edge_start_index])
+					for (int32_t edge_end_index : edge_link_graph.get_adjacency_nodes(edge_start_index))
 					{
 						uint32_t remapped_cluster_index = partitionar._node_map[edge_cluster_map[edge_end_index]];
 						
@@ -875,15 +1459,65 @@ namespace fantasy
 		return true;
 	}
 
-	bool VirtualMesh::build_parent_clusters(VirtualSubmesh& submesh, uint32_t cluster_group_index)
+	// build_parent_clusters 的临时数据, 每个线程一份, 在同一线程的多次调用之间复用内存.
+	struct ParentClusterScratch
 	{
-		auto& cluster_group = submesh.cluster_groups[cluster_group_index];
+		std::vector<Sphere> parent_lod_bounding_spheres;
+		std::vector<uint32_t> indices;
+		std::vector<Vertex> vertices;
+		std::vector<float3> cluster_vertex_positions;
+		std::unordered_map<uint32_t, uint32_t> cluster_vertex_index_map;
+		HashTable edge_table;
+		CsrGraphBuilder graph_builder;
+		CsrGraph edge_link_graph;
+		CsrGraph triangle_adjacency_graph;
+		GraphPartitionar partitionar;
+		MeshOptimizer optimizer;
+
+		bool in_use = false;
+	};
+
+	static thread_local ParentClusterScratch thread_parent_cluster_scratch;
+
+	// 同一线程上嵌套调用时 (等待时执行了其他任务) 退回到临时的 scratch, 只有这时才构造它.
+	class ParentClusterScratchScope
+	{
+	public:
+		ParentClusterScratchScope()
+		{
+			if (thread_parent_cluster_scratch.in_use) _scratch = &_local_scratch.emplace();
+			else _scratch = &thread_parent_cluster_scratch;
+			_scratch->in_use = true;
+		}
+
+		~ParentClusterScratchScope() { _scratch->in_use = false; }
+
+		ParentClusterScratch& get() { return *_scratch; }
+
+	private:
+		std::optional<ParentClusterScratch> _local_scratch;
+		ParentClusterScratch* _scratch = nullptr;
+	};
+
+	bool VirtualMesh::build_parent_clusters(
+		const VirtualSubmesh& submesh, 
+		MeshClusterGroup& cluster_group, 
+		std::vector<MeshCluster>& parent_clusters, 
+		LevelStatistics& statistics
+	)
+	{
+		ParentClusterScratchScope scratch_scope;
+		ParentClusterScratch& scratch = scratch_scope.get();
+
+		auto& indices = scratch.indices;
+		auto& vertex_positions = scratch.vertices;
+		auto& parent_lod_bounding_spheres = scratch.parent_lod_bounding_spheres;
+		indices.clear();
+		vertex_positions.clear();
+		parent_lod_bounding_spheres.clear();
 
 		uint32_t index_offset = 0;
 		float parent_lod_error = 0.0f;
-		std::vector<Sphere> parent_lod_bounding_spheres;
-		std::vector<uint32_t> indices;
-		std::vector<Vertex> vertex_positions;
 		for (auto cluster_index : cluster_group.cluster_indices)
 		{
 			const auto& cluster = submesh.clusters[cluster_index];
@@ -898,13 +1532,15 @@ namespace fantasy
 		cluster_group.lod_bounding_sphere = merge(parent_lod_bounding_spheres);
 		cluster_group.parent_lod_error = parent_lod_error;
 
-		MeshOptimizer optimizer(vertex_positions, indices);
-		HashTable edge_table(static_cast<uint32_t>(cluster_group.external_edges.size()));
+		MeshOptimizer& optimizer = scratch.optimizer;
+		optimizer.reset(vertex_positions, indices);
+		HashTable& edge_table = scratch.edge_table;
+		edge_table.resize(static_cast<uint32_t>(cluster_group.external_edges.size()));
 		for (uint32_t ix = 0; ix < cluster_group.external_edges.size(); ++ix)
 		{
 			const auto& [cluster_index, edge_index] = cluster_group.external_edges[ix];
-			auto& positions = submesh.clusters[cluster_index].vertices;
-        	auto& vertex_indices = submesh.clusters[cluster_index].indices;
+			const auto& positions = submesh.clusters[cluster_index].vertices;
+        	const auto& vertex_indices = submesh.clusters[cluster_index].indices;
 			
 			const Vertex& p0 = positions[vertex_indices[edge_index]];
 			const Vertex& p1 = positions[vertex_indices[triangle_index_cycle3(edge_index)]];
@@ -918,24 +1554,27 @@ namespace fantasy
 		));
 		parent_lod_error = std::max(parent_lod_error, std::sqrt(optimizer._max_error));
 
-		SimpleGraph edge_link_graph;
-		SimpleGraph triangle_adjacency_graph;
+		CsrGraph& edge_link_graph = scratch.edge_link_graph;
+		CsrGraph& triangle_adjacency_graph = scratch.triangle_adjacency_graph;
 		build_adjacency_graph(
 			vertex_positions,
 			indices,
+			scratch.graph_builder,
 			edge_link_graph, 
 			triangle_adjacency_graph
 		);
 
-		GraphPartitionar partitionar;
+		GraphPartitionar& partitionar = scratch.partitionar;
 		partitionar.partition_graph(triangle_adjacency_graph, MeshCluster::cluster_size - 4, MeshCluster::cluster_size);
 
+		parent_clusters.reserve(partitionar._part_ranges.size());
 		for (const auto& [left, right] : partitionar._part_ranges)
 		{
-			auto& cluster = submesh.clusters.emplace_back();
+			auto& cluster = parent_clusters.emplace_back();
 
 			// Map the vertices in _vertices to the _clusters.
-			std::unordered_map<uint32_t, uint32_t> cluster_vertex_index_map;
+			auto& cluster_vertex_index_map = scratch.cluster_vertex_index_map;
+			cluster_vertex_index_map.clear();
 			for (uint32_t ix = left; ix < right; ++ix)
 			{
 				uint32_t triangle_index = partitionar._node_indices[ix];
@@ -950,7 +1589,7 @@ namespace fantasy
 					}
 
 					bool is_external = false;
-					for (const auto& [edge_end_index, weight] : edge_link_graph[edge_start_index])
+					for (int32_t edge_end_index : edge_link_graph.get_adjacency_nodes(edge_start_index))
 					{
 						uint32_t remapped_triangle_index = partitionar._node_map[edge_end_index / 3];
 						
@@ -968,8 +1607,8 @@ namespace fantasy
 						for (uint32_t jx : edge_table[edge_hash(p0.position, p1.position)])
 						{
 							const auto& [cluster_index, edge_index] = cluster_group.external_edges[jx];
-							auto& positions = submesh.clusters[cluster_index].vertices;
-        					auto& vertex_indices = submesh.clusters[cluster_index].indices;
+							const auto& positions = submesh.clusters[cluster_index].vertices;
+        					const auto& vertex_indices = submesh.clusters[cluster_index].indices;
 
 							if (
 								p0 == positions[vertex_indices[edge_index]] && 
@@ -990,13 +1629,17 @@ namespace fantasy
 				}
 			}
 			cluster.mip_level = cluster_group.mip_level + 1;
+			cluster.geometry_id = submesh.clusters[cluster_group.cluster_indices[0]].geometry_id;
+
+			optimize_cluster(cluster, statistics.vertex_cache_before, statistics.vertex_cache_after);
 
 			
-			std::vector<float3> vertex_positions(cluster.vertices.size());
-			for (uint32_t ix = 0; ix < vertex_positions.size(); ++ix) vertex_positions[ix] = cluster.vertices[ix].position;
+			auto& cluster_vertex_positions = scratch.cluster_vertex_positions;
+			cluster_vertex_positions.resize(cluster.vertices.size());
+			for (uint32_t ix = 0; ix < cluster_vertex_positions.size(); ++ix) cluster_vertex_positions[ix] = cluster.vertices[ix].position;
 
-			cluster.bounding_box = Bounds3F(vertex_positions);
-			cluster.bounding_sphere = Sphere(vertex_positions);
+			cluster.bounding_box = Bounds3F(cluster_vertex_positions);
+			cluster.bounding_sphere = Sphere(cluster_vertex_positions);
 
 			// The LOD bounding box of the parent node covers all the LOD bounding boxes of its child nodes.
 			cluster.lod_bounding_sphere = cluster_group.lod_bounding_sphere;
@@ -1005,11 +1648,198 @@ namespace fantasy
 		return true;
 	}
 
-    bool SceneSystem::publish(World* world, const event::OnComponentAssigned<VirtualMesh>& event)
+	// 覆盖 range 所需的 16 位量化间距, 同时不小于 max_value 的浮点精度, 使网格坐标与间距的乘积可以精确表示.
+	static float get_quantize_step(float range, float max_value)
+	{
+		int32_t value_exponent = 0;
+		std::frexp(max_value, &value_exponent);
+		int32_t exponent = value_exponent - 24;
+		if (range > 0.0f)
+		{
+			int32_t range_exponent = 0;
+			std::frexp(range / 65534.0f, &range_exponent);
+			exponent = std::max(exponent, range_exponent);
+		}
+		return std::ldexp(1.0f, exponent);
+	}
+
+	static float sign_not_zero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// 八面体编码, 长度为 0 的向量编码为 (0, 0), 解码为 (0, 0, 1).
+	static void encode_octahedron(const float3& vector, uint16_t* encoded)
+	{
+		float x = 0.0f;
+		float y = 0.0f;
+		float length = std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z);
+		if (length > 0.0f)
+		{
+			x = vector.x / length;
+			y = vector.y / length;
+			if (vector.z < 0.0f)
+			{
+				float folded_x = (1.0f - std::abs(y)) * sign_not_zero(x);
+				y = (1.0f - std::abs(x)) * sign_not_zero(y);
+				x = folded_x;
+			}
+		}
+		encoded[0] = static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(x, -1.0f, 1.0f) * 32767.0f)));
+		encoded[1] = static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(y, -1.0f, 1.0f) * 32767.0f)));
+	}
+
+	static float3 decode_octahedron(const uint16_t* encoded)
+	{
+		float x = static_cast<int16_t>(encoded[0]) / 32767.0f;
+		float y = static_cast<int16_t>(encoded[1]) / 32767.0f;
+		float z = 1.0f - std::abs(x) - std::abs(y);
+		if (z < 0.0f)
+		{
+			float folded_x = (1.0f - std::abs(y)) * sign_not_zero(x);
+			y = (1.0f - std::abs(x)) * sign_not_zero(y);
+			x = folded_x;
+		}
+		return normalize(float3(x, y, z));
+	}
+
+	static float2 get_uv_lower(const MeshCluster& cluster)
+	{
+		float2 uv_lower(INFINITY, INFINITY);
+		for (const auto& vertex : cluster.vertices) uv_lower = min(uv_lower, vertex.uv);
+		return uv_lower;
+	}
+
+	MeshClusterQuantization get_mesh_cluster_quantization(std::span<const MeshCluster> clusters)
+	{
+		float max_position_extent = 0.0f;
+		float max_position_value = 0.0f;
+		float max_uv_extent = 0.0f;
+		float max_uv_value = 0.0f;
+		for (const auto& cluster : clusters)
+		{
+			if (cluster.vertices.empty()) continue;
+
+			const float3& lower = cluster.bounding_box._lower;
+			const float3& upper = cluster.bounding_box._upper;
+			max_position_extent = std::max({ max_position_extent, upper.x - lower.x, upper.y - lower.y, upper.z - lower.z });
+			max_position_value = std::max({ 
+				max_position_value, 
+				std::abs(lower.x), std::abs(lower.y), std::abs(lower.z), 
+				std::abs(upper.x), std::abs(upper.y), std::abs(upper.z) 
+			});
+
+			float2 uv_lower = get_uv_lower(cluster);
+			float2 uv_upper(-INFINITY, -INFINITY);
+			for (const auto& vertex : cluster.vertices) uv_upper = max(uv_upper, vertex.uv);
+			max_uv_extent = std::max({ max_uv_extent, uv_upper.x - uv_lower.x, uv_upper.y - uv_lower.y });
+			max_uv_value = std::max({ max_uv_value, std::abs(uv_lower.x), std::abs(uv_lower.y), std::abs(uv_upper.x), std::abs(uv_upper.y) });
+		}
+
+		return MeshClusterQuantization{
+			.position_step = get_quantize_step(max_position_extent, max_position_value),
+			.uv_step = get_quantize_step(max_uv_extent, max_uv_value)
+		};
+	}
+
+	bool encode_mesh_cluster(const MeshCluster& cluster, const MeshClusterQuantization& quantization, EncodedMeshCluster& encoded_cluster)
+	{
+		ReturnIfFalse(cluster.vertices.size() <= 256);
+
+		// 下界取整到最近的网格点, 解码后的下界正好落在该网格点上, 再编码时得到相同的 offset.
+		float position_step = quantization.position_step;
+		float uv_step = quantization.uv_step;
+		float2 uv_lower = cluster.vertices.empty() ? float2(0.0f, 0.0f) : get_uv_lower(cluster);
+
+		encoded_cluster.position_step = position_step;
+		encoded_cluster.uv_step = uv_step;
+		encoded_cluster.position_offset[0] = static_cast<int32_t>(std::round(cluster.bounding_box._lower.x / position_step));
+		encoded_cluster.position_offset[1] = static_cast<int32_t>(std::round(cluster.bounding_box._lower.y / position_step));
+		encoded_cluster.position_offset[2] = static_cast<int32_t>(std::round(cluster.bounding_box._lower.z / position_step));
+		encoded_cluster.uv_offset[0] = static_cast<int32_t>(std::round(uv_lower.x / uv_step));
+		encoded_cluster.uv_offset[1] = static_cast<int32_t>(std::round(uv_lower.y / uv_step));
+
+		auto quantize = [](float value, float step, int32_t offset, uint16_t& quantized)
+		{
+			int64_t grid_value = static_cast<int64_t>(std::round(value / step)) - offset;
+			ReturnIfFalse(grid_value >= 0 && grid_value <= 0xffff);
+			quantized = static_cast<uint16_t>(grid_value);
+			return true;
+		};
+
+		encoded_cluster.vertices.resize(cluster.vertices.size());
+		for (uint32_t ix = 0; ix < cluster.vertices.size(); ++ix)
+		{
+			const Vertex& vertex = cluster.vertices[ix];
+			EncodedClusterVertex& encoded_vertex = encoded_cluster.vertices[ix];
+
+			ReturnIfFalse(quantize(vertex.position.x, position_step, encoded_cluster.position_offset[0], encoded_vertex.position[0]));
+			ReturnIfFalse(quantize(vertex.position.y, position_step, encoded_cluster.position_offset[1], encoded_vertex.position[1]));
+			ReturnIfFalse(quantize(vertex.position.z, position_step, encoded_cluster.position_offset[2], encoded_vertex.position[2]));
+			ReturnIfFalse(quantize(vertex.uv.x, uv_step, encoded_cluster.uv_offset[0], encoded_vertex.uv[0]));
+			ReturnIfFalse(quantize(vertex.uv.y, uv_step, encoded_cluster.uv_offset[1], encoded_vertex.uv[1]));
+
+			encode_octahedron(vertex.normal, encoded_vertex.normal);
+			encode_octahedron(vertex.tangent, encoded_vertex.tangent);
+		}
+
+		encoded_cluster.indices.resize(cluster.indices.size());
+		for (uint32_t ix = 0; ix < cluster.indices.size(); ++ix)
+		{
+			encoded_cluster.indices[ix] = static_cast<uint8_t>(cluster.indices[ix]);
+		}
+		return true;
+	}
+
+	void decode_mesh_cluster(const EncodedMeshCluster& encoded_cluster, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		float position_step = encoded_cluster.position_step;
+		float uv_step = encoded_cluster.uv_step;
+		const int32_t* position_offset = encoded_cluster.position_offset;
+		const int32_t* uv_offset = encoded_cluster.uv_offset;
+
+		vertices.resize(encoded_cluster.vertices.size());
+		for (uint32_t ix = 0; ix < encoded_cluster.vertices.size(); ++ix)
+		{
+			const EncodedClusterVertex& encoded_vertex = encoded_cluster.vertices[ix];
+			Vertex& vertex = vertices[ix];
+
+			vertex.position = float3(
+				static_cast<float>(position_offset[0] + encoded_vertex.position[0]) * position_step,
+				static_cast<float>(position_offset[1] + encoded_vertex.position[1]) * position_step,
+				static_cast<float>(position_offset[2] + encoded_vertex.position[2]) * position_step
+			);
+			vertex.normal = decode_octahedron(encoded_vertex.normal);
+			vertex.tangent = decode_octahedron(encoded_vertex.tangent);
+			vertex.uv = float2(
+				static_cast<float>(uv_offset[0] + encoded_vertex.uv[0]) * uv_step,
+				static_cast<float>(uv_offset[1] + encoded_vertex.uv[1]) * uv_step
+			);
+		}
+
+		indices.resize(encoded_cluster.indices.size());
+		for (uint32_t ix = 0; ix < encoded_cluster.indices.size(); ++ix) indices[ix] = encoded_cluster.indices[ix];
+	}
+
+	bool SceneSystem::load_virtual_mesh(ModelImport& model_import)
+	{
+		VirtualMesh* virtual_mesh = model_import.entity->get_component<VirtualMesh>();
+		Mesh* mesh = model_import.entity->get_component<Mesh>();
+
+		if (virtual_mesh->load(model_import.virtual_mesh_path, VirtualMesh::get_source_hash(mesh), mesh))
+		{
+			model_import.virtual_mesh_loaded = true;
+			gui::notify_message(gui::ENotifyType::Info, "Loaded " + model_import.virtual_mesh_path.substr(model_import.virtual_mesh_path.find("asset")));
+		}
+		return true;
+	}
+
+	bool SceneSystem::save_virtual_mesh(ModelImport& model_import)
 	{
-		VirtualMesh* virtual_geometry = event.component;
-		Mesh* mesh = event.entity->get_component<Mesh>();
+		VirtualMesh* virtual_mesh = model_import.entity->get_component<VirtualMesh>();
+		Mesh* mesh = model_import.entity->get_component<Mesh>();
 
-		return virtual_geometry->build(mesh);
+		if (!virtual_mesh->end_build()) return false;
+		return virtual_mesh->save(model_import.virtual_mesh_path, VirtualMesh::get_source_hash(mesh));
 	}
 }
\ No newline at end of file
@@ -8,27 +8,38 @@
 #include "../core/tools/hash_table.h"
 #include "../core/tools/bit_allocator.h"
 #include "geometry.h"
+#include <span>
+#include <string>
 #include <utility>
 
 namespace fantasy 
 {
+    // 基于索引的二次误差边折叠简化.
+    // 相同位置的顶点先合并, 边和堆都以合并后的顶点索引表示, 每个顶点的二次误差只累加一次, 折叠时增量合并.
+    // 误差中包含 uv 与法线, 折叠后的属性取误差最小的插值结果.
+    // 内部的数组在多次 reset() / optimize() 之间复用.
     class MeshOptimizer
     {
     public:
-        MeshOptimizer(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+        void reset(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 
         bool optimize(uint32_t target_triangle_num);
         void lock_position(const float3& position);
 
-        float _max_error;
+        float _max_error = 0.0f;
 
     private:
+        static const uint32_t attribute_num = 5;     // uv, normal.
+        using Quadric = AttributeQuadric<attribute_num>;
+
         bool compact();
-        void fix_triangle(uint32_t triangle_index);
+        void remove_triangle(uint32_t triangle_index);
+        bool is_same_triangle(uint32_t triangle_index0, uint32_t triangle_index1);
 
-        float evaluate(const Vertex& p0, const Vertex& p1, bool bMerge);
-        void merge_begin(const Vertex& p);
-        void mergen_end();
+        // 折叠 vertex_index0 与 vertex_index1 的误差, merged_vertex 不为空时同时输出折叠后的顶点.
+        float evaluate(uint32_t vertex_index0, uint32_t vertex_index1, Vertex* merged_vertex);
+        void evaluate_vertex(uint32_t vertex_index);
+        void collapse(uint32_t vertex_index, uint32_t target_vertex_index, const Vertex& merged_vertex);
 
         class BinaryHeap
         {
@@ -55,36 +66,36 @@ namespace fantasy
         };
 
     private:
-        std::vector<Vertex>& _vertices;
-        std::vector<uint32_t>& _indices;
-        uint32_t _remain_vertex_num;
-        uint32_t _remain_triangle_num;
+        std::vector<Vertex>* _vertices = nullptr;
+        std::vector<uint32_t>* _indices = nullptr;
+        uint32_t _remain_vertex_num = 0;
+        uint32_t _remain_triangle_num = 0;
 
         enum
         {
-            AdjacencyFlag   = 1,
-            LockFlag        = 2
+            LockFlag = 1
         };
-        std::vector<uint8_t> _flags;
-        std::vector<uint32_t> _vertex_ref_count;
-        std::vector<QuadricSurface> _triangle_surfaces;
-
-        BitSetAllocator _triangle_removed_array;
+        std::vector<uint8_t> _vertex_flags;
+        std::vector<uint32_t> _vertex_triangle_num;
+        std::vector<Quadric> _quadrics;
+        std::vector<uint8_t> _triangle_removed;
 
-        HashTable _vertex_table;    // key: vertex_position; hash value: vertex_index.
-        HashTable _index_table;     // key: vertex_position; hash value: index_index.
+        HashTable _position_table;      // key: vertex_position; hash value: vertex_index, 只包含合并后的顶点.
+        HashTable _triangle_table;      // key: triangle vertex indices; hash value: triangle_index.
 
+        // 每个顶点所在的三角形角 (index_index) 组成链表, 删除的三角形在遍历时摘除.
+        std::vector<uint32_t> _corner_heads;
+        std::vector<uint32_t> _corner_nexts;
 
-        std::vector<std::pair<Vertex, Vertex>> _edges;
-        HashTable _edges_begin_table;   // key: vertex_position; hash value: edge_index.   
-        HashTable _edges_end_table;     // key: vertex_position; hash value: edge_index.
+        // 每个顶点误差最小的折叠目标, 堆以顶点索引为下标.
+        std::vector<uint32_t> _collapse_targets;
         BinaryHeap _heap;
 
-
-        std::vector<uint32_t> moved_vertex_indices;
-        std::vector<uint32_t> moved_index_indices;
-        std::vector<uint32_t> moved_edge_indices;
-        std::vector<uint32_t> edge_need_reevaluate_indices;
+        std::vector<uint32_t> _vertex_marks;
+        uint32_t _current_mark = 0;
+        std::vector<uint32_t> _moved_triangle_indices;
+        std::vector<uint32_t> _reevaluate_vertex_indices;
+        std::vector<uint32_t> _update_vertex_indices;
     };
 
     struct MeshCluster
@@ -104,6 +115,48 @@ namespace fantasy
         uint32_t geometry_id = 0;
     };
 
+    // 压缩的 cluster 顶点, 18 字节 (Vertex 为 44 字节).
+    // 位置与 uv 在 submesh 统一的量化网格上存放相对 cluster 下界的 16 位偏移, 相邻 cluster 共享的顶点解码后完全相同, 不会产生裂缝.
+    // 法线与切线为 16 位的八面体编码.
+    struct EncodedClusterVertex
+    {
+        uint16_t position[3];
+        uint16_t normal[2];
+        uint16_t tangent[2];
+        uint16_t uv[2];
+    };
+    static_assert(sizeof(EncodedClusterVertex) == sizeof(uint16_t) * 9);
+
+    struct EncodedMeshCluster
+    {
+        int32_t position_offset[3];     // bounding_box 下界在量化网格上的坐标.
+        int32_t uv_offset[2];
+        float position_step = 0.0f;
+        float uv_step = 0.0f;
+
+        std::vector<EncodedClusterVertex> vertices;
+        std::vector<uint8_t> indices;   // cluster 内的局部顶点索引, 每个 cluster 最多 256 个顶点.
+
+        uint64_t memory_size() const
+        {
+            return sizeof(EncodedMeshCluster) + vertices.size() * sizeof(EncodedClusterVertex) + indices.size() * sizeof(uint8_t);
+        }
+    };
+
+    // 量化网格的间距, 都是 2 的幂且不小于坐标本身的浮点精度, 解码时的乘法没有舍入误差.
+    struct MeshClusterQuantization
+    {
+        float position_step = 0.0f;
+        float uv_step = 0.0f;
+    };
+
+    // 使所有 cluster 相对各自下界的量化偏移都能用 16 位表示的最小网格间距.
+    MeshClusterQuantization get_mesh_cluster_quantization(std::span<const MeshCluster> clusters);
+
+    // 用相同的 quantization 对解码结果再编码, 得到的结果与原编码完全相同. 顶点数超过 256 时返回 false.
+    bool encode_mesh_cluster(const MeshCluster& cluster, const MeshClusterQuantization& quantization, EncodedMeshCluster& encoded_cluster);
+    void decode_mesh_cluster(const EncodedMeshCluster& encoded_cluster, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
     struct MeshClusterGroup
     {
         static const uint32_t group_size = 32;
@@ -116,39 +169,6 @@ namespace fantasy
         uint32_t mip_level = 0;
     };
 
-    class VirtualMesh
-    {
-    public:
-        bool build(const Mesh* mesh);
-
-        struct VirtualSubmesh
-        {
-            std::vector<MeshCluster> clusters;
-            std::vector<MeshClusterGroup> cluster_groups;
-            uint32_t mip_level_num;
-        };
-
-        std::vector<VirtualSubmesh> _submeshes;
-
-    private:
-        bool cluster_triangles(VirtualSubmesh& submesh);
-        bool build_cluster_groups(VirtualSubmesh& submesh, uint32_t level_offset, uint32_t level_cluster_count, uint32_t mip_level);
-        bool build_parent_clusters(VirtualSubmesh& submesh, uint32_t cluster_group_index);
-        void build_adjacency_graph(
-            const std::vector<Vertex>& vertices, 
-            const std::vector<uint32_t>& indices, 
-            SimpleGraph& edge_link_graph, 
-            SimpleGraph& adjacency_graph
-        );
-        uint32_t edge_hash(const float3& p0, const float3& p1);
-
-    private:
-		std::vector<uint32_t> _indices;
-        std::vector<Vertex> _vertices;
-        uint32_t _current_geometry_id = 0;
-    };
-
-
     struct MeshClusterGpu
     {
         float4 bounding_sphere;
@@ -174,6 +194,87 @@ namespace fantasy
         float max_parent_lod_error;
     };
 
+    class VirtualMesh
+    {
+    public:
+        bool build(const Mesh* mesh);
+
+        // 分步构建, 各 submesh 的 build 互不依赖, 可以作为独立的任务调度, 全部完成后调用 end_build.
+        void begin_build(const Mesh* mesh);
+        bool build(const Mesh* mesh, uint32_t submesh_index);
+        bool end_build();
+
+        // 以源网格的哈希为键的磁盘缓存, 哈希或版本不一致时 load 返回 false, 需要重新 build.
+        static uint64_t get_source_hash(const Mesh* mesh);
+        bool save(const std::string& path, uint64_t source_hash) const;
+        bool load(const std::string& path, uint64_t source_hash, const Mesh* mesh);
+
+        struct VirtualSubmesh
+        {
+            std::vector<MeshCluster> clusters;
+            std::vector<MeshClusterGroup> cluster_groups;
+            uint32_t mip_level_num;
+        };
+
+        std::vector<VirtualSubmesh> _submeshes;
+
+        // 按 group 顺序展开的 gpu 数据, 偏移都相对于这个 VirtualMesh, 可以直接上传.
+        std::vector<MeshClusterGpu> _cluster_gpus;
+        std::vector<MeshClusterGroupGpu> _cluster_group_gpus;
+        std::vector<Vertex> _cluster_vertices;
+        std::vector<uint32_t> _cluster_triangles;   // 每个三角形的 3 个 8 位局部索引.
+
+    private:
+        bool flatten();
+
+        // 每个 mip level 的构建统计, 所有 submesh 汇总后输出.
+        struct LevelStatistics
+        {
+            uint32_t cluster_group_num = 0;
+            uint32_t parent_cluster_num = 0;
+            float build_time = 0.0f;    // ms, 各 group 构建耗时之和, 可能包含等待期间窃取执行的其他任务, 只是近似值.
+
+            // 这一 level 的 cluster 重排三角形与顶点前后的统计.
+            VertexCacheStatistics vertex_cache_before;
+            VertexCacheStatistics vertex_cache_after;
+        };
+
+        uint32_t _build_submesh_offset = 0;
+        std::vector<std::vector<LevelStatistics>> _build_statistics;
+
+        bool build_submesh(
+            const Mesh::Submesh& submesh, 
+            uint32_t geometry_id, 
+            VirtualSubmesh& virtual_submesh, 
+            std::vector<LevelStatistics>& level_statistics
+        );
+        bool cluster_triangles(
+            VirtualSubmesh& submesh, 
+            const std::vector<Vertex>& vertices, 
+            const std::vector<uint32_t>& indices, 
+            uint32_t geometry_id,
+            LevelStatistics& statistics
+        );
+        bool build_cluster_groups(VirtualSubmesh& submesh, uint32_t level_offset, uint32_t level_cluster_count, uint32_t mip_level);
+
+        // 同一 level 的 cluster group 之间互不依赖, 只读 submesh.clusters, 生成的 parent cluster 写入 parent_clusters.
+        bool build_parent_clusters(
+            const VirtualSubmesh& submesh, 
+            MeshClusterGroup& cluster_group, 
+            std::vector<MeshCluster>& parent_clusters, 
+            LevelStatistics& statistics
+        );
+        void build_adjacency_graph(
+            const std::vector<Vertex>& vertices, 
+            const std::vector<uint32_t>& indices, 
+            CsrGraphBuilder& graph_builder,
+            CsrGraph& edge_link_graph, 
+            CsrGraph& adjacency_graph
+        );
+        uint32_t edge_hash(const float3& p0, const float3& p1);
+    };
+
+
     inline MeshClusterGpu convert_mesh_cluster(
         const MeshCluster& cluster,
         uint32_t vertex_offset,
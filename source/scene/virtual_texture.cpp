@@ -1,211 +1,704 @@
 #include "virtual_texture.h"
 #include "../core/tools/morton_code.h"
+#include "../core/tools/file.h"
 #include "../core/parallel/parallel.h"
+#include "../gui/gui_panel.h"
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <memory>
 
 #include "geometry.h"
+#include "scene.h"
 
 namespace fantasy 
 {
+    // 每个 mip 第一个 page 的序号, 最后一项是 page 总数.
+    static std::vector<uint32_t> get_mip_page_offsets(uint32_t mip0_resolution, uint32_t mip_levels)
+    {
+        std::vector<uint32_t> offsets(mip_levels + 1, 0);
+        for (uint32_t ix = 0; ix < mip_levels; ++ix)
+        {
+            uint32_t resolution_in_page = (mip0_resolution / page_size) >> ix;
+            offsets[ix + 1] = offsets[ix] + resolution_in_page * resolution_in_page;
+        }
+        return offsets;
+    }
+
     bool MipmapLUT::initialize(uint32_t mip0_resolution)
     {
-        ReturnIfFalse(is_power_of_2(mip0_resolution));
+        ReturnIfFalse(is_power_of_2(mip0_resolution) && mip0_resolution >= page_size * 2);
         
         _mip0_resolution = mip0_resolution;
-        
-        uint32_t mip0_resolution_in_page = mip0_resolution / page_size;
-        uint32_t mip_levels = std::log2(mip0_resolution_in_page);
+        // 与 VTPageFile 相同, mip 链一直到只剩一个 page, 缺页时总能回退到覆盖整张贴图的最粗一级.
+        _mip_levels = static_cast<uint32_t>(std::log2(mip0_resolution / page_size)) + 1;
+        _mip_page_offsets = get_mip_page_offsets(mip0_resolution, _mip_levels);
+        _pages.resize(_mip_page_offsets.back());
 
-        _quad_tree.initialize(mip0_resolution_in_page, mip_levels);
-
-        _mips.resize(mip_levels);
-        for (uint32_t ix = 0; ix < mip_levels; ++ix)
+        for (uint32_t ix = 0; ix < _mip_levels; ++ix)
         {
-            auto& mip = _mips[ix];
-            
-            mip.resolution = ix == 0 ? mip0_resolution : _mips[ix - 1].resolution >> 1;
-            
-            uint32_t resolution_in_page = mip.resolution / page_size;
-            mip.pages.resize(resolution_in_page * resolution_in_page);
-            
+            uint32_t resolution_in_page = (mip0_resolution / page_size) >> ix;
+            VTPage* mip_pages = _pages.data() + _mip_page_offsets[ix];
+
+            // page 的 bounds 是该 mip 内以像素为单位的范围.
             parallel::parallel_for(
-                [&](uint64_t x, uint64_t y)
+                parallel::Range{ 0, resolution_in_page * resolution_in_page },
+                [&](const parallel::Range& range)
                 {
-                    uint32_t morton_code = MortonEncode(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
-                    auto& page = mip.pages[morton_code];
-                    page.mip_level = ix;
-                    
-                    uint2 lower = uint2(x * page_size, y * page_size);
-                    page.bounds = Bounds2I(lower, lower + page_size);
-                }, 
-                resolution_in_page, 
-                resolution_in_page
+                    for (uint64_t jx = range.begin; jx < range.end; ++jx)
+                    {
+                        auto& page = mip_pages[jx];
+                        page.mip_level = ix;
+
+                        uint2 lower = MortonDecode(static_cast<uint32_t>(jx)) * page_size;
+                        page.bounds = Bounds2I(lower, lower + page_size);
+                    }
+                }
             );
         }
         return true;
     }
 
-    VTPage* MipmapLUT::query_page(uint2 page_id, uint32_t mip_level)
+    void MipmapLUT::query_pages(std::span<const uint2> page_ids, uint32_t mip_level, std::span<VTPage*> pages)
     {
-        uint32_t morton_code = _quad_tree.query_page_morton_code(page_id, mip_level);
-        return &_mips[mip_level].pages[morton_code];
-    }
+        assert(page_ids.size() == pages.size() && mip_level < _mip_levels);
 
-    MipmapLUT::QuadTree::QuadTree(const QuadTree& other)
-    {
-        _root = std::make_unique<Node>(*other._root);
+        VTPage* mip_pages = _pages.data() + _mip_page_offsets[mip_level];
+        for (uint64_t ix = 0; ix < page_ids.size(); ++ix)
+        {
+            pages[ix] = mip_pages + MortonEncode(page_ids[ix].x >> mip_level, page_ids[ix].y >> mip_level);
+        }
     }
 
-    MipmapLUT::QuadTree& MipmapLUT::QuadTree::operator=(const QuadTree& other)
+    uint2 VTPhysicalTable::add_page(uint32_t geometry_id, VTPage* page, uint64_t frame_index)
     {
-        _root = std::make_unique<Node>(*other._root);
-        return *this;
+        uint32_t slot = _tiles.insert(get_page_key(geometry_id, page), Tile{ .geometry_id = geometry_id, .cache_page = page, .frame_index = frame_index });
+        return get_tile_position(slot);
     }
 
-    
-    MipmapLUT::QuadTree::Node::Node(const Node& other) : 
-        virtual_bounds(other.virtual_bounds),
-        parent_node(other.parent_node),
-        mip_level(other.mip_level),
-        morton_code(other.mip_level)
+    void VTPhysicalTable::add_pages(std::span<const uint32_t> geometry_ids, std::span<VTPage* const> pages, std::span<uint2> positions)
     {
-        for (uint32_t ix = 0; ix < children.size(); ++ix)
+        assert(geometry_ids.size() == pages.size() && positions.size() == pages.size());
+
+        _keys.resize(pages.size());
+        _values.resize(pages.size());
+        _slots.resize(pages.size());
+        for (uint64_t ix = 0; ix < pages.size(); ++ix)
         {
-            children[ix] = std::make_unique<Node>(*other.children[ix]);
+            _keys[ix] = get_page_key(geometry_ids[ix], pages[ix]);
+            _values[ix] = Tile{ .geometry_id = geometry_ids[ix], .cache_page = pages[ix] };
         }
+
+        // 一批的 page 数超过容量时, 先加入的 page 会被同一批中后加入的淘汰, 此时返回的是被占用的 tile.
+        _tiles.insert(_keys, _values, _slots);
+        for (uint64_t ix = 0; ix < pages.size(); ++ix) positions[ix] = get_tile_position(_slots[ix]);
+    }
+
+    bool VTPhysicalTable::touch_page(uint32_t geometry_id, VTPage* page, uint64_t frame_index, uint2& position)
+    {
+        uint32_t slot = _tiles.touch(get_page_key(geometry_id, page));
+        if (slot == _tiles.invalid_slot) return false;
+
+        _tiles[slot].frame_index = frame_index;
+        position = get_tile_position(slot);
+        return true;
+    }
+
+    std::string VTPhysicalTable::get_slice_name(uint32_t texture_type, uint32_t slice_index)
+    {
+        std::string ret;
+        switch (texture_type) 
+		{
+		case Material::TextureType_BaseColor: 
+			ret = "vt_physical_texture_base_color" + std::to_string(slice_index); break;
+		case Material::TextureType_Normal:  
+			ret = "vt_physical_texture_normal" + std::to_string(slice_index);; break;
+		case Material::TextureType_PBR:  
+			ret = "vt_physical_texture_pbr" + std::to_string(slice_index);; break;
+		case Material::TextureType_Emissive:  
+			ret = "vt_physical_texture_emissive" + std::to_string(slice_index);; break;
+		default: break;
+		}
+        return ret;
     }
-    
-    MipmapLUT::QuadTree::Node& MipmapLUT::QuadTree::Node::operator=(const Node& other)
+
+    static constexpr uint64_t invalid_page_key = ~0ull;
+
+    // 开放寻址的 page key 表, 线性探测, 装载率不超过一半.
+    class PageKeyTable
     {
-        virtual_bounds = other.virtual_bounds;
-        parent_node = other.parent_node;
-        mip_level = other.mip_level;
-        morton_code = other.mip_level;
-        for (uint32_t ix = 0; ix < children.size(); ++ix)
+    public:
+        explicit PageKeyTable(uint64_t capacity) { reset(capacity); }
+
+        void reset(uint64_t capacity)
+        {
+            _keys.assign(std::bit_ceil(std::max<uint64_t>(capacity * 2, 16)), invalid_page_key);
+            _values.resize(_keys.size());
+            _size = 0;
+        }
+
+        // key 已存在时返回 false, 不修改 value.
+        bool insert(uint64_t key, uint32_t value)
+        {
+            if ((_size + 1) * 2 > _keys.size()) rehash();
+
+            uint64_t slot = find_slot(key);
+            if (_keys[slot] == key) return false;
+
+            _keys[slot] = key;
+            _values[slot] = value;
+            _size++;
+            return true;
+        }
+
+        uint32_t find(uint64_t key) const
         {
-            children[ix] = std::make_unique<Node>(*other.children[ix]);
+            uint64_t slot = find_slot(key);
+            return _keys[slot] == key ? _values[slot] : INVALID_SIZE_32;
         }
-        return *this;
+
+    private:
+        static uint64_t hash(uint64_t key)
+        {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            key *= 0xc4ceb9fe1a85ec53ull;
+            key ^= key >> 33;
+            return key;
+        }
+
+        uint64_t find_slot(uint64_t key) const
+        {
+            uint64_t mask = _keys.size() - 1;
+            uint64_t slot = hash(key) & mask;
+            while (_keys[slot] != key && _keys[slot] != invalid_page_key) slot = (slot + 1) & mask;
+            return slot;
+        }
+
+        void rehash()
+        {
+            std::vector<uint64_t> keys = std::move(_keys);
+            std::vector<uint32_t> values = std::move(_values);
+
+            _keys.assign(keys.size() * 2, invalid_page_key);
+            _values.resize(_keys.size());
+            for (uint64_t ix = 0; ix < keys.size(); ++ix)
+            {
+                if (keys[ix] == invalid_page_key) continue;
+                uint64_t slot = find_slot(keys[ix]);
+                _keys[slot] = keys[ix];
+                _values[slot] = values[ix];
+            }
+        }
+
+    private:
+        std::vector<uint64_t> _keys;
+        std::vector<uint32_t> _values;
+        uint64_t _size = 0;
+    };
+
+    void VTFeedbackResolver::set_mipmap_lut(MipmapLUT* mipmap_lut)
+    {
+        uint32_t resolution = mipmap_lut->get_mip0_resolution();
+        if (mipmap_lut->get_mip_levels() == 0 || !is_power_of_2(resolution)) return;
+        if (resolution < lowest_texture_resolution || resolution > highest_texture_resolution) return;
+
+        _mipmap_luts[std::bit_width(resolution / lowest_texture_resolution) - 1] = mipmap_lut;
     }
 
+    MipmapLUT* VTFeedbackResolver::get_mipmap_lut(uint32_t resolution) const
+    {
+        if (resolution < lowest_texture_resolution || resolution > highest_texture_resolution || !is_power_of_2(resolution)) return nullptr;
+        return _mipmap_luts[std::bit_width(resolution / lowest_texture_resolution) - 1];
+    }
 
-    bool MipmapLUT::QuadTree::initialize(uint32_t mip0_resolution_in_page, uint32_t mip_levels)
+    void VTFeedbackResolver::resolve(
+        std::span<const VTPageInfo> page_infos,
+        uint32_t width,
+        uint32_t height,
+        std::span<const uint32_t> mesh_texture_resolutions,
+        std::vector<uint32_t>* pixel_requests
+    )
     {
-        ReturnIfFalse(is_power_of_2(mip0_resolution_in_page));
+        auto get_mesh_mipmap_lut = [&](uint32_t geometry_id) -> MipmapLUT*
+        {
+            uint32_t mesh_id = geometry_id >> 16;
+            if (geometry_id == INVALID_SIZE_32 || mesh_id >= mesh_texture_resolutions.size()) return nullptr;
+            return get_mipmap_lut(mesh_texture_resolutions[mesh_id]);
+        };
 
-        const auto func_recursive_build_tree = [&](std::unique_ptr<Node>& node, Node* parent, uint32_t child_index) 
+        // key 依次为 geometry_id, mip_level, 该 mip 内的 page x 与 page y, 按 key 排序即按请求排序.
+        auto get_page_key = [&](const VTPageInfo& info) -> uint64_t
         {
-            auto build_tree_impl = [&](std::unique_ptr<Node>& node, uint32_t child_index, Node* parent, auto& build_tree_impl_ref) mutable 
-            {
-                if (parent->mip_level == 0) return;
+            const MipmapLUT* mipmap_lut = get_mesh_mipmap_lut(info.geometry_id);
+            if (mipmap_lut == nullptr) return invalid_page_key;
 
-                node->parent_node = parent;
-                node->mip_level = parent->mip_level - 1;
+            // 与 virtual_gbuffer_ps.slang 的打包方式对应, page_id 是 mip 0 以 page 为单位的坐标.
+            uint32_t data = info.page_id_mip_level;
+            uint2 page_id = uint2(
+                (((data >> 12) & 0xf) << 8) | ((data >> 24) & 0xff),
+                (((data >> 8) & 0xf) << 8) | ((data >> 16) & 0xff)
+            );
+            uint32_t resolution_in_page = mipmap_lut->get_mip0_resolution() / page_size;
+            if (page_id.x >= resolution_in_page || page_id.y >= resolution_in_page) return invalid_page_key;
 
-                // child_index: 0 ~ 3.
-                uint2 offset = uint2(child_index & 0x01, (child_index & 0x02) >> 1);
+            // 超出 MipmapLUT 的 mip 按最粗的一级处理.
+            uint32_t mip_level = std::min(data & 0xff, mipmap_lut->get_mip_levels() - 1);
+            return (static_cast<uint64_t>(info.geometry_id) << 32) | 
+                   (mip_level << 24) | 
+                   ((page_id.x >> mip_level) << 12) | 
+                   (page_id.y >> mip_level);
+        };
 
-                uint2 morton = MortonDecode(parent->morton_code) * 2 + offset;
-                node->morton_code = MortonEncode(morton);
+        // 每个 tile 先在本地去重并统计像素数, 相邻像素的请求大多相同, 连续相同的 key 只计数, 变化时才查表.
+        uint32_t tile_num_x = (width + tile_size - 1) / tile_size;
+        uint32_t tile_num_y = (height + tile_size - 1) / tile_size;
+        _tile_keys.resize(tile_num_x * tile_num_y);
+        parallel::parallel_for(
+            parallel::Range2D{ .x = { 0, width }, .y = { 0, height } },
+            [&](const parallel::Range2D& tile)
+            {
+                auto& keys = _tile_keys[tile.x.begin / tile_size + tile.y.begin / tile_size * tile_num_x];
+                keys.clear();
 
-                uint32_t resolution = parent->virtual_bounds.width() / 2;
-                uint2 lower = parent->virtual_bounds._lower + offset * resolution;
-                node->virtual_bounds = Bounds2I(lower, lower + resolution);
+                PageKeyTable key_table(64);
+                uint64_t last_key = invalid_page_key;
+                uint32_t last_pixel_num = 0;
+                auto flush_last_key = [&]()
+                {
+                    if (last_key == invalid_page_key) return;
+                    if (key_table.insert(last_key, static_cast<uint32_t>(keys.size()))) keys.emplace_back(last_key, last_pixel_num);
+                    else keys[key_table.find(last_key)].second += last_pixel_num;
+                };
 
-                for (uint32_t ix = 0; ix < node->children.size(); ++ix)
+                for (uint64_t y = tile.y.begin; y < tile.y.end; ++y)
                 {
-                    build_tree_impl_ref(node->children[ix], ix, node.get(), build_tree_impl_ref);
+                    for (uint64_t x = tile.x.begin; x < tile.x.end; ++x)
+                    {
+                        uint64_t key = get_page_key(page_infos[y * width + x]);
+                        if (key == last_key)
+                        {
+                            last_pixel_num++;
+                            continue;
+                        }
+
+                        flush_last_key();
+                        last_key = key;
+                        last_pixel_num = 1;
+                    }
                 }
-            };
-            return build_tree_impl(node, child_index, parent, build_tree_impl);
-        };
+                flush_last_key();
+            },
+            tile_size
+        );
 
-        _root = std::make_unique<Node>();
-        _root->morton_code = 0;
-        _root->mip_level = mip_levels - 1;
-        _root->virtual_bounds = Bounds2I(uint2(0u), uint2(mip0_resolution_in_page));
-        for (uint32_t ix = 0; ix < _root->children.size(); ++ix)
+        _keys.clear();
+        for (const auto& keys : _tile_keys) _keys.insert(_keys.end(), keys.begin(), keys.end());
+        std::sort(_keys.begin(), _keys.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+        // 合并不同 tile 中相同的 key.
+        uint64_t key_num = 0;
+        for (uint64_t ix = 0; ix < _keys.size(); ++ix)
         {
-            func_recursive_build_tree(_root->children[ix], _root.get(), ix);
+            if (key_num > 0 && _keys[key_num - 1].first == _keys[ix].first) _keys[key_num - 1].second += _keys[ix].second;
+            else _keys[key_num++] = _keys[ix];
         }
+        _keys.resize(key_num);
 
-        return true;
+        _requests.resize(_keys.size());
+        for (uint64_t ix = 0; ix < _keys.size(); ++ix)
+        {
+            uint64_t key = _keys[ix].first;
+
+            Request& request = _requests[ix];
+            request.geometry_id = static_cast<uint32_t>(key >> 32);
+            request.mip_level = static_cast<uint32_t>(key >> 24) & 0xff;
+            request.page_id = uint2(static_cast<uint32_t>(key >> 12) & 0xfff, static_cast<uint32_t>(key) & 0xfff);
+            request.pixel_num = _keys[ix].second;
+
+            uint2 mip0_page_id = uint2(request.page_id.x << request.mip_level, request.page_id.y << request.mip_level);
+            request.mipmap_lut = get_mesh_mipmap_lut(request.geometry_id);
+            request.page = request.mipmap_lut->query_page(mip0_page_id, request.mip_level);
+        }
+
+        if (pixel_requests != nullptr)
+        {
+            PageKeyTable request_indices(_keys.size());
+            for (uint32_t ix = 0; ix < _keys.size(); ++ix) request_indices.insert(_keys[ix].first, ix);
+
+            pixel_requests->resize(static_cast<uint64_t>(width) * height);
+            parallel::parallel_for(
+                parallel::Range{ 0, height },
+                [&](const parallel::Range& range)
+                {
+                    uint64_t last_key = invalid_page_key;
+                    uint32_t last_index = INVALID_SIZE_32;
+                    for (uint64_t ix = range.begin * width; ix < range.end * width; ++ix)
+                    {
+                        uint64_t key = get_page_key(page_infos[ix]);
+                        if (key != last_key)
+                        {
+                            last_key = key;
+                            last_index = key == invalid_page_key ? INVALID_SIZE_32 : request_indices.find(key);
+                        }
+                        (*pixel_requests)[ix] = last_index;
+                    }
+                }
+            );
+        }
     }
 
+    VTStreamingScheduler::VTStreamingScheduler() :
+        _page_upload_byte_size(static_cast<uint64_t>(VTPageFile::page_byte_size) * Material::TextureType_Num)
+    {
+    }
 
-    uint32_t MipmapLUT::QuadTree::query_page_morton_code(uint2 page_id, uint32_t mip_level)
+    VTStreamingScheduler::Mapping VTStreamingScheduler::find_resident_page(const VTFeedbackResolver::Request& request, uint32_t mip_level)
     {
-        uint32_t ret = INVALID_SIZE_32;
-        Node* current_node = _root.get();
-        while (current_node != nullptr)
+        uint2 mip0_page_id = uint2(request.page_id.x << request.mip_level, request.page_id.y << request.mip_level);
+        for (; mip_level < request.mipmap_lut->get_mip_levels(); ++mip_level)
         {
-            if (mip_level != current_node->mip_level)
+            Mapping mapping;
+            if (_physical_table.touch_page(request.geometry_id, request.mipmap_lut->query_page(mip0_page_id, mip_level), _frame_index, mapping.physical_position))
             {
-                for (uint32_t ix = 0; ix < current_node->children.size(); ++ix)
+                mapping.mip_level = mip_level;
+                return mapping;
+            }
+        }
+        return Mapping{};
+    }
+
+    void VTStreamingScheduler::schedule(std::span<const VTFeedbackResolver::Request> requests)
+    {
+        _frame_index++;
+        _candidates.clear();
+        _uploads.clear();
+        _mappings.resize(requests.size());
+
+        // 先标记本帧用到的 page, 之后的上传不会替换它们.
+        for (uint64_t ix = 0; ix < requests.size(); ++ix)
+        {
+            const auto& request = requests[ix];
+            _mappings[ix] = find_resident_page(request, request.mip_level);
+            if (_mappings[ix].mip_level == request.mip_level) continue;
+
+            _candidates.push_back(Candidate{ request.geometry_id, request.mip_level, request.pixel_num, request.page });
+
+            // 没有可回退的 page 时同时请求最粗一级, 它只有一个 page, 覆盖整张贴图.
+            uint32_t coarsest_mip_level = request.mipmap_lut->get_mip_levels() - 1;
+            if (_mappings[ix].mip_level == INVALID_SIZE_32 && request.mip_level < coarsest_mip_level)
+            {
+                uint2 mip0_page_id = uint2(request.page_id.x << request.mip_level, request.page_id.y << request.mip_level);
+                VTPage* page = request.mipmap_lut->query_page(mip0_page_id, coarsest_mip_level);
+                _candidates.push_back(Candidate{ request.geometry_id, coarsest_mip_level, request.pixel_num, page });
+            }
+        }
+
+        // 同一 geometry 的多个请求回退到同一个 page 时合并覆盖的像素数.
+        // 共享 MipmapLUT 的不同 geometry 的同一个 VTPage 是不同贴图的 page, 不能合并.
+        auto candidate_less = [](const Candidate& lhs, const Candidate& rhs)
+        {
+            if (lhs.geometry_id != rhs.geometry_id) return lhs.geometry_id < rhs.geometry_id;
+            return lhs.page < rhs.page;
+        };
+        std::sort(_candidates.begin(), _candidates.end(), candidate_less);
+        uint64_t candidate_num = 0;
+        for (uint64_t ix = 0; ix < _candidates.size(); ++ix)
+        {
+            if (candidate_num > 0 && !candidate_less(_candidates[candidate_num - 1], _candidates[ix])) _candidates[candidate_num - 1].pixel_num += _candidates[ix].pixel_num;
+            else _candidates[candidate_num++] = _candidates[ix];
+        }
+        _candidates.resize(candidate_num);
+
+        std::sort(
+            _candidates.begin(), 
+            _candidates.end(), 
+            [&](const auto& lhs, const auto& rhs) 
+            { 
+                if (lhs.mip_level != rhs.mip_level) return lhs.mip_level > rhs.mip_level;
+                if (lhs.pixel_num != rhs.pixel_num) return lhs.pixel_num > rhs.pixel_num;
+                return candidate_less(lhs, rhs);
+            }
+        );
+
+        uint64_t upload_num = std::min<uint64_t>(_candidates.size(), _frame_byte_budget / std::max<uint64_t>(_page_upload_byte_size, 1));
+        for (uint64_t ix = 0; ix < upload_num; ++ix)
+        {
+            if (!_physical_table.can_add_page(_frame_index)) break;
+
+            const auto& candidate = _candidates[ix];
+            _uploads.push_back(Upload{ 
+                .geometry_id = candidate.geometry_id, 
+                .page = candidate.page, 
+                .physical_position = _physical_table.add_page(candidate.geometry_id, candidate.page, _frame_index) 
+            });
+        }
+        _deferred_num = static_cast<uint32_t>(_candidates.size() - _uploads.size());
+
+        // 本帧上传的 page 在渲染前已经拷贝完成, 重新查找缺失的请求.
+        if (_uploads.empty()) return;
+        for (uint64_t ix = 0; ix < requests.size(); ++ix)
+        {
+            const auto& request = requests[ix];
+            if (_mappings[ix].mip_level == request.mip_level) continue;
+
+            Mapping mapping = find_resident_page(request, request.mip_level);
+            if (mapping.mip_level != INVALID_SIZE_32) _mappings[ix] = mapping;
+        }
+    }
+
+    // [1 3 3 1] / 8 的可分离滤波, 比 2x2 box 滤波的混叠更少, 边界按 clamp 处理.
+    static void downsample(std::span<const uint8_t> src, uint32_t src_resolution, std::vector<uint8_t>& dst)
+    {
+        static const float weights[4] = { 0.125f, 0.375f, 0.375f, 0.125f };
+
+        uint32_t dst_resolution = src_resolution / 2;
+        dst.resize(static_cast<uint64_t>(dst_resolution) * dst_resolution * 4);
+
+        parallel::parallel_for(
+            parallel::Range{ 0, dst_resolution },
+            [&](const parallel::Range& range)
+            {
+                auto clamp_coord = [&](int32_t coord) { return static_cast<uint32_t>(std::clamp(coord, 0, static_cast<int32_t>(src_resolution) - 1)); };
+
+                for (uint64_t y = range.begin; y < range.end; ++y)
                 {
-                    // 不包含右边界和下边界
-                    if (inside_exclusive(page_id, current_node->children[ix]->virtual_bounds))
+                    const uint8_t* rows[4];
+                    for (uint32_t jx = 0; jx < 4; ++jx)
                     {
-                        current_node = current_node->children[ix].get();
-                        break;
+                        rows[jx] = src.data() + static_cast<uint64_t>(clamp_coord(static_cast<int32_t>(y * 2 + jx) - 1)) * src_resolution * 4;
+                    }
+
+                    uint8_t* dst_row = dst.data() + y * dst_resolution * 4;
+                    for (uint32_t x = 0; x < dst_resolution; ++x)
+                    {
+                        uint32_t columns[4];
+                        for (uint32_t ix = 0; ix < 4; ++ix) columns[ix] = clamp_coord(static_cast<int32_t>(x * 2 + ix) - 1) * 4;
+
+                        float sum[4] = { 0.0f };
+                        for (uint32_t jx = 0; jx < 4; ++jx)
+                        {
+                            float row_sum[4] = { 0.0f };
+                            for (uint32_t ix = 0; ix < 4; ++ix)
+                            {
+                                for (uint32_t c = 0; c < 4; ++c) row_sum[c] += weights[ix] * rows[jx][columns[ix] + c];
+                            }
+                            for (uint32_t c = 0; c < 4; ++c) sum[c] += weights[jx] * row_sum[c];
+                        }
+                        for (uint32_t c = 0; c < 4; ++c) dst_row[x * 4 + c] = static_cast<uint8_t>(std::min(sum[c] + 0.5f, 255.0f));
                     }
                 }
             }
-            else
+        );
+    }
+
+    // 把一级 mip 切成 page, 按 morton code 依次写入 pages.
+    static void write_pages(std::span<const uint8_t> mip, uint32_t resolution, uint8_t* pages)
+    {
+        uint32_t resolution_in_page = resolution / page_size;
+        parallel::parallel_for(
+            parallel::Range{ 0, resolution_in_page * resolution_in_page },
+            [&](const parallel::Range& range)
             {
-                ret = current_node->morton_code;
-                break;
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    uint2 page_id = MortonDecode(static_cast<uint32_t>(ix));
+                    uint8_t* page = pages + ix * VTPageFile::page_byte_size;
+                    for (uint32_t y = 0; y < page_size; ++y)
+                    {
+                        uint64_t src_offset = (static_cast<uint64_t>(page_id.y * page_size + y) * resolution + page_id.x * page_size) * 4;
+                        memcpy(page + y * page_size * 4, mip.data() + src_offset, page_size * 4);
+                    }
+                }
             }
-        }
-        return ret;
+        );
     }
 
-    uint2 VTPhysicalTable::add_page(VTPage* page)
+    uint64_t VTPageFile::get_source_hash(const Mesh* mesh, const Material* material)
     {
-        uint64_t key = reinterpret_cast<uint64_t>(page);
-        Tile* tile = _tiles.get(key);
+        std::vector<uint32_t> parameters = {
+            page_size,
+            material->image_resolution,
+            static_cast<uint32_t>(material->submaterials.size()),
+            static_cast<uint32_t>(mesh->submeshes.size())
+        };
+        for (const auto& submesh : mesh->submeshes) parameters.push_back(submesh.material_index);
 
-        uint2 ret;
-        if (tile == nullptr)
+        // 贴图数据较大, 各贴图分别计算后再合并.
+        uint32_t image_num = static_cast<uint32_t>(material->submaterials.size()) * Material::TextureType_Num;
+        std::vector<uint64_t> image_hashes(image_num, 0);
+        parallel::parallel_for(
+            parallel::Range{ 0, image_num },
+            [&](const parallel::Range& range)
+            {
+                for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                {
+                    const Image& image = material->submaterials[ix / Material::TextureType_Num].images[ix % Material::TextureType_Num];
+                    if (image.is_valid()) image_hashes[ix] = serialization::get_checksum(std::span<const uint8_t>(image.data.get(), image.size));
+                }
+            },
+            1
+        );
+
+        uint64_t hash = serialization::get_checksum(
+            std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(parameters.data()), parameters.size() * sizeof(uint32_t))
+        );
+        return serialization::get_checksum(
+            std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(image_hashes.data()), image_hashes.size() * sizeof(uint64_t)), 
+            hash
+        );
+    }
+
+    bool VTPageFile::cook(const std::string& path, const Mesh* mesh, const Material* material)
+    {
+        uint32_t resolution = material->image_resolution;
+        if (resolution < page_size || !is_power_of_2(resolution))
         {
-            _tiles.insert(key, Tile{ .cache_page = page, .position = _current_avaible_pos});
+            LOG_ERROR("Virtual texture page file requires power of 2 images no smaller than the page size.");
+            return false;
+        }
+
+        uint32_t mip_levels = static_cast<uint32_t>(std::log2(resolution / page_size)) + 1;
+        std::vector<uint32_t> mip_page_offsets = get_mip_page_offsets(resolution, mip_levels);
 
-            ret = _current_avaible_pos;
-            _current_avaible_pos.x = (_current_avaible_pos.x + 1) % _resolution_in_tile;
-            if (_current_avaible_pos.x == 0) _current_avaible_pos.y++;
-            
-            assert(_current_avaible_pos.y < _resolution_in_tile);
+        std::filesystem::path file_path(path);
+        if (file_path.has_parent_path())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(file_path.parent_path(), error);
         }
-        else 
+
+        serialization::BinaryOutput output(path);
+        output(page_size, resolution, mip_levels, static_cast<uint32_t>(material->submaterials.size()), get_source_hash(mesh, material));
+
+        std::vector<uint32_t> submesh_material_indices;
+        for (const auto& submesh : mesh->submeshes) submesh_material_indices.push_back(submesh.material_index);
+        output(submesh_material_indices);
+
+        std::vector<uint8_t> pages;
+        std::vector<uint8_t> mips[2];
+        for (const auto& submaterial : material->submaterials)
         {
-            // 将其提到 LruCache 最前面 (即更新其 least recently used time).
-            _tiles.insert(key, *tile);
+            for (const auto& image : submaterial.images)
+            {
+                pages.clear();
+                if (image.is_valid())
+                {
+                    if (image.width != resolution || image.height != resolution || image.format != Format::RGBA8_UNORM)
+                    {
+                        LOG_ERROR("Virtual texture page file requires RGBA8 images of the same resolution.");
+                        return false;
+                    }
+
+                    pages.resize(static_cast<uint64_t>(mip_page_offsets.back()) * page_byte_size);
+
+                    std::span<const uint8_t> mip(image.data.get(), image.size);
+                    for (uint32_t ix = 0; ix < mip_levels; ++ix)
+                    {
+                        uint32_t mip_resolution = resolution >> ix;
+                        write_pages(mip, mip_resolution, pages.data() + static_cast<uint64_t>(mip_page_offsets[ix]) * page_byte_size);
 
-            ret = tile->position;
+                        // 两个缓冲交替作为下一级的输入和输出.
+                        if (ix + 1 < mip_levels)
+                        {
+                            downsample(mip, mip_resolution, mips[ix % 2]);
+                            mip = mips[ix % 2];
+                        }
+                    }
+                }
+                output(pages);
+            }
         }
+        return output.is_valid();
+    }
+
+    bool VTPageFile::open(const std::string& path, uint64_t source_hash)
+    {
+        auto file = std::make_shared<serialization::MappedBinaryInput>(path);
+
+        uint32_t file_page_size = 0;
+        uint32_t mip0_resolution = 0;
+        uint32_t mip_levels = 0;
+        uint32_t submaterial_num = 0;
+        uint64_t file_source_hash = 0;
+        (*file)(file_page_size, mip0_resolution, mip_levels, submaterial_num, file_source_hash);
+        if (!file->is_valid() || file_page_size != page_size || file_source_hash != source_hash) return false;
+        if (mip0_resolution < page_size || !is_power_of_2(mip0_resolution) || mip_levels != static_cast<uint32_t>(std::log2(mip0_resolution / page_size)) + 1) return false;
 
-        page->flag = VTPage::LoadFlag::Loaded;
+        std::vector<uint32_t> mip_page_offsets = get_mip_page_offsets(mip0_resolution, mip_levels);
+        uint64_t texture_byte_size = static_cast<uint64_t>(mip_page_offsets.back()) * page_byte_size;
 
-        return ret * page_size;
+        std::span<const uint32_t> submesh_material_indices = file->get_span<uint32_t>();
+        for (uint32_t material_index : submesh_material_indices)
+        {
+            if (material_index >= submaterial_num) return false;
+        }
+
+        std::vector<std::span<const uint8_t>> textures(submaterial_num * Material::TextureType_Num);
+        for (auto& texture : textures)
+        {
+            texture = file->get_span<uint8_t>();
+            if (!texture.empty() && texture.size() != texture_byte_size) return false;
+        }
+        if (!file->is_valid()) return false;
+
+        _mip0_resolution = mip0_resolution;
+        _mip_levels = mip_levels;
+        _mip_page_offsets = std::move(mip_page_offsets);
+        _submesh_material_indices = submesh_material_indices;
+        _textures = std::move(textures);
+        _file = std::move(file);
+        return true;
     }
 
+    bool VTPageFile::has_textures(uint32_t geometry_id) const
+    {
+        uint32_t submesh_index = geometry_id & 0xffff;
+        if (submesh_index >= _submesh_material_indices.size()) return false;
 
-    std::string VTPhysicalTable::get_slice_name(uint32_t texture_type, uint32_t slice_index)
+        uint32_t texture_offset = _submesh_material_indices[submesh_index] * Material::TextureType_Num;
+        for (uint32_t ix = 0; ix < Material::TextureType_Num; ++ix)
+        {
+            if (!_textures[texture_offset + ix].empty()) return true;
+        }
+        return false;
+    }
+
+    std::span<const uint8_t> VTPageFile::get_page(uint32_t geometry_id, uint32_t texture_type, uint2 page_id, uint32_t mip_level) const
     {
-        std::string ret;
-        switch (texture_type) 
-		{
-		case Material::TextureType_BaseColor: 
-			ret = "vt_physical_texture_base_color" + std::to_string(slice_index); break;
-		case Material::TextureType_Normal:  
-			ret = "vt_physical_texture_normal" + std::to_string(slice_index);; break;
-		case Material::TextureType_PBR:  
-			ret = "vt_physical_texture_pbr" + std::to_string(slice_index);; break;
-		case Material::TextureType_Emissive:  
-			ret = "vt_physical_texture_emissive" + std::to_string(slice_index);; break;
-		default: break;
-		}
-        return ret;
+        uint32_t submesh_index = geometry_id & 0xffff;
+        if (submesh_index >= _submesh_material_indices.size() || texture_type >= Material::TextureType_Num || mip_level >= _mip_levels) return {};
+
+        uint32_t resolution_in_page = (_mip0_resolution / page_size) >> mip_level;
+        if (page_id.x >= resolution_in_page || page_id.y >= resolution_in_page) return {};
+
+        std::span<const uint8_t> texture = _textures[_submesh_material_indices[submesh_index] * Material::TextureType_Num + texture_type];
+        if (texture.empty()) return {};
+
+        uint64_t page_index = _mip_page_offsets[mip_level] + MortonEncode(page_id);
+        return texture.subspan(page_index * page_byte_size, page_byte_size);
+    }
+
+    bool SceneSystem::prepare_page_file(ModelImport& model_import)
+    {
+        Mesh* mesh = model_import.entity->get_component<Mesh>();
+        Material* material = model_import.entity->get_component<Material>();
+        VTPageFile* page_file = model_import.entity->get_component<VTPageFile>();
+
+        // 没有贴图.
+        if (material->image_resolution < page_size) return true;
+
+        uint64_t source_hash = VTPageFile::get_source_hash(mesh, material);
+        if (page_file->open(model_import.page_file_path, source_hash))
+        {
+            gui::notify_message(gui::ENotifyType::Info, "Loaded " + model_import.page_file_path.substr(model_import.page_file_path.find("asset")));
+            return true;
+        }
+
+        if (!VTPageFile::cook(model_import.page_file_path, mesh, material)) return false;
+        return page_file->open(model_import.page_file_path, source_hash);
     }
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #ifndef SCENE_VIRTUAL_Table_H
 #define SCENE_VIRTUAL_Table_H
 
+#include <array>
+#include <bit>
+#include <cassert>
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 #include <string>
+#include <utility>
 #include "../core/tools/lru_cache.h"
+#include "../core/tools/morton_code.h"
 #include "../core/tools/delegate.h"
 #include "../core/math/bounds.h"
 #include "../core/tools/ecs.h"
@@ -17,23 +24,24 @@ namespace fantasy
     static const uint32_t physical_texture_slice_size = 1024u;
     static const uint32_t physical_texture_resolution = 4096u;
 
+    struct Mesh;
+    struct Material;
+
+    namespace serialization
+    {
+        class MappedBinaryInput;
+    }
+
     namespace event
 	{
 		DELCARE_DELEGATE_EVENT(GenerateMipmap, Entity*);
 	};
 
+    // MipmapLUT 由分辨率相同的所有 mesh 共享, page 是否已加载由 VTPhysicalTable 按 (geometry_id, page) 记录.
     struct VTPage
     {
-        enum class LoadFlag : uint8_t
-        {
-            Unload,
-            Loaded
-        };
-
         Bounds2I bounds;
         uint32_t mip_level = INVALID_SIZE_32;
-        
-        LoadFlag flag = LoadFlag::Unload;
 
         bool always_in_cache = false;
     };
@@ -44,77 +52,173 @@ namespace fantasy
         uint32_t page_id_mip_level;
     };
 
+    // 所有 mip 的 page 放在一个数组中, 每个 mip 内以 morton code 排序, page 的序号直接由坐标算出.
     class MipmapLUT
     {
     public:
         bool initialize(uint32_t mip0_resolution);
-        VTPage* query_page(uint2 page_id, uint32_t mip_level);
+
+        // page_id 是 mip 0 以 page 为单位的坐标.
+        uint32_t get_page_index(uint2 page_id, uint32_t mip_level) const
+        {
+            assert(mip_level < _mip_levels && page_id.x < (_mip0_resolution / page_size) && page_id.y < (_mip0_resolution / page_size));
+            return _mip_page_offsets[mip_level] + MortonEncode(page_id.x >> mip_level, page_id.y >> mip_level);
+        }
+
+        VTPage* query_page(uint2 page_id, uint32_t mip_level) { return &_pages[get_page_index(page_id, mip_level)]; }
+        
+        // 同一 mip 的一批 page, pages 的大小需要与 page_ids 相同.
+        void query_pages(std::span<const uint2> page_ids, uint32_t mip_level, std::span<VTPage*> pages);
+
         uint32_t get_mip0_resolution() const { return _mip0_resolution; }
-        uint32_t get_mip_levels() const { return static_cast<uint32_t>(_mips.size()); }
+        uint32_t get_mip_levels() const { return _mip_levels; }
 
     private:
-        struct Mip
-        {
-            uint32_t resolution = 0;
-            std::vector<VTPage> pages;  // 以 morton code 排序.
-        };
+        uint32_t _mip0_resolution = 0;
+        uint32_t _mip_levels = 0;
+
+        std::vector<uint32_t> _mip_page_offsets;    // 每个 mip 第一个 page 的序号, 最后一项是 page 总数.
+        std::vector<VTPage> _pages;
+    };
+
+    // 离线烘焙的 page 文件, 每张贴图的 mip 链都切成 page_size 大小的 page, 每个 mip 内按 morton code 排列, 与 MipmapLUT 一致.
+    // mip 链一直生成到只剩一个 page, 与 MipmapLUT 的 mip 数相同.
+    // 文件以内存映射的方式打开, 运行时按 (geometry_id, page_id, mip_level) 取出单个 page, 不需要常驻整张贴图.
+    class VTPageFile
+    {
+    public:
+        static constexpr uint32_t page_byte_size = page_size * page_size * 4;
 
-        class QuadTree
+        static uint64_t get_source_hash(const Mesh* mesh, const Material* material);
+        static bool cook(const std::string& path, const Mesh* mesh, const Material* material);
+
+        // 文件不存在, 损坏或 source_hash 不一致时返回 false.
+        bool open(const std::string& path, uint64_t source_hash);
+        bool is_valid() const { return _file != nullptr; }
+
+        uint32_t get_mip0_resolution() const { return _mip0_resolution; }
+        uint32_t get_mip_levels() const { return _mip_levels; }
+
+        // geometry 对应的 submaterial 至少有一种贴图.
+        bool has_textures(uint32_t geometry_id) const;
+
+        // page_id 是该 mip 内以 page 为单位的坐标, 贴图不存在或越界时返回空.
+        std::span<const uint8_t> get_page(uint32_t geometry_id, uint32_t texture_type, uint2 page_id, uint32_t mip_level) const;
+
+    private:
+        uint32_t _mip0_resolution = 0;
+        uint32_t _mip_levels = 0;
+        std::vector<uint32_t> _mip_page_offsets;
+
+        std::span<const uint32_t> _submesh_material_indices;
+        std::vector<std::span<const uint8_t>> _textures;     // submaterial index * TextureType_Num + texture type.
+
+        // 组件需要可以拷贝, 映射的文件由拷贝共享.
+        std::shared_ptr<serialization::MappedBinaryInput> _file;
+    };
+
+    // 把屏幕大小的 feedback 合并为不重复的 page 请求, 按 (geometry_id, mip_level, page_id) 排序.
+    // 按 tile 并行去重, 之后 page 的处理只与不重复的 page 数有关, 与像素数无关.
+    class VTFeedbackResolver
+    {
+    public:
+        struct Request
         {
-        public:
-            QuadTree() = default;
-            QuadTree(const QuadTree& other);
-            QuadTree& operator=(const QuadTree& other);
-
-            bool initialize(uint32_t mip0_resolution_in_page, uint32_t mip_levels);
-            uint32_t query_page_morton_code(uint2 page_id, uint32_t mip_level);
-
-        private:
-            // 每个 Node 代表一个 Page.
-            struct Node
-            {
-                std::array<std::unique_ptr<Node>, 4> children;
-                Node* parent_node = nullptr;
-                
-                Bounds2I virtual_bounds;    // 代表该 node 实际映射 virtual texture 的部分 (单位是 page).
-                uint32_t mip_level = INVALID_SIZE_32;
-                uint32_t morton_code = INVALID_SIZE_32;
-
-                Node() = default;
-                Node(const Node& other);
-                Node& operator=(const Node& other);
-                bool is_leaf() const { return children[0] == nullptr; }
-            };
-
-            std::unique_ptr<Node> _root;
+            uint32_t geometry_id = 0;
+            uint32_t mip_level = 0;
+            uint2 page_id;              // mip_level 内以 page 为单位的坐标.
+            uint32_t pixel_num = 0;     // 请求该 page 的像素数, 即屏幕覆盖.
+            VTPage* page = nullptr;
+            MipmapLUT* mipmap_lut = nullptr;
         };
 
-        uint32_t _mip0_resolution = 0;
+        static constexpr uint32_t tile_size = 64;
+        static constexpr uint32_t mipmap_lut_num = std::bit_width(highest_texture_resolution / lowest_texture_resolution);
+
+        // 按分辨率直接索引.
+        void set_mipmap_lut(MipmapLUT* mipmap_lut);
+        MipmapLUT* get_mipmap_lut(uint32_t resolution) const;
 
-        QuadTree _quad_tree;
-        std::vector<Mip> _mips;
+        // mesh_texture_resolutions 以 mesh_id 索引, 没有对应 MipmapLUT 的 mesh 不产生请求.
+        // pixel_requests 不为空时输出每个像素对应的请求序号, 没有请求的像素为 INVALID_SIZE_32.
+        void resolve(
+            std::span<const VTPageInfo> page_infos,
+            uint32_t width,
+            uint32_t height,
+            std::span<const uint32_t> mesh_texture_resolutions,
+            std::vector<uint32_t>* pixel_requests = nullptr
+        );
+
+        const std::vector<Request>& get_requests() const { return _requests; }
+
+    private:
+        std::array<MipmapLUT*, mipmap_lut_num> _mipmap_luts = {};
+
+        std::vector<std::vector<std::pair<uint64_t, uint32_t>>> _tile_keys;     // (key, pixel_num).
+        std::vector<std::pair<uint64_t, uint32_t>> _keys;
+        std::vector<Request> _requests;
     };
 
+    // physical_position 是 tile 在整个 physical texture 中的坐标, 返回 tile 在 slice 中的坐标 (x, y) 与 slice 的序号 (z).
+    // 上传 page 与写入 indirect table 都由此换算, 两者总是指向同一个 tile.
+    inline uint3 get_physical_slice_position(uint2 physical_position)
+    {
+        constexpr uint32_t slice_tile_num = physical_texture_slice_size / page_size;
+        constexpr uint32_t slice_row_num = physical_texture_resolution / physical_texture_slice_size;
+        assert(physical_position.x < slice_tile_num * slice_row_num && physical_position.y < slice_tile_num * slice_row_num);
+
+        return uint3(
+            physical_position.x % slice_tile_num,
+            physical_position.y % slice_tile_num,
+            physical_position.x / slice_tile_num + (physical_position.y / slice_tile_num) * slice_row_num
+        );
+    }
+
+    // 每个像素一项: x, y 为 tile 在 physical texture slice 中的位置, z 为 slice 的序号,
+    // w 的低 8 位为实际使用的 mip 与请求的 mip 之差, 回退到更粗的 page 时其余位依次存放请求的 page 在该 page 内的偏移 (各 8 位).
+    // shader 中 tile_uv 先缩小 2^delta 倍再加上偏移, 得到在回退 page 中的 uv.
     class VTIndirectTable
     {
     public:
         VTIndirectTable() : 
-            page_pointers(CLIENT_WIDTH * CLIENT_HEIGHT, uint2(INVALID_SIZE_32)),
+            page_pointers(CLIENT_WIDTH * CLIENT_HEIGHT, uint4(INVALID_SIZE_32)),
             resolution(CLIENT_WIDTH, CLIENT_HEIGHT) 
         {
         }
 
-        void set_page(uint2 page_id, uint2 page_pos)
+        // physical_position 是 tile 在整个 physical texture 中的 tile 坐标 (不是像素坐标), 即 VTPhysicalTable 返回的位置.
+        // page_offset 是请求的 page 在回退 page 中的坐标, 小于 2^mip_delta.
+        void set_page(uint2 pixel_id, uint2 physical_position, uint32_t mip_delta = 0, uint2 page_offset = uint2(0u, 0u))
+        {
+            assert(mip_delta < 8 && page_offset.x < (1u << mip_delta) && page_offset.y < (1u << mip_delta));
+
+            uint3 slice_position = get_physical_slice_position(physical_position);
+            set_pointer(pixel_id, uint4(
+                slice_position.x,
+                slice_position.y,
+                slice_position.z,
+                mip_delta | (page_offset.x << 8) | (page_offset.y << 16)
+            ));
+        }
+
+        uint4 get_page(uint2 pixel_id) const
         {
-            assert(uv < resolution);
-            page_pointers[page_id.y * resolution.x + page_id.x] = page_pos;
+            assert(pixel_id.x < resolution.x && pixel_id.y < resolution.y);
+            return page_pointers[pixel_id.y * resolution.x + pixel_id.x];
         }
 
-        void set_page_null(uint2 page_id) { set_page(page_id, uint2(INVALID_SIZE_32)); }
-        uint2* get_data() { return page_pointers.data(); }
+        void set_page_null(uint2 pixel_id) { set_pointer(pixel_id, uint4(INVALID_SIZE_32)); }
+        uint4* get_data() { return page_pointers.data(); }
 
     private:
-        std::vector<uint2> page_pointers;
+        void set_pointer(uint2 pixel_id, const uint4& pointer)
+        {
+            assert(pixel_id.x < resolution.x && pixel_id.y < resolution.y);
+            page_pointers[pixel_id.y * resolution.x + pixel_id.x] = pointer;
+        }
+
+    private:
+        std::vector<uint4> page_pointers;
         std::string texture_name;
         uint2 resolution;
     };
@@ -123,30 +227,118 @@ namespace fantasy
     class VTPhysicalTable
     {
     public:
-        // 一个 Tile 对应 一个 Page.
+        // 一个 Tile 对应 一个 geometry 的一个 Page, tile 在 physical texture 中的位置由它所在的 slot 决定.
         struct Tile
         {
+            uint32_t geometry_id = INVALID_SIZE_32;
             VTPage* cache_page = nullptr;
-            uint2 position = uint2(INVALID_SIZE_32);
+            uint64_t frame_index = 0;       // 最后一次使用该 tile 的帧.
         };
 
-        static void on_page_evict(Tile& tile)
+        // VTPage 由使用同一 MipmapLUT 的所有 geometry 共享, 以 geometry_id 与 page 在 mip 内的坐标区分不同贴图的 page.
+        // 与 VTFeedbackResolver 的请求 key 排列相同.
+        static uint64_t get_page_key(uint32_t geometry_id, const VTPage* page)
         {
-            tile.cache_page->flag = VTPage::LoadFlag::Unload;
+            return (static_cast<uint64_t>(geometry_id) << 32) |
+                   (page->mip_level << 24) |
+                   ((static_cast<uint32_t>(page->bounds._lower.x) / page_size) << 12) |
+                   (static_cast<uint32_t>(page->bounds._lower.y) / page_size);
         }
 
     public:
-        VTPhysicalTable() : _tiles(_resolution_in_tile * _resolution_in_tile, on_page_evict) {}
+        VTPhysicalTable() : _tiles(_resolution_in_tile * _resolution_in_tile) {}
+
+        // page 已在表中时更新它的访问时间, 否则占用空闲的 tile, 没有空闲时替换最久未访问的 page.
+        // 返回的位置以 tile 为单位, 可直接传给 VTIndirectTable::set_page.
+        uint2 add_page(uint32_t geometry_id, VTPage* page, uint64_t frame_index = 0);
+        void add_pages(std::span<const uint32_t> geometry_ids, std::span<VTPage* const> pages, std::span<uint2> positions);
+
+        // page 在表中时更新它的访问时间并返回 true, position 与 add_page 相同以 tile 为单位.
+        bool touch_page(uint32_t geometry_id, VTPage* page, uint64_t frame_index, uint2& position);
+
+        // 加入新的 page 不会替换 frame_index 这一帧用到的 page.
+        bool can_add_page(uint64_t frame_index) const
+        {
+            uint32_t slot = _tiles.get_evict_slot();
+            return slot == _tiles.invalid_slot || _tiles[slot].frame_index != frame_index;
+        }
+
+        uint32_t get_capacity() const { return _tiles.capacity(); }
 
-        uint2 add_page(VTPage* page);
         static std::string get_slice_name(uint32_t texture_type, uint32_t slice_index);
 
+    private:
+        uint2 get_tile_position(uint32_t slot) const { return uint2(slot % _resolution_in_tile, slot / _resolution_in_tile); }
+
     private:
         uint32_t _resolution = physical_texture_resolution;
         uint32_t _resolution_in_tile = physical_texture_resolution / page_size;
 
-        LruCache<Tile> _tiles;
-        uint2 _current_avaible_pos = uint2(0u);
+        FixedLruCache<Tile> _tiles;
+
+        std::vector<uint64_t> _keys;
+        std::vector<Tile> _values;
+        std::vector<uint32_t> _slots;
+    };
+
+    // 决定每帧把哪些缺失的 page 上传到 physical texture, 不依赖 RHI, 只输出上传列表与每个请求可用的 page.
+    // 按 mip 从粗到细, 同一 mip 内按屏幕覆盖从大到小的顺序上传, 每帧上传的字节数不超过预算, 超出的留到之后的帧重新请求.
+    // 缺失的 page 回退到已加载的更粗一级 mip, 一级都没有时同时请求最粗一级. tile 的回收由 physical table 的 LRU 决定, 不会替换本帧用到的 page.
+    class VTStreamingScheduler
+    {
+    public:
+        struct Upload
+        {
+            uint32_t geometry_id = 0;
+            VTPage* page = nullptr;
+            uint2 physical_position;
+        };
+
+        // 请求实际使用的 page, mip_level 大于请求的 mip 时为回退的 page, 没有可用的 page 时为 INVALID_SIZE_32.
+        struct Mapping
+        {
+            uint32_t mip_level = INVALID_SIZE_32;
+            uint2 physical_position;
+        };
+
+        static constexpr uint64_t default_frame_byte_budget = 4 * 1024 * 1024;
+
+        VTStreamingScheduler();
+
+        void set_frame_byte_budget(uint64_t frame_byte_budget) { _frame_byte_budget = frame_byte_budget; }
+        void set_page_upload_byte_size(uint64_t page_upload_byte_size) { _page_upload_byte_size = page_upload_byte_size; }
+
+        // requests 来自 VTFeedbackResolver, 同一帧内不重复.
+        void schedule(std::span<const VTFeedbackResolver::Request> requests);
+
+        const std::vector<Upload>& get_uploads() const { return _uploads; }
+        const std::vector<Mapping>& get_mappings() const { return _mappings; }     // 与 requests 一一对应.
+        uint64_t get_upload_byte_size() const { return _uploads.size() * _page_upload_byte_size; }
+        uint32_t get_deferred_num() const { return _deferred_num; }
+
+    private:
+        struct Candidate
+        {
+            uint32_t geometry_id = 0;
+            uint32_t mip_level = 0;
+            uint64_t pixel_num = 0;
+            VTPage* page = nullptr;
+        };
+
+        // 从 mip_level 开始向更粗的 mip 查找已加载的 page.
+        Mapping find_resident_page(const VTFeedbackResolver::Request& request, uint32_t mip_level);
+
+    private:
+        uint64_t _frame_byte_budget = default_frame_byte_budget;
+        uint64_t _page_upload_byte_size = 0;     // 一个 page 所有种类贴图的字节数.
+        uint64_t _frame_index = 0;
+        uint32_t _deferred_num = 0;
+
+        VTPhysicalTable _physical_table;
+
+        std::vector<Candidate> _candidates;
+        std::vector<Upload> _uploads;
+        std::vector<Mapping> _mappings;
     };
 }
 
@@ -33,19 +33,29 @@ namespace fantasy
 
         serialization::BinaryOutput output(cache_path);
         output(data._data.size());
-        output.save_binary_data(data._data.data(), data._data.size());
+        output.save_compressed_data(data._data.data(), data._data.size());
     }
 
     ShaderData load_from_cache(const char* cache_path)
     {
         ShaderData shader_data;
+
+        serialization::MappedBinaryInput mapped_input(cache_path);
+        if (mapped_input.is_valid())
+        {
+            uint64_t byte_code_size = 0;
+            mapped_input(byte_code_size);
+            if (!mapped_input.load_compressed_data(shader_data._data, byte_code_size)) shader_data._data.clear();
+            return shader_data;
+        }
         
+        // 没有文件头的旧缓存.
         serialization::BinaryInput input(cache_path);
 
-        uint64_t ByteCodeSize = 0;
-        input(ByteCodeSize);
-        shader_data._data.resize(ByteCodeSize);
-        input.load_binary_data(shader_data._data.data(), ByteCodeSize);
+        // 与 string 的格式相同, 读取时会检查大小不超过文件剩余的字节数.
+        std::string byte_code;
+        input(byte_code);
+        if (input.is_valid()) shader_data._data.assign(byte_code.begin(), byte_code.end());
 
         return shader_data;
     }
@@ -80,9 +90,11 @@ namespace shader_compile
         const std::string cache_path = proj_path + "asset/shader_cache/" + remove_file_extension(desc.shader_name.c_str()) + "_" + desc.entry_point + "_DEBUG.bin";
         const std::string shader_path = proj_path + "source/shader/" + desc.shader_name;
 
+        // 缓存的格式或版本不一致时重新编译.
         if (check_cache(cache_path.c_str(), shader_path.c_str()))
         {
-            return load_from_cache(cache_path.c_str());
+            ShaderData shader_data = load_from_cache(cache_path.c_str());
+            if (!shader_data.invalid()) return shader_data;
         }
 
 		size_t pos = shader_path.find_last_of('/');
@@ -0,0 +1,116 @@
+#include "benchmark.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/log.h"
+#include "../scene/geometry.h"
+#include <assimp/scene.h>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+namespace fantasy 
+{
+    namespace benchmark
+    {
+        bool load_triangles(const std::string& model_path, std::vector<float3>& positions)
+        {
+            Assimp::Importer assimp_importer;
+            const aiScene* assimp_scene = assimp_importer.ReadFile(
+                std::string(PROJ_DIR) + model_path,
+                aiProcess_Triangulate | aiProcess_PreTransformVertices
+            );
+            if (!assimp_scene || assimp_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) return false;
+
+            positions.clear();
+            for (uint32_t ix = 0; ix < assimp_scene->mNumMeshes; ++ix)
+            {
+                const aiMesh* assimp_mesh = assimp_scene->mMeshes[ix];
+                for (uint32_t jx = 0; jx < assimp_mesh->mNumFaces; ++jx)
+                {
+                    const aiFace& face = assimp_mesh->mFaces[jx];
+                    if (face.mNumIndices != 3) continue;
+
+                    for (uint32_t kx = 0; kx < 3; ++kx)
+                    {
+                        const aiVector3D& position = assimp_mesh->mVertices[face.mIndices[kx]];
+                        positions.push_back(float3(position.x, position.y, position.z));
+                    }
+                }
+            }
+            return !positions.empty();
+        }
+
+        bool load_mesh(const std::string& model_path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+        {
+            Assimp::Importer assimp_importer;
+            const aiScene* assimp_scene = assimp_importer.ReadFile(
+                std::string(PROJ_DIR) + model_path,
+                aiProcess_Triangulate | 
+                aiProcess_GenSmoothNormals | 
+                aiProcess_CalcTangentSpace | 
+                aiProcess_PreTransformVertices
+            );
+            if (!assimp_scene || assimp_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) return false;
+
+            vertices.clear();
+            indices.clear();
+            for (uint32_t ix = 0; ix < assimp_scene->mNumMeshes; ++ix)
+            {
+                const aiMesh* assimp_mesh = assimp_scene->mMeshes[ix];
+                uint32_t vertex_offset = static_cast<uint32_t>(vertices.size());
+                for (uint32_t jx = 0; jx < assimp_mesh->mNumVertices; ++jx)
+                {
+                    Vertex& vertex = vertices.emplace_back();
+                    vertex.position = float3(assimp_mesh->mVertices[jx].x, assimp_mesh->mVertices[jx].y, assimp_mesh->mVertices[jx].z);
+                    if (assimp_mesh->HasNormals())
+                    {
+                        vertex.normal = float3(assimp_mesh->mNormals[jx].x, assimp_mesh->mNormals[jx].y, assimp_mesh->mNormals[jx].z);
+                    }
+                    if (assimp_mesh->HasTangentsAndBitangents())
+                    {
+                        vertex.tangent = float3(assimp_mesh->mTangents[jx].x, assimp_mesh->mTangents[jx].y, assimp_mesh->mTangents[jx].z);
+                    }
+                    if (assimp_mesh->HasTextureCoords(0))
+                    {
+                        vertex.uv = float2(assimp_mesh->mTextureCoords[0][jx].x, assimp_mesh->mTextureCoords[0][jx].y);
+                    }
+                }
+                for (uint32_t jx = 0; jx < assimp_mesh->mNumFaces; ++jx)
+                {
+                    const aiFace& face = assimp_mesh->mFaces[jx];
+                    if (face.mNumIndices != 3) continue;
+
+                    for (uint32_t kx = 0; kx < 3; ++kx) indices.push_back(vertex_offset + face.mIndices[kx]);
+                }
+            }
+            return !indices.empty();
+        }
+
+        bool run()
+        {
+            parallel::initialize();
+
+            bool res = true;
+            res &= thread_pool_throughput();
+            res &= bvh_build();
+            res &= bvh_ray_throughput();
+            res &= graph_partition();
+            res &= mesh_simplify();
+            res &= vertex_weld();
+            res &= vertex_cache();
+            res &= cluster_encoding();
+            res &= virtual_mesh_cache();
+            res &= serialization_throughput();
+            res &= cache_compression();
+            res &= model_import();
+            res &= image_cache();
+            res &= vt_page_cook();
+            res &= vt_feedback_resolve();
+            res &= vt_page_lookup();
+            res &= lru_cache();
+            res &= vt_streaming();
+            res &= mesh_cluster_culling();
+
+            parallel::destroy();
+            return res;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef TEST_BENCHMARK_H
+#define TEST_BENCHMARK_H
+
+#include "../core/math/vector.h"
+#include <string>
+#include <vector>
+
+namespace fantasy 
+{
+    struct Vertex;
+
+    namespace benchmark
+    {
+        // 以 xmake f --benchmark=y 构建时, main() 只运行这些 CPU 基准测试.
+        bool run();
+
+        // 读取 asset 下的模型, 输出世界空间的三角形顶点, 每 3 个一组.
+        bool load_triangles(const std::string& model_path, std::vector<float3>& positions);
+
+        // 读取 asset 下的模型, 所有 mesh 合并为一组带法线, 切线与 uv 的顶点和索引.
+        bool load_mesh(const std::string& model_path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+        bool thread_pool_throughput();
+        bool bvh_build();
+        bool bvh_ray_throughput();
+        bool graph_partition();
+        bool mesh_simplify();
+        bool vertex_weld();
+        bool vertex_cache();
+        bool cluster_encoding();
+        bool virtual_mesh_cache();
+        bool serialization_throughput();
+        bool cache_compression();
+        bool model_import();
+        bool image_cache();
+        bool vt_page_cook();
+        bool vt_feedback_resolve();
+        bool vt_page_lookup();
+        bool lru_cache();
+        bool vt_streaming();
+        bool mesh_cluster_culling();
+    }
+}
+
+#endif
@@ -0,0 +1,273 @@
+#include "benchmark.h"
+#include "../core/math/bvh.h"
+#include "../core/math/wide_bvh.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include <bvh/bvh.hpp>
+#include <bvh/leaf_collapser.hpp>
+#include <bvh/locally_ordered_clustering_builder.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        static bool load_triangles(const std::string& model_path, std::vector<Bvh::Vertex>& vertices)
+        {
+            std::vector<float3> positions;
+            if (!load_triangles(model_path, positions)) return false;
+
+            vertices.resize(positions.size());
+            for (uint64_t ix = 0; ix < positions.size(); ++ix) vertices[ix].position = positions[ix];
+            return true;
+        }
+
+        // 旧版 Bvh::build 的路径: 转换为 bvh 库的类型, LocallyOrderedClusteringBuilder 构建后逐个拷贝节点与三角形.
+        // 返回与 Bvh::sah_cost() 相同定义的 SAH 代价.
+        static float legacy_build(std::span<const Bvh::Vertex> vertices, uint32_t triangle_num)
+        {
+            auto convert_vector = [](float3 vec) { return bvh::Vector3<float>(vec.x, vec.y, vec.z); };
+            auto convert_bounds = [&](const Bounds3F& box) { return bvh::BoundingBox<float>(convert_vector(box._lower), convert_vector(box._upper)); };
+
+            Bounds3F global_box;
+            std::vector<bvh::BoundingBox<float>> primitive_boxes(triangle_num);
+            std::vector<bvh::Vector3<float>> primitive_centroids(triangle_num);
+            for (uint32_t ix = 0; ix < triangle_num; ++ix)
+            {
+                const float3& p0 = vertices[ix * 3].position;
+                const float3& p1 = vertices[ix * 3 + 1].position;
+                const float3& p2 = vertices[ix * 3 + 2].position;
+
+                Bounds3F box = merge(Bounds3F(p0, p1), p2);
+                global_box = merge(global_box, box);
+                primitive_boxes[ix] = convert_bounds(box);
+                primitive_centroids[ix] = convert_vector((p0 + p1 + p2) / 3.0f);
+            }
+
+            bvh::Bvh<float> bvh;
+            bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint32_t> builder(bvh);
+            builder.build(convert_bounds(global_box), primitive_boxes.data(), primitive_centroids.data(), triangle_num);
+            bvh::LeafCollapser<bvh::Bvh<float>> leaf_collapser(bvh);
+            leaf_collapser.collapse();
+
+            std::vector<Bvh::Node> nodes(bvh.node_count);
+            std::vector<Bvh::Vertex> leaf_vertices;
+            for (size_t ix = 0; ix < bvh.node_count; ++ix)
+            {
+                const auto& node = bvh.nodes[ix];
+                nodes[ix].box = Bounds3F(
+                    node.bounds[0], node.bounds[2], node.bounds[4],
+                    node.bounds[1], node.bounds[3], node.bounds[5]
+                );
+
+                if (node.is_leaf())
+                {
+                    nodes[ix].child_index = static_cast<uint32_t>(leaf_vertices.size()) / 3;
+                    nodes[ix].child_num = static_cast<uint32_t>(node.primitive_count);
+                    for (size_t jx = node.first_child_or_primitive; jx < node.first_child_or_primitive + node.primitive_count; ++jx)
+                    {
+                        uint64_t index = bvh.primitive_indices[jx] * 3;
+                        leaf_vertices.emplace_back(vertices[index]);
+                        leaf_vertices.emplace_back(vertices[index + 1]);
+                        leaf_vertices.emplace_back(vertices[index + 2]);
+                    }
+                }
+                else
+                {
+                    nodes[ix].child_index = static_cast<uint32_t>(node.first_child_or_primitive);
+                    nodes[ix].child_num = 0;
+                }
+            }
+
+            float cost = 0.0f;
+            for (const auto& node : nodes)
+            {
+                cost += node.box.surface_area() * (node.child_num == 0 ? 1.0f : node.child_num);
+            }
+            return cost / nodes[0].box.surface_area();
+        }
+
+        bool bvh_build()
+        {
+            constexpr uint32_t repeat_num = 5;
+            const char* model_paths[] = {
+                "asset/Model/Box/Box.gltf",
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            // 没有图元时得到空的 Bvh 与 WideBvh.
+            {
+                Bvh bvh;
+                bvh.build(std::span<Bvh::Vertex>(), 0);
+                if (!bvh.GetNodes().empty() || bvh.sah_cost() != 0.0f) return false;
+
+                std::vector<Bounds3F> boxes;
+                bvh.build(boxes, Bounds3F());
+                if (!bvh.GetNodes().empty()) return false;
+
+                WideBvh wide_bvh;
+                wide_bvh.build(bvh);
+                WideBvh::Hit hit;
+                if (!wide_bvh.empty() || wide_bvh.intersect_closest(Ray(float3(0.0f), float3(0.0f, 0.0f, 1.0f)), hit)) return false;
+            }
+
+            LOG_INFO("Bvh build (ms, SAH cost):");
+            for (const char* model_path : model_paths)
+            {
+                std::vector<Bvh::Vertex> vertices;
+                if (!load_triangles(model_path, vertices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+                uint32_t triangle_num = static_cast<uint32_t>(vertices.size() / 3);
+
+                float legacy_cost = 0.0f;
+                Timer legacy_timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix) legacy_cost = legacy_build(vertices, triangle_num);
+                float legacy_time = legacy_timer.peek() * 1000.0f / repeat_num;
+
+                Bvh bvh;
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix) bvh.build(vertices, triangle_num);
+                float time = timer.peek() * 1000.0f / repeat_num;
+
+                LOG_INFO(
+                    "    " + std::string(model_path) + " (" + std::to_string(triangle_num) + " triangles): " +
+                    "legacy " + std::to_string(legacy_time) + " / " + std::to_string(legacy_cost) + ", " +
+                    "binned sah " + std::to_string(time) + " / " + std::to_string(bvh.sah_cost())
+                );
+            }
+            return true;
+        }
+
+        // 二叉 Bvh 上的标量遍历, 与 sdf_generate_cs.slang 中 trace_triangle_index() 的做法相同, 作为对照.
+        static bool scalar_intersect_closest(const Bvh& bvh, const Ray& ray, float& hit_t)
+        {
+            std::span<const Bvh::Node> nodes = bvh.GetNodes();
+            std::span<const Bvh::Vertex> vertices = bvh.GetVertices();
+
+            float3 inv_dir(1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z);
+            uint32_t dir_is_neg[3] = { inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0 };
+
+            bool hit = false;
+            hit_t = ray.max;
+
+            uint32_t stack[64];
+            uint32_t top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const Bvh::Node& node = nodes[stack[--top]];
+
+                Ray clipped_ray(ray.ori, ray.dir, hit_t);
+                if (!node.box.intersect(clipped_ray, inv_dir, dir_is_neg)) continue;
+
+                if (node.child_num == 0)
+                {
+                    stack[top++] = node.child_index;
+                    stack[top++] = node.child_index + 1;
+                    continue;
+                }
+
+                for (uint32_t ix = node.child_index; ix < node.child_index + node.child_num; ++ix)
+                {
+                    FTrianglePrimitive triangle(vertices[ix * 3].position, vertices[ix * 3 + 1].position, vertices[ix * 3 + 2].position);
+                    if (!triangle.intersect(clipped_ray)) continue;
+
+                    float3 e1 = triangle.b - triangle.a;
+                    float3 e2 = triangle.c - triangle.a;
+                    float3 q = cross(ray.ori - triangle.a, e1);
+                    float t = dot(e2, q) / dot(e1, cross(ray.dir, e2));
+                    if (t < hit_t)
+                    {
+                        hit_t = t;
+                        hit = true;
+                        clipped_ray.max = t;
+                    }
+                }
+            }
+            return hit;
+        }
+
+        bool bvh_ray_throughput()
+        {
+            constexpr uint32_t ray_num = 1 << 20;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            LOG_INFO("Bvh ray throughput (Mrays/s, " + std::to_string(ray_num) + " rays):");
+            for (const char* model_path : model_paths)
+            {
+                std::vector<Bvh::Vertex> vertices;
+                if (!load_triangles(model_path, vertices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+
+                Bvh bvh;
+                bvh.build(vertices, static_cast<uint32_t>(vertices.size() / 3));
+                WideBvh wide_bvh;
+                wide_bvh.build(bvh);
+
+                // 从包围球上随机一点射向包围盒内随机一点.
+                const Bounds3F& box = bvh.global_box;
+                float3 center = (box._lower + box._upper) * 0.5f;
+                float radius = distance(box._lower, box._upper) * 0.5f;
+
+                std::mt19937 random_engine(0);
+                std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+                auto random_float3 = [&]() { return float3(distribution(random_engine), distribution(random_engine), distribution(random_engine)); };
+
+                std::vector<Ray> rays(ray_num);
+                for (auto& ray : rays)
+                {
+                    float3 origin = center + normalize(random_float3() - 0.5f) * radius;
+                    float3 target = box._lower + (box._upper - box._lower) * random_float3();
+                    ray = Ray(origin, normalize(target - origin));
+                }
+
+                auto measure = [&](auto&& func)
+                {
+                    std::atomic<uint32_t> hit_num = 0;
+                    Timer timer;
+                    parallel::parallel_for(
+                        parallel::Range{ 0, ray_num },
+                        [&](const parallel::Range& range)
+                        {
+                            uint32_t local_hit_num = 0;
+                            for (uint64_t ix = range.begin; ix < range.end; ++ix)
+                            {
+                                if (func(rays[ix])) local_hit_num++;
+                            }
+                            hit_num.fetch_add(local_hit_num, std::memory_order_relaxed);
+                        }
+                    );
+                    float time = timer.peek();
+                    return std::to_string(ray_num / time * 1e-6f) + " (" + std::to_string(hit_num.load()) + " hits)";
+                };
+
+                std::string scalar_result = measure([&](const Ray& ray) { float t; return scalar_intersect_closest(bvh, ray, t); });
+                std::string closest_result = measure([&](const Ray& ray) { WideBvh::Hit hit; return wide_bvh.intersect_closest(ray, hit); });
+                std::string any_result = measure([&](const Ray& ray) { return wide_bvh.intersect_any(ray); });
+
+                LOG_INFO("    " + std::string(model_path) + ":");
+                LOG_INFO("        binary scalar closest: " + scalar_result);
+                LOG_INFO("        wide sse closest:      " + closest_result);
+                LOG_INFO("        wide sse any:          " + any_result);
+            }
+            return true;
+        }
+    }
+}
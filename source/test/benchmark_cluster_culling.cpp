@@ -0,0 +1,223 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../render_pass/culling/mesh_cluster_culler.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        // mesh_cluster_culling_cs.slang 逐 group 的直接移植, 作为 MeshClusterCuller 的对照.
+        struct ScalarClusterCuller
+        {
+            const ClusterCullingView& view;
+            const DepthPyramid* hzb;
+            float near_z;
+
+            float3 transform(const float4& sphere) const
+            {
+                float4 position = mul(float4(sphere.x, sphere.y, sphere.z, 1.0f), view.view_matrix);
+                return float3(position.x, position.y, position.z);
+            }
+
+            bool check_lod(float3 position, float radius, float error) const
+            {
+                float distance = std::max(std::sqrt(position.x * position.x + position.y * position.y + position.z * position.z) - radius, 0.0f);
+                return distance * (radians(view.camera_fov_y) / view.client_height) >= error;
+            }
+
+            bool frustum_cull(float3 position, float radius) const
+            {
+                float p00 = view.proj_matrix[0][0];
+                float p11 = view.proj_matrix[1][1];
+                float x_distance = (std::abs(position.x) * p00 - position.z) * (1.0f / std::sqrt(p00 * p00 + 1.0f));
+                float y_distance = (std::abs(position.y) * p11 - position.z) * (1.0f / std::sqrt(p11 * p11 + 1.0f));
+                return x_distance < radius && y_distance < radius && position.z + radius > near_z;
+            }
+
+            bool hierarchical_zbuffer_cull(float3 center, float radius) const
+            {
+                if (hzb == nullptr || center.z - radius <= near_z) return true;
+
+                float zr2 = center.z * center.z - radius * radius;
+                float vx = std::sqrt(center.x * center.x + zr2);
+                float min_x = (vx * center.x - radius * center.z) / (vx * center.z + radius * center.x);
+                float max_x = (vx * center.x + radius * center.z) / (vx * center.z - radius * center.x);
+                float vy = std::sqrt(center.y * center.y + zr2);
+                float min_y = (vy * center.y - radius * center.z) / (vy * center.z + radius * center.y);
+                float max_y = (vy * center.y + radius * center.z) / (vy * center.z - radius * center.y);
+
+                float resolution = static_cast<float>(hzb->get_resolution());
+                float u0 = std::clamp(min_x * view.proj_matrix[0][0] * 0.5f + 0.5f, 0.0f, 1.0f);
+                float u1 = std::clamp(max_x * view.proj_matrix[0][0] * 0.5f + 0.5f, 0.0f, 1.0f);
+                float v0 = std::clamp(max_y * view.proj_matrix[1][1] * -0.5f + 0.5f, 0.0f, 1.0f);
+                float v1 = std::clamp(min_y * view.proj_matrix[1][1] * -0.5f + 0.5f, 0.0f, 1.0f);
+
+                float extent = std::max((u1 - u0) * resolution, (v1 - v0) * resolution);
+                uint32_t mip_level = 0;
+                while ((1u << mip_level) < std::ceil(std::max(extent, 1.0f))) mip_level++;
+                mip_level = std::min(mip_level, hzb->get_mip_levels() - 1);
+
+                uint32_t mip_resolution = hzb->get_resolution() >> mip_level;
+                uint32_t x0 = std::min(static_cast<uint32_t>(u0 * resolution) >> mip_level, mip_resolution - 1);
+                uint32_t x1 = std::min(static_cast<uint32_t>(u1 * resolution) >> mip_level, mip_resolution - 1);
+                uint32_t y0 = std::min(static_cast<uint32_t>(v0 * resolution) >> mip_level, mip_resolution - 1);
+                uint32_t y1 = std::min(static_cast<uint32_t>(v1 * resolution) >> mip_level, mip_resolution - 1);
+
+                float min_depth = 1.0f;
+                for (uint32_t y = y0; y <= y1; ++y)
+                {
+                    for (uint32_t x = x0; x <= x1; ++x) min_depth = std::min(min_depth, hzb->load(x, y, mip_level));
+                }
+                return near_z / (center.z - radius) >= min_depth;
+            }
+
+            void cull(const std::vector<MeshClusterGroupGpu>& groups, const std::vector<MeshClusterGpu>& clusters, std::vector<uint32_t>& visible_cluster_ids) const
+            {
+                visible_cluster_ids.clear();
+                for (const auto& group : groups)
+                {
+                    if (check_lod(transform(group.lod_bounding_sphere), group.lod_bounding_sphere.w, group.max_parent_lod_error)) continue;
+
+                    for (uint32_t ix = 0; ix < group.cluster_count; ++ix)
+                    {
+                        uint32_t cluster_id = group.cluster_index_offset + ix;
+                        const MeshClusterGpu& cluster = clusters[cluster_id];
+                        if (!check_lod(transform(cluster.lod_bounding_sphere), cluster.lod_bounding_sphere.w, cluster.lod_error)) continue;
+
+                        float3 position = transform(cluster.bounding_sphere);
+                        if (frustum_cull(position, cluster.bounding_sphere.w) && hierarchical_zbuffer_cull(position, cluster.bounding_sphere.w))
+                        {
+                            visible_cluster_ids.push_back(cluster_id);
+                        }
+                    }
+                }
+            }
+        };
+
+        bool mesh_cluster_culling()
+        {
+            constexpr uint32_t grid_size = 512;         // 最细一级每边的 cluster 数, 一个 cluster 覆盖 1x1 的地面.
+            constexpr float base_lod_error = 0.05f;
+            constexpr uint32_t view_num = 8;
+            constexpr uint32_t repeat_num = 4;
+            constexpr uint32_t hzb_resolution = 1024;
+
+            // 地形状的 cluster DAG: 第 L 级的 cluster 覆盖 2^L x 2^L 的地面, 误差为 base_lod_error * 2^L.
+            // 同一级 2x2 个 cluster 组成一个 group, group 的 lod 球与 parent error 即上一级覆盖同一范围的 cluster.
+            auto get_cell_sphere = [](uint32_t x, uint32_t z, uint32_t size)
+            {
+                float half_size = size * 0.5f;
+                return float4(x * static_cast<float>(size) + half_size, 0.0f, z * static_cast<float>(size) + half_size, half_size * 1.5f);
+            };
+            auto get_lod_error = [](uint32_t mip_level) { return mip_level == 0 ? 0.0f : base_lod_error * static_cast<float>(1u << mip_level); };
+
+            std::vector<MeshClusterGroupGpu> groups;
+            std::vector<MeshClusterGpu> clusters;
+            for (uint32_t mip_level = 0; (grid_size >> mip_level) > 0; ++mip_level)
+            {
+                uint32_t cell_size = 1u << mip_level;
+                uint32_t level_size = grid_size >> mip_level;
+                uint32_t group_size = std::min(level_size, 2u);
+                bool is_root = level_size == 1;
+
+                for (uint32_t gz = 0; gz < level_size / group_size; ++gz)
+                {
+                    for (uint32_t gx = 0; gx < level_size / group_size; ++gx)
+                    {
+                        groups.push_back(MeshClusterGroupGpu{
+                            .lod_bounding_sphere = get_cell_sphere(gx, gz, cell_size * group_size),
+                            .cluster_count = group_size * group_size,
+                            .cluster_index_offset = static_cast<uint32_t>(clusters.size()),
+                            .max_parent_lod_error = is_root ? FLT_MAX : get_lod_error(mip_level + 1)
+                        });
+                        for (uint32_t ix = 0; ix < group_size * group_size; ++ix)
+                        {
+                            float4 sphere = get_cell_sphere(gx * group_size + ix % group_size, gz * group_size + ix / group_size, cell_size);
+                            clusters.push_back(MeshClusterGpu{
+                                .bounding_sphere = sphere,
+                                .lod_bounding_sphere = sphere,
+                                .mip_level = mip_level,
+                                .group_id = static_cast<uint32_t>(groups.size() - 1),
+                                .lod_error = get_lod_error(mip_level),
+                                .vertex_offset = 0,
+                                .triangle_offset = 0,
+                                .triangle_count = 0,
+                                .geometry_id = 0
+                            });
+                        }
+                    }
+                }
+            }
+
+            MeshClusterCuller culler;
+            culler.set_clusters(groups, clusters);
+
+            // 画面中间靠近地平线处有一堵墙作为遮挡物, 其余为背景.
+            constexpr float near_z = 0.1f;
+            std::vector<float> view_depths(CLIENT_WIDTH * CLIENT_HEIGHT, INFINITY);
+            for (uint32_t y = CLIENT_HEIGHT / 4; y < CLIENT_HEIGHT * 3 / 5; ++y)
+            {
+                for (uint32_t x = CLIENT_WIDTH / 4; x < CLIENT_WIDTH * 3 / 4; ++x) view_depths[y * CLIENT_WIDTH + x] = 30.0f;
+            }
+            DepthPyramid hzb;
+            if (!hzb.build(view_depths, CLIENT_WIDTH, CLIENT_HEIGHT, hzb_resolution, near_z)) return false;
+
+            // 相机在地形中间的上方绕一圈.
+            std::vector<ClusterCullingView> views(view_num);
+            for (uint32_t ix = 0; ix < view_num; ++ix)
+            {
+                float angle = 2.0f * PI * ix / view_num;
+                float3 position(grid_size * 0.5f, 6.0f, grid_size * 0.5f);
+                float3 target = position + float3(std::sin(angle), -0.3f, std::cos(angle));
+
+                views[ix].view_matrix = look_at_left_hand(position, target, float3(0.0f, 1.0f, 0.0f));
+                views[ix].proj_matrix = perspective_left_hand(60.0f, 1.0f * CLIENT_WIDTH / CLIENT_HEIGHT, near_z, 1000.0f);
+                views[ix].camera_fov_y = 60.0f;
+            }
+
+            float scalar_time = 0.0f;
+            float culler_time = 0.0f;
+            uint64_t visible_num = 0;
+            uint64_t occluded_visible_num = 0;
+            std::vector<uint32_t> scalar_visible_cluster_ids;
+            const DepthPyramid* depth_pyramids[] = { nullptr, &hzb };
+            for (const DepthPyramid* depth_pyramid : depth_pyramids)
+            {
+                for (const auto& view : views)
+                {
+                    ScalarClusterCuller scalar_culler{ .view = view, .hzb = depth_pyramid, .near_z = -view.proj_matrix[3][2] / view.proj_matrix[2][2] };
+
+                    Timer timer;
+                    for (uint32_t ix = 0; ix < repeat_num; ++ix) scalar_culler.cull(groups, clusters, scalar_visible_cluster_ids);
+                    scalar_time += timer.peek();
+
+                    timer.tick();
+                    for (uint32_t ix = 0; ix < repeat_num; ++ix) culler.cull(view, depth_pyramid);
+                    culler_time += timer.peek();
+
+                    if (culler.get_visible_cluster_ids() != scalar_visible_cluster_ids)
+                    {
+                        LOG_ERROR("MeshClusterCuller visible clusters do not match the scalar reference.");
+                        return false;
+                    }
+                    (depth_pyramid == nullptr ? visible_num : occluded_visible_num) += scalar_visible_cluster_ids.size();
+                }
+            }
+            if (visible_num == 0 || occluded_visible_num >= visible_num) return false;
+
+            uint32_t cull_num = view_num * repeat_num * 2;
+            LOG_INFO(
+                "Mesh cluster culling (ms, " + std::to_string(groups.size()) + " groups, " + std::to_string(clusters.size()) + " clusters, " +
+                std::to_string(visible_num / view_num) + " visible, " + std::to_string(occluded_visible_num / view_num) + " visible with hzb): scalar " +
+                std::to_string(scalar_time * 1000.0f / cull_num) + ", simd parallel " + std::to_string(culler_time * 1000.0f / cull_num)
+            );
+            return true;
+        }
+    }
+}
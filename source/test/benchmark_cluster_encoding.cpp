@@ -0,0 +1,118 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_mesh.h"
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        // 索引完全相同, 位置与 uv 的误差不超过半个量化网格, 法线与切线的方向误差在八面体编码的精度以内.
+        static bool check_decoded_cluster(
+            const MeshCluster& cluster,
+            const MeshClusterQuantization& quantization,
+            const std::vector<Vertex>& vertices,
+            const std::vector<uint32_t>& indices
+        )
+        {
+            if (indices != cluster.indices || vertices.size() != cluster.vertices.size()) return false;
+
+            auto check_value = [](float decoded, float value, float step)
+            {
+                return std::abs(decoded - value) <= step * 0.5f + std::abs(value) * FLT_EPSILON;
+            };
+            auto check_direction = [](const float3& decoded, const float3& value)
+            {
+                // 零向量 (或化简时由零向量插值得到的 nan) 没有方向, 解码结果不作要求.
+                float length = std::sqrt(value.x * value.x + value.y * value.y + value.z * value.z);
+                if (!(length > 0.0f) || !std::isfinite(length)) return true;
+                float3 direction = value / length;
+                return std::abs(decoded.x - direction.x) <= 1e-3f && std::abs(decoded.y - direction.y) <= 1e-3f && std::abs(decoded.z - direction.z) <= 1e-3f;
+            };
+
+            for (uint64_t ix = 0; ix < vertices.size(); ++ix)
+            {
+                const Vertex& decoded = vertices[ix];
+                const Vertex& vertex = cluster.vertices[ix];
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    if (!check_value(decoded.position[axis], vertex.position[axis], quantization.position_step)) return false;
+                }
+                if (!check_value(decoded.uv.x, vertex.uv.x, quantization.uv_step) || !check_value(decoded.uv.y, vertex.uv.y, quantization.uv_step)) return false;
+                if (!check_direction(decoded.normal, vertex.normal) || !check_direction(decoded.tangent, vertex.tangent)) return false;
+            }
+            return true;
+        }
+
+        bool cluster_encoding()
+        {
+            constexpr uint32_t repeat_num = 10;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            LOG_INFO("Mesh cluster encoding (MB raw -> encoded, decode Mvertices/s):");
+            for (const char* model_path : model_paths)
+            {
+                Mesh mesh;
+                auto& submesh = mesh.submeshes.emplace_back();
+                if (!load_mesh(model_path, submesh.vertices, submesh.indices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+
+                VirtualMesh virtual_mesh;
+                if (!virtual_mesh.build(&mesh)) return false;
+
+                uint64_t raw_size = 0;
+                uint64_t encoded_size = 0;
+                uint64_t vertex_num = 0;
+                std::vector<EncodedMeshCluster> encoded_clusters;
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+                for (const auto& virtual_submesh : virtual_mesh._submeshes)
+                {
+                    MeshClusterQuantization quantization = get_mesh_cluster_quantization(virtual_submesh.clusters);
+                    for (const auto& cluster : virtual_submesh.clusters)
+                    {
+                        if (!encode_mesh_cluster(cluster, quantization, encoded_clusters.emplace_back())) return false;
+
+                        decode_mesh_cluster(encoded_clusters.back(), vertices, indices);
+                        if (!check_decoded_cluster(cluster, quantization, vertices, indices))
+                        {
+                            LOG_ERROR(std::string("Decoded mesh cluster does not match the source cluster: ") + model_path);
+                            return false;
+                        }
+
+                        raw_size += sizeof(MeshCluster) + cluster.vertices.size() * sizeof(Vertex) + cluster.indices.size() * sizeof(uint32_t);
+                        encoded_size += encoded_clusters.back().memory_size();
+                        vertex_num += cluster.vertices.size();
+                    }
+                }
+
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    for (const auto& encoded_cluster : encoded_clusters) decode_mesh_cluster(encoded_cluster, vertices, indices);
+                }
+                float time = timer.peek() / repeat_num;
+
+                LOG_INFO(
+                    "    " + std::string(model_path) + " (" + std::to_string(encoded_clusters.size()) + " clusters): " +
+                    std::to_string(raw_size / 1048576.0f) + " -> " + std::to_string(encoded_size / 1048576.0f) + ", " +
+                    std::to_string(vertex_num / time * 1e-6f)
+                );
+            }
+            return true;
+        }
+    }
+}
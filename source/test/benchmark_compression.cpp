@@ -0,0 +1,76 @@
+#include "benchmark.h"
+#include "../core/tools/file.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/distance_field.h"
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool cache_compression()
+        {
+            constexpr uint32_t repeat_num = 10;
+
+            // 与 .sdf 中每个 mesh 的数据大小相同的距离场, 以及与 .sc 中每个 surface 大小相同的 RGBA8 图像.
+            std::vector<uint8_t> sdf_data(static_cast<uint64_t>(SDF_RESOLUTION) * SDF_RESOLUTION * SDF_RESOLUTION * sizeof(float));
+            float* distances = reinterpret_cast<float*>(sdf_data.data());
+            for (uint32_t z = 0; z < SDF_RESOLUTION; ++z)
+            {
+                for (uint32_t y = 0; y < SDF_RESOLUTION; ++y)
+                {
+                    for (uint32_t x = 0; x < SDF_RESOLUTION; ++x)
+                    {
+                        float3 position = float3(x, y, z) / static_cast<float>(SDF_RESOLUTION) - 0.5f;
+                        float sphere = distance(position, float3(0.0f, 0.0f, 0.0f)) - 0.3f;
+                        float box = std::max(std::abs(position.x), std::max(std::abs(position.y), std::abs(position.z))) - 0.35f;
+                        distances[(z * SDF_RESOLUTION + y) * SDF_RESOLUTION + x] = std::max(sphere, -box);
+                    }
+                }
+            }
+
+            std::mt19937 random_engine(0);
+            std::vector<uint8_t> surface_data(static_cast<uint64_t>(SURFACE_RESOLUTION) * SURFACE_RESOLUTION * 4 * 16);
+            for (uint64_t ix = 0; ix < surface_data.size(); ix += 4)
+            {
+                uint64_t pixel = ix / 4;
+                surface_data[ix] = static_cast<uint8_t>(pixel % SURFACE_RESOLUTION);
+                surface_data[ix + 1] = static_cast<uint8_t>(pixel / SURFACE_RESOLUTION);
+                surface_data[ix + 2] = static_cast<uint8_t>(128 + random_engine() % 8);
+                surface_data[ix + 3] = 255;
+            }
+
+            auto measure = [&](const std::vector<uint8_t>& data, int32_t level)
+            {
+                Timer compress_timer;
+                std::vector<uint8_t> compressed_data;
+                serialization::compress_blocks(data, compressed_data, level);
+                float compress_time = compress_timer.peek() * 1000.0f;
+
+                std::vector<uint8_t> decompressed_data(data.size());
+                Timer decompress_timer;
+                bool result = true;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    result &= serialization::decompress_blocks(compressed_data, decompressed_data);
+                }
+                float decompress_time = decompress_timer.peek() * 1000.0f / repeat_num;
+                if (!result || decompressed_data != data) return std::string("mismatch");
+
+                return std::to_string(data.size() / 1048576.0f) + " -> " + std::to_string(compressed_data.size() / 1048576.0f) + ", " +
+                       std::to_string(compress_time) + " / " + std::to_string(decompress_time);
+            };
+
+            LOG_INFO("Cache compression (MB raw -> compressed, ms compress / decompress):");
+            LOG_INFO("    sdf level 1:     " + measure(sdf_data, 1));
+            LOG_INFO("    sdf level 6:     " + measure(sdf_data, 6));
+            LOG_INFO("    surface level 1: " + measure(surface_data, 1));
+            LOG_INFO("    surface level 6: " + measure(surface_data, 6));
+            return true;
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include "benchmark.h"
+#include "../core/math/graph.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_mesh.h"
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        // 共享边的三角形相邻, 与 VirtualMesh::build_adjacency_graph 得到的三角形图相同.
+        static void build_triangle_graph(const std::vector<float3>& positions, CsrGraph& graph)
+        {
+            uint32_t triangle_num = static_cast<uint32_t>(positions.size() / 3);
+
+            // 按位置合并顶点.
+            auto position_less = [&](uint32_t lhs, uint32_t rhs)
+            {
+                return std::tie(positions[lhs].x, positions[lhs].y, positions[lhs].z) <
+                       std::tie(positions[rhs].x, positions[rhs].y, positions[rhs].z);
+            };
+            std::vector<uint32_t> sorted_indices(positions.size());
+            std::iota(sorted_indices.begin(), sorted_indices.end(), 0);
+            std::sort(sorted_indices.begin(), sorted_indices.end(), position_less);
+
+            std::vector<uint32_t> vertex_ids(positions.size());
+            uint32_t vertex_id = 0;
+            for (uint32_t ix = 0; ix < sorted_indices.size(); ++ix)
+            {
+                if (ix > 0 && position_less(sorted_indices[ix - 1], sorted_indices[ix])) vertex_id++;
+                vertex_ids[sorted_indices[ix]] = vertex_id;
+            }
+
+            struct Edge
+            {
+                uint32_t v0;
+                uint32_t v1;
+                uint32_t triangle_index;
+            };
+            std::vector<Edge> edges(positions.size());
+            for (uint32_t ix = 0; ix < positions.size(); ++ix)
+            {
+                uint32_t v0 = vertex_ids[ix];
+                uint32_t v1 = vertex_ids[ix / 3 * 3 + (ix + 1) % 3];
+                edges[ix] = Edge{ std::min(v0, v1), std::max(v0, v1), ix / 3 };
+            }
+            std::sort(edges.begin(), edges.end(), [](const Edge& lhs, const Edge& rhs) { return std::tie(lhs.v0, lhs.v1) < std::tie(rhs.v0, rhs.v1); });
+
+            CsrGraphBuilder graph_builder;
+            graph_builder.reset(triangle_num);
+            for (uint32_t ix = 0; ix < edges.size();)
+            {
+                uint32_t jx = ix + 1;
+                while (jx < edges.size() && edges[jx].v0 == edges[ix].v0 && edges[jx].v1 == edges[ix].v1) jx++;
+
+                for (uint32_t a = ix; a < jx; ++a)
+                {
+                    for (uint32_t b = a + 1; b < jx; ++b)
+                    {
+                        graph_builder.add_edge(edges[a].triangle_index, edges[b].triangle_index);
+                        graph_builder.add_edge(edges[b].triangle_index, edges[a].triangle_index);
+                    }
+                }
+                ix = jx;
+            }
+            graph_builder.build(graph);
+        }
+
+        static std::vector<uint32_t> get_node_parts(const CsrGraph& graph, const GraphPartitionar& partitionar)
+        {
+            std::vector<uint32_t> node_parts(graph.node_num());
+            for (uint32_t ix = 0; ix < partitionar._part_ranges.size(); ++ix)
+            {
+                const auto& [begin, end] = partitionar._part_ranges[ix];
+                for (uint32_t jx = begin; jx < end; ++jx) node_parts[partitionar._node_indices[jx]] = ix;
+            }
+            return node_parts;
+        }
+
+        // 每个 part 作为一个节点, 权重为 part 之间被切断的边的权重之和, 与 build_cluster_groups 中的 cluster 图对应.
+        static void build_part_graph(const CsrGraph& graph, const GraphPartitionar& partitionar, CsrGraph& part_graph)
+        {
+            std::vector<uint32_t> node_parts = get_node_parts(graph, partitionar);
+
+            CsrGraphBuilder graph_builder;
+            graph_builder.reset(static_cast<uint32_t>(partitionar._part_ranges.size()));
+            for (uint32_t ix = 0; ix < graph.node_num(); ++ix)
+            {
+                std::span<const int32_t> adjacency_nodes = graph.get_adjacency_nodes(ix);
+                std::span<const int32_t> adjacency_weights = graph.get_adjacency_weights(ix);
+                for (uint32_t jx = 0; jx < adjacency_nodes.size(); ++jx)
+                {
+                    graph_builder.add_edge(node_parts[ix], node_parts[adjacency_nodes[jx]], adjacency_weights[jx]);
+                }
+            }
+            graph_builder.build(part_graph);
+        }
+
+        static int64_t get_edge_cut(const CsrGraph& graph, const GraphPartitionar& partitionar)
+        {
+            std::vector<uint32_t> node_parts = get_node_parts(graph, partitionar);
+
+            int64_t edge_cut = 0;
+            for (uint32_t ix = 0; ix < graph.node_num(); ++ix)
+            {
+                std::span<const int32_t> adjacency_nodes = graph.get_adjacency_nodes(ix);
+                std::span<const int32_t> adjacency_weights = graph.get_adjacency_weights(ix);
+                for (uint32_t jx = 0; jx < adjacency_nodes.size(); ++jx)
+                {
+                    if (node_parts[ix] != node_parts[adjacency_nodes[jx]]) edge_cut += adjacency_weights[jx];
+                }
+            }
+            return edge_cut / 2;
+        }
+
+        bool graph_partition()
+        {
+            constexpr uint32_t repeat_num = 3;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            auto measure = [&](const CsrGraph& graph, uint32_t min_part_size, uint32_t max_part_size, GraphPartitionar::Mode mode, GraphPartitionar& partitionar)
+            {
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix) partitionar.partition_graph(graph, min_part_size, max_part_size, mode);
+                float time = timer.peek() * 1000.0f / repeat_num;
+
+                return std::to_string(time) + " / " +
+                       std::to_string(partitionar._part_ranges.size()) + " / " +
+                       std::to_string(get_edge_cut(graph, partitionar));
+            };
+
+            LOG_INFO("Graph partition (ms / parts / edge cut):");
+            for (const char* model_path : model_paths)
+            {
+                std::vector<float3> positions;
+                if (!load_triangles(model_path, positions))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+
+                CsrGraph triangle_graph;
+                build_triangle_graph(positions, triangle_graph);
+
+                GraphPartitionar partitionar;
+                std::string triangle_kway = measure(
+                    triangle_graph, MeshCluster::cluster_size - 4, MeshCluster::cluster_size, GraphPartitionar::Mode::Kway, partitionar
+                );
+                std::string triangle_bisection = measure(
+                    triangle_graph, MeshCluster::cluster_size - 4, MeshCluster::cluster_size, GraphPartitionar::Mode::RecursiveBisection, partitionar
+                );
+
+                // 用递归二分得到的 cluster 构建 cluster 图.
+                CsrGraph cluster_graph;
+                build_part_graph(triangle_graph, partitionar, cluster_graph);
+
+                std::string cluster_kway = measure(
+                    cluster_graph, MeshClusterGroup::group_size - 4, MeshClusterGroup::group_size, GraphPartitionar::Mode::Kway, partitionar
+                );
+                std::string cluster_bisection = measure(
+                    cluster_graph, MeshClusterGroup::group_size - 4, MeshClusterGroup::group_size, GraphPartitionar::Mode::RecursiveBisection, partitionar
+                );
+
+                LOG_INFO("    " + std::string(model_path) + ":");
+                LOG_INFO("        triangle graph (" + std::to_string(triangle_graph.node_num()) + " nodes): bisection " + triangle_bisection + ", kway " + triangle_kway);
+                LOG_INFO("        cluster graph (" + std::to_string(cluster_graph.node_num()) + " nodes): bisection " + cluster_bisection + ", kway " + cluster_kway);
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#include "benchmark.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/image.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool image_cache()
+        {
+            // 每张贴图被引用 3 次, 相当于多个 submaterial 共用同一组贴图.
+            constexpr uint32_t reference_num = 3;
+            std::string texture_directory = std::string(PROJ_DIR) + "asset/Model/sponza/";
+
+            std::vector<std::string> file_paths;
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(texture_directory, error))
+            {
+                std::string extension = entry.path().extension().string();
+                if (extension != ".png" && extension != ".jpg" && extension != ".tga") continue;
+                for (uint32_t ix = 0; ix < reference_num; ++ix) file_paths.push_back(entry.path().string());
+            }
+            if (file_paths.empty())
+            {
+                LOG_INFO("Image cache: skip " + texture_directory);
+                return true;
+            }
+
+            Timer serial_timer;
+            uint64_t serial_size = 0;
+            for (const auto& file_path : file_paths) serial_size += Image::load_image_from_file(file_path.c_str()).size;
+            float serial_time = serial_timer.peek() * 1000.0f;
+
+            ImageCache cache;
+            std::vector<Image> images(file_paths.size());
+            Timer cache_timer;
+            parallel::parallel_for(
+                parallel::Range{ 0, file_paths.size() },
+                [&](const parallel::Range& range)
+                {
+                    for (uint64_t ix = range.begin; ix < range.end; ++ix) images[ix] = cache.load(file_paths[ix]);
+                },
+                1
+            );
+            float cache_time = cache_timer.peek() * 1000.0f;
+
+            uint64_t cache_size = 0;
+            for (const auto& image : images) cache_size += image.size;
+            if (cache_size != serial_size) return false;
+
+            LOG_INFO(
+                "Image cache (ms, " + std::to_string(file_paths.size()) + " references): serial decode " + std::to_string(serial_time) + 
+                ", parallel cache " + std::to_string(cache_time) + " (" + std::to_string(cache.get_decode_num()) + " decoded, " + 
+                std::to_string(cache.get_hit_num()) + " hits)"
+            );
+            return true;
+        }
+    }
+}
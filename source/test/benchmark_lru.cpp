@@ -0,0 +1,180 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/lru_cache.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_texture.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool lru_cache()
+        {
+            constexpr uint32_t capacity = 1024;        // physical texture 中的 tile 数.
+            constexpr uint32_t page_num = 16384;
+            constexpr uint32_t frame_num = 2000;
+            constexpr uint32_t window_size = 384;
+            constexpr uint32_t window_step = 6;
+            constexpr uint32_t random_page_num = 32;
+
+            struct Tile
+            {
+                uint64_t page = 0;
+            };
+
+            // 每帧请求一段随相机移动的连续 page, 再加上少量随机的 page (例如 mip 变化), 同一帧内不重复且有序, 与 feedback 的输出相同.
+            std::mt19937 random_engine(0);
+            std::vector<std::vector<uint64_t>> frames(frame_num);
+            uint64_t access_num = 0;
+            for (uint32_t ix = 0; ix < frame_num; ++ix)
+            {
+                auto& keys = frames[ix];
+                uint32_t window_begin = (ix * window_step) % (page_num - window_size);
+                for (uint32_t jx = 0; jx < window_size; ++jx) keys.push_back((window_begin + jx) * 64ull + 0x10000);
+                for (uint32_t jx = 0; jx < random_page_num; ++jx) keys.push_back((random_engine() % page_num) * 64ull + 0x10000);
+
+                std::sort(keys.begin(), keys.end());
+                keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+                access_num += keys.size();
+            }
+
+            // 原来 VTPhysicalTable::add_page 的用法: 先 get, 不存在时 insert, 存在时再 insert 一次提到最前.
+            uint64_t list_miss_num = 0;
+            float list_time = 0.0f;
+            {
+                LruCache<Tile> cache(capacity);
+                Timer timer;
+                for (const auto& keys : frames)
+                {
+                    for (uint64_t key : keys)
+                    {
+                        Tile* tile = cache.get(key);
+                        if (tile == nullptr)
+                        {
+                            cache.insert(key, Tile{ .page = key });
+                            list_miss_num++;
+                        }
+                        else
+                        {
+                            cache.insert(key, *tile);
+                        }
+                    }
+                }
+                list_time = timer.peek();
+            }
+
+            uint64_t evict_num = 0;
+            auto on_evict = [&](uint32_t, Tile&) { evict_num++; };
+
+            float fixed_time = 0.0f;
+            uint64_t fixed_miss_num = 0;
+            {
+                FixedLruCache<Tile, decltype(on_evict)> cache(capacity, on_evict);
+                Timer timer;
+                for (const auto& keys : frames)
+                {
+                    for (uint64_t key : keys) cache.insert(key, Tile{ .page = key });
+                }
+                fixed_time = timer.peek();
+                fixed_miss_num = evict_num + cache.size();
+            }
+
+            evict_num = 0;
+            float batch_time = 0.0f;
+            uint64_t batch_miss_num = 0;
+            {
+                FixedLruCache<Tile, decltype(on_evict)> cache(capacity, on_evict);
+                std::vector<Tile> values;
+                std::vector<uint32_t> slots;
+                Timer timer;
+                for (const auto& keys : frames)
+                {
+                    values.resize(keys.size());
+                    slots.resize(keys.size());
+                    for (uint64_t ix = 0; ix < keys.size(); ++ix) values[ix].page = keys[ix];
+                    cache.insert(keys, values, slots);
+                }
+                batch_time = timer.peek();
+                batch_miss_num = evict_num + cache.size();
+
+                // 每个 slot 中的数据都能由 key 找到.
+                for (uint32_t ix = 0; ix < cache.size(); ++ix)
+                {
+                    if (cache.find(cache[ix].page) != ix) return false;
+                }
+            }
+
+            // VTPhysicalTable 返回的 tile 坐标经 VTIndirectTable::set_page 换算为 slice 与 slice 内的 tile, 应还原为同一个 tile, 且各 tile 互不重叠.
+            {
+                constexpr uint32_t slice_tile_num = physical_texture_slice_size / page_size;
+                constexpr uint32_t slice_row_num = physical_texture_resolution / physical_texture_slice_size;
+
+                MipmapLUT mipmap_lut;
+                if (!mipmap_lut.initialize(highest_texture_resolution)) return false;
+
+                VTPhysicalTable physical_table;
+                uint32_t resolution_in_page = highest_texture_resolution / page_size;
+                // 两个 geometry 共享同一个 MipmapLUT, 同一个 VTPage 对应两张贴图的 page, 需要占用不同的 tile.
+                std::vector<VTPage*> pages(std::min(physical_table.get_capacity(), resolution_in_page * resolution_in_page * 2));
+                std::vector<uint32_t> geometry_ids(pages.size());
+                for (uint32_t ix = 0; ix < pages.size(); ++ix)
+                {
+                    uint32_t page_index = ix / 2;
+                    pages[ix] = mipmap_lut.query_page(uint2(page_index % resolution_in_page, page_index / resolution_in_page), 0);
+                    geometry_ids[ix] = (ix % 2) << 16;
+                }
+
+                std::vector<uint2> positions(pages.size());
+                physical_table.add_pages(geometry_ids, pages, positions);
+
+                VTIndirectTable indirect_table;
+                std::vector<bool> used_tiles(slice_row_num * slice_row_num * slice_tile_num * slice_tile_num, false);
+                for (uint32_t ix = 0; ix < pages.size(); ++ix)
+                {
+                    uint2 pixel_id(ix % CLIENT_WIDTH, ix / CLIENT_WIDTH);
+                    indirect_table.set_page(pixel_id, positions[ix]);
+
+                    uint4 pointer = indirect_table.get_page(pixel_id);
+                    if (pointer.x >= slice_tile_num || pointer.y >= slice_tile_num || pointer.z >= slice_row_num * slice_row_num)
+                    {
+                        LOG_ERROR("Virtual texture page position is outside the physical texture.");
+                        return false;
+                    }
+
+                    uint2 texel_position(
+                        (pointer.z % slice_row_num) * physical_texture_slice_size + pointer.x * page_size,
+                        (pointer.z / slice_row_num) * physical_texture_slice_size + pointer.y * page_size
+                    );
+                    uint32_t tile_index = (pointer.z * slice_tile_num + pointer.y) * slice_tile_num + pointer.x;
+                    if (texel_position.x != positions[ix].x * page_size || texel_position.y != positions[ix].y * page_size || used_tiles[tile_index])
+                    {
+                        LOG_ERROR("Virtual texture page does not map back to the tile it was uploaded to.");
+                        return false;
+                    }
+                    used_tiles[tile_index] = true;
+
+                    // 已在表中的 page 再次加入时位置不变.
+                    uint2 position = physical_table.add_page(geometry_ids[ix], pages[ix]);
+                    if (position.x != positions[ix].x || position.y != positions[ix].y) return false;
+                }
+            }
+
+            if (fixed_miss_num != list_miss_num || batch_miss_num != list_miss_num)
+            {
+                LOG_ERROR("FixedLruCache misses do not match LruCache.");
+                return false;
+            }
+
+            LOG_INFO(
+                "Lru cache (Maccesses/s, " + std::to_string(access_num) + " accesses, " + std::to_string(list_miss_num) + " misses, capacity " +
+                std::to_string(capacity) + "): list " + std::to_string(access_num / list_time * 1e-6f) + ", fixed " +
+                std::to_string(access_num / fixed_time * 1e-6f) + ", fixed batched " + std::to_string(access_num / batch_time * 1e-6f)
+            );
+            return true;
+        }
+    }
+}
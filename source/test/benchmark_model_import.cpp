@@ -0,0 +1,71 @@
+#include "benchmark.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/scene.h"
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool model_import()
+        {
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf"
+            };
+
+            // 每次使用新的 World, mesh_id 从 0 开始. overlap 为 true 时所有模型同时导入, 否则逐个导入.
+            auto import_models = [&](bool overlap, float& time) -> bool
+            {
+                World world;
+                if (!world.register_system(new SceneSystem())) return false;
+
+                bool result = true;
+                Timer timer;
+                if (overlap)
+                {
+                    std::vector<uint64_t> thread_ids;
+                    for (const char* model_path : model_paths)
+                    {
+                        Entity* entity = world.create_entity_delay();
+                        thread_ids.push_back(parallel::begin_thread(
+                            [&world, entity, model_path]() -> bool
+                            {
+                                return world.broadcast(event::OnModelLoad{ .entity = entity, .model_path = model_path });
+                            }
+                        ));
+                    }
+                    for (uint64_t thread_id : thread_ids) result &= parallel::thread_success(thread_id);
+                }
+                else
+                {
+                    for (const char* model_path : model_paths)
+                    {
+                        result &= world.broadcast(event::OnModelLoad{ .entity = world.create_entity_delay(), .model_path = model_path });
+                    }
+                }
+                time = timer.peek() * 1000.0f;
+                return result;
+            };
+
+            // 第一次导入会生成 virtual mesh 等磁盘缓存, 之后两次的条件相同.
+            float warm_up_time = 0.0f;
+            float serial_time = 0.0f;
+            float overlap_time = 0.0f;
+            if (!import_models(true, warm_up_time) || !import_models(false, serial_time) || !import_models(true, overlap_time))
+            {
+                LOG_INFO("Model import: skip, failed to import models.");
+                return true;
+            }
+
+            LOG_INFO(
+                "Model import (ms, " + std::to_string(std::size(model_paths)) + " models): first " + std::to_string(warm_up_time) + 
+                ", serial " + std::to_string(serial_time) + ", overlapped " + std::to_string(overlap_time)
+            );
+            return true;
+        }
+    }
+}
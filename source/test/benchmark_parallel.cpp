@@ -0,0 +1,136 @@
+#include "benchmark.h"
+#include "../core/parallel/thread_pool.h"
+#include "../core/parallel/thread_queue.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include <atomic>
+#include <future>
+#include <thread>
+
+namespace fantasy 
+{
+    namespace benchmark
+    {
+        // 旧版线程池的提交路径: 每个任务一个 packaged_task, 一个 future, 经过双锁链表队列.
+        class LegacyThreadPool
+        {
+        public:
+            LegacyThreadPool(uint32_t thread_num)
+            {
+                for (uint32_t ix = 0; ix < thread_num; ++ix)
+                {
+                    _threads.emplace_back(&LegacyThreadPool::worker_thread, this);
+                }
+            }
+
+            ~LegacyThreadPool()
+            {
+                _done = true;
+                _queue.condition_variable.notify_all();
+                for (auto& thread : _threads) thread.join();
+            }
+
+            void run(std::function<void(uint64_t)> func, uint64_t count)
+            {
+                std::vector<std::future<bool>> futures;
+                for (uint64_t ix = 0; ix < count; ++ix)
+                {
+                    auto task = std::make_shared<std::packaged_task<bool()>>([&func, ix]() { func(ix); return true; });
+                    futures.emplace_back(task->get_future());
+                    _queue.push([task]() { (*task)(); });
+                }
+                for (auto& future : futures) future.get();
+            }
+
+        private:
+            void worker_thread()
+            {
+                std::mutex mutex;
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!_done)
+                {
+                    std::function<void()> task;
+                    if (_queue.try_pop(task)) task();
+                    else _queue.condition_variable.wait_for(lock, std::chrono::milliseconds(1));
+                }
+            }
+
+        private:
+            std::atomic<bool> _done = false;
+            std::vector<std::thread> _threads;
+            ConcurrentQueue<std::function<void()>> _queue;
+        };
+
+        static void tiny_work(std::atomic<uint64_t>& sink, uint64_t ix)
+        {
+            uint64_t value = ix;
+            for (uint32_t jx = 0; jx < 64; ++jx) value = value * 6364136223846793005ull + 1442695040888963407ull;
+            sink.fetch_add(value & 1, std::memory_order_relaxed);
+        }
+
+        bool thread_pool_throughput()
+        {
+            constexpr uint64_t task_num = 100000;
+            constexpr uint32_t repeat_num = 5;
+
+            ThreadPool pool;
+            uint32_t thread_num = pool.get_thread_num();
+
+            std::atomic<uint64_t> sink = 0;
+            float legacy_time = 0.0f;
+            {
+                LegacyThreadPool legacy_pool(thread_num);
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    legacy_pool.run([&sink](uint64_t ix) { tiny_work(sink, ix); }, task_num);
+                }
+                legacy_time = timer.peek();
+            }
+
+            float spawn_time = 0.0f;
+            {
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    std::atomic<uint32_t> counter = static_cast<uint32_t>(task_num);
+                    for (uint64_t jx = 0; jx < task_num; ++jx)
+                    {
+                        pool.spawn([&sink, &counter, jx]() { tiny_work(sink, jx); counter.fetch_sub(1, std::memory_order_release); });
+                    }
+                    pool.wait(counter);
+                }
+                spawn_time = timer.peek();
+            }
+
+            float nested_spawn_time = 0.0f;
+            {
+                // 从 worker 线程提交, 任务进入该 worker 自己的双端队列并被其他 worker 窃取.
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    std::atomic<uint32_t> counter = static_cast<uint32_t>(task_num + 1);
+                    pool.spawn(
+                        [&]()
+                        {
+                            for (uint64_t jx = 0; jx < task_num; ++jx)
+                            {
+                                pool.spawn([&sink, &counter, jx]() { tiny_work(sink, jx); counter.fetch_sub(1, std::memory_order_release); });
+                            }
+                            counter.fetch_sub(1, std::memory_order_release);
+                        }
+                    );
+                    pool.wait(counter);
+                }
+                nested_spawn_time = timer.peek();
+            }
+
+            auto throughput = [](float time) { return std::to_string(static_cast<uint64_t>(task_num * repeat_num / time)); };
+            LOG_INFO("Thread pool throughput (" + std::to_string(thread_num) + " threads, tasks/s):");
+            LOG_INFO("    legacy queue:        " + throughput(legacy_time));
+            LOG_INFO("    external spawn:      " + throughput(spawn_time));
+            LOG_INFO("    worker spawn/steal:  " + throughput(nested_spawn_time));
+            return true;
+        }
+    }
+}
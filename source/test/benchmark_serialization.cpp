@@ -0,0 +1,74 @@
+#include "benchmark.h"
+#include "../core/tools/file.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool serialization_throughput()
+        {
+            const uint32_t element_nums[] = { 1u << 12, 1u << 18, 64u * 64u * 64u * 4u };
+            std::string path = (std::filesystem::temp_directory_path() / "benchmark.bin").string();
+
+            LOG_INFO("Serialization (ms, per element write / bulk write / stream read / mapped span):");
+            for (uint32_t element_num : element_nums)
+            {
+                std::vector<float3> data(element_num);
+                for (uint32_t ix = 0; ix < element_num; ++ix) data[ix] = float3(ix, ix * 0.5f, ix * 0.25f);
+
+                // 旧的写法: 每个元素单独写入.
+                Timer element_timer;
+                {
+                    serialization::BinaryOutput output(path);
+                    uint64_t size = data.size();
+                    output(size);
+                    for (const auto& element : data) output.save_binary_data(&element, sizeof(float3));
+                }
+                float element_time = element_timer.peek() * 1000.0f;
+
+                Timer bulk_timer;
+                {
+                    serialization::BinaryOutput output(path);
+                    output(data);
+                }
+                float bulk_time = bulk_timer.peek() * 1000.0f;
+
+                std::vector<float3> stream_data;
+                Timer stream_timer;
+                {
+                    serialization::BinaryInput input(path);
+                    input(stream_data);
+                }
+                float stream_time = stream_timer.peek() * 1000.0f;
+
+                std::span<const float3> mapped_data;
+                Timer mapped_timer;
+                serialization::MappedBinaryInput mapped_input(path);
+                mapped_data = mapped_input.get_span<float3>();
+                float mapped_time = mapped_timer.peek() * 1000.0f;
+
+                if (
+                    stream_data.size() != data.size() || mapped_data.size() != data.size() ||
+                    !(stream_data.back() == data.back()) || !(mapped_data.back() == data.back())
+                )
+                {
+                    LOG_ERROR("Serialization round trip mismatch.");
+                    return false;
+                }
+
+                LOG_INFO(
+                    "    " + std::to_string(element_num) + " float3: " +
+                    std::to_string(element_time) + " / " + std::to_string(bulk_time) + " / " +
+                    std::to_string(stream_time) + " / " + std::to_string(mapped_time)
+                );
+            }
+            std::filesystem::remove(path);
+            return true;
+        }
+    }
+}
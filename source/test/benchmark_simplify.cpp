@@ -0,0 +1,68 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_mesh.h"
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool mesh_simplify()
+        {
+            constexpr uint32_t repeat_num = 3;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+            const float target_ratios[] = { 0.5f, 0.1f };
+
+            LOG_INFO("Mesh simplify (Mtriangles/s of input, output triangles, max error):");
+            for (const char* model_path : model_paths)
+            {
+                std::vector<Vertex> source_vertices;
+                std::vector<uint32_t> source_indices;
+                if (!load_mesh(model_path, source_vertices, source_indices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+                uint32_t triangle_num = static_cast<uint32_t>(source_indices.size() / 3);
+
+                // 与 build_parent_clusters 相同, 同一个 MeshOptimizer 在多次简化之间复用内存.
+                MeshOptimizer optimizer;
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+
+                std::string result = "    " + std::string(model_path) + " (" + std::to_string(triangle_num) + " triangles):";
+                for (float target_ratio : target_ratios)
+                {
+                    float time = 0.0f;
+                    for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                    {
+                        vertices = source_vertices;
+                        indices = source_indices;
+
+                        Timer timer;
+                        optimizer.reset(vertices, indices);
+                        if (!optimizer.optimize(static_cast<uint32_t>(triangle_num * target_ratio))) return false;
+                        time += timer.peek();
+                    }
+                    time /= repeat_num;
+
+                    result += 
+                        " " + std::to_string(static_cast<uint32_t>(target_ratio * 100.0f)) + "% " + 
+                        std::to_string(triangle_num / time * 1e-6f) + " / " + 
+                        std::to_string(indices.size() / 3) + " / " + 
+                        std::to_string(optimizer._max_error);
+                }
+                LOG_INFO(result);
+            }
+            return true;
+        }
+    }
+}
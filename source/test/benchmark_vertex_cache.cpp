@@ -0,0 +1,61 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_mesh.h"
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool vertex_cache()
+        {
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            auto to_string = [](const VertexCacheStatistics& statistics)
+            {
+                return std::to_string(statistics.acmr()) + " / " + std::to_string(statistics.atvr());
+            };
+
+            LOG_INFO("Vertex cache optimization (ms, ACMR / ATVR before -> after, fifo cache of 16):");
+            for (const char* model_path : model_paths)
+            {
+                Mesh mesh;
+                auto& submesh = mesh.submeshes.emplace_back();
+                if (!load_mesh(model_path, submesh.vertices, submesh.indices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+
+                std::vector<uint32_t> vertex_remap;
+                uint32_t vertex_num = weld_vertices(submesh.vertices, submesh.indices, vertex_remap);
+                VertexCacheStatistics before = analyze_vertex_cache(submesh.indices, vertex_num);
+
+                Timer timer;
+                std::vector<uint32_t> triangle_order;
+                optimize_vertex_cache(submesh.indices, vertex_num, triangle_order);
+                vertex_num = optimize_vertex_fetch(submesh.vertices, submesh.indices, vertex_remap);
+                float time = timer.peek() * 1000.0f;
+
+                VertexCacheStatistics after = analyze_vertex_cache(submesh.indices, vertex_num);
+                LOG_INFO(
+                    "    " + std::string(model_path) + " (" + std::to_string(submesh.indices.size() / 3) + " triangles): " +
+                    std::to_string(time) + ", " + to_string(before) + " -> " + to_string(after)
+                );
+
+                // VirtualMesh::build 按 mip level 输出 cluster 重排前后的 ACMR.
+                VirtualMesh virtual_mesh;
+                if (!virtual_mesh.build(&mesh)) return false;
+            }
+            return true;
+        }
+    }
+}
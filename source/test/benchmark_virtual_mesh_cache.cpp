@@ -0,0 +1,81 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_mesh.h"
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool virtual_mesh_cache()
+        {
+            constexpr uint32_t repeat_num = 5;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+            std::string cache_path = (std::filesystem::temp_directory_path() / "benchmark.vm").string();
+
+            LOG_INFO("Virtual mesh cache (ms, build / save / load, MB):");
+            for (const char* model_path : model_paths)
+            {
+                Mesh mesh;
+                auto& submesh = mesh.submeshes.emplace_back();
+                if (!load_mesh(model_path, submesh.vertices, submesh.indices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+                uint64_t source_hash = VirtualMesh::get_source_hash(&mesh);
+
+                VirtualMesh virtual_mesh;
+                Timer build_timer;
+                if (!virtual_mesh.build(&mesh)) return false;
+                float build_time = build_timer.peek() * 1000.0f;
+
+                Timer save_timer;
+                if (!virtual_mesh.save(cache_path, source_hash)) return false;
+                float save_time = save_timer.peek() * 1000.0f;
+
+                VirtualMesh loaded_virtual_mesh;
+                Timer load_timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    if (!loaded_virtual_mesh.load(cache_path, source_hash, &mesh)) return false;
+                }
+                float load_time = load_timer.peek() * 1000.0f / repeat_num;
+
+                // 读回的 gpu 数据应与构建结果逐字节相同.
+                auto is_same = [](const auto& lhs, const auto& rhs)
+                {
+                    return lhs.size() == rhs.size() && memcmp(lhs.data(), rhs.data(), lhs.size() * sizeof(lhs[0])) == 0;
+                };
+                if (
+                    !is_same(virtual_mesh._cluster_gpus, loaded_virtual_mesh._cluster_gpus) ||
+                    !is_same(virtual_mesh._cluster_group_gpus, loaded_virtual_mesh._cluster_group_gpus) ||
+                    !is_same(virtual_mesh._cluster_vertices, loaded_virtual_mesh._cluster_vertices) ||
+                    !is_same(virtual_mesh._cluster_triangles, loaded_virtual_mesh._cluster_triangles)
+                )
+                {
+                    LOG_ERROR(std::string("Virtual mesh cache mismatch: ") + model_path);
+                    return false;
+                }
+
+                LOG_INFO(
+                    "    " + std::string(model_path) + " (" + std::to_string(virtual_mesh._cluster_gpus.size()) + " clusters): " +
+                    std::to_string(build_time) + " / " + std::to_string(save_time) + " / " + std::to_string(load_time) + ", " +
+                    std::to_string(std::filesystem::file_size(cache_path) / 1048576.0f)
+                );
+            }
+            std::filesystem::remove(cache_path);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#include "benchmark.h"
+#include "../core/tools/file.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/geometry.h"
+#include "../scene/virtual_texture.h"
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool vt_page_cook()
+        {
+            constexpr uint32_t resolution = 2048;
+            constexpr uint32_t submaterial_num = 2;
+            constexpr uint32_t submesh_num = 4;
+            constexpr uint32_t read_num = 1 << 16;
+
+            // 随机噪声贴图, 所有 submaterial 的每种贴图都存在.
+            std::mt19937 random_engine(0);
+            Material material;
+            material.image_resolution = resolution;
+            material.submaterials.resize(submaterial_num);
+            for (auto& submaterial : material.submaterials)
+            {
+                for (auto& image : submaterial.images)
+                {
+                    image.width = resolution;
+                    image.height = resolution;
+                    image.format = Format::RGBA8_UNORM;
+                    image.size = static_cast<uint64_t>(resolution) * resolution * 4;
+                    image.data = std::shared_ptr<uint8_t[]>(new uint8_t[image.size]);
+                    for (uint64_t ix = 0; ix < image.size; ++ix) image.data[ix] = static_cast<uint8_t>(random_engine());
+                }
+            }
+
+            Mesh mesh;
+            mesh.submeshes.resize(submesh_num);
+            for (uint32_t ix = 0; ix < submesh_num; ++ix) mesh.submeshes[ix].material_index = ix % submaterial_num;
+
+            std::string page_file_path = (std::filesystem::temp_directory_path() / "benchmark.vt").string();
+            uint64_t source_size = submaterial_num * Material::TextureType_Num * static_cast<uint64_t>(resolution) * resolution * 4;
+
+            Timer cook_timer;
+            if (!VTPageFile::cook(page_file_path, &mesh, &material)) return false;
+            float cook_time = cook_timer.peek();
+
+            Timer open_timer;
+            VTPageFile page_file;
+            if (!page_file.open(page_file_path, VTPageFile::get_source_hash(&mesh, &material))) return false;
+            float open_time = open_timer.peek() * 1000.0f;
+
+            // 随机读取各级 mip 的 page, 相当于 feedback 请求的 page 逐个上传.
+            struct PageRequest
+            {
+                uint32_t geometry_id;
+                uint32_t texture_type;
+                uint2 page_id;
+                uint32_t mip_level;
+            };
+            std::vector<PageRequest> requests(read_num);
+            for (auto& request : requests)
+            {
+                request.mip_level = random_engine() % page_file.get_mip_levels();
+                uint32_t resolution_in_page = (resolution / page_size) >> request.mip_level;
+                request.page_id = uint2(random_engine() % resolution_in_page, random_engine() % resolution_in_page);
+                request.geometry_id = random_engine() % submesh_num;
+                request.texture_type = random_engine() % Material::TextureType_Num;
+            }
+
+            uint64_t read_size = 0;
+            uint64_t checksum = 0;
+            Timer read_timer;
+            for (const auto& request : requests)
+            {
+                std::span<const uint8_t> page = page_file.get_page(request.geometry_id, request.texture_type, request.page_id, request.mip_level);
+                if (page.size() != VTPageFile::page_byte_size) return false;
+
+                checksum = serialization::get_checksum(page, checksum);
+                read_size += page.size();
+            }
+            float read_time = read_timer.peek();
+
+            LOG_INFO(
+                "Virtual texture page cook (" + std::to_string(submaterial_num * Material::TextureType_Num) + " textures of " +
+                std::to_string(resolution) + "): cook " + std::to_string(cook_time * 1000.0f) + " ms (" +
+                std::to_string(source_size / 1048576.0f / cook_time) + " MB/s), " +
+                std::to_string(std::filesystem::file_size(page_file_path) / 1048576.0f) + " MB on disk, open " + std::to_string(open_time) + " ms, " +
+                "random page read " + std::to_string(read_num / read_time * 1e-6f) + " Mpages/s (" +
+                std::to_string(read_size / 1048576.0f / read_time) + " MB/s, checksum " + std::to_string(checksum & 0xffff) + ")"
+            );
+
+            // 先解除映射再删除文件.
+            page_file = VTPageFile();
+            std::error_code error;
+            std::filesystem::remove(page_file_path, error);
+            return true;
+        }
+    }
+}
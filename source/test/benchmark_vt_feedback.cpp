@@ -0,0 +1,171 @@
+#include "benchmark.h"
+#include "../core/parallel/parallel.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_texture.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        // 与 virtual_gbuffer_ps.slang 相同的打包方式, page_id 是 mip 0 以 page 为单位的坐标.
+        static uint32_t pack_page_id_mip_level(uint2 page_id, uint32_t mip_level)
+        {
+            return ((page_id.x & 0xff) << 24) | ((page_id.y & 0xff) << 16) | (((page_id.x >> 8) & 0xf) << 12) | (((page_id.y >> 8) & 0xf) << 8) | (mip_level & 0xff);
+        }
+
+        bool vt_feedback_resolve()
+        {
+            constexpr uint32_t width = 1920;
+            constexpr uint32_t height = 1080;
+            constexpr uint32_t repeat_num = 5;
+
+            std::vector<MipmapLUT> mipmap_luts(VTFeedbackResolver::mipmap_lut_num);
+            for (uint32_t ix = 0; ix < mipmap_luts.size(); ++ix)
+            {
+                if (!mipmap_luts[ix].initialize(lowest_texture_resolution << ix)) return false;
+            }
+
+            // 屏幕按列分给 4 个 mesh, 每个 mesh 的贴图铺满自己的区域, 越往下 mip 越粗.
+            // 左上角留一块空白, 相当于没有几何的背景.
+            const uint32_t mesh_texture_resolutions[] = { 512, 1024, 2048, 2048 };
+            constexpr uint32_t mesh_num = 4;
+            constexpr uint32_t submesh_num = 3;
+
+            std::vector<VTPageInfo> page_infos(width * height);
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    VTPageInfo& info = page_infos[x + y * width];
+                    if (x < 128 && y < 128)
+                    {
+                        info = VTPageInfo{ .geometry_id = INVALID_SIZE_32, .page_id_mip_level = 0 };
+                        continue;
+                    }
+
+                    uint32_t strip_width = width / mesh_num;
+                    uint32_t mesh_id = std::min(x / strip_width, mesh_num - 1);
+                    uint32_t submesh_id = (y * submesh_num) / height;
+                    uint32_t resolution_in_page = mesh_texture_resolutions[mesh_id] / page_size;
+
+                    uint2 page_id(
+                        (x % strip_width) * resolution_in_page / strip_width,
+                        y * resolution_in_page / height
+                    );
+                    uint32_t mip_level = y * 3 / height;
+                    info = VTPageInfo{
+                        .geometry_id = (mesh_id << 16) | submesh_id,
+                        .page_id_mip_level = pack_page_id_mip_level(page_id, mip_level)
+                    };
+                }
+            }
+
+            // 原来的做法: 每个像素查找分辨率相同的 MipmapLUT, 加锁访问 physical table.
+            float per_pixel_time = 0.0f;
+            {
+                std::mutex mutex;
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    VTPhysicalTable physical_table;
+                    parallel::parallel_for(
+                        [&](uint64_t x, uint64_t y)
+                        {
+                            const VTPageInfo& info = page_infos[x + y * width];
+                            if (info.geometry_id == INVALID_SIZE_32) return;
+
+                            uint32_t data = info.page_id_mip_level;
+                            uint2 page_id(
+                                (((data >> 12) & 0xf) << 8) | ((data >> 24) & 0xff),
+                                (((data >> 8) & 0xf) << 8) | ((data >> 16) & 0xff)
+                            );
+                            for (auto& mipmap_lut : mipmap_luts)
+                            {
+                                if (mipmap_lut.get_mip0_resolution() != mesh_texture_resolutions[info.geometry_id >> 16]) continue;
+
+                                uint32_t mip_level = std::min(data & 0xff, mipmap_lut.get_mip_levels() - 1);
+                                VTPage* page = mipmap_lut.query_page(page_id, mip_level);
+
+                                std::lock_guard lock(mutex);
+                                physical_table.add_page(info.geometry_id, page);
+                            }
+                        },
+                        width,
+                        height
+                    );
+                }
+                per_pixel_time = timer.peek() * 1000.0f / repeat_num;
+            }
+
+            VTFeedbackResolver resolver;
+            for (auto& mipmap_lut : mipmap_luts) resolver.set_mipmap_lut(&mipmap_lut);
+
+            std::vector<uint32_t> pixel_requests;
+            float resolve_time = 0.0f;
+            float pixel_request_time = 0.0f;
+            {
+                Timer timer;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    VTPhysicalTable physical_table;
+                    resolver.resolve(page_infos, width, height, mesh_texture_resolutions);
+                    for (const auto& request : resolver.get_requests()) physical_table.add_page(request.geometry_id, request.page);
+                }
+                resolve_time = timer.peek() * 1000.0f / repeat_num;
+
+                timer.tick();
+                for (uint32_t ix = 0; ix < repeat_num; ++ix) resolver.resolve(page_infos, width, height, mesh_texture_resolutions, &pixel_requests);
+                pixel_request_time = timer.peek() * 1000.0f / repeat_num;
+            }
+
+            // 检查请求有序且不重复, 每个像素都指向自己的请求.
+            const auto& requests = resolver.get_requests();
+            for (uint32_t ix = 1; ix < requests.size(); ++ix)
+            {
+                const auto& prev = requests[ix - 1];
+                const auto& curr = requests[ix];
+                if (std::tie(prev.geometry_id, prev.mip_level, prev.page_id.x, prev.page_id.y) >=
+                    std::tie(curr.geometry_id, curr.mip_level, curr.page_id.x, curr.page_id.y))
+                {
+                    LOG_ERROR("Virtual texture feedback requests are not sorted.");
+                    return false;
+                }
+            }
+            std::vector<uint32_t> request_pixel_nums(requests.size(), 0);
+            for (uint32_t ix = 0; ix < page_infos.size(); ++ix)
+            {
+                const VTPageInfo& info = page_infos[ix];
+                if (info.geometry_id == INVALID_SIZE_32)
+                {
+                    if (pixel_requests[ix] != INVALID_SIZE_32) return false;
+                    continue;
+                }
+                if (pixel_requests[ix] >= requests.size() || requests[pixel_requests[ix]].geometry_id != info.geometry_id) return false;
+                request_pixel_nums[pixel_requests[ix]]++;
+            }
+
+            // 每个请求统计的屏幕覆盖与指向它的像素数相同.
+            for (uint32_t ix = 0; ix < requests.size(); ++ix)
+            {
+                if (requests[ix].pixel_num != request_pixel_nums[ix])
+                {
+                    LOG_ERROR("Virtual texture feedback request pixel count does not match.");
+                    return false;
+                }
+            }
+
+            LOG_INFO(
+                "Virtual texture feedback resolve (ms, " + std::to_string(width) + "x" + std::to_string(height) + " pixels, " +
+                std::to_string(requests.size()) + " unique pages): per pixel " + std::to_string(per_pixel_time) +
+                ", resolver " + std::to_string(resolve_time) + ", resolver with pixel requests " + std::to_string(pixel_request_time)
+            );
+            return true;
+        }
+    }
+}
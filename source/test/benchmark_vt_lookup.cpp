@@ -0,0 +1,134 @@
+#include "benchmark.h"
+#include "../core/math/bounds.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_texture.h"
+#include <array>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        // 原来 MipmapLUT 的做法: 每个 page 一个堆上的节点, 从根节点开始逐级找包含 page_id 的子节点.
+        struct QuadTreeNode
+        {
+            std::array<std::unique_ptr<QuadTreeNode>, 4> children;
+            Bounds2I virtual_bounds;    // mip 0 以 page 为单位的范围.
+            uint32_t mip_level = 0;
+            uint32_t page_index = INVALID_SIZE_32;
+        };
+
+        static void build_quad_tree(QuadTreeNode* node, const MipmapLUT& mipmap_lut)
+        {
+            if (node->mip_level == 0) return;
+
+            uint32_t child_size = node->virtual_bounds.width() / 2;
+            for (uint32_t ix = 0; ix < 4; ++ix)
+            {
+                uint2 lower = node->virtual_bounds._lower + uint2(ix & 1, ix >> 1) * child_size;
+
+                auto& child = node->children[ix];
+                child = std::make_unique<QuadTreeNode>();
+                child->virtual_bounds = Bounds2I(lower, lower + child_size);
+                child->mip_level = node->mip_level - 1;
+                child->page_index = mipmap_lut.get_page_index(lower, child->mip_level);
+                build_quad_tree(child.get(), mipmap_lut);
+            }
+        }
+
+        static uint32_t query_quad_tree(const QuadTreeNode* root, uint2 page_id, uint32_t mip_level)
+        {
+            const QuadTreeNode* node = root;
+            while (node->mip_level != mip_level)
+            {
+                for (const auto& child : node->children)
+                {
+                    if (inside_exclusive(page_id, child->virtual_bounds))
+                    {
+                        node = child.get();
+                        break;
+                    }
+                }
+            }
+            return node->page_index;
+        }
+
+        bool vt_page_lookup()
+        {
+            constexpr uint32_t lookup_num = 1 << 22;
+            constexpr uint32_t batch_size = 256;
+
+            MipmapLUT mipmap_lut;
+            if (!mipmap_lut.initialize(highest_texture_resolution)) return false;
+            uint32_t mip_levels = mipmap_lut.get_mip_levels();
+            uint32_t resolution_in_page = highest_texture_resolution / page_size;
+
+            // 根节点是最粗的一级 mip, 只有一个 page, 覆盖整张贴图.
+            QuadTreeNode root;
+            root.virtual_bounds = Bounds2I(uint2(0u), uint2(resolution_in_page));
+            root.mip_level = mip_levels - 1;
+            root.page_index = mipmap_lut.get_page_index(uint2(0u), root.mip_level);
+            if (mipmap_lut.get_page_index(uint2(resolution_in_page - 1), root.mip_level) != root.page_index) return false;
+            build_quad_tree(&root, mipmap_lut);
+
+            // 每 batch_size 个查询属于同一级 mip, 与 feedback 按 mip 分组后的请求相同.
+            std::mt19937 random_engine(0);
+            std::vector<uint2> page_ids(lookup_num);
+            std::vector<uint32_t> mip_levels_of_batch(lookup_num / batch_size);
+            for (uint32_t ix = 0; ix < lookup_num; ++ix)
+            {
+                if (ix % batch_size == 0) mip_levels_of_batch[ix / batch_size] = random_engine() % mip_levels;
+                page_ids[ix] = uint2(random_engine() % resolution_in_page, random_engine() % resolution_in_page);
+            }
+
+            std::vector<VTPage*> tree_pages(lookup_num);
+            Timer tree_timer;
+            for (uint32_t ix = 0; ix < lookup_num; ++ix)
+            {
+                tree_pages[ix] = mipmap_lut.query_page(uint2(0u), 0) + query_quad_tree(&root, page_ids[ix], mip_levels_of_batch[ix / batch_size]);
+            }
+            float tree_time = tree_timer.peek();
+
+            std::vector<VTPage*> pages(lookup_num);
+            Timer flat_timer;
+            for (uint32_t ix = 0; ix < lookup_num; ++ix)
+            {
+                pages[ix] = mipmap_lut.query_page(page_ids[ix], mip_levels_of_batch[ix / batch_size]);
+            }
+            float flat_time = flat_timer.peek();
+            if (pages != tree_pages)
+            {
+                LOG_ERROR("MipmapLUT flat lookup does not match the quad tree.");
+                return false;
+            }
+
+            std::vector<VTPage*> batch_pages(lookup_num);
+            Timer batch_timer;
+            for (uint32_t ix = 0; ix < lookup_num; ix += batch_size)
+            {
+                mipmap_lut.query_pages(
+                    std::span<const uint2>(page_ids).subspan(ix, batch_size),
+                    mip_levels_of_batch[ix / batch_size],
+                    std::span<VTPage*>(batch_pages).subspan(ix, batch_size)
+                );
+            }
+            float batch_time = batch_timer.peek();
+            if (batch_pages != tree_pages)
+            {
+                LOG_ERROR("MipmapLUT batched lookup does not match the quad tree.");
+                return false;
+            }
+
+            LOG_INFO(
+                "MipmapLUT page lookup (Mlookups/s, " + std::to_string(highest_texture_resolution) + " texture, " + std::to_string(mip_levels) + " mips): " +
+                "quad tree " + std::to_string(lookup_num / tree_time * 1e-6f) + ", flat " + std::to_string(lookup_num / flat_time * 1e-6f) +
+                ", flat batched " + std::to_string(lookup_num / batch_time * 1e-6f)
+            );
+            return true;
+        }
+    }
+}
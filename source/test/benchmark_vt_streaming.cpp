@@ -0,0 +1,189 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/virtual_texture.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        struct StreamingStats
+        {
+            uint64_t peak_upload_byte_size = 0;
+            uint64_t total_upload_byte_size = 0;
+            uint64_t exact_num = 0;
+            uint64_t fallback_num = 0;
+            uint64_t missing_num = 0;
+            float schedule_time = 0.0f;
+        };
+
+        static bool run_streaming_trace(
+            const std::vector<std::vector<VTFeedbackResolver::Request>>& frames,
+            uint64_t frame_byte_budget,
+            StreamingStats& stats
+        )
+        {
+            VTStreamingScheduler scheduler;
+            scheduler.set_frame_byte_budget(frame_byte_budget);
+
+            Timer timer;
+            for (const auto& requests : frames)
+            {
+                timer.tick();
+                scheduler.schedule(requests);
+                stats.schedule_time += timer.peek();
+
+                uint64_t upload_byte_size = scheduler.get_upload_byte_size();
+                if (upload_byte_size > frame_byte_budget) return false;
+                stats.peak_upload_byte_size = std::max(stats.peak_upload_byte_size, upload_byte_size);
+                stats.total_upload_byte_size += upload_byte_size;
+
+                // mapping 与 upload 的位置以 tile 为单位, 都在 physical texture 之内.
+                constexpr uint32_t resolution_in_tile = physical_texture_resolution / page_size;
+                auto is_valid_position = [&](uint2 position) { return position.x < resolution_in_tile && position.y < resolution_in_tile; };
+                for (const auto& upload : scheduler.get_uploads())
+                {
+                    if (!is_valid_position(upload.physical_position)) return false;
+                }
+
+                const auto& mappings = scheduler.get_mappings();
+                for (uint64_t ix = 0; ix < requests.size(); ++ix)
+                {
+                    if (mappings[ix].mip_level != INVALID_SIZE_32 && !is_valid_position(mappings[ix].physical_position)) return false;
+
+                    if (mappings[ix].mip_level == INVALID_SIZE_32) stats.missing_num++;
+                    else if (mappings[ix].mip_level == requests[ix].mip_level) stats.exact_num++;
+                    else if (mappings[ix].mip_level > requests[ix].mip_level) stats.fallback_num++;
+                    else return false;
+                }
+            }
+
+            // 相机停下后所有请求都应该得到自己的 page.
+            const auto& mappings = scheduler.get_mappings();
+            for (uint64_t ix = 0; ix < mappings.size(); ++ix)
+            {
+                if (mappings[ix].mip_level != frames.back()[ix].mip_level) return false;
+            }
+            return true;
+        }
+
+        bool vt_streaming()
+        {
+            constexpr uint32_t geometry_num = 4;
+            constexpr uint32_t moving_frame_num = 600;
+            constexpr uint32_t still_frame_num = 120;
+            constexpr uint32_t window_size = 16;        // 每个 geometry 可见的 mip 0 page 范围.
+
+            std::vector<MipmapLUT> mipmap_luts(geometry_num);
+            for (auto& mipmap_lut : mipmap_luts)
+            {
+                if (!mipmap_lut.initialize(highest_texture_resolution)) return false;
+            }
+            uint32_t resolution_in_page = highest_texture_resolution / page_size;
+
+            // 录制的 feedback: 相机沿 x 方向往返平移, 同时周期性地拉近拉远, 最后停在原地.
+            // 每个 geometry 请求可见范围内的 page, 离屏幕中心越近覆盖的像素越多, 与 VTFeedbackResolver 的输出相同.
+            std::vector<std::vector<VTFeedbackResolver::Request>> frames(moving_frame_num + still_frame_num);
+            uint64_t request_num = 0;
+            for (uint32_t frame_index = 0; frame_index < frames.size(); ++frame_index)
+            {
+                uint32_t time = std::min(frame_index, moving_frame_num);
+                uint32_t period = 2 * (resolution_in_page - window_size);
+                uint32_t camera_x = time % period;
+                if (camera_x > resolution_in_page - window_size) camera_x = period - camera_x;
+                uint32_t mip_level = (time / 90) % 3;
+
+                auto& requests = frames[frame_index];
+                for (uint32_t geometry_id = 0; geometry_id < geometry_num; ++geometry_id)
+                {
+                    MipmapLUT& mipmap_lut = mipmap_luts[geometry_id];
+                    uint32_t geometry_mip_level = std::min(mip_level + geometry_id / 2, mipmap_lut.get_mip_levels() - 1);
+                    uint32_t step = 1u << geometry_mip_level;
+
+                    for (uint32_t y = 0; y < window_size; y += step)
+                    {
+                        for (uint32_t x = camera_x & ~(step - 1); x < camera_x + window_size; x += step)
+                        {
+                            uint2 mip0_page_id = uint2(x, y);
+                            int32_t distance = std::abs(static_cast<int32_t>(x) - static_cast<int32_t>(camera_x + window_size / 2)) +
+                                               std::abs(static_cast<int32_t>(y) - static_cast<int32_t>(window_size / 2));
+
+                            requests.push_back(VTFeedbackResolver::Request{
+                                .geometry_id = geometry_id << 16,
+                                .mip_level = geometry_mip_level,
+                                .page_id = uint2(x >> geometry_mip_level, y >> geometry_mip_level),
+                                .pixel_num = static_cast<uint32_t>(4096 / (1 + distance)),
+                                .page = mipmap_lut.query_page(mip0_page_id, geometry_mip_level),
+                                .mipmap_lut = &mipmap_lut
+                            });
+                        }
+                    }
+                }
+                request_num += requests.size();
+            }
+
+            // 共享 MipmapLUT 的两个 geometry 请求同一个 page 时各自上传, 映射到不同的 tile.
+            {
+                VTStreamingScheduler scheduler;
+                std::vector<VTFeedbackResolver::Request> requests;
+                for (uint32_t geometry_id = 0; geometry_id < 2; ++geometry_id)
+                {
+                    requests.push_back(VTFeedbackResolver::Request{
+                        .geometry_id = geometry_id << 16,
+                        .mip_level = 0,
+                        .page_id = uint2(0u, 0u),
+                        .pixel_num = 1,
+                        .page = mipmap_luts[0].query_page(uint2(0u, 0u), 0),
+                        .mipmap_lut = &mipmap_luts[0]
+                    });
+                }
+                scheduler.schedule(requests);
+
+                const auto& mappings = scheduler.get_mappings();
+                if (mappings[0].mip_level != 0 || mappings[1].mip_level != 0 ||
+                    (mappings[0].physical_position.x == mappings[1].physical_position.x && mappings[0].physical_position.y == mappings[1].physical_position.y))
+                {
+                    LOG_ERROR("Virtual texture streaming merges the same page of different geometries.");
+                    return false;
+                }
+            }
+
+            // 原来的做法: 所有缺失的 page 在同一帧上传.
+            StreamingStats unbudgeted;
+            if (!run_streaming_trace(frames, std::numeric_limits<uint64_t>::max(), unbudgeted))
+            {
+                LOG_ERROR("Virtual texture streaming without budget failed.");
+                return false;
+            }
+
+            StreamingStats budgeted;
+            if (!run_streaming_trace(frames, VTStreamingScheduler::default_frame_byte_budget, budgeted))
+            {
+                LOG_ERROR("Virtual texture streaming exceeds the frame budget or does not converge.");
+                return false;
+            }
+
+            auto to_string = [&](const StreamingStats& stats)
+            {
+                return "peak " + std::to_string(stats.peak_upload_byte_size / 1048576.0f) + " MB/frame, total " +
+                       std::to_string(stats.total_upload_byte_size / 1048576.0f) + " MB, exact " +
+                       std::to_string(stats.exact_num * 100.0f / request_num) + "%, fallback " +
+                       std::to_string(stats.fallback_num * 100.0f / request_num) + "%, missing " +
+                       std::to_string(stats.missing_num * 100.0f / request_num) + "%, schedule " +
+                       std::to_string(stats.schedule_time * 1e6f / frames.size()) + " us/frame";
+            };
+
+            LOG_INFO(
+                "Virtual texture streaming (" + std::to_string(frames.size()) + " frames, " + std::to_string(request_num / frames.size()) +
+                " requests/frame): unbudgeted " + to_string(unbudgeted) + "; budget " +
+                std::to_string(VTStreamingScheduler::default_frame_byte_budget / 1048576) + " MB " + to_string(budgeted)
+            );
+            return true;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "benchmark.h"
+#include "../core/tools/log.h"
+#include "../core/tools/timer.h"
+#include "../scene/geometry.h"
+#include <string>
+#include <vector>
+
+namespace fantasy
+{
+    namespace benchmark
+    {
+        bool vertex_weld()
+        {
+            constexpr uint32_t repeat_num = 3;
+            const char* model_paths[] = {
+                "asset/Model/Suzanne/Suzanne.gltf",
+                "asset/Model/cow/cow.gltf",
+                "asset/Model/Mountain/TinyTerrain.gltf",
+                "asset/Model/AGame/AGame.gltf",
+                "asset/Model/sponza/Sponza.gltf"
+            };
+
+            auto measure = [&](const std::vector<Vertex>& source_vertices, const std::vector<uint32_t>& source_indices, bool position_only, float quantize_step)
+            {
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+                std::vector<uint32_t> vertex_remap;
+                uint32_t vertex_num = 0;
+
+                float time = 0.0f;
+                for (uint32_t ix = 0; ix < repeat_num; ++ix)
+                {
+                    vertices = source_vertices;
+                    indices = source_indices;
+
+                    Timer timer;
+                    vertex_num = weld_vertices(vertices, indices, vertex_remap, position_only, quantize_step);
+                    time += timer.peek();
+                }
+                time = time * 1000.0f / repeat_num;
+
+                return std::to_string(time) + " / " + std::to_string(source_vertices.size()) + " -> " + std::to_string(vertex_num);
+            };
+
+            LOG_INFO("Vertex weld (ms / vertices before -> after):");
+            for (const char* model_path : model_paths)
+            {
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+                if (!load_mesh(model_path, vertices, indices))
+                {
+                    LOG_INFO(std::string("    skip ") + model_path);
+                    continue;
+                }
+
+                // 每个三角形顶点各自独立, 相当于没有索引的源数据.
+                std::vector<Vertex> unindexed_vertices(indices.size());
+                std::vector<uint32_t> unindexed_indices(indices.size());
+                for (uint32_t ix = 0; ix < indices.size(); ++ix)
+                {
+                    unindexed_vertices[ix] = vertices[indices[ix]];
+                    unindexed_indices[ix] = ix;
+                }
+
+                LOG_INFO("    " + std::string(model_path) + ":");
+                LOG_INFO("        imported exact:     " + measure(vertices, indices, false, 0.0f));
+                LOG_INFO("        unindexed exact:    " + measure(unindexed_vertices, unindexed_indices, false, 0.0f));
+                LOG_INFO("        unindexed 1e-4:     " + measure(unindexed_vertices, unindexed_indices, false, 1e-4f));
+                LOG_INFO("        unindexed position: " + measure(unindexed_vertices, unindexed_indices, true, 0.0f));
+            }
+            return true;
+        }
+    }
+}
@@ -4,12 +4,28 @@ add_rules("mode.debug", "mode.release")
 add_rules("plugin.compile_commands.autoupdate", {outputdir = "$(projectdir)"})
 
 set_runtimes("MD")
+
+option("benchmark")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the CPU benchmarks instead of the renderer.")
+    add_defines("BENCHMARK")
+option_end()
+
+option("sdf_cpu_bake")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Bake missing mesh SDF caches on the CPU instead of SdfGeneratePass.")
+    add_defines("SDF_CPU_BAKE")
+option_end()
+
 local proj_dir = os.projectdir()
 local normalized_proj_dir = proj_dir:gsub("\\", "/")
 
 target("FTS-Render")
     set_kind("binary")
     set_languages("c99", "c++20")
+    add_options("benchmark", "sdf_cpu_bake")
     add_defines(
         "NDEBUG", 
     	"DEBUG",